@@ -0,0 +1,187 @@
+// AutomationSplitter.h
+//
+// Sample-accurate automation for the engine.  Parameter changes and transport
+// jumps are queued with their offset into the host block; process() slices the
+// block at those offsets (and at a maximum sub-block size), applies each event
+// at its sample and renders the segments in between.  Because the engine
+// renders identically however a stretch of audio is split, the output depends
+// only on where the events fall, not on the host buffer size.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MemoryDelayEngine.h"
+#include <cstdint>
+#include <vector>
+
+class AutomationSplitter
+{
+public:
+    enum class Parameter
+    {
+        Mix = 0,
+        Feedback,
+        Scan,
+        Spread,
+        Size,
+        Character,
+        TapeWindow,
+        Bypass
+    };
+
+    struct Event
+    {
+        enum class Type
+        {
+            ParameterChange = 0,
+            TransportJump
+        };
+
+        int sampleOffset { 0 };
+        Type type { Type::ParameterChange };
+        Parameter parameter { Parameter::Mix };
+        float value { 0.0f };
+        int64_t transportSample { -1 };
+        bool playing { false };
+    };
+
+    static constexpr int kDefaultMaxSubBlockSamples = 256;
+    static constexpr int kDefaultMaxEvents = 512;
+
+    AutomationSplitter() { events.reserve(static_cast<size_t>(kDefaultMaxEvents)); }
+
+    /** Sets the event capacity.  Allocates, so call it while audio is stopped. */
+    void prepare(int maxEventsPerBlock)
+    {
+        events.clear();
+        events.reserve(static_cast<size_t>(juce::jmax(1, maxEventsPerBlock)));
+    }
+
+    /** Bounds the length of any segment handed to the engine. */
+    void setMaxSubBlockSize(int numSamples) { maxSubBlockSamples = juce::jmax(1, numSamples); }
+
+    int getMaxSubBlockSize() const { return maxSubBlockSamples; }
+
+    /** Queues a parameter change at sampleOffset into the next processed block.
+        Events are kept in time order; events at the same offset apply in the
+        order they were added.  When the queue is full the event is dropped. */
+    void addParameterChange(int sampleOffset, Parameter parameter, float value)
+    {
+        Event event;
+        event.sampleOffset = sampleOffset;
+        event.type = Event::Type::ParameterChange;
+        event.parameter = parameter;
+        event.value = value;
+        insertEvent(event);
+    }
+
+    /** Queues a jump of the host transport to transportSample at sampleOffset
+        (a loop point or a relocation inside the block). */
+    void addTransportJump(int sampleOffset, int64_t transportSample, bool playing)
+    {
+        Event event;
+        event.sampleOffset = sampleOffset;
+        event.type = Event::Type::TransportJump;
+        event.transportSample = transportSample;
+        event.playing = playing;
+        insertEvent(event);
+    }
+
+    /** Sets the transport at the start of the next block, as reported by the
+        host; timeInSamples is negative when the host has no position. */
+    void setBlockTransport(int64_t timeInSamples, bool playing)
+    {
+        transportSample = timeInSamples;
+        transportPlaying = playing;
+    }
+
+    /** Renders buffer through the engine, applying the queued events at their
+        offsets, then clears the queue.  Offsets past the end of the block apply
+        at its last segment boundary.  Works with any MemoryDelayEngine
+        instantiation whose sample type matches the buffer.  Does not allocate. */
+    template <typename SampleType, typename StorageType>
+    void process(MemoryDelayEngine<SampleType, StorageType>& engine, juce::AudioBuffer<SampleType>& buffer)
+    {
+        const int numSamples = buffer.getNumSamples();
+        size_t next = 0;
+        int start = 0;
+
+        while (start < numSamples)
+        {
+            while (next < events.size() && events[next].sampleOffset <= start)
+                applyEvent(engine, events[next++]);
+
+            int end = juce::jmin(numSamples, start + maxSubBlockSamples);
+            if (next < events.size())
+                end = juce::jmin(end, events[next].sampleOffset);
+
+            engine.setTransportPosition(getTransportAt(start), transportPlaying);
+            juce::AudioBuffer<SampleType> segment(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start,
+                                                  end - start);
+            engine.processBlock(segment);
+            start = end;
+        }
+
+        for (; next < events.size(); ++next)
+            applyEvent(engine, events[next]);
+
+        if (transportSample >= 0 && transportPlaying)
+            transportSample += numSamples - transportOffset;
+        transportOffset = 0;
+        events.clear();
+    }
+
+private:
+    void insertEvent(const Event& event)
+    {
+        if (events.size() == events.capacity())
+        {
+            jassertfalse;
+            return;
+        }
+
+        auto position = events.end();
+        while (position != events.begin() && (position - 1)->sampleOffset > event.sampleOffset)
+            --position;
+        events.insert(position, event);
+    }
+
+    template <typename Engine>
+    void applyEvent(Engine& engine, const Event& event)
+    {
+        if (event.type == Event::Type::TransportJump)
+        {
+            transportSample = event.transportSample;
+            transportPlaying = event.playing;
+            transportOffset = event.sampleOffset;
+            return;
+        }
+
+        switch (event.parameter)
+        {
+            case Parameter::Mix:        engine.setMix(event.value); break;
+            case Parameter::Feedback:   engine.setFeedback(event.value); break;
+            case Parameter::Scan:       engine.setScan(event.value); break;
+            case Parameter::Spread:     engine.setSpread(event.value); break;
+            case Parameter::Size:       engine.setSize(event.value); break;
+            case Parameter::Character:  engine.setCharacter(event.value); break;
+            case Parameter::TapeWindow: engine.setTapeWindowSeconds(event.value); break;
+            case Parameter::Bypass:     engine.setBypassed(event.value > 0.5f); break;
+        }
+    }
+
+    /** The transport position at sample offset of the current block, counted
+        from the block start or from the last jump inside it. */
+    int64_t getTransportAt(int offset) const
+    {
+        if (transportSample < 0 || !transportPlaying)
+            return transportSample;
+        return transportSample + (offset - transportOffset);
+    }
+
+    std::vector<Event> events;
+    int maxSubBlockSamples { kDefaultMaxSubBlockSamples };
+    int64_t transportSample { -1 };
+    int transportOffset { 0 };
+    bool transportPlaying { false };
+};
@@ -19,8 +19,8 @@ public:
         constexpr int blockSize = 128;
         constexpr float bufferSeconds = 10.0f;
 
-        MemoryDelayEngine engineA;
-        MemoryDelayEngine engineB;
+        MemoryDelayEngine<> engineA;
+        MemoryDelayEngine<> engineB;
         engineA.prepare(sampleRate, blockSize, bufferSeconds);
         engineB.prepare(sampleRate, blockSize, bufferSeconds);
 
@@ -28,8 +28,8 @@ public:
         engineB.setMix(1.0f);
         engineA.setScan(0.25f);
         engineB.setScan(0.25f);
-        engineA.setScanMode(static_cast<int>(MemoryDelayEngine::ScanMode::Auto));
-        engineB.setScanMode(static_cast<int>(MemoryDelayEngine::ScanMode::Auto));
+        engineA.setScanMode(static_cast<int>(MemoryDelayEngine<>::ScanMode::Auto));
+        engineB.setScanMode(static_cast<int>(MemoryDelayEngine<>::ScanMode::Auto));
         engineA.setAutoScanRate(0.35f);
         engineB.setAutoScanRate(0.35f);
         engineA.setSpread(0.3f);
@@ -40,10 +40,10 @@ public:
         engineB.setSize(5.0f);
         engineA.setCharacter(0.7f);
         engineB.setCharacter(0.7f);
-        engineA.setStereoMode(static_cast<int>(MemoryDelayEngine::StereoMode::Independent));
-        engineB.setStereoMode(static_cast<int>(MemoryDelayEngine::StereoMode::Independent));
-        engineA.setMode(static_cast<int>(MemoryDelayEngine::FeedbackMode::Closed));
-        engineB.setMode(static_cast<int>(MemoryDelayEngine::FeedbackMode::Closed));
+        engineA.setStereoMode(static_cast<int>(MemoryDelayEngine<>::StereoMode::Independent));
+        engineB.setStereoMode(static_cast<int>(MemoryDelayEngine<>::StereoMode::Independent));
+        engineA.setMode(static_cast<int>(MemoryDelayEngine<>::FeedbackMode::Closed));
+        engineB.setMode(static_cast<int>(MemoryDelayEngine<>::FeedbackMode::Closed));
         engineA.setRandomSeed(1234);
         engineB.setRandomSeed(1234);
 
@@ -0,0 +1,168 @@
+// EngineSlot.h
+//
+// Owns the engine across host prepare/release cycles.  Hosts call
+// releaseResources() and prepareToPlay() on every transport restart, buffer
+// size change or device switch; rebuilding the engine each time would throw the
+// recorded memory away and allocate it again on the message thread.  The slot
+// keeps the engine whenever the sample rate and memory length are unchanged and
+// only re-prepares the block-size state, so a restart at the same rate
+// allocates no memory buffer.  When a new engine is unavoidable it is built by
+// the memory thread in service() (or at once for offline rendering), with the
+// old engine's memory resampled into it, and handed to the audio thread
+// through an atomic pointer; acquire() on the audio thread never allocates or
+// frees.  Until then acquire() returns nullptr and the caller outputs silence.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+template <typename Engine>
+class EngineSlot
+{
+public:
+    /** Called on every newly built engine after prepare(), to apply the
+        current parameters.  Runs on whichever thread builds the engine. */
+    using Configure = std::function<void(Engine&)>;
+
+    EngineSlot() = default;
+    ~EngineSlot() { delete ready.exchange(nullptr, std::memory_order_acquire); }
+
+    /** Engines built from now on allocate their memory lazily (see
+        MemoryDelayEngine::setLazyMemoryAllocation()). */
+    void setLazyMemoryAllocation(bool shouldAllocateLazily) { lazyAllocation = shouldAllocateLazily; }
+
+    void setConfigure(Configure newConfigure) { configure = std::move(newConfigure); }
+
+    /** Prepares the slot for playback.  Keeps the current engine and its memory
+        if it was prepared for this sample rate and memory length, and returns
+        true.  Otherwise a new engine is built, right away if buildNow is set
+        (offline rendering) or by the next service() call, the old engine's
+        memory is resampled into it and false is returned.  Call while audio is
+        stopped and service() is not running. */
+    bool prepare(double sampleRate, int maxBlockSize, float maxBufferSeconds, bool buildNow)
+    {
+        buildRequested.store(false, std::memory_order_relaxed);
+        if (auto* built = ready.exchange(nullptr, std::memory_order_acquire))
+            active.reset(built);
+
+        if (active != nullptr && active->isPreparedFor(sampleRate, maxBufferSeconds))
+        {
+            active->prepareBlockSize(maxBlockSize);
+            current.store(active.get(), std::memory_order_release);
+            return true;
+        }
+
+        current.store(nullptr, std::memory_order_release);
+        if (active != nullptr)
+            previous = std::move(active);
+        request = { sampleRate, maxBlockSize, maxBufferSeconds };
+        if (buildNow)
+        {
+            active = build();
+            current.store(active.get(), std::memory_order_release);
+        }
+        else
+        {
+            buildRequested.store(true, std::memory_order_release);
+        }
+        return false;
+    }
+
+    /** Drops the engine and its memory.  Same threading rules as prepare(). */
+    void release()
+    {
+        buildRequested.store(false, std::memory_order_relaxed);
+        delete ready.exchange(nullptr, std::memory_order_acquire);
+        current.store(nullptr, std::memory_order_release);
+        active.reset();
+        previous.reset();
+    }
+
+    /** Returns the engine to render with, or nullptr while a new one is still
+        being built.  Audio thread only: picking up a built engine is a pointer
+        swap and never frees anything. */
+    Engine* acquire()
+    {
+        if (active == nullptr)
+        {
+            if (auto* built = ready.exchange(nullptr, std::memory_order_acquire))
+            {
+                active.reset(built);
+                current.store(built, std::memory_order_release);
+            }
+        }
+        return active.get();
+    }
+
+    /** The engine the audio thread renders with, if any.  It stays valid
+        only until the next prepare() or release(), so callers on other
+        threads must keep those from running while they use it. */
+    Engine* get() const { return current.load(std::memory_order_acquire); }
+
+    bool isBuildPending() const
+    {
+        return buildRequested.load(std::memory_order_acquire)
+            || ready.load(std::memory_order_acquire) != nullptr;
+    }
+
+    /** Builds a requested engine and services the current engine's memory.
+        Call regularly from the memory thread.  Returns true if an engine was
+        built or any memory page was allocated or released. */
+    bool service()
+    {
+        bool changed = false;
+        if (buildRequested.exchange(false, std::memory_order_acquire))
+        {
+            delete ready.exchange(build().release(), std::memory_order_acq_rel);
+            changed = true;
+        }
+
+        if (auto* engine = current.load(std::memory_order_acquire))
+            changed = engine->serviceMemory() || changed;
+
+        return changed;
+    }
+
+private:
+    struct Request
+    {
+        double sampleRate { 44100.0 };
+        int maxBlockSize { 512 };
+        float maxBufferSeconds { 0.0f };
+    };
+
+    std::unique_ptr<Engine> build()
+    {
+        auto engine = std::make_unique<Engine>();
+        engine->setLazyMemoryAllocation(lazyAllocation);
+        engine->prepare(request.sampleRate, request.maxBlockSize, request.maxBufferSeconds);
+        if (configure)
+            configure(*engine);
+
+        if (previous != nullptr)
+        {
+            engine->resampleMemoryFrom(*previous);
+            previous.reset();
+        }
+        return engine;
+    }
+
+    // Owned by the audio thread while playing and by prepare()/release() while stopped
+    std::unique_ptr<Engine> active;
+    // Mirrors active for the memory thread and the editor
+    std::atomic<Engine*> current { nullptr };
+    // Built by service(), waiting for acquire()
+    std::atomic<Engine*> ready { nullptr };
+    // The engine a rebuild replaces, kept until its memory is resampled
+    std::unique_ptr<Engine> previous;
+    // Set by prepare(), published to service() through buildRequested
+    Request request;
+    std::atomic<bool> buildRequested { false };
+    bool lazyAllocation { false };
+    Configure configure;
+
+    JUCE_DECLARE_NON_COPYABLE(EngineSlot)
+};
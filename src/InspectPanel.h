@@ -15,5 +15,5 @@ private:
     void timerCallback() override;
 
     StereoMemoryDelayAudioProcessor& audioProcessor;
-    MemoryDelayEngine::VisualSnapshot snapshot;
+    MemoryDelayEngineTypes::VisualSnapshot snapshot;
 };
@@ -0,0 +1,228 @@
+// Lfo.h
+//
+// Modulation sources rendered a block at a time.  QuadratureOscillator turns a
+// sine by rotating a (cosine, sine) pair, four frames per step in vector lanes,
+// so a frame of sine costs a load instead of a std::sin call.  LfoWavetable
+// holds one cycle of a band-limited periodic shape and renders it at any phase
+// by linear interpolation.  Both give a frame the same value however the
+// frames around it are split into calls, so their users stay independent of
+// the host block size.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SimdConfig.h"
+#include <array>
+#include <cmath>
+
+class QuadratureOscillator
+{
+public:
+    // Frames rendered at a time; a new frequency takes effect at the next one
+    static constexpr int kBlockFrames = 64;
+
+    /** Sets the frequency, keeping the phase.  The rotation is only rebuilt
+        when the frequency moves, so this is cheap to call at control rate. */
+    void setFrequency(double frequencyHz, double sampleRate)
+    {
+        const double newIncrement = juce::MathConstants<double>::twoPi * frequencyHz / sampleRate;
+        if (newIncrement == increment)
+            return;
+
+        increment = newIncrement;
+        setLanes(re[0], im[0]);
+    }
+
+    /** Restarts at phase zero, so the next frame is sin(0). */
+    void reset()
+    {
+        setLanes(1.0, 0.0);
+        frame = kBlockFrames;
+    }
+
+    /** The sine of the next frame. */
+    float getNextSine()
+    {
+        if (frame == kBlockFrames)
+            renderBlock();
+        return sine[static_cast<size_t>(frame++)];
+    }
+
+private:
+    static constexpr int kLanes = 4;
+
+    /** Puts lane 0 at (cosine, sine) and each later lane one increment ahead
+        of the one before, and sets the rotation that moves every lane on by
+        kLanes increments. */
+    void setLanes(double cosine, double sineValue)
+    {
+        const double c = std::cos(increment);
+        const double s = std::sin(increment);
+        re[0] = cosine;
+        im[0] = sineValue;
+        for (size_t lane = 1; lane < kLanes; ++lane)
+        {
+            re[lane] = re[lane - 1] * c - im[lane - 1] * s;
+            im[lane] = re[lane - 1] * s + im[lane - 1] * c;
+        }
+
+        // Two squarings of the single step: a rotation by four increments
+        const double c2 = c * c - s * s;
+        const double s2 = 2.0 * c * s;
+        stepCos = c2 * c2 - s2 * s2;
+        stepSin = 2.0 * c2 * s2;
+    }
+
+    /** Renders the next kBlockFrames sines, then pulls the lanes back onto the
+        unit circle so rounding cannot grow or shrink the amplitude. */
+    void renderBlock()
+    {
+        int i = 0;
+
+#if ECHOFORM_SIMD_SSE
+        {
+            const __m128d c = _mm_set1_pd(stepCos);
+            const __m128d s = _mm_set1_pd(stepSin);
+            __m128d reLow = _mm_loadu_pd(re.data());
+            __m128d reHigh = _mm_loadu_pd(re.data() + 2);
+            __m128d imLow = _mm_loadu_pd(im.data());
+            __m128d imHigh = _mm_loadu_pd(im.data() + 2);
+            for (; i < kBlockFrames; i += kLanes)
+            {
+                _mm_storeu_ps(sine.data() + i, _mm_movelh_ps(_mm_cvtpd_ps(imLow), _mm_cvtpd_ps(imHigh)));
+                const __m128d nextReLow = _mm_sub_pd(_mm_mul_pd(reLow, c), _mm_mul_pd(imLow, s));
+                const __m128d nextReHigh = _mm_sub_pd(_mm_mul_pd(reHigh, c), _mm_mul_pd(imHigh, s));
+                imLow = _mm_add_pd(_mm_mul_pd(reLow, s), _mm_mul_pd(imLow, c));
+                imHigh = _mm_add_pd(_mm_mul_pd(reHigh, s), _mm_mul_pd(imHigh, c));
+                reLow = nextReLow;
+                reHigh = nextReHigh;
+            }
+            _mm_storeu_pd(re.data(), reLow);
+            _mm_storeu_pd(re.data() + 2, reHigh);
+            _mm_storeu_pd(im.data(), imLow);
+            _mm_storeu_pd(im.data() + 2, imHigh);
+        }
+#elif ECHOFORM_SIMD_NEON64
+        {
+            const float64x2_t c = vdupq_n_f64(stepCos);
+            const float64x2_t s = vdupq_n_f64(stepSin);
+            float64x2_t reLow = vld1q_f64(re.data());
+            float64x2_t reHigh = vld1q_f64(re.data() + 2);
+            float64x2_t imLow = vld1q_f64(im.data());
+            float64x2_t imHigh = vld1q_f64(im.data() + 2);
+            for (; i < kBlockFrames; i += kLanes)
+            {
+                vst1q_f32(sine.data() + i, vcombine_f32(vcvt_f32_f64(imLow), vcvt_f32_f64(imHigh)));
+                const float64x2_t nextReLow = vsubq_f64(vmulq_f64(reLow, c), vmulq_f64(imLow, s));
+                const float64x2_t nextReHigh = vsubq_f64(vmulq_f64(reHigh, c), vmulq_f64(imHigh, s));
+                imLow = vaddq_f64(vmulq_f64(reLow, s), vmulq_f64(imLow, c));
+                imHigh = vaddq_f64(vmulq_f64(reHigh, s), vmulq_f64(imHigh, c));
+                reLow = nextReLow;
+                reHigh = nextReHigh;
+            }
+            vst1q_f64(re.data(), reLow);
+            vst1q_f64(re.data() + 2, reHigh);
+            vst1q_f64(im.data(), imLow);
+            vst1q_f64(im.data() + 2, imHigh);
+        }
+#endif
+
+        for (; i < kBlockFrames; i += kLanes)
+        {
+            for (size_t lane = 0; lane < kLanes; ++lane)
+            {
+                sine[static_cast<size_t>(i) + lane] = static_cast<float>(im[lane]);
+                const double nextRe = re[lane] * stepCos - im[lane] * stepSin;
+                im[lane] = re[lane] * stepSin + im[lane] * stepCos;
+                re[lane] = nextRe;
+            }
+        }
+
+        for (size_t lane = 0; lane < kLanes; ++lane)
+        {
+            const double gain = 1.5 - 0.5 * (re[lane] * re[lane] + im[lane] * im[lane]);
+            re[lane] *= gain;
+            im[lane] *= gain;
+        }
+        frame = 0;
+    }
+
+    static_assert(kBlockFrames % kLanes == 0, "a block is a whole number of lane steps");
+
+    // Lane k holds the cosine and sine of frame k of the next rendered block
+    std::array<double, kLanes> re { 1.0, 1.0, 1.0, 1.0 };
+    std::array<double, kLanes> im {};
+    double increment { 0.0 };
+    double stepCos { 1.0 };
+    double stepSin { 0.0 };
+    std::array<float, kBlockFrames> sine {};
+    int frame { kBlockFrames };
+};
+
+class LfoWavetable
+{
+public:
+    /** A triangle rising from 0 at phase 0 to 1 at phase 0.5 and back, built
+        from its first numHarmonics odd harmonics with Lanczos sigma factors
+        and rescaled to hit 0 and 1 exactly.  Its corners are rounded, so a
+        read position that follows it changes speed smoothly there. */
+    static LfoWavetable makeTriangle(int numHarmonics)
+    {
+        LfoWavetable table;
+        const int highest = 2 * numHarmonics - 1;
+        for (size_t i = 0; i <= kTableSize; ++i)
+        {
+            const double phase = juce::MathConstants<double>::twoPi * static_cast<double>(i) / kTableSize;
+            double value = 0.0;
+            for (int harmonic = 1; harmonic <= highest; harmonic += 2)
+            {
+                const double x = juce::MathConstants<double>::pi * harmonic / (highest + 2);
+                const double sigma = std::sin(x) / x;
+                value -= sigma * std::cos(harmonic * phase) / (harmonic * harmonic);
+            }
+            table.values[i] = static_cast<float>(value);
+        }
+
+        const float low = table.values[0];
+        const float high = table.values[kTableSize / 2];
+        float maxStep = 0.0f;
+        for (size_t i = 0; i <= kTableSize; ++i)
+        {
+            table.values[i] = (table.values[i] - low) / (high - low);
+            if (i > 0)
+                maxStep = juce::jmax(maxStep, std::abs(table.values[i] - table.values[i - 1]));
+        }
+        table.maxSlope = maxStep * static_cast<float>(kTableSize);
+        return table;
+    }
+
+    /** The shape at phase, in cycles from 0 to 1. */
+    float getValue(double phase) const
+    {
+        const double position = phase * kTableSize;
+        const auto index = juce::jlimit<size_t>(0, kTableSize - 1, static_cast<size_t>(position));
+        const auto frac = static_cast<float>(position - static_cast<double>(index));
+        return values[index] + frac * (values[index + 1] - values[index]);
+    }
+
+    /** Writes numSamples values to dest, at phase firstFrame * phaseStep and
+        on by phaseStep per frame.  Each phase is computed from its frame
+        number rather than accumulated, so a run rendered in pieces matches
+        the same run rendered whole. */
+    void render(float* dest, int firstFrame, double phaseStep, int numSamples) const
+    {
+        for (int i = 0; i < numSamples; ++i)
+            dest[i] = getValue(static_cast<double>(firstFrame + i) * phaseStep);
+    }
+
+    /** The steepest slope of the shape, in units per cycle; 2 for an exact
+        triangle. */
+    float getMaxSlope() const { return maxSlope; }
+
+private:
+    static constexpr size_t kTableSize = 256;
+
+    // One cycle plus a guard point equal to the first
+    std::array<float, kTableSize + 1> values {};
+    float maxSlope { 0.0f };
+};
@@ -1,14 +1,66 @@
 // MemoryBuffer.h
 //
-// A simple circular memory buffer for storing stereo audio samples.
-// This class allocates a fixed‑size buffer and allows writing
-// incoming audio as well as reading past samples at arbitrary
-// fractional delays.  It is designed to be thread‑safe when called
-// from the audio thread only (no locking).
+// A circular memory buffer for storing stereo audio samples.  The buffer is
+// split into fixed-size pages that are allocated either all at prepare() time
+// or lazily, off the audio thread, as the write head and the retained span
+// need them.  Reading and writing happen on the audio thread without locks;
+// pages are handed over through an atomic page table.  Samples are kept in the
+// engine's storage type or in a compact encoding (see SampleFormat.h).  Each
+// page carries the epoch it was last cleared in, so clearing the whole buffer
+// is a counter increment; stale pages read as silence until they are zeroed.
+// A spilled buffer keeps only its recent pages in RAM and older ones in a
+// memory-mapped scratch file, from which a prefetch brings them back.
 
 #pragma once
 
 #include <JuceHeader.h>
+#include "MemorySpillFile.h"
+#include "PageArena.h"
+#include "SampleFormat.h"
+#include "SimdInterpolator.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+/** Types shared by every MemoryBuffer instantiation. */
+struct MemoryBufferTypes
+{
+    enum class Layout
+    {
+        Planar = 0,
+        Interleaved
+    };
+
+    enum class Allocation
+    {
+        Eager = 0,  // every page is allocated in prepare()
+        Lazy,       // pages follow the write head, see servicePages()
+        Spilled     // as Lazy, with older pages kept in a scratch file, see setResidentSeconds()
+    };
+
+    enum class Format
+    {
+        Native = 0, // the buffer's StorageType
+        Half,       // IEEE half precision
+        Int16,      // 16-bit integers with TPDF dither
+        Packed24    // 24-bit integers in three bytes
+    };
+
+    using Phase = SimdInterpolator::Phase;
+
+    static constexpr int kNumChannels = 2;
+    static constexpr int kPageFrameBits = 12;
+    static constexpr int kPageFrames = 1 << kPageFrameBits;
+    static constexpr int kPageFrameMask = kPageFrames - 1;
+    // Spans of frames a spilled buffer brings back into RAM, see setPrefetchWindow()
+    static constexpr int kMaxPrefetchWindows = 2;
+};
 
 /**
     A circular audio buffer that records incoming stereo samples and
@@ -17,49 +69,347 @@
     single write pointer is maintained; reads compute positions
     relative to this pointer.  Linear interpolation is used for
     fractional sample positions.
+
+    Read positions are 32.32 fixed point (Phase), so the fraction keeps
+    full resolution however long the buffer is, and wrapping is a single
+    compare rather than a loop.
+
+    Frames are stored either planar (all left samples, then all right
+    samples) or interleaved (LRLR), so that one cache line serves both
+    channels of a frame.  The layout only changes how samples are
+    addressed; every read and write method behaves the same in both.
+
+    Storage is split into pages of kPageFrames frames, each holding both
+    channels in the chosen layout.  A page that is not allocated reads as
+    silence from a shared zero page.  Clearing advances the buffer's epoch
+    instead of touching the pages: a page stamped with an earlier epoch
+    reads as silence, and is zeroed when the write head enters it or by
+    servicePages(), whichever comes first.  With Allocation::Lazy only the pages
+    within the retained span behind the write head (see setRetainedSeconds())
+    and a lookahead in front of it are kept; servicePages(), called from a
+    background thread, allocates and releases them.  Frames older than the
+    retained span read back as silence once their page has been released.
+    Pages are drawn from and returned to the process-wide PageArena, so every
+    instance recycles the same memory.
+
+    Allocation::Spilled keeps a memory longer than RAM should hold: only the
+    resident span behind the write head (see setResidentSeconds()) stays in
+    RAM, and servicePages() writes each older page of the retained span to a
+    MemorySpillFile as it leaves.  Pages come back when a prefetch window asks
+    for them (see setPrefetchWindow()), so the audio thread only ever reads
+    RAM; a spilled page nobody asked for reads as silence there, while
+    readFrames() and restoreFrames() go to the file for it.
+
+    StorageType is the sample type read from and written to memory (float or
+    double).  It is independent of the engine's processing precision, so a
+    double-precision engine can keep float memory at half the footprint.  The
+    Format chooses how samples are encoded in the pages: natively, or as
+    half, dithered 16-bit or packed 24-bit values, which cut the footprint
+    and the bandwidth of every read and write to a half or three quarters of
+    float (see setFormat()).
 */
-class MemoryBuffer
+template <typename StorageType = float>
+class MemoryBuffer : public MemoryBufferTypes
 {
 public:
     MemoryBuffer() = default;
     ~MemoryBuffer() = default;
 
+    /** Copies the configuration, write position and recorded pages.  Call
+        while neither buffer is in use on another thread. */
+    MemoryBuffer(const MemoryBuffer& other) { copyFrom(other); }
+
+    MemoryBuffer& operator=(const MemoryBuffer& other)
+    {
+        if (this != &other)
+            copyFrom(other);
+        return *this;
+    }
+
     /** Prepares the buffer.  Must be called before use.  @param sampleRate the
         current sample rate; @param maxDelaySeconds the maximum number of
-        seconds we need to store. */
-    void prepare(double sampleRate, float maxDelaySeconds)
+        seconds we need to store.  Releases every page, so the buffer starts
+        silent; with Allocation::Lazy the pages around the write head are
+        allocated before it returns. */
+    void prepare(double newSampleRate, float maxDelaySeconds)
     {
-        jassert(sampleRate > 0.0);
-        const int maxSamples = static_cast<int>(sampleRate * maxDelaySeconds) + 1;
-        buffer.setSize(2, maxSamples);
-        buffer.clear();
+        jassert(newSampleRate > 0.0);
+        sampleRate = newSampleRate;
+        numFrames = static_cast<int>(sampleRate * maxDelaySeconds) + 1;
+        numPages = (numFrames + kPageFrameMask) >> kPageFrameBits;
+
+        releasePages();
+        pageTable = std::vector<std::atomic<unsigned char*>>(static_cast<size_t>(numPages));
+        for (auto& entry : pageTable)
+            entry.store(getZeroPage(), std::memory_order_relaxed);
+        pageEpochs = std::vector<std::atomic<std::uint32_t>>(static_cast<size_t>(numPages));
+        for (auto& stamp : pageEpochs)
+            stamp.store(epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        ownedPages.resize(static_cast<size_t>(numPages));
+        for (int window = 0; window < kMaxPrefetchWindows; ++window)
+            setPrefetchWindow(window, 0, 0);
+
+        // Without a file, a spilled buffer keeps no more than its resident span
+        if (allocation == Allocation::Spilled)
+            spill.open(numPages, pageBytes);
+        else
+            spill.close();
+
+        updateStrides();
         writePos = 0;
+        writtenFrames = 0;
+        publishWritePosition();
+        missedWrites.store(0, std::memory_order_relaxed);
+
+        if (allocation == Allocation::Eager)
+        {
+            for (int page = 0; page < numPages; ++page)
+                installPage(page);
+        }
+        else
+        {
+            servicePages();
+        }
     }
 
-    void clear()
+    /** Chooses eager or lazy page allocation.  Takes effect at the next
+        prepare(). */
+    void setAllocation(Allocation newAllocation) { allocation = newAllocation; }
+
+    Allocation getAllocation() const { return allocation; }
+
+    /** Sets how far behind the write head recorded frames must stay readable;
+        a negative value keeps the whole buffer.  Only used with
+        Allocation::Lazy and Allocation::Spilled.  Safe from any thread. */
+    void setRetainedSeconds(float seconds) { retainedSeconds.store(seconds, std::memory_order_relaxed); }
+
+    /** Sets how far behind the write head pages stay in RAM with
+        Allocation::Spilled; older pages of the retained span go to the spill
+        file.  A negative value keeps the whole retained span resident.  Safe
+        from any thread. */
+    void setResidentSeconds(float seconds) { residentSeconds.store(seconds, std::memory_order_relaxed); }
+
+    /** Asks servicePages() to bring frames [firstFrame, endFrame) back from
+        the spill file, and keep them resident while the window stays.  Frames
+        are counted as getWrittenFrames() counts them, so a window stays put
+        while the write head moves; an empty window asks for nothing.  Only
+        used with Allocation::Spilled.  Call from the audio thread, or from
+        prepare() while audio is stopped. */
+    void setPrefetchWindow(int window, std::int64_t firstFrame, std::int64_t endFrame)
     {
-        buffer.clear();
-        writePos = 0;
+        jassert(window >= 0 && window < kMaxPrefetchWindows);
+        prefetchWindows[static_cast<size_t>(window)][0].store(firstFrame, std::memory_order_relaxed);
+        prefetchWindows[static_cast<size_t>(window)][1].store(endFrame, std::memory_order_relaxed);
     }
 
-    /** Writes a block of input samples into the buffer.  The input
-        buffer must have at least two channels.  Only the first two
-        channels are recorded. */
-    void write(const juce::AudioBuffer<float>& input, int numSamples)
+    /** Zeroes pages left stale by clear() and, with Allocation::Lazy,
+        allocates the pages the write head is about to reach and the retained
+        span needs, and releases the rest.  With Allocation::Spilled, pages of
+        the retained span beyond the resident span are written to the spill
+        file before they are released, and read back for the prefetch windows.
+        Call periodically from a background thread (or between blocks when
+        there is no audio thread); never from the audio thread.  Returns true if
+        the page table changed. */
+    bool servicePages()
     {
-        const int bufferSize = buffer.getNumSamples();
-        for (int sample = 0; sample < numSamples; ++sample)
+        if (numPages == 0)
+            return false;
+
+        const int writePage = sharedWritePos.load(std::memory_order_acquire) >> kPageFrameBits;
+        const int keepAhead = getLookaheadPages();
+        zeroStalePages(writePage, keepAhead);
+
+        if (allocation == Allocation::Eager)
+            return false;
+
+        releaseQuarantinedPages();
+
+        const int keepBehind = getRetainedPages();
+        const bool spilling = isSpilling();
+        const int keepResident = allocation == Allocation::Spilled ? juce::jmin(keepBehind, getResidentPages())
+                                                                   : keepBehind;
+        if (spilling)
+            findPrefetchedPages();
+        bool changed = false;
+
+        for (int page = 0; page < numPages; ++page)
         {
-            for (int channel = 0; channel < 2; ++channel)
+            const int behind = (writePage - page + numPages) % numPages;
+            const int ahead = (page - writePage + numPages) % numPages;
+            const bool retained = behind <= keepBehind;
+            const bool prefetched = spilling && retained && prefetchedPages[static_cast<size_t>(page)] != 0;
+            const bool needed = behind <= keepResident || ahead <= keepAhead || prefetched;
+            const bool owned = ownedPages[static_cast<size_t>(page)] != nullptr;
+
+            if (needed && !owned)
             {
-                auto* dest = buffer.getWritePointer(channel);
-                auto* src  = input.getReadPointer(channel);
-                dest[writePos] = src[sample];
+                if (!installPage(page))
+                    continue;
             }
-            // advance write position and wrap
-            if (++writePos >= bufferSize)
-                writePos = 0;
+            else if (!needed && owned)
+            {
+                if (spilling && retained)
+                    spillPage(page);
+                retirePage(page);
+            }
+            else
+            {
+                continue;
+            }
+
+            changed = true;
+        }
+
+        return changed;
+    }
+
+    /** Bytes held by this buffer's pages (in use or waiting to go back to
+        the PageArena) and its page table.  Safe from any thread. */
+    size_t getResidentBytes() const
+    {
+        return residentPages.load(std::memory_order_relaxed) * pageBytes
+               + pageTable.size() * (sizeof(std::atomic<unsigned char*>) + sizeof(std::atomic<std::uint32_t>));
+    }
+
+    /** Bytes of address space the spill file takes with Allocation::Spilled,
+        or zero without one.  Not safe while prepare() runs. */
+    size_t getSpillFileBytes() const { return spill.getFileBytes(); }
+
+    /** Frames dropped because their page had not been allocated in time. */
+    int getMissedWrites() const { return missedWrites.load(std::memory_order_relaxed); }
+
+    /** Selects the frame layout.  Existing contents are rearranged, which
+        allocates, so call this from the message thread, never while audio
+        is running.  Pages in the spill file are dropped. */
+    void setLayout(Layout newLayout)
+    {
+        if (newLayout == layout)
+            return;
+
+        if (spill.isOpen())
+            spill.open(numPages, pageBytes);
+
+        const int newFrameStride = (newLayout == Layout::Interleaved) ? kNumChannels : 1;
+        const int newChannelStride = (newLayout == Layout::Interleaved) ? 1 : kPageFrames;
+        const auto sampleBytes = static_cast<size_t>(getBytesPerSample(format));
+        std::vector<unsigned char> rearranged(pageBytes);
+        for (auto& page : ownedPages)
+        {
+            if (page == nullptr)
+                continue;
+
+            for (int channel = 0; channel < kNumChannels; ++channel)
+                for (int frame = 0; frame < kPageFrames; ++frame)
+                {
+                    const auto to = static_cast<size_t>(frame * newFrameStride + channel * newChannelStride);
+                    const auto from = static_cast<size_t>(frame * frameStride + channel * channelStride);
+                    std::memcpy(rearranged.data() + to * sampleBytes, page.get() + from * sampleBytes, sampleBytes);
+                }
+
+            std::copy(rearranged.begin(), rearranged.end(), page.get());
+        }
+
+        layout = newLayout;
+        updateStrides();
+    }
+
+    Layout getLayout() const { return layout; }
+
+    /** Selects how samples are encoded.  Existing contents are converted, and
+        retired pages are returned to the PageArena, which allocates, so call this
+        from the message thread, never while audio is running.  Converting to
+        a narrower format loses the precision it cannot hold.  Pages in the
+        spill file are dropped. */
+    void setFormat(Format newFormat)
+    {
+        if (newFormat == format)
+            return;
+
+        const size_t newPageBytes = kPageSamples * static_cast<size_t>(getBytesPerSample(newFormat));
+        std::vector<StorageType> samples(kPageSamples);
+        for (int pageIndex = 0; pageIndex < numPages; ++pageIndex)
+        {
+            auto& page = ownedPages[static_cast<size_t>(pageIndex)];
+            if (page == nullptr)
+                continue;
+
+            withCodec(format, [&](auto codec)
+            {
+                using Codec = decltype(codec);
+                for (int index = 0; index < static_cast<int>(kPageSamples); ++index)
+                {
+                    const auto value = Codec::decode(Codec::load(page.get(), index));
+                    samples[static_cast<size_t>(index)] = static_cast<StorageType>(value);
+                }
+            });
+
+            Page converted = PageArena::getInstance().acquire(newPageBytes);
+            if (converted == nullptr)
+            {
+                // Out of memory: the page's frames are lost and it reads as silence
+                pageTable[static_cast<size_t>(pageIndex)].store(getZeroPage(), std::memory_order_release);
+                page.reset();
+                residentPages.fetch_sub(1, std::memory_order_relaxed);
+                continue;
+            }
+
+            withCodec(newFormat, [&](auto codec)
+            {
+                using Codec = decltype(codec);
+                using Value = typename Codec::Value;
+                const auto firstFrame = static_cast<std::uint64_t>(pageIndex) << kPageFrameBits;
+                for (int channel = 0; channel < kNumChannels; ++channel)
+                    for (int frame = 0; frame < kPageFrames; ++frame)
+                    {
+                        const int index = frame * frameStride + channel * channelStride;
+                        const auto value = static_cast<Value>(samples[static_cast<size_t>(index)]);
+                        Codec::store(converted.get(), index,
+                                     Codec::encode(value, firstFrame + static_cast<std::uint64_t>(frame), channel));
+                    }
+            });
+
+            page = std::move(converted);
+            pageTable[static_cast<size_t>(pageIndex)].store(page.get(), std::memory_order_release);
         }
+
+        residentPages.fetch_sub(retiredPages.size(), std::memory_order_relaxed);
+        retiredPages.clear();
+        format = newFormat;
+        pageBytes = newPageBytes;
+        if (spill.isOpen())
+            spill.open(numPages, pageBytes);
+    }
+
+    Format getFormat() const { return format; }
+
+    /** Bytes one sample occupies in the given format. */
+    static int getBytesPerSample(Format sampleFormat)
+    {
+        return withCodec(sampleFormat, [](auto codec) { return decltype(codec)::kBytes; });
+    }
+
+    /** Silences everything recorded so far in constant time: the epoch moves
+        on, so every page reads as silence until it is zeroed (see
+        servicePages()).  Only the page under the write head is zeroed here.
+        The write head keeps its position.  Audio thread only. */
+    void clear()
+    {
+        if (numPages == 0)
+            return;
+
+        epoch.store(epoch.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        claimWritePage();
+    }
+
+    /** The number of times the buffer has been cleared. */
+    std::uint32_t getEpoch() const { return epoch.load(std::memory_order_relaxed); }
+
+    /** Writes a block of input samples into the buffer.  The input
+        buffer must have at least two channels.  Only the first two
+        channels are recorded. */
+    void write(const juce::AudioBuffer<StorageType>& input, int numSamples)
+    {
+        writeBlock(input.getReadPointer(0), input.getReadPointer(1), numSamples);
     }
 
     /** Reads a sample at the given delay in samples for the specified channel.
@@ -68,56 +418,724 @@ public:
         @param channel The channel index (0 = left, 1 = right)
         @param delayInSamples The delay time in samples.
         @return The interpolated sample value from the past. */
-    float read(int channel, float delayInSamples) const
-    {
-        jassert(channel >= 0 && channel < buffer.getNumChannels());
-        const int bufferSize = buffer.getNumSamples();
-        // compute the read position relative to writePos
-        float readPos = static_cast<float>(writePos) - delayInSamples;
-        // wrap into buffer range
-        while (readPos < 0.0f)
-            readPos += bufferSize;
-        while (readPos >= bufferSize)
-            readPos -= bufferSize;
-        // integer part and fractional part
-        int index1 = static_cast<int>(readPos);
-        int index2 = index1 + 1;
-        if (index2 >= bufferSize)
-            index2 -= bufferSize;
-        float frac = readPos - static_cast<float>(index1);
-        const auto* src = buffer.getReadPointer(channel);
-        float s1 = src[index1];
-        float s2 = src[index2];
-        return s1 + frac * (s2 - s1);
+    StorageType read(int channel, float delayInSamples) const
+    {
+        return readPhase(channel, clampPhase(SimdInterpolator::toPhase(delayInSamples)));
+    }
+
+    /** Reads a sample delay samples (32.32 fixed point) behind the write head.
+        The delay must lie within [0, getMaxPhase()]. */
+    StorageType readPhase(int channel, Phase delay) const
+    {
+        jassert(channel >= 0 && channel < kNumChannels);
+        jassert(delay <= getMaxPhase());
+        return withCodec(format, [&](auto codec) -> StorageType
+        {
+            return SimdInterpolator::readOne(getReader<decltype(codec)>(channel), numFrames, writePos, delay);
+        });
+    }
+
+    /** The longest delay that can be read, getBufferSize() - 1 samples. */
+    Phase getMaxPhase() const
+    {
+        return static_cast<Phase>(juce::jmax(0, numFrames - 1)) << SimdInterpolator::kPhaseFractionBits;
+    }
+
+    Phase clampPhase(Phase delay) const { return juce::jmin(delay, getMaxPhase()); }
+
+    /** Reads a block of interpolated samples for one channel.  delays[i] is the
+        delay of output sample i, as for readPhase().  When writeAdvancing is true the
+        write head is taken to move forward one frame per output sample, which is
+        how the engine records; otherwise it stays at the current position.  The
+        request is split into contiguous spans around the point where the write
+        head wraps (at most two for any block shorter than the buffer), and each
+        span runs through the SimdInterpolator kernels.  Delays must lie within
+        [0, getMaxPhase()]. */
+    void readBlock(int channel, const Phase* delays, StorageType* dest, int numSamples, bool writeAdvancing) const
+    {
+        readSpans(channel, writePos, delays, dest, numSamples, writeAdvancing);
+    }
+
+    /** Reads a block whose delay moves linearly from startDelay by delayIncrement
+        (32.32 fixed point, signed) per sample.  The delay is accumulated in fixed
+        point, so long ramps do not drift, and is clamped to the buffer length. */
+    void readBlock(int channel, Phase startDelay, std::int64_t delayIncrement, StorageType* dest, int numSamples,
+                   bool writeAdvancing) const
+    {
+        constexpr int kRampChunk = 64;
+        Phase delays[kRampChunk];
+        const auto maxDelay = static_cast<std::int64_t>(getMaxPhase());
+        auto delay = static_cast<std::int64_t>(startDelay);
+        int writeStart = writePos;
+
+        for (int start = 0; start < numSamples; start += kRampChunk)
+        {
+            const int count = juce::jmin(kRampChunk, numSamples - start);
+            for (int i = 0; i < count; ++i, delay += delayIncrement)
+                delays[i] = static_cast<Phase>(juce::jlimit(std::int64_t { 0 }, maxDelay, delay));
+
+            readSpans(channel, writeStart, delays, dest + start, count, writeAdvancing);
+            if (writeAdvancing)
+                writeStart = (writeStart + count) % numFrames;
+        }
     }
 
     /** Returns the current maximum delay in samples. */
-    int getBufferSize() const { return buffer.getNumSamples(); }
+    int getBufferSize() const { return numFrames; }
 
     int getWritePosition() const { return writePos; }
 
-    float getSample(int channel, int index) const
+    double getSampleRate() const { return sampleRate; }
+
+    /** Frames written since prepare(). */
+    std::uint64_t getWrittenFrames() const { return writtenFrames; }
+
+    /** getWrittenFrames() as of the last time the write head crossed into a
+        page, which is always at a page boundary.  Safe from any thread; frames
+        behind this point stay as they are until the write head comes round
+        again. */
+    std::uint64_t getPublishedWrittenFrames() const { return sharedWrittenFrames.load(std::memory_order_acquire); }
+
+    /** The span set by setRetainedSeconds(); negative for the whole buffer. */
+    float getRetainedSeconds() const { return retainedSeconds.load(std::memory_order_relaxed); }
+
+    /** How many frames behind the write head keep what was recorded: the whole
+        buffer, or with Allocation::Lazy or Allocation::Spilled the retained
+        span. */
+    int getRecallableFrames() const
     {
-        jassert(channel >= 0 && channel < buffer.getNumChannels());
-        if (buffer.getNumSamples() == 0)
-            return 0.0f;
-        index = juce::jlimit(0, buffer.getNumSamples() - 1, index);
-        return buffer.getSample(channel, index);
+        const float seconds = retainedSeconds.load(std::memory_order_relaxed);
+        if (allocation == Allocation::Eager || seconds < 0.0f)
+            return juce::jmax(0, numFrames - 1);
+
+        return juce::jmin(numFrames - 1, static_cast<int>(std::ceil(static_cast<double>(seconds) * sampleRate)));
+    }
+
+    /** Decodes numSamples consecutive frames of one channel, starting at frame
+        index startFrame and wrapping at the end of the buffer.  Works a page
+        at a time, so the page table and epoch stamps are read once per page.
+        With Allocation::Spilled, pages that are not resident are read from the
+        spill file, so never call it from the audio thread then. */
+    void readFrames(int channel, int startFrame, StorageType* dest, int numSamples) const
+    {
+        jassert(channel >= 0 && channel < kNumChannels);
+        jassert(startFrame >= 0 && startFrame < numFrames);
+        withCodec(format, [&](auto codec)
+        {
+            using Codec = decltype(codec);
+            const auto current = epoch.load(std::memory_order_relaxed);
+            const bool spilling = isSpilling();
+            int frame = startFrame;
+            for (int done = 0; done < numSamples;)
+            {
+                const int index = frame >> kPageFrameBits;
+                const int count = juce::jmin(numSamples - done, kPageFrames - (frame & kPageFrameMask),
+                                             numFrames - frame);
+                const int first = (frame & kPageFrameMask) * frameStride + channel * channelStride;
+                const auto decode = [&](const unsigned char* page)
+                {
+                    for (int i = 0; i < count; ++i)
+                        dest[done + i] = static_cast<StorageType>(
+                            Codec::decode(Codec::load(page, first + i * frameStride)));
+                };
+
+                if (spilling && pageTable[static_cast<size_t>(index)].load(std::memory_order_acquire) == getZeroPage())
+                {
+                    if (!spill.read(index, getPageFirstFrame(index), current, decode))
+                        std::fill(dest + done, dest + done + count, StorageType {});
+                }
+                else if (pageEpochs[static_cast<size_t>(index)].load(std::memory_order_acquire) != current)
+                {
+                    std::fill(dest + done, dest + done + count, StorageType {});
+                }
+                else
+                {
+                    decode(pageTable[static_cast<size_t>(index)].load(std::memory_order_acquire));
+                }
+
+                done += count;
+                frame += count;
+                if (frame == numFrames)
+                    frame = 0;
+            }
+        });
+    }
+
+    /** Overwrites numSamples frames of history starting at frame index
+        startFrame, wrapping at the end of the buffer, as readFrames() would
+        read them.  Frames in pages that are not allocated or are stale from a
+        clear are skipped, and the number stored is returned; with
+        Allocation::Spilled, pages that are not resident are written in the
+        spill file instead.  Never call it from the audio thread: it is for
+        restoring recorded memory behind the write head, from the thread that
+        calls servicePages(), and must not touch the page the write head is
+        in. */
+    int restoreFrames(int startFrame, const StorageType* left, const StorageType* right, int numSamples)
+    {
+        jassert(startFrame >= 0 && startFrame < numFrames);
+        return withCodec(format, [&](auto codec)
+        {
+            using Codec = decltype(codec);
+            using Value = typename Codec::Value;
+            const StorageType* const sources[kNumChannels] = { left, right };
+            const auto current = epoch.load(std::memory_order_acquire);
+            const bool spilling = isSpilling();
+            int stored = 0;
+            int frame = startFrame;
+            for (int done = 0; done < numSamples;)
+            {
+                const int index = frame >> kPageFrameBits;
+                const int count = juce::jmin(numSamples - done, kPageFrames - (frame & kPageFrameMask),
+                                             numFrames - frame);
+                const auto encode = [&](unsigned char* page)
+                {
+                    const int first = (frame & kPageFrameMask) * frameStride;
+                    for (int channel = 0; channel < kNumChannels; ++channel)
+                        for (int i = 0; i < count; ++i)
+                        {
+                            const auto value = static_cast<Value>(sources[channel][done + i]);
+                            const auto ditherFrame = static_cast<std::uint64_t>(frame + i);
+                            Codec::store(page, first + i * frameStride + channel * channelStride,
+                                         Codec::encode(value, ditherFrame, channel));
+                        }
+                    stored += count;
+                };
+
+                unsigned char* page = pageTable[static_cast<size_t>(index)].load(std::memory_order_acquire);
+                const auto stamp = pageEpochs[static_cast<size_t>(index)].load(std::memory_order_acquire);
+                if (page != getZeroPage() && stamp == current)
+                {
+                    encode(page);
+                    // The spilled copy no longer matches the page
+                    if (spilling)
+                        spill.invalidate(index);
+                }
+                else if (spilling && page == getZeroPage())
+                {
+                    const auto firstFrame = getPageFirstFrame(index);
+                    const bool held = spill.holds(index, firstFrame, current);
+                    unsigned char* slot = spill.beginWrite(index);
+                    if (!held)
+                        std::fill(slot, slot + pageBytes, static_cast<unsigned char>(0));
+                    encode(slot);
+                    spill.endWrite(index, firstFrame, current);
+                }
+
+                done += count;
+                frame += count;
+                if (frame == numFrames)
+                    frame = 0;
+            }
+            return stored;
+        });
+    }
+
+    StorageType getSample(int channel, int index) const
+    {
+        jassert(channel >= 0 && channel < kNumChannels);
+        if (numFrames == 0)
+            return StorageType {};
+        index = juce::jlimit(0, numFrames - 1, index);
+        return withCodec(format, [&](auto codec) { return getReader<decltype(codec)>(channel)(index); });
     }
 
     /** Writes a single stereo sample into the buffer.  This avoids
         allocating a temporary AudioBuffer for one sample.  Call this
-        from the audio thread only. */
-    void writeSample(float left, float right)
+        from the audio thread only.  A frame whose page has not been
+        allocated yet is dropped and counted (see getMissedWrites()). */
+    void writeSample(StorageType left, StorageType right)
     {
-        const int bufferSize = buffer.getNumSamples();
-        buffer.setSample(0, writePos, left);
-        buffer.setSample(1, writePos, right);
-        if (++writePos >= bufferSize)
+        unsigned char* page = pageTable[static_cast<size_t>(writePos >> kPageFrameBits)]
+                                  .load(std::memory_order_acquire);
+        if (page != getZeroPage())
+        {
+            const int index = (writePos & kPageFrameMask) * frameStride;
+            if (format == Format::Native)
+            {
+                auto* samples = reinterpret_cast<StorageType*>(page);
+                samples[index] = left;
+                samples[index + channelStride] = right;
+            }
+            else
+            {
+                withCodec(format, [&](auto codec)
+                {
+                    using Codec = decltype(codec);
+                    using Value = typename Codec::Value;
+                    Codec::store(page, index, Codec::encode(static_cast<Value>(left), writtenFrames, 0));
+                    Codec::store(page, index + channelStride,
+                                 Codec::encode(static_cast<Value>(right), writtenFrames, 1));
+                });
+            }
+        }
+        else
+        {
+            missedWrites.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        ++writtenFrames;
+        if (++writePos >= numFrames)
             writePos = 0;
+        if ((writePos & kPageFrameMask) == 0)
+            enterWritePage();
+    }
+
+    /** Writes numSamples stereo frames, as writeSample() would one at a time,
+        but encoding them a chunk at a time with the codec's block conversion.
+        Audio thread only. */
+    void writeBlock(const StorageType* left, const StorageType* right, int numSamples)
+    {
+        withCodec(format, [&](auto codec) { writeFrames<decltype(codec)>(left, right, numSamples); });
     }
 
 private:
-    juce::AudioBuffer<float> buffer;
+    static constexpr size_t kPageSamples = static_cast<size_t>(kPageFrames) * kNumChannels;
+    static constexpr int kEncodeChunk = 64;
+    static constexpr double kLookaheadSeconds = 1.0;
+    // A page is released this many page crossings of the write head after it
+    // leaves the page table, by which time no read can still be using it.
+    static constexpr std::uint64_t kQuarantineCrossings = 2;
+
+    using Page = PageArena::Page;
+
+    struct RetiredPage
+    {
+        Page page;
+        std::uint64_t crossing { 0 };
+    };
+
+    /** Addresses and decodes sample n of one channel through the page table,
+        for the SimdInterpolator kernels. */
+    template <typename Codec>
+    struct PageReader
+    {
+        StorageType operator()(int frame) const
+        {
+            const int index = frame >> kPageFrameBits;
+            if (epochs[index].load(std::memory_order_acquire) != epoch)
+                return StorageType {};
+
+            const unsigned char* page = pages[index].load(std::memory_order_acquire);
+            return static_cast<StorageType>(
+                Codec::decode(Codec::load(page, (frame & kPageFrameMask) * frameStride + channelOffset)));
+        }
+
+        static constexpr bool kGathers = Codec::kPrefersBlockDecode;
+
+        /** Loads the raw samples at frames[0..numSamples) and decodes them as a
+            block.  Only used by the float kernels, for at most eight lanes. */
+        void gather(const int* frames, float* dest, int numSamples) const
+        {
+            typename Codec::Raw raw[8];
+            for (int i = 0; i < numSamples; ++i)
+            {
+                const int index = frames[i] >> kPageFrameBits;
+                const unsigned char* page = pages[index].load(std::memory_order_acquire);
+                raw[i] = epochs[index].load(std::memory_order_acquire) == epoch
+                             ? Codec::load(page, (frames[i] & kPageFrameMask) * frameStride + channelOffset)
+                             : typename Codec::Raw {};
+            }
+
+            Codec::decodeBlock(raw, dest, numSamples);
+        }
+
+        const std::atomic<unsigned char*>* pages;
+        const std::atomic<std::uint32_t>* epochs;
+        std::uint32_t epoch;
+        int frameStride;
+        int channelOffset;
+    };
+
+    /** Backs every page that is not allocated, so reads need no check.  Zero
+        bytes decode to silence in every format. */
+    static unsigned char* getZeroPage()
+    {
+        alignas(64) static unsigned char zeros[kPageSamples * sizeof(StorageType)] {};
+        return zeros;
+    }
+
+    /** Calls function with a value of the codec for sampleFormat, so a
+        read or write picks its conversions once rather than per sample. */
+    template <typename Function>
+    static decltype(auto) withCodec(Format sampleFormat, Function&& function)
+    {
+        switch (sampleFormat)
+        {
+            case Format::Half:     return function(HalfSampleCodec {});
+            case Format::Int16:    return function(Int16SampleCodec {});
+            case Format::Packed24: return function(Packed24SampleCodec {});
+            case Format::Native:
+            default:               return function(NativeSampleCodec<StorageType> {});
+        }
+    }
+
+    template <typename Codec>
+    PageReader<Codec> getReader(int channel) const
+    {
+        return { pageTable.data(), pageEpochs.data(), epoch.load(std::memory_order_relaxed), frameStride,
+                 channel * channelStride };
+    }
+
+    /** The body of writeBlock() for one codec.  Frames are encoded in chunks
+        that stop at page boundaries and at the end of the buffer, where the
+        write head wraps. */
+    template <typename Codec>
+    void writeFrames(const StorageType* left, const StorageType* right, int numSamples)
+    {
+        using Value = typename Codec::Value;
+        Value values[kEncodeChunk];
+        typename Codec::Raw raw[kEncodeChunk];
+        const StorageType* const sources[kNumChannels] = { left, right };
+
+        int done = 0;
+        while (done < numSamples)
+        {
+            const int pageRemaining = kPageFrames - (writePos & kPageFrameMask);
+            const int count = juce::jmin(kEncodeChunk, numSamples - done,
+                                         juce::jmin(pageRemaining, numFrames - writePos));
+            unsigned char* page = pageTable[static_cast<size_t>(writePos >> kPageFrameBits)]
+                                      .load(std::memory_order_acquire);
+            if (page != getZeroPage())
+            {
+                const int first = (writePos & kPageFrameMask) * frameStride;
+                for (int channel = 0; channel < kNumChannels; ++channel)
+                {
+                    const StorageType* source = sources[channel] + done;
+                    const Value* input = values;
+                    if constexpr (std::is_same_v<Value, StorageType>)
+                        input = source;
+                    else
+                        std::transform(source, source + count, values,
+                                       [](StorageType sample) { return static_cast<Value>(sample); });
+
+                    Codec::encodeBlock(input, raw, count, writtenFrames, channel);
+                    const int offset = first + channel * channelStride;
+                    for (int i = 0; i < count; ++i)
+                        Codec::store(page, offset + i * frameStride, raw[i]);
+                }
+            }
+            else
+            {
+                missedWrites.fetch_add(count, std::memory_order_relaxed);
+            }
+
+            done += count;
+            writtenFrames += static_cast<std::uint64_t>(count);
+            writePos += count;
+            if (writePos >= numFrames)
+                writePos = 0;
+            if ((writePos & kPageFrameMask) == 0)
+                enterWritePage();
+        }
+    }
+
+    void updateStrides()
+    {
+        frameStride = (layout == Layout::Interleaved) ? kNumChannels : 1;
+        channelStride = (layout == Layout::Interleaved) ? 1 : kPageFrames;
+    }
+
+    /** Called when the write head crosses into a new page. */
+    void enterWritePage()
+    {
+        publishWritePosition();
+        claimWritePage();
+    }
+
+    /** Zeroes the page under the write head if it is stale, before anything
+        is written to it. */
+    void claimWritePage()
+    {
+        const auto index = static_cast<size_t>(writePos >> kPageFrameBits);
+        const auto current = epoch.load(std::memory_order_relaxed);
+        if (pageEpochs[index].load(std::memory_order_relaxed) == current)
+            return;
+
+        unsigned char* page = pageTable[index].load(std::memory_order_acquire);
+        if (page != getZeroPage())
+            std::fill(page, page + pageBytes, static_cast<unsigned char>(0));
+        pageEpochs[index].store(current, std::memory_order_release);
+    }
+
+    /** Zeroes and restamps stale pages outside the span the write head will
+        reach before the next service.  Each stamp is read before the epoch,
+        so a page the audio thread has just claimed is never seen as stale. */
+    void zeroStalePages(int writePage, int keepAhead)
+    {
+        for (int page = 0; page < numPages; ++page)
+        {
+            const int ahead = (page - writePage + numPages) % numPages;
+            auto& owned = ownedPages[static_cast<size_t>(page)];
+            if (ahead <= keepAhead || owned == nullptr)
+                continue;
+
+            auto& stamp = pageEpochs[static_cast<size_t>(page)];
+            const auto pageEpoch = stamp.load(std::memory_order_acquire);
+            const auto current = epoch.load(std::memory_order_acquire);
+            if (pageEpoch == current)
+                continue;
+
+            std::fill(owned.get(), owned.get() + pageBytes, static_cast<unsigned char>(0));
+            stamp.store(current, std::memory_order_release);
+        }
+    }
+
+    void publishWritePosition()
+    {
+        sharedWritePos.store(writePos, std::memory_order_release);
+        sharedWrittenFrames.store(writtenFrames, std::memory_order_release);
+        pageCrossings.store(pageCrossings.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    int getRetainedPages() const
+    {
+        const float seconds = retainedSeconds.load(std::memory_order_relaxed);
+        if (seconds < 0.0f)
+            return numPages;
+
+        const auto frames = static_cast<double>(seconds) * sampleRate;
+        return juce::jmin(numPages, static_cast<int>(std::ceil(frames / kPageFrames)) + 2);
+    }
+
+    int getLookaheadPages() const
+    {
+        return static_cast<int>(std::ceil(kLookaheadSeconds * sampleRate / kPageFrames)) + 1;
+    }
+
+    int getResidentPages() const
+    {
+        const float seconds = residentSeconds.load(std::memory_order_relaxed);
+        if (seconds < 0.0f)
+            return numPages;
+
+        const auto frames = static_cast<double>(seconds) * sampleRate;
+        return juce::jmin(numPages, static_cast<int>(std::ceil(frames / kPageFrames)) + 2);
+    }
+
+    bool isSpilling() const { return allocation == Allocation::Spilled && spill.isOpen(); }
+
+    /** The frame, counted as getWrittenFrames() counts, that a page's current
+        contents start at: where the write head last entered it, as of the last
+        page boundary it crossed.  It stays the same until the write head comes
+        round to the page again, so it ties a spilled copy to the contents it
+        was taken from. */
+    std::int64_t getPageFirstFrame(int page) const
+    {
+        const auto published = static_cast<std::int64_t>(sharedWrittenFrames.load(std::memory_order_acquire));
+        const int head = static_cast<int>(published % numFrames);
+        return published - (head - page * kPageFrames + numFrames) % numFrames;
+    }
+
+    /** Marks the pages the prefetch windows cover, as far back as the buffer
+        reaches and up to the last page boundary the write head crossed. */
+    void findPrefetchedPages()
+    {
+        prefetchedPages.assign(static_cast<size_t>(numPages), 0);
+        const auto published = static_cast<std::int64_t>(sharedWrittenFrames.load(std::memory_order_acquire));
+        for (const auto& window : prefetchWindows)
+        {
+            const auto firstFrame = juce::jmax(window[0].load(std::memory_order_relaxed), published - numFrames);
+            const auto endFrame = juce::jmin(window[1].load(std::memory_order_relaxed), published);
+            int frame = static_cast<int>((firstFrame % numFrames + numFrames) % numFrames);
+            for (auto remaining = endFrame - firstFrame; remaining > 0;)
+            {
+                const int page = frame >> kPageFrameBits;
+                const int pageEnd = juce::jmin((page + 1) * kPageFrames, numFrames);
+                const int count = static_cast<int>(juce::jmin(remaining, static_cast<std::int64_t>(pageEnd - frame)));
+                prefetchedPages[static_cast<size_t>(page)] = 1;
+                remaining -= count;
+                frame += count;
+                if (frame == numFrames)
+                    frame = 0;
+            }
+        }
+    }
+
+    /** Writes a page that is leaving RAM to the spill file, unless the file
+        already holds its contents or a clear has left it stale. */
+    void spillPage(int page)
+    {
+        const auto current = epoch.load(std::memory_order_acquire);
+        if (pageEpochs[static_cast<size_t>(page)].load(std::memory_order_acquire) != current)
+            return;
+
+        const auto firstFrame = getPageFirstFrame(page);
+        if (!spill.holds(page, firstFrame, current))
+            spill.store(page, ownedPages[static_cast<size_t>(page)].get(), firstFrame, current);
+    }
+
+    /** Allocates a page and puts it in the page table.  If the system is out
+        of memory the page stays on the zero page, so writes to it are dropped
+        and counted as missed, and false is returned. */
+    bool installPage(int page)
+    {
+        auto& owned = ownedPages[static_cast<size_t>(page)];
+        owned = PageArena::getInstance().acquire(pageBytes);
+        if (owned == nullptr)
+            return false;
+
+        residentPages.fetch_add(1, std::memory_order_relaxed);
+        const auto current = epoch.load(std::memory_order_acquire);
+        // A spilled page comes back with what it held
+        if (isSpilling())
+            spill.load(page, owned.get(), getPageFirstFrame(page), current);
+        pageEpochs[static_cast<size_t>(page)].store(current, std::memory_order_release);
+        pageTable[static_cast<size_t>(page)].store(owned.get(), std::memory_order_release);
+        return true;
+    }
+
+    void retirePage(int page)
+    {
+        pageTable[static_cast<size_t>(page)].store(getZeroPage(), std::memory_order_release);
+        retiredPages.push_back({ std::move(ownedPages[static_cast<size_t>(page)]),
+                                 pageCrossings.load(std::memory_order_acquire) });
+    }
+
+    /** Returns pages that no read can still reach to the PageArena, where
+        this or any other buffer can reuse them. */
+    void releaseQuarantinedPages()
+    {
+        const auto crossings = pageCrossings.load(std::memory_order_acquire);
+        auto kept = retiredPages.begin();
+        for (auto& retired : retiredPages)
+        {
+            if (crossings - retired.crossing < kQuarantineCrossings)
+            {
+                *kept++ = std::move(retired);
+                continue;
+            }
+
+            retired.page.reset();
+            residentPages.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        retiredPages.erase(kept, retiredPages.end());
+    }
+
+    void releasePages()
+    {
+        pageTable.clear();
+        pageEpochs.clear();
+        ownedPages.clear();
+        retiredPages.clear();
+        residentPages.store(0, std::memory_order_relaxed);
+    }
+
+    void copyFrom(const MemoryBuffer& other)
+    {
+        releasePages();
+        allocation = other.allocation;
+        layout = other.layout;
+        format = other.format;
+        pageBytes = other.pageBytes;
+        sampleRate = other.sampleRate;
+        numFrames = other.numFrames;
+        numPages = other.numPages;
+        retainedSeconds.store(other.retainedSeconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        residentSeconds.store(other.residentSeconds.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        missedWrites.store(other.missedWrites.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        epoch.store(other.epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+        pageTable = std::vector<std::atomic<unsigned char*>>(static_cast<size_t>(numPages));
+        pageEpochs = std::vector<std::atomic<std::uint32_t>>(static_cast<size_t>(numPages));
+        ownedPages.resize(static_cast<size_t>(numPages));
+        spill.close();
+        for (int page = 0; page < numPages; ++page)
+        {
+            const auto& source = other.ownedPages[static_cast<size_t>(page)];
+            if (source != nullptr && installPage(page))
+                std::copy(source.get(), source.get() + pageBytes, ownedPages[static_cast<size_t>(page)].get());
+            else
+                pageTable[static_cast<size_t>(page)].store(getZeroPage(), std::memory_order_relaxed);
+
+            const auto stamp = other.pageEpochs[static_cast<size_t>(page)].load(std::memory_order_relaxed);
+            pageEpochs[static_cast<size_t>(page)].store(stamp, std::memory_order_relaxed);
+        }
+
+        updateStrides();
+        writePos = other.writePos;
+        writtenFrames = other.writtenFrames;
+        publishWritePosition();
+        copySpilledPages(other);
+    }
+
+    /** Gives this buffer a spill file of its own holding what other's holds. */
+    void copySpilledPages(const MemoryBuffer& other)
+    {
+        if (!other.isSpilling() || !spill.open(numPages, pageBytes))
+            return;
+
+        const auto current = epoch.load(std::memory_order_relaxed);
+        for (int page = 0; page < numPages; ++page)
+        {
+            unsigned char* slot = spill.beginWrite(page);
+            const bool held = other.spill.load(page, slot, other.getPageFirstFrame(page), current);
+            spill.endWrite(page, held ? getPageFirstFrame(page) : MemorySpillFile::kNoFrame, current);
+        }
+    }
+
+    void readSpans(int channel, int writeStart, const Phase* delays, StorageType* dest, int numSamples,
+                   bool writeAdvancing) const
+    {
+        jassert(channel >= 0 && channel < kNumChannels);
+        withCodec(format, [&](auto codec)
+        {
+            readSpansWith(getReader<decltype(codec)>(channel), writeStart, delays, dest, numSamples, writeAdvancing);
+        });
+    }
+
+    template <typename Source>
+    void readSpansWith(const Source& source, int writeStart, const Phase* delays, StorageType* dest, int numSamples,
+                       bool writeAdvancing) const
+    {
+        const int bufferSize = numFrames;
+
+        if (!writeAdvancing)
+        {
+            SimdInterpolator::readSpan(source, bufferSize, writeStart, 0, delays, dest, numSamples);
+            return;
+        }
+
+        int done = 0;
+        while (done < numSamples)
+        {
+            const int span = juce::jmin(numSamples - done, bufferSize - writeStart);
+            SimdInterpolator::readSpan(source, bufferSize, writeStart, 1, delays + done, dest + done, span);
+            done += span;
+            writeStart = 0;
+        }
+    }
+
+    // The page table and epoch stamps are read and written by the audio
+    // thread; ownedPages and the retired list belong to prepare() and
+    // servicePages().  Pages come from and go back to the PageArena.
+    std::vector<std::atomic<unsigned char*>> pageTable;
+    std::vector<std::atomic<std::uint32_t>> pageEpochs;
+    std::vector<Page> ownedPages;
+    std::vector<RetiredPage> retiredPages;
+    // With Allocation::Spilled, the retained pages beyond the resident span
+    MemorySpillFile spill;
+    // First and end frame of each prefetch window, set by the audio thread
+    std::array<std::array<std::atomic<std::int64_t>, 2>, kMaxPrefetchWindows> prefetchWindows {};
+    // The pages the windows cover, found by servicePages()
+    std::vector<unsigned char> prefetchedPages;
+    std::atomic<size_t> residentPages { 0 };
+    std::atomic<int> sharedWritePos { 0 };
+    std::atomic<std::uint64_t> sharedWrittenFrames { 0 };
+    std::atomic<std::uint64_t> pageCrossings { 0 };
+    std::atomic<float> retainedSeconds { -1.0f };
+    std::atomic<float> residentSeconds { -1.0f };
+    std::atomic<int> missedWrites { 0 };
+    std::atomic<std::uint32_t> epoch { 0 };
+    Allocation allocation { Allocation::Eager };
+    Layout layout { Layout::Planar };
+    Format format { Format::Native };
+    size_t pageBytes { kPageSamples * sizeof(StorageType) };
+    double sampleRate { 44100.0 };
+    int numFrames { 0 };
+    int numPages { 0 };
+    int frameStride { 1 };
+    int channelStride { 0 };
     int writePos { 0 };
+    std::uint64_t writtenFrames { 0 };  // every frame written since prepare(), for dither
 };
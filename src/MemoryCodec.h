@@ -0,0 +1,554 @@
+// MemoryCodec.h
+//
+// Compresses blocks of recorded stereo memory for the plug-in state.  Samples
+// are quantised to 24 bits, scaled per block so a block louder than full
+// scale keeps its peaks; this is exact for 16- and 24-bit memory and within
+// 2^-24 of full scale for float memory.  Each block is then coded the way
+// FLAC codes a frame: the cheapest of left/right, left/side, side/right and
+// mid/side, common trailing zero bits shifted out, the best fixed polynomial
+// predictor of order 0 to 4, and Rice-coded residuals with a parameter per
+// partition.  Blocks are independent, so one can be encoded once and reused by
+// every snapshot that still contains it (see MemorySnapshot.h).
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <type_traits>
+#include <vector>
+
+#if defined(_MSC_VER)
+ #include <intrin.h>
+#endif
+
+class MemoryCodec
+{
+public:
+    static constexpr int kMaxBlockFrames = 1 << 12;
+    static constexpr int kQuantizationBits = 24;
+
+private:
+    /** Writes bits most significant first to a byte vector, which is grown
+        by the most a block can take up front and trimmed by flush(). */
+    class BitWriter
+    {
+    public:
+        explicit BitWriter(std::vector<unsigned char>& destination, int numFrames)
+            : out(destination), start(destination.size())
+        {
+            out.resize(start + getMaxBlockBytes(numFrames));
+            next = out.data() + start;
+        }
+
+        /** Appends the low bits of value; bits <= 32. */
+        void put(std::uint32_t value, int bits)
+        {
+            if (bits == 0)
+                return;
+
+            cache = (cache << bits) | (static_cast<std::uint64_t>(value) & (~std::uint64_t { 0 } >> (64 - bits)));
+            cached += bits;
+            if (cached >= 32)
+            {
+                cached -= 32;
+                const auto word = static_cast<std::uint32_t>(cache >> cached);
+                next[0] = static_cast<unsigned char>(word >> 24);
+                next[1] = static_cast<unsigned char>(word >> 16);
+                next[2] = static_cast<unsigned char>(word >> 8);
+                next[3] = static_cast<unsigned char>(word);
+                next += 4;
+            }
+        }
+
+        /** Pads the last byte with zeros and trims the vector after it. */
+        void flush()
+        {
+            if (cached % 8 != 0)
+                put(0, 8 - cached % 8);
+            for (; cached > 0; cached -= 8)
+                *next++ = static_cast<unsigned char>(cache >> (cached - 8));
+            out.resize(static_cast<size_t>(next - out.data()));
+        }
+
+    private:
+        // Two headers, and per channel its header, a Rice parameter per
+        // partition and at worst an escaped code per frame.
+        static size_t getMaxBlockBytes(int numFrames)
+        {
+            const int partitions = (numFrames + kPartitionFrames - 1) / kPartitionFrames;
+            return static_cast<size_t>(2 + 2 * (1 + partitions + 8 * numFrames) + 8);
+        }
+
+        std::vector<unsigned char>& out;
+        size_t start;
+        unsigned char* next { nullptr };
+        std::uint64_t cache { 0 };
+        int cached { 0 };
+    };
+
+    /** Reads what BitWriter wrote.  Reads past the end return zeros and are
+        reported by overran(). */
+    class BitReader
+    {
+    public:
+        BitReader(const unsigned char* begin, const unsigned char* finish)
+            : start(begin), next(begin), end(finish), availableBits(static_cast<std::uint64_t>(finish - begin) * 8)
+        {
+        }
+
+        /** Returns the next bits (at most 32) as an unsigned value. */
+        std::uint32_t get(int bits)
+        {
+            if (bits == 0)
+                return 0;
+
+            refill();
+            cached -= bits;
+            consumedBits += static_cast<std::uint64_t>(bits);
+            return static_cast<std::uint32_t>((cache >> cached) & (~std::uint64_t { 0 } >> (64 - bits)));
+        }
+
+        /** Counts and consumes zero bits up to the next one bit, which is
+            consumed too.  Stops at 32 zeros without consuming a one. */
+        int getUnary()
+        {
+            refill();
+            const auto top = static_cast<std::uint32_t>(cache >> (cached - 32));
+            const int zeros = (top == 0) ? 32 : countLeadingZeros(top);
+            const int consumed = (zeros == 32) ? 32 : zeros + 1;
+            cached -= consumed;
+            consumedBits += static_cast<std::uint64_t>(consumed);
+            return zeros;
+        }
+
+        bool overran() const { return consumedBits > availableBits; }
+
+        /** The first byte after everything read so far. */
+        const unsigned char* finish() const
+        {
+            return start + std::min(static_cast<std::ptrdiff_t>((consumedBits + 7) / 8), end - start);
+        }
+
+    private:
+        void refill()
+        {
+            while (cached <= 56)
+            {
+                cache = (cache << 8) | (next < end ? *next++ : 0u);
+                cached += 8;
+            }
+        }
+
+        static int countLeadingZeros(std::uint32_t value)
+        {
+           #if defined(__GNUC__) || defined(__clang__)
+            return __builtin_clz(value);
+           #elif defined(_MSC_VER)
+            unsigned long index = 0;
+            _BitScanReverse(&index, value);
+            return 31 - static_cast<int>(index);
+           #else
+            int zeros = 0;
+            for (std::uint32_t bit = 0x80000000u; (value & bit) == 0; bit >>= 1)
+                ++zeros;
+            return zeros;
+           #endif
+        }
+
+        const unsigned char* start;
+        const unsigned char* next;
+        const unsigned char* end;
+        std::uint64_t availableBits;
+        std::uint64_t consumedBits { 0 };
+        std::uint64_t cache { 0 };
+        int cached { 0 };
+    };
+
+public:
+    /** Appends numFrames frames (at most kMaxBlockFrames) to out.  Non-finite
+        samples are stored as silence. */
+    template <typename Sample>
+    static void encodeBlock(const Sample* left, const Sample* right, int numFrames, std::vector<unsigned char>& out)
+    {
+        jassert(numFrames > 0 && numFrames <= kMaxBlockFrames);
+        double peak = 0.0;
+        for (int i = 0; i < numFrames; ++i)
+            peak = std::max({ peak, magnitude(left[i]), magnitude(right[i]) });
+
+        BitWriter writer(out, numFrames);
+        if (peak == 0.0)
+        {
+            writer.put(kSilentBlock, 8);
+            writer.flush();
+            return;
+        }
+
+        // Every sample lies below 2^exponent, so it quantises to at most
+        // kQuantizationBits bits with the sign.
+        int exponent = 0;
+        std::frexp(peak, &exponent);
+        exponent = juce::jlimit(0, kMaxExponent, exponent);
+        const double scale = std::ldexp(1.0, kQuantizationBits - 1 - exponent);
+
+        Channels channels;
+        for (int i = 0; i < numFrames; ++i)
+        {
+            const auto l = quantize(left[i], scale);
+            const auto r = quantize(right[i], scale);
+            const auto index = static_cast<size_t>(i);
+            channels[kLeft][index] = l;
+            channels[kRight][index] = r;
+            channels[kSide][index] = l - r;
+            channels[kMid][index] = (l + r) >> 1;
+        }
+
+        // The pair with the smallest second differences nearly always codes smallest.
+        std::array<std::uint64_t, kNumCandidates> cost {};
+        for (size_t channel = 0; channel < cost.size(); ++channel)
+            cost[channel] = getSecondDifferenceCost(channels[channel].data(), numFrames);
+
+        int stereo = 0;
+        for (int mode = 1; mode < kNumStereoModes; ++mode)
+            if (getPairCost(cost, mode) < getPairCost(cost, stereo))
+                stereo = mode;
+
+        writer.put(static_cast<std::uint32_t>(stereo), 8);
+        writer.put(static_cast<std::uint32_t>(exponent), 8);
+        for (int channel : kStereoPairs[stereo])
+            encodeChannel(channels[static_cast<size_t>(channel)].data(), numFrames, writer);
+        writer.flush();
+    }
+
+    /** Decodes a block of numFrames frames written by encodeBlock() from
+        [data, end) and advances data past it.  Returns false if the block is
+        malformed or truncated. */
+    template <typename Sample>
+    static bool decodeBlock(const unsigned char*& data, const unsigned char* end, Sample* left, Sample* right,
+                            int numFrames)
+    {
+        if (numFrames <= 0 || numFrames > kMaxBlockFrames)
+            return false;
+
+        BitReader reader(data, end);
+        const auto header = reader.get(8);
+        if (header == kSilentBlock)
+        {
+            std::fill(left, left + numFrames, Sample {});
+            std::fill(right, right + numFrames, Sample {});
+            data = reader.finish();
+            return !reader.overran();
+        }
+
+        const auto stereo = static_cast<int>(header);
+        const int exponent = static_cast<int>(reader.get(8));
+        if (stereo >= kNumStereoModes)
+            return false;
+
+        std::array<std::array<std::int32_t, kMaxBlockFrames>, 2> decoded;
+        for (auto& channel : decoded)
+            if (!decodeChannel(reader, channel.data(), numFrames))
+                return false;
+        if (reader.overran())
+            return false;
+
+        const double step = std::ldexp(1.0, exponent - (kQuantizationBits - 1));
+        const auto* first = decoded[0].data();
+        const auto* second = decoded[1].data();
+        for (int i = 0; i < numFrames; ++i)
+        {
+            std::int64_t l = first[i];
+            std::int64_t r = second[i];
+            if (stereo == kLeftSide)
+            {
+                r = l - second[i];
+            }
+            else if (stereo == kSideRight)
+            {
+                l = first[i] + r;
+            }
+            else if (stereo == kMidSide)
+            {
+                const std::int64_t mid = (l * 2) | (second[i] & 1);
+                l = (mid + second[i]) >> 1;
+                r = (mid - second[i]) >> 1;
+            }
+
+            left[i] = static_cast<Sample>(static_cast<double>(l) * step);
+            right[i] = static_cast<Sample>(static_cast<double>(r) * step);
+        }
+
+        data = reader.finish();
+        return true;
+    }
+
+private:
+    static constexpr std::uint32_t kSilentBlock = 0xff;
+    static constexpr int kPartitionFrames = 256;
+    static constexpr int kMaxOrder = 4;
+    // Peaks beyond 2^kMaxExponent are clipped to it.
+    static constexpr int kMaxExponent = 127;
+    // A quotient this long is followed by the raw residual instead of a unary code.
+    static constexpr int kEscapeQuotient = 32;
+    // Marks a channel that is zero throughout; a coded channel never has this many zero bits.
+    static constexpr std::uint32_t kZeroChannel = 31;
+    // Larger decoded values can only come from a corrupt block.
+    static constexpr std::int64_t kMaxDecodedMagnitude = std::int64_t { 1 } << (kQuantizationBits + 1);
+
+    enum Candidate
+    {
+        kLeft = 0,
+        kRight,
+        kSide,
+        kMid,
+        kNumCandidates
+    };
+
+    enum StereoMode
+    {
+        kLeftRight = 0,
+        kLeftSide,
+        kSideRight,
+        kMidSide,
+        kNumStereoModes
+    };
+
+    static constexpr int kStereoPairs[kNumStereoModes][2] = {
+        { kLeft, kRight }, { kLeft, kSide }, { kSide, kRight }, { kMid, kSide }
+    };
+
+    using Channels = std::array<std::array<std::int32_t, kMaxBlockFrames>, kNumCandidates>;
+
+    static std::uint64_t getPairCost(const std::array<std::uint64_t, kNumCandidates>& cost, int mode)
+    {
+        return cost[static_cast<size_t>(kStereoPairs[mode][0])] + cost[static_cast<size_t>(kStereoPairs[mode][1])];
+    }
+
+    template <typename Sample>
+    static double magnitude(Sample sample)
+    {
+        const auto value = std::abs(static_cast<double>(sample));
+        return std::isfinite(value) ? value : 0.0;
+    }
+
+    template <typename Sample>
+    static std::int32_t quantize(Sample sample, double scale)
+    {
+        const auto value = static_cast<double>(sample);
+        constexpr double limit = static_cast<double>(1 << (kQuantizationBits - 1));
+        return std::isfinite(value) ? static_cast<std::int32_t>(std::lrint(juce::jlimit(-limit, limit, value * scale)))
+                                    : 0;
+    }
+
+    static std::uint32_t zigzag(std::int32_t value)
+    {
+        return (static_cast<std::uint32_t>(value) << 1) ^ static_cast<std::uint32_t>(value >> 31);
+    }
+
+    static std::int64_t unzigzag(std::uint32_t value)
+    {
+        return static_cast<std::int64_t>(value >> 1) ^ -static_cast<std::int64_t>(value & 1);
+    }
+
+    static std::uint64_t getSecondDifferenceCost(const std::int32_t* samples, int numFrames)
+    {
+        std::uint64_t sum = 0;
+        for (int i = 2; i < numFrames; ++i)
+            sum += static_cast<std::uint64_t>(std::abs(samples[i] - 2 * samples[i - 1] + samples[i - 2]));
+        return sum;
+    }
+
+    /** Shifts out the channel's common zero bits, picks the fixed predictor
+        with the smallest residuals and Rice-codes them.  Frames before the
+        block count as zero, so blocks decode on their own. */
+    static void encodeChannel(const std::int32_t* samples, int numFrames, BitWriter& writer)
+    {
+        std::uint32_t usedBits = 0;
+        for (int i = 0; i < numFrames; ++i)
+            usedBits |= static_cast<std::uint32_t>(samples[i]);
+
+        if (usedBits == 0)
+        {
+            writer.put(kZeroChannel, 5);
+            return;
+        }
+
+        int shift = 0;
+        while ((usedBits & (1u << shift)) == 0)
+            ++shift;
+
+        // Frames before the block read as the zeros in front of it.
+        std::array<std::int32_t, kMaxOrder + kMaxBlockFrames> padded {};
+        std::int32_t* const x = padded.data() + kMaxOrder;
+        for (int i = 0; i < numFrames; ++i)
+            x[i] = samples[i] >> shift;
+
+        std::uint64_t cost[kMaxOrder + 1] {};
+        for (int i = 0; i < numFrames; ++i)
+        {
+            const std::int32_t e1 = x[i] - x[i - 1];
+            const std::int32_t e2 = e1 - (x[i - 1] - x[i - 2]);
+            const std::int32_t e3 = e2 - (x[i - 1] - 2 * x[i - 2] + x[i - 3]);
+            const std::int32_t e4 = e3 - (x[i - 1] - 3 * x[i - 2] + 3 * x[i - 3] - x[i - 4]);
+            cost[0] += static_cast<std::uint32_t>(std::abs(x[i]));
+            cost[1] += static_cast<std::uint32_t>(std::abs(e1));
+            cost[2] += static_cast<std::uint32_t>(std::abs(e2));
+            cost[3] += static_cast<std::uint32_t>(std::abs(e3));
+            cost[4] += static_cast<std::uint32_t>(std::abs(e4));
+        }
+
+        const int order = static_cast<int>(std::min_element(cost, cost + kMaxOrder + 1) - cost);
+        std::array<std::int32_t, kMaxBlockFrames> residuals;
+        withOrder(order, [&](auto predictorOrder)
+        {
+            for (int i = 0; i < numFrames; ++i)
+                residuals[static_cast<size_t>(i)] = residual(x, i, decltype(predictorOrder)::value);
+        });
+
+        writer.put(static_cast<std::uint32_t>(shift), 5);
+        writer.put(static_cast<std::uint32_t>(order), 3);
+
+        std::array<std::uint32_t, kPartitionFrames> codes;
+        for (int start = 0; start < numFrames; start += kPartitionFrames)
+        {
+            const int count = std::min(kPartitionFrames, numFrames - start);
+            std::uint64_t sum = 0;
+            for (int i = 0; i < count; ++i)
+            {
+                codes[static_cast<size_t>(i)] = zigzag(residuals[static_cast<size_t>(start + i)]);
+                sum += codes[static_cast<size_t>(i)];
+            }
+
+            const int parameter = chooseRiceParameter(codes.data(), count, sum);
+            writer.put(static_cast<std::uint32_t>(parameter), 5);
+            for (int i = 0; i < count; ++i)
+            {
+                const std::uint32_t code = codes[static_cast<size_t>(i)];
+                const std::uint32_t quotient = code >> parameter;
+                if (quotient >= static_cast<std::uint32_t>(kEscapeQuotient))
+                {
+                    writer.put(0, kEscapeQuotient);
+                    writer.put(code, 32);
+                }
+                else if (static_cast<int>(quotient) + 1 + parameter <= 32)
+                {
+                    writer.put((1u << parameter) | (code & ((1u << parameter) - 1)),
+                               static_cast<int>(quotient) + 1 + parameter);
+                }
+                else
+                {
+                    writer.put(1, static_cast<int>(quotient) + 1);
+                    writer.put(code, parameter);
+                }
+            }
+        }
+    }
+
+    /** Calls function with std::integral_constant<int, order>, so loops over
+        one predictor order compile without a branch per sample. */
+    template <typename Function>
+    static void withOrder(int order, Function&& function)
+    {
+        switch (order)
+        {
+            case 1:  function(std::integral_constant<int, 1> {}); break;
+            case 2:  function(std::integral_constant<int, 2> {}); break;
+            case 3:  function(std::integral_constant<int, 3> {}); break;
+            case 4:  function(std::integral_constant<int, 4> {}); break;
+            default: function(std::integral_constant<int, 0> {}); break;
+        }
+    }
+
+    /** The residual of the fixed predictor of the given order at x[i]; x
+        must have kMaxOrder readable frames before it. */
+    static std::int32_t residual(const std::int32_t* x, int i, int order)
+    {
+        switch (order)
+        {
+            case 1:  return x[i] - x[i - 1];
+            case 2:  return x[i] - 2 * x[i - 1] + x[i - 2];
+            case 3:  return x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+            case 4:  return x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+            default: return x[i];
+        }
+    }
+
+    /** The Rice parameter near log2 of the mean code that costs fewest bits. */
+    static int chooseRiceParameter(const std::uint32_t* codes, int count, std::uint64_t sum)
+    {
+        int estimate = 0;
+        while (estimate < 30 && (static_cast<std::uint64_t>(count) << (estimate + 1)) <= sum)
+            ++estimate;
+
+        // Escapes are rare enough to leave out of the estimate.
+        const int lowest = std::max(0, estimate - 1);
+        std::array<std::uint64_t, 3> bits {};
+        for (int candidate = 0; candidate < 3; ++candidate)
+        {
+            const int parameter = lowest + candidate;
+            std::uint64_t quotients = 0;
+            for (int i = 0; i < count; ++i)
+                quotients += codes[i] >> parameter;
+            bits[static_cast<size_t>(candidate)] = quotients + static_cast<std::uint64_t>(count) * (parameter + 1u);
+        }
+
+        return lowest + static_cast<int>(std::min_element(bits.begin(), bits.end()) - bits.begin());
+    }
+
+    static bool decodeChannel(BitReader& reader, std::int32_t* samples, int numFrames)
+    {
+        const auto shift = reader.get(5);
+        if (shift == kZeroChannel)
+        {
+            std::fill(samples, samples + numFrames, 0);
+            return true;
+        }
+
+        const auto order = static_cast<int>(reader.get(3));
+        if (order > kMaxOrder || shift > static_cast<std::uint32_t>(kQuantizationBits + 1))
+            return false;
+
+        std::array<std::int64_t, kMaxOrder> history {};  // history[k] is the sample k + 1 frames back
+        for (int start = 0; start < numFrames; start += kPartitionFrames)
+        {
+            const int count = std::min(kPartitionFrames, numFrames - start);
+            const auto parameter = static_cast<int>(reader.get(5));
+            for (int i = start; i < start + count; ++i)
+            {
+                const int quotient = reader.getUnary();
+                const std::uint32_t code = (quotient == kEscapeQuotient)
+                                               ? reader.get(32)
+                                               : (static_cast<std::uint32_t>(quotient) << parameter)
+                                                     | reader.get(parameter);
+
+                const std::int64_t value = unzigzag(code) + predict(history, order);
+                if (std::abs(value) > kMaxDecodedMagnitude)
+                    return false;
+
+                for (int k = kMaxOrder - 1; k > 0; --k)
+                    history[static_cast<size_t>(k)] = history[static_cast<size_t>(k - 1)];
+                history[0] = value;
+                const std::int64_t sample = value * (std::int64_t { 1 } << shift);
+                if (std::abs(sample) > kMaxDecodedMagnitude)
+                    return false;
+                samples[i] = static_cast<std::int32_t>(sample);
+            }
+        }
+        return true;
+    }
+
+    static std::int64_t predict(const std::array<std::int64_t, kMaxOrder>& x, int order)
+    {
+        switch (order)
+        {
+            case 1:  return x[0];
+            case 2:  return 2 * x[0] - x[1];
+            case 3:  return 3 * x[0] - 3 * x[1] + x[2];
+            case 4:  return 4 * x[0] - 6 * x[1] + 4 * x[2] - x[3];
+            default: return 0;
+        }
+    }
+};
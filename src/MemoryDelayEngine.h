@@ -7,17 +7,25 @@
 
 #include <JuceHeader.h>
 #include "MemoryBuffer.h"
+#include "MemoryResampler.h"
+#include "Lfo.h"
+#include "MemorySnapshot.h"
 #include "Playhead.h"
 #include "RandomGenerator.h"
 #include "Modifiers.h"
+#include "Saturator.h"
+#include "SmoothedParameter.h"
 #include <array>
 #include <atomic>
 #include <cmath>
 #include <cstddef>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
-class MemoryDelayEngine
+/** Modes and metering types shared by every MemoryDelayEngine instantiation. */
+struct MemoryDelayEngineTypes
 {
-public:
     enum class StereoMode
     {
         Independent = 0,
@@ -54,6 +62,20 @@ public:
         float secondaryPosition { 0.0f };
         int writeIndex { 0 };
     };
+};
+
+/** SampleType is the processing precision (the host buffers, modifiers and
+    mixing); StorageType is the precision of the recorded memory.  They are
+    chosen independently, so a double-precision host can keep a float memory
+    and half the footprint.  Control values (mix, feedback, scan, sizes) stay
+    float in every instantiation. */
+template <typename SampleType = float, typename StorageType = float>
+class MemoryDelayEngine : public MemoryDelayEngineTypes
+{
+public:
+    using Phase = MemoryBufferTypes::Phase;
+    using Layout = MemoryBufferTypes::Layout;
+    using Format = MemoryBufferTypes::Format;
 
     MemoryDelayEngine() = default;
     ~MemoryDelayEngine() = default;
@@ -61,26 +83,27 @@ public:
     void prepare(double newSampleRate, int maxBlockSize, float maxBufferSeconds)
     {
         sampleRate = newSampleRate;
-        bufferMaxSeconds = juce::jmax(kMemorySeconds, maxBufferSeconds);
-        maxBlock = juce::jmax(1, maxBlockSize);
-        sizeSecondsTarget = juce::jlimit(kMinSizeSeconds,
-                                         juce::jmin(kMaxSizeSeconds, bufferMaxSeconds),
-                                         sizeSecondsTarget);
-        sizeSecondsCurrent = sizeSecondsTarget;
-        sizeSecondsPrevious = sizeSecondsTarget;
-        sizeCrossfadeSamplesRemaining = 0;
-        sizeCrossfadeSamplesTotal = 0;
-
+        bufferMaxSeconds = getMemorySeconds(maxBufferSeconds);
+        prepareBlockSize(maxBlockSize);
+        sizeSecondsTarget = juce::jlimit(kMinSizeSeconds, getMaxSizeSeconds(), sizeSecondsTarget);
+
+        buffer.setAllocation(extendedMemorySeconds > 0.0f ? MemoryBufferTypes::Allocation::Spilled
+                             : lazyAllocation         ? MemoryBufferTypes::Allocation::Lazy
+                                                      : MemoryBufferTypes::Allocation::Eager);
+        buffer.setRetainedSeconds(getReachableSeconds());
+        buffer.setResidentSeconds(kExtendedResidentSeconds);
         buffer.prepare(sampleRate, bufferMaxSeconds);
+        snapshotter.reset();
         primary.setMemoryBuffer(&buffer);
         secondary.setMemoryBuffer(&buffer);
-        primary.setMaxDelaySeconds(sizeSecondsCurrent);
-        secondary.setMaxDelaySeconds(sizeSecondsCurrent);
-        updateSpreadSeconds();
+        settleSizeAtTarget();
 
         modifierBankA.prepare(sampleRate, maxBlock, 2);
         modifierBankB.prepare(sampleRate, maxBlock, 2);
 
+        Saturator::prepare();
+        prepareSmoothedParameters();
+
         resetVisualState();
         autoScanOffset = manualScan;
         autoScanSamplesRemaining = 0;
@@ -88,24 +111,67 @@ public:
         requestReseed = true;
     }
 
+    /** Re-prepares only the state sized by the host block: the memory,
+        settings, modifiers and read positions are kept, so a host restarting
+        playback at the same sample rate carries on where it stopped.  Call
+        while the engine is not processing. */
+    void prepareBlockSize(int maxBlockSize)
+    {
+        maxBlock = juce::jmax(1, maxBlockSize);
+        effectScratchLeft.assign(static_cast<size_t>(maxBlock), 0.0f);
+        effectScratchRight.assign(static_cast<size_t>(maxBlock), 0.0f);
+        inputScratchLeft.assign(static_cast<size_t>(maxBlock), 0.0f);
+        inputScratchRight.assign(static_cast<size_t>(maxBlock), 0.0f);
+        readScratch.prepare(maxBlock);
+        parameterScratch.prepare(maxBlock);
+    }
+
+    /** True if prepare() has run with this sample rate and memory length, so
+        prepareBlockSize() is enough to play again. */
+    bool isPreparedFor(double newSampleRate, float maxBufferSeconds) const
+    {
+        return buffer.getBufferSize() > 0
+            && sampleRate == newSampleRate
+            && bufferMaxSeconds == getMemorySeconds(maxBufferSeconds);
+    }
+
+    double getSampleRate() const { return sampleRate; }
+
+    /** Replaces the memory with what other has recorded, converted to this
+        engine's sample rate (see MemoryResampler), so every delay in seconds
+        reads the same audio as before.  Allocates and takes a while for a long
+        memory: call it after prepare() and before this engine processes, from
+        the thread that built it. */
+    void resampleMemoryFrom(const MemoryDelayEngine& other)
+    {
+        MemoryResampler<StorageType> resampler;
+        resampler.prepare(other.sampleRate, sampleRate);
+        resampler.process(other.buffer, buffer);
+    }
+
+    /** Silences the memory and returns the engine to its prepared state.  The
+        memory is cleared in constant time (see MemoryBuffer::clear()), so this
+        may be called on the audio thread. */
     void reset()
     {
-        buffer.prepare(sampleRate, bufferMaxSeconds);
-        sizeSecondsCurrent = sizeSecondsTarget;
-        sizeSecondsPrevious = sizeSecondsTarget;
-        sizeCrossfadeSamplesRemaining = 0;
-        sizeCrossfadeSamplesTotal = 0;
-        primary.setMaxDelaySeconds(sizeSecondsCurrent);
-        secondary.setMaxDelaySeconds(sizeSecondsCurrent);
-        updateSpreadSeconds();
+        buffer.setRetainedSeconds(getReachableSeconds());
+        buffer.clear();
+        clearRequested.store(false, std::memory_order_relaxed);
+        settleSizeAtTarget();
         modifierBankA.reset();
         modifierBankB.reset();
+        snapParametersOnNextBlock = true;
         resetVisualState();
         if (tapeMode)
             resetTapeState();
     }
 
-    void setMix(float newMix) { mix = juce::jlimit(0.0f, 1.0f, newMix); }
+    /** Parameter setters (mix, feedback, spread, character and the modifier
+        banks) only store a target and may be called from any thread.  The audio
+        thread picks the targets up at the start of each block and ramps to them
+        (see SmoothedParameter); the first block after prepare() or reset() starts
+        at the targets directly. */
+    void setMix(float newMix) { mix.setTarget(juce::jlimit(0.0f, 1.0f, newMix)); }
 
     void setScan(float newScan)
     {
@@ -133,13 +199,12 @@ public:
 
     void setSpread(float newSpreadNormalized)
     {
-        spreadNormalized = juce::jlimit(0.0f, 1.0f, newSpreadNormalized);
-        updateSpreadSeconds();
+        spread.setTarget(juce::jlimit(0.0f, 1.0f, newSpreadNormalized));
     }
 
     void setFeedback(float newFeedback)
     {
-        feedback = juce::jlimit(0.0f, 0.98f, newFeedback);
+        feedback.setTarget(juce::jlimit(0.0f, 0.98f, newFeedback));
     }
 
     void setTapeMode(bool enabled)
@@ -148,8 +213,8 @@ public:
         if (!tapeMode)
             return;
 
-        spreadNormalized = 0.0f;
-        feedback = kTapeFeedback;
+        spread.setTarget(0.0f);
+        feedback.setTarget(kTapeFeedback);
         mode = FeedbackMode::Feed;
         scanMode = ScanMode::Manual;
         autoScanRateHz = 0.0f;
@@ -157,9 +222,8 @@ public:
         alwaysRecord = true;
         routingModeA = RoutingMode::Out;
         routingModeB = RoutingMode::Out;
-        modifierBankA.setModValues(0.0f, 0.0f, 0.0f);
-        modifierBankB.setModValues(0.0f, 0.0f, 0.0f);
-        character = 0.0f;
+        setModifierBankA(0.0f, 0.0f, 0.0f);
+        setModifierBankB(0.0f, 0.0f, 0.0f);
         setTapeWindowSeconds(tapeWindowSeconds);
         resetTapeState();
     }
@@ -171,13 +235,7 @@ public:
             return;
 
         sizeSecondsTarget = tapeWindowSeconds;
-        sizeSecondsCurrent = tapeWindowSeconds;
-        sizeSecondsPrevious = tapeWindowSeconds;
-        sizeCrossfadeSamplesRemaining = 0;
-        sizeCrossfadeSamplesTotal = 0;
-        primary.setMaxDelaySeconds(sizeSecondsCurrent);
-        secondary.setMaxDelaySeconds(sizeSecondsCurrent);
-        updateSpreadSeconds();
+        settleSizeAtTarget();
 
         if (sizeSecondsCurrent <= 0.0f)
         {
@@ -193,26 +251,20 @@ public:
         }
     }
 
+    /** Sets the memory size.  The change is picked up at the next render
+        segment: jumps whose read delay can slew there at kSizeGlideMaxSlope
+        within kSizeGlideMaxSeconds glide (a pitch bend under a semitone, one
+        read per head), larger ones crossfade between the old and new size for
+        kSizeCrossfadeSeconds.  Slow automation therefore glides and costs no
+        more than a fixed size; faster moves crossfade rather than chirp. */
     void setSize(float newSizeSeconds)
     {
-        const float clamped = juce::jlimit(kMinSizeSeconds,
-                                           juce::jmin(kMaxSizeSeconds, bufferMaxSeconds),
-                                           newSizeSeconds);
+        const float clamped = juce::jlimit(kMinSizeSeconds, getMaxSizeSeconds(), newSizeSeconds);
 
         if (std::abs(clamped - sizeSecondsTarget) < kSizeEpsilon)
             return;
 
-        if (sizeCrossfadeSamplesRemaining > 0 && sizeCrossfadeSamplesTotal > 0)
-        {
-            const float progress = 1.0f - (static_cast<float>(sizeCrossfadeSamplesRemaining)
-                                           / static_cast<float>(sizeCrossfadeSamplesTotal));
-            sizeSecondsCurrent = sizeSecondsPrevious + (sizeSecondsTarget - sizeSecondsPrevious) * progress;
-        }
-
-        sizeSecondsPrevious = sizeSecondsCurrent;
         sizeSecondsTarget = clamped;
-        sizeCrossfadeSamplesTotal = juce::jmax(1, static_cast<int>(sampleRate * kSizeCrossfadeSeconds));
-        sizeCrossfadeSamplesRemaining = sizeCrossfadeSamplesTotal;
     }
 
     void setStereoMode(int modeIndex)
@@ -246,12 +298,12 @@ public:
 
     void setModifierBankA(float mod1, float mod2, float mod3)
     {
-        modifierBankA.setModValues(mod1, mod2, mod3);
+        setModifierValues(0, mod1, mod2, mod3);
     }
 
     void setModifierBankB(float mod1, float mod2, float mod3)
     {
-        modifierBankB.setModValues(mod1, mod2, mod3);
+        setModifierValues(1, mod1, mod2, mod3);
     }
 
     void setAlwaysRecord(bool shouldAlwaysRecord)
@@ -289,11 +341,51 @@ public:
         bypassed = isBypassed;
     }
 
+    /** Silences everything recorded so far, and the modifiers' internal
+        delay lines, at the start of the next block.  Safe from any thread; the
+        memory is cleared in constant time on the audio thread and the stale
+        pages are zeroed as the write head reaches them or by serviceMemory(). */
+    void clearMemory() { clearRequested.store(true, std::memory_order_release); }
+
+    /** Selects between the compile-time specialized kernels (default) and the
+        generic kernel that tests every mode at run time.  Both render identically. */
+    void setSpecializedKernelsEnabled(bool shouldUseSpecializedKernels)
+    {
+        specializedKernelsEnabled = shouldUseSpecializedKernels;
+    }
+
+    /** Selects the saturator applied to every frame written into memory
+        (see Saturator::Mode).  Exact, the default, is std::tanh. */
+    void setSaturatorMode(int modeIndex)
+    {
+        saturatorMode = static_cast<Saturator::Mode>(juce::jlimit(0, 3, modeIndex));
+    }
+
+    /** Chooses planar or interleaved (LRLR) storage for the memory buffer.  The
+        recorded contents are kept.  This reallocates, so call it while audio is
+        stopped; output is the same in either layout. */
+    void setMemoryLayout(Layout newLayout)
+    {
+        buffer.setLayout(newLayout);
+    }
+
+    Layout getMemoryLayout() const { return buffer.getLayout(); }
+
+    /** Chooses how the memory buffer encodes samples: natively in StorageType,
+        or as half, dithered 16-bit or packed 24-bit values, which take less
+        memory and bandwidth at some cost in noise floor.  The recorded
+        contents are converted.  This reallocates, so call it while audio is
+        stopped. */
+    void setMemoryFormat(Format newFormat)
+    {
+        buffer.setFormat(newFormat);
+    }
+
+    Format getMemoryFormat() const { return buffer.getFormat(); }
+
     void setCharacter(float newCharacter)
     {
-        character = juce::jlimit(0.0f, 1.0f, newCharacter);
-        modifierBankA.setCharacter(character);
-        modifierBankB.setCharacter(character);
+        character.setTarget(juce::jlimit(0.0f, 1.0f, newCharacter));
     }
 
     void setRandomSeed(int newSeed)
@@ -316,9 +408,11 @@ public:
         lastTransportSample = transportSample;
     }
 
-    void processBlock(juce::AudioBuffer<float>& audioBuffer)
+    void processBlock(juce::AudioBuffer<SampleType>& audioBuffer)
     {
         updateRandomSeedIfNeeded();
+        beginParameterBlock();
+        buffer.setRetainedSeconds(getReachableSeconds());
 
         if (bypassed != lastBypassed)
         {
@@ -328,16 +422,12 @@ public:
             lastBypassed = bypassed;
         }
 
-        const int numSamples = audioBuffer.getNumSamples();
-        const float dryMix = dryKill ? 0.0f : (1.0f - mix);
-        const float wetMix = mix;
-        float energySum = 0.0f;
-
-        const int readChannelLeft = getReadChannel(0);
-        const int readChannelRight = getReadChannel(1);
-
-        float lastOffset = manualScan;
-        constexpr float kCollectDecay = 0.98f;
+        if (clearRequested.exchange(false, std::memory_order_acquire))
+        {
+            buffer.clear();
+            modifierBankA.reset();
+            modifierBankB.reset();
+        }
 
         if (latchEnabled && !lastLatchEnabled)
         {
@@ -349,172 +439,808 @@ public:
             lastLatchEnabled = false;
         }
 
-        for (int sample = 0; sample < numSamples; ++sample)
+        const int numSamples = audioBuffer.getNumSamples();
+        SampleType* left = audioBuffer.getWritePointer(0);
+        SampleType* right = audioBuffer.getWritePointer(1);
+        const BlockSettings settings = makeBlockSettings();
+        const Kernel kernel = selectKernel();
+
+        float energySum = 0.0f;
+        float lastOffset = manualScan;
+
+        // Render in chunks no larger than the prepared scratch size, and no longer
+        // than a control period while the modifier settings are ramping.  The read
+        // and write stages are per-sample wherever a written frame can be read
+        // back by the next one; the In and Out modifiers, mixing and metering run
+        // as block passes.
+        int count = 0;
+        for (int start = 0; start < numSamples; start += count)
         {
-            const float offset = latchEnabled ? latchedOffset : getNextScanOffset();
-            lastOffset = offset;
-            primary.setOffsetNormalized(offset);
-            secondary.setOffsetNormalized(offset);
+            updateModifiersAtControlRate();
+            count = juce::jmin(maxBlock, numSamples - start);
+            if (modifierSettingsRamping)
+                count = juce::jmin(count, controlSamplesRemaining);
+
+            renderParameterRamps(count);
+            (this->*kernel)(settings, left + start, right + start, count, lastOffset);
+            accumulateEnergy(count, energySum);
+            mixOutput(settings, left + start, right + start, count);
+
+            if (modifierSettingsRamping)
+                controlSamplesRemaining -= count;
+        }
 
-            const float inLeft = audioBuffer.getSample(0, sample);
-            const float inRight = audioBuffer.getSample(1, sample);
+        const int index = visualWriteIndex.load();
+        visualEnergy[static_cast<size_t>(index)].store(energySum / static_cast<float>(juce::jmax(1, numSamples)));
+        visualWriteIndex.store((index + 1) % kVisualBins);
 
-            float rawEffectLeft = 0.0f;
-            float rawEffectRight = 0.0f;
-            if (sizeCrossfadeSamplesRemaining > 0 && sizeCrossfadeSamplesTotal > 0)
-            {
-                float rawALeft = 0.0f;
-                float rawARight = 0.0f;
-                float rawBLeft = 0.0f;
-                float rawBRight = 0.0f;
-                computeRawEffect(readChannelLeft, readChannelRight, sizeSecondsPrevious, rawALeft, rawARight);
-                computeRawEffect(readChannelLeft, readChannelRight, sizeSecondsTarget, rawBLeft, rawBRight);
-                const float progress = 1.0f - (static_cast<float>(sizeCrossfadeSamplesRemaining)
-                                               / static_cast<float>(sizeCrossfadeSamplesTotal));
-                rawEffectLeft = rawALeft + (rawBLeft - rawALeft) * progress;
-                rawEffectRight = rawARight + (rawBRight - rawARight) * progress;
-
-                --sizeCrossfadeSamplesRemaining;
-                if (sizeCrossfadeSamplesRemaining <= 0)
-                {
-                    sizeSecondsCurrent = sizeSecondsTarget;
-                    sizeSecondsPrevious = sizeSecondsTarget;
-                    sizeCrossfadeSamplesTotal = 0;
-                    updateSpreadSeconds();
-                    primary.setMaxDelaySeconds(sizeSecondsCurrent);
-                    secondary.setMaxDelaySeconds(sizeSecondsCurrent);
-                }
-            }
-            else
-            {
-                computeRawEffect(readChannelLeft, readChannelRight, sizeSecondsCurrent, rawEffectLeft, rawEffectRight);
-            }
+        const float spreadNorm = spread.getCurrentValue();
+        visualPrimary.store(lastOffset);
+        visualSecondary.store(juce::jlimit(0.0f, 1.0f, lastOffset + spreadNorm));
+
+        // Measured from the last page boundary the write head crossed, where a
+        // memory snapshot taken now ends
+        const auto framesIntoPage = static_cast<double>(buffer.getWrittenFrames()
+                                                        - buffer.getPublishedWrittenFrames());
+        const double sizeFrames = static_cast<double>(sizeSecondsCurrent) * sampleRate;
+        playheadDelays[0].store(static_cast<double>(lastOffset) * sizeFrames - framesIntoPage);
+        playheadDelays[1].store(static_cast<double>(lastOffset + spreadNorm) * sizeFrames - framesIntoPage);
+
+        if (buffer.getAllocation() == MemoryBufferTypes::Allocation::Spilled)
+            updatePrefetchWindows(lastOffset);
+    }
+
+    void getVisualSnapshot(VisualSnapshot& snapshot) const
+    {
+        for (size_t i = 0; i < snapshot.energy.size(); ++i)
+            snapshot.energy[i] = visualEnergy[i].load();
+
+        snapshot.primaryPosition = visualPrimary.load();
+        snapshot.secondaryPosition = visualSecondary.load();
+        snapshot.writeIndex = visualWriteIndex.load();
+    }
+
+    /** Allocates the memory lazily: only the span the current size can reach
+        (and a short lookahead for the write head) stays resident, and
+        serviceMemory() must be called regularly from a background thread.
+        Recorded audio beyond that span is released, so growing the size later
+        reveals silence rather than older audio.  Takes effect at the next
+        prepare(). */
+    void setLazyMemoryAllocation(bool shouldAllocateLazily) { lazyAllocation = shouldAllocateLazily; }
+
+    /** Extends the memory to seconds, far beyond what RAM should hold: the
+        last kExtendedResidentSeconds stay resident and older pages go to a
+        scratch file (see MemoryBufferTypes::Allocation::Spilled), and the size
+        may grow to half the memory, so the furthest head reaches its oldest
+        frames.  After each block the engine tells the memory where the heads
+        are headed, and serviceMemory(), which must then be called regularly
+        from a background thread, brings those pages back before they are read.
+        A jump the heads' trajectories did not announce reads silence from a
+        spilled page until the next serviceMemory() has fetched it.  Zero turns
+        it off.  Takes effect at the next prepare(); a memory snapshot still
+        covers everything the heads can reach.  Engine only: the plug-in keeps
+        its fixed memory, since saving the memory with its state would carry
+        all of it. */
+    void setExtendedMemorySeconds(float seconds) { extendedMemorySeconds = juce::jmax(0.0f, seconds); }
+
+    /** Zeroes memory left stale by a clear and allocates and releases pages for
+        lazy allocation, then moves any memory snapshot work along (see
+        restoreMemorySnapshot()).  Never call it from the audio thread.  Returns
+        true if any page was allocated or released. */
+    bool serviceMemory()
+    {
+        const bool changed = buffer.servicePages();
+        snapshotter.service(buffer);
+        return changed;
+    }
+
+    /** Keeps compressed copies of the memory's completed pages up to date in
+        serviceMemory(), so captureMemorySnapshot() only has the newest few
+        pages left to encode. */
+    void setMemorySnapshotCaching(bool shouldCache) { snapshotter.setCaching(shouldCache); }
+
+    /** Returns what the playheads can reach of the memory, compressed (see
+        MemorySnapshot).  Safe from any thread but the audio thread while the
+        engine is not being prepared. */
+    std::shared_ptr<const MemorySnapshot> captureMemorySnapshot() const { return snapshotter.capture(buffer); }
+
+    /** Writes a captured memory back, behind the write head, a few pages per
+        serviceMemory() call; a snapshot from another sample rate is resampled
+        first.  The engine keeps processing meanwhile.  Safe from any thread but
+        the audio thread. */
+    void restoreMemorySnapshot(std::shared_ptr<const MemorySnapshot> snapshot)
+    {
+        snapshotter.beginRestore(std::move(snapshot));
+    }
+
+    /** Records feed behind the write head as its frames arrive, a few pages
+        per serviceMemory() call, replacing any restore under way (see
+        MemoryFeed).  The engine keeps processing meanwhile.  Safe from any
+        thread but the audio thread. */
+    void feedMemory(std::shared_ptr<MemoryFeed> feed) { snapshotter.beginFeed(std::move(feed)); }
+
+    /** True while a snapshot restore or a feed is being written. */
+    bool isRestoringMemory() const { return snapshotter.isRestoring(); }
+
+    /** Where the primary and secondary playheads read as of the last
+        processBlock(), in frames before the end of a snapshot
+        captureMemorySnapshot() returns (used for export markers); negative
+        while a head reads newer frames than the snapshot holds.  Safe from
+        any thread. */
+    std::array<double, 2> getPlayheadSnapshotDelays() const
+    {
+        return { playheadDelays[0].load(), playheadDelays[1].load() };
+    }
+
+    /** Bytes of memory buffer currently allocated.  Safe from any thread. */
+    size_t getMemoryResidentBytes() const { return buffer.getResidentBytes(); }
+
+    /** Bytes of scratch file behind an extended memory, or zero. */
+    size_t getMemorySpillBytes() const { return buffer.getSpillFileBytes(); }
+
+    /** Frames that could not be recorded because lazy allocation fell behind. */
+    int getMissedMemoryWrites() const { return buffer.getMissedWrites(); }
+
+    int getMaxSamples() const { return buffer.getBufferSize(); }
+    int getWriteIndex() const { return buffer.getWritePosition(); }
+    StorageType debugGetMemorySample(int channel, int index) const { return buffer.getSample(channel, index); }
+    bool debugIsSizeCrossfading() const { return isSizeCrossfading(); }
+
+private:
+    enum class OutputMode
+    {
+        Normal = 0,
+        Wipe,
+        BypassTrails,
+        BypassDry
+    };
+
+    // Decisions that stay fixed for a whole block, resolved once up front.  The
+    // stereo/feedback/routing/tape modes are carried separately by a Modes policy.
+    // The gains point at the per-sample ramps of the chunk being rendered.
+    struct BlockSettings
+    {
+        OutputMode outputMode { OutputMode::Normal };
+        const float* dryMix { nullptr };
+        const float* wetMix { nullptr };
+        const float* feedback { nullptr };
+        bool trailsKeepDry { true };
+        bool shouldWrite { false };
+        bool feedbackActive { false };
+    };
+
+    // Mode tuple read from the engine at run time; drives the generic kernel.
+    struct DynamicModes
+    {
+        StereoMode stereo { StereoMode::Independent };
+        FeedbackMode feedback { FeedbackMode::Feed };
+        RoutingMode routingA { RoutingMode::Out };
+        RoutingMode routingB { RoutingMode::Out };
+        bool tape { false };
+    };
+
+    // Mode tuple fixed at compile time, so every mode test in the kernel folds away.
+    template <StereoMode Stereo, FeedbackMode Feedback, RoutingMode RoutingA, RoutingMode RoutingB, bool Tape>
+    struct StaticModes
+    {
+        static constexpr StereoMode stereo = Stereo;
+        static constexpr FeedbackMode feedback = Feedback;
+        static constexpr RoutingMode routingA = RoutingA;
+        static constexpr RoutingMode routingB = RoutingB;
+        static constexpr bool tape = Tape;
+    };
+
+    // Per-segment scratch for block reads: scan offsets, sizes and spreads, head
+    // delays for the current (and, while crossfading, outgoing) size, the mixed
+    // head output and the frames waiting to be saturated and recorded.
+    struct ReadScratch
+    {
+        void prepare(int maxSamples)
+        {
+            const auto size = static_cast<size_t>(maxSamples);
+            offsets.assign(size, 0.0f);
+            sizes.assign(size, 0.0f);
+            previousSizes.assign(size, 0.0f);
+            spreads.assign(size, 0.0f);
+            head.assign(size, 0.0f);
+            for (auto& delays : primaryDelays)
+                delays.assign(size, 0);
+            for (auto& delays : secondaryDelays)
+                delays.assign(size, 0);
+            for (auto& channel : raw)
+                channel.assign(size, 0.0f);
+            for (auto& channel : writes)
+                channel.assign(size, 0.0f);
+        }
+
+        std::vector<float> offsets;
+        std::vector<float> sizes;
+        std::vector<float> previousSizes;
+        std::vector<float> spreads;
+        std::vector<StorageType> head;
+        std::array<std::vector<Phase>, 2> primaryDelays;
+        std::array<std::vector<Phase>, 2> secondaryDelays;
+        std::array<std::vector<StorageType>, 4> raw;
+        std::array<std::vector<SampleType>, 2> writes;
+    };
+
+    // Per-chunk ramps of the smoothed gains.
+    struct ParameterScratch
+    {
+        void prepare(int maxSamples)
+        {
+            const auto size = static_cast<size_t>(maxSamples);
+            dryMix.assign(size, 0.0f);
+            wetMix.assign(size, 0.0f);
+            feedback.assign(size, 0.0f);
+        }
+
+        std::vector<float> dryMix;
+        std::vector<float> wetMix;
+        std::vector<float> feedback;
+    };
+
+    using Kernel = void (MemoryDelayEngine::*)(const BlockSettings&, const SampleType*, const SampleType*, int, float&);
+
+    static constexpr size_t kNumStereoModes = 3;
+    static constexpr size_t kNumFeedbackModes = 3;
+    static constexpr size_t kNumRoutingModes = 3;
+    static constexpr size_t kNumKernels = kNumStereoModes * kNumFeedbackModes * kNumRoutingModes * kNumRoutingModes * 2;
+
+    template <size_t Index>
+    void renderSpecializedKernel(const BlockSettings& settings, const SampleType* left, const SampleType* right,
+                                 int numSamples, float& lastOffset)
+    {
+        constexpr size_t tapeIndex = Index % 2;
+        constexpr size_t routingBIndex = (Index / 2) % kNumRoutingModes;
+        constexpr size_t routingAIndex = (Index / (2 * kNumRoutingModes)) % kNumRoutingModes;
+        constexpr size_t feedbackIndex = (Index / (2 * kNumRoutingModes * kNumRoutingModes)) % kNumFeedbackModes;
+        constexpr size_t stereoIndex = Index / (2 * kNumRoutingModes * kNumRoutingModes * kNumFeedbackModes);
+
+        using Modes = StaticModes<static_cast<StereoMode>(stereoIndex),
+                                  static_cast<FeedbackMode>(feedbackIndex),
+                                  static_cast<RoutingMode>(routingAIndex),
+                                  static_cast<RoutingMode>(routingBIndex),
+                                  tapeIndex != 0>;
+        renderEffectAndWrite(Modes {}, settings, left, right, numSamples, lastOffset);
+    }
+
+    void renderGenericKernel(const BlockSettings& settings, const SampleType* left, const SampleType* right,
+                             int numSamples, float& lastOffset)
+    {
+        const DynamicModes modes { stereoMode, mode, routingModeA, routingModeB, tapeMode };
+        renderEffectAndWrite(modes, settings, left, right, numSamples, lastOffset);
+    }
+
+    template <size_t... Indices>
+    static constexpr std::array<Kernel, sizeof...(Indices)> makeKernelTable(std::index_sequence<Indices...>)
+    {
+        return { { &MemoryDelayEngine::renderSpecializedKernel<Indices>... } };
+    }
+
+    Kernel selectKernel() const
+    {
+        if (!specializedKernelsEnabled)
+            return &MemoryDelayEngine::renderGenericKernel;
+
+        static constexpr std::array<Kernel, kNumKernels> kernels = makeKernelTable(std::make_index_sequence<kNumKernels>());
+        size_t index = static_cast<size_t>(stereoMode);
+        index = index * kNumFeedbackModes + static_cast<size_t>(mode);
+        index = index * kNumRoutingModes + static_cast<size_t>(routingModeA);
+        index = index * kNumRoutingModes + static_cast<size_t>(routingModeB);
+        index = index * 2 + (tapeMode ? 1u : 0u);
+        return kernels[index];
+    }
 
-            float effectLeft = rawEffectLeft;
-            float effectRight = rawEffectRight;
+    BlockSettings makeBlockSettings() const
+    {
+        BlockSettings settings;
+
+        if (wipeEnabled)
+            settings.outputMode = OutputMode::Wipe;
+        else if (bypassed)
+            settings.outputMode = (trailsEnabled && !memoryDryEnabled) ? OutputMode::BypassTrails
+                                                                       : OutputMode::BypassDry;
+
+        settings.dryMix = parameterScratch.dryMix.data();
+        settings.wetMix = parameterScratch.wetMix.data();
+        settings.feedback = parameterScratch.feedback.data();
+        settings.trailsKeepDry = !dryKill;
+        settings.shouldWrite = !wipeEnabled && !latchEnabled
+                               && (!bypassed || alwaysRecord || mode == FeedbackMode::Collect);
+        settings.feedbackActive = !bypassed;
+        return settings;
+    }
 
-            applyModifierBanks(RoutingMode::Out, effectLeft, effectRight);
+    static SampleType mixOutputSample(const BlockSettings& settings, int frame, SampleType input, SampleType effect)
+    {
+        const float dryMix = settings.dryMix[frame];
+        const float wetMix = settings.wetMix[frame];
+        switch (settings.outputMode)
+        {
+            case OutputMode::Wipe:
+                return wetMix * effect;
+            case OutputMode::BypassTrails:
+                return (settings.trailsKeepDry ? input : SampleType(0)) + wetMix * effect;
+            case OutputMode::BypassDry:
+                return input;
+            case OutputMode::Normal:
+                break;
+        }
+
+        return dryMix * input + wetMix * effect;
+    }
 
-            float outLeft = effectLeft;
-            float outRight = effectRight;
+    /** Reads the playheads, runs the Out modifiers into the effect scratch and
+        records the block into memory.  Inputs are read from left/right but not
+        modified; the output mix is applied afterwards by mixOutput().  Modes is
+        either DynamicModes or a StaticModes instantiation from the kernel table.
+
+        The In modifiers only see the input, so they run over the whole chunk
+        first.  The block is then walked in scan segments (see
+        renderScanOffsets()).  Within a segment the playhead reads come from
+        MemoryBuffer::readBlock() whenever no read can land on a frame written
+        earlier in the same segment; otherwise they are made per sample
+        alongside the writes.  With block reads nothing in the segment reads
+        back its own writes, so the Out modifiers run over the segment's
+        effect as a block, and the frames are queued and saturated and
+        recorded as one block at the end of the segment. */
+    template <typename Modes>
+    void renderEffectAndWrite(const Modes& modes, const BlockSettings& settings, const SampleType* left,
+                              const SampleType* right, int numSamples, float& lastOffset)
+    {
+        SampleType* effectLeft = effectScratchLeft.data();
+        SampleType* effectRight = effectScratchRight.data();
+        const int readChannelLeft = getReadChannel(modes, 0);
+        const int readChannelRight = getReadChannel(modes, 1);
+        const float* offsets = readScratch.offsets.data();
+        const float* sizes = readScratch.sizes.data();
+        const float* spreads = readScratch.spreads.data();
+        const SampleType* inputLeft = left;
+        const SampleType* inputRight = right;
+        if (settings.shouldWrite && (modes.routingA == RoutingMode::In || modes.routingB == RoutingMode::In))
+        {
+            std::copy(left, left + numSamples, inputScratchLeft.data());
+            std::copy(right, right + numSamples, inputScratchRight.data());
+            SampleType* const input[] = { inputScratchLeft.data(), inputScratchRight.data() };
+            applyModifierBanks(modes, RoutingMode::In, input, numSamples);
+            inputLeft = input[0];
+            inputRight = input[1];
+        }
 
-            if (wipeEnabled)
+        int sample = 0;
+        while (sample < numSamples)
+        {
+            const int segmentLength = renderScanOffsets(modes, readScratch.offsets.data(), readScratch.sizes.data(),
+                                                        readScratch.spreads.data(), numSamples - sample);
+            const bool blockReads = readSegmentBlock(settings.shouldWrite, readChannelLeft, readChannelRight, segmentLength);
+            const bool queueWrites = blockReads && settings.shouldWrite && segmentLength < buffer.getBufferSize();
+            SampleType* writesLeft = readScratch.writes[0].data();
+            SampleType* writesRight = readScratch.writes[1].data();
+            int writeIndex = buffer.getWritePosition();
+
+            if (blockReads)
             {
-                outLeft = wetMix * effectLeft;
-                outRight = wetMix * effectRight;
+                for (int i = 0; i < segmentLength; ++i)
+                    takeBlockReadWithCrossfade(i, effectLeft[sample + i], effectRight[sample + i]);
+
+                SampleType* const effect[] = { effectLeft + sample, effectRight + sample };
+                applyModifierBanks(modes, RoutingMode::Out, effect, segmentLength);
             }
-            else if (bypassed)
+
+            for (int i = 0; i < segmentLength; ++i, ++sample)
             {
-                if (trailsEnabled && !memoryDryEnabled)
+                if (!blockReads)
                 {
-                    outLeft = (dryKill ? 0.0f : inLeft) + wetMix * effectLeft;
-                    outRight = (dryKill ? 0.0f : inRight) + wetMix * effectRight;
+                    SampleType rawEffectLeft = 0;
+                    SampleType rawEffectRight = 0;
+                    primary.setOffsetNormalized(offsets[i]);
+                    secondary.setOffsetNormalized(offsets[i]);
+                    computeRawEffectWithCrossfade(readChannelLeft, readChannelRight, sizes[i], spreads[i],
+                                                  rawEffectLeft, rawEffectRight);
+                    applyModifierBanks(modes, RoutingMode::Out, rawEffectLeft, rawEffectRight);
+                    effectLeft[sample] = rawEffectLeft;
+                    effectRight[sample] = rawEffectRight;
                 }
-                else
+
+                if (queueWrites)
+                {
+                    writesLeft[i] = inputLeft[sample];
+                    writesRight[i] = inputRight[sample];
+                    renderWriteFrame(modes, settings, sample, left[sample], right[sample], effectLeft[sample],
+                                     effectRight[sample], writeIndex, writesLeft[i], writesRight[i]);
+                    if (++writeIndex == buffer.getBufferSize())
+                        writeIndex = 0;
+                }
+                else if (settings.shouldWrite)
                 {
-                    outLeft = inLeft;
-                    outRight = inRight;
+                    writeSample(modes, settings, sample, left[sample], right[sample], inputLeft[sample],
+                                inputRight[sample], effectLeft[sample], effectRight[sample]);
                 }
             }
-            else
+
+            if (queueWrites)
             {
-                outLeft = dryMix * inLeft + wetMix * effectLeft;
-                outRight = dryMix * inRight + wetMix * effectRight;
+                Saturator::processBlock(saturatorMode, writesLeft, writesRight, segmentLength);
+                writeBlockToMemory(modes, writesLeft, writesRight, segmentLength);
             }
 
-            audioBuffer.setSample(0, sample, outLeft);
-            audioBuffer.setSample(1, sample, outRight);
+            lastOffset = offsets[segmentLength - 1];
+            primary.setOffsetNormalized(lastOffset);
+            secondary.setOffsetNormalized(lastOffset);
+        }
+    }
 
-            energySum += 0.5f * (std::abs(effectLeft) + std::abs(effectRight));
+    /** Runs the Feed stage for one frame and records it into memory.  writeLeft
+        and writeRight are the input after the In modifiers. */
+    template <typename Modes>
+    void writeSample(const Modes& modes, const BlockSettings& settings, int frame, SampleType inLeft,
+                     SampleType inRight, SampleType writeLeft, SampleType writeRight, SampleType rawEffectLeft,
+                     SampleType rawEffectRight)
+    {
+        renderWriteFrame(modes, settings, frame, inLeft, inRight, rawEffectLeft, rawEffectRight,
+                         buffer.getWritePosition(), writeLeft, writeRight);
+        Saturator::processStereo(saturatorMode, writeLeft, writeRight);
+        writeToMemory(modes, writeLeft, writeRight);
+    }
 
-            const bool shouldWrite = !wipeEnabled && !latchEnabled
-                                     && (!bypassed || alwaysRecord || mode == FeedbackMode::Collect);
-            if (!shouldWrite)
-                continue;
+    /** Runs the Feed stage for one frame.  writeLeft/writeRight come in holding
+        the input after the In modifiers and return the frame to record, before
+        saturation.  frame indexes the chunk's parameter ramps; writeIndex is the
+        memory frame it will be recorded at, which Collect mode mixes with. */
+    template <typename Modes>
+    void renderWriteFrame(const Modes& modes, const BlockSettings& settings, int frame, SampleType inLeft,
+                          SampleType inRight, SampleType rawEffectLeft, SampleType rawEffectRight, int writeIndex,
+                          SampleType& writeLeft, SampleType& writeRight)
+    {
+        constexpr float kCollectDecay = 0.98f;
 
-            float writeLeft = inLeft;
-            float writeRight = inRight;
+        SampleType feedbackSourceLeft = 0;
+        SampleType feedbackSourceRight = 0;
+
+        if (modes.feedback == FeedbackMode::Feed && settings.feedbackActive)
+        {
+            // Feed mode recirculates the processed playback (no dry mix).
+            feedbackSourceLeft = rawEffectLeft;
+            feedbackSourceRight = rawEffectRight;
+        }
+        else if (modes.feedback == FeedbackMode::Closed && settings.feedbackActive)
+        {
+            // Closed mode feeds the full output (mix + modifiers) for accumulation.
+            feedbackSourceLeft = mixOutputSample(settings, frame, inLeft, rawEffectLeft);
+            feedbackSourceRight = mixOutputSample(settings, frame, inRight, rawEffectRight);
+        }
 
-            applyModifierBanks(RoutingMode::In, writeLeft, writeRight);
+        const float feedbackGain = settings.feedback[frame];
+        SampleType feedbackLeft = feedbackGain * feedbackSourceLeft;
+        SampleType feedbackRight = feedbackGain * feedbackSourceRight;
 
-            float feedbackSourceLeft = 0.0f;
-            float feedbackSourceRight = 0.0f;
+        applyModifierBanks(modes, RoutingMode::Feed, feedbackLeft, feedbackRight);
 
-            if (!bypassed)
+        writeLeft += feedbackLeft;
+        writeRight += feedbackRight;
+
+        if (modes.feedback == FeedbackMode::Collect)
+        {
+            const auto existingLeft = static_cast<SampleType>(buffer.getSample(0, writeIndex));
+            const auto existingRight = static_cast<SampleType>(buffer.getSample(1, writeIndex));
+            writeLeft = existingLeft * kCollectDecay + writeLeft;
+            writeRight = existingRight * kCollectDecay + writeRight;
+        }
+    }
+
+    /** Fills offsets with the scan position, sizes with the (possibly gliding)
+        memory size and spreads with the (possibly ramping) spread for up to
+        maxSamples samples, and returns how many were produced.  A pending size
+        change starts here.  A segment ends before any
+        sample whose scan step would draw from the random generator, and at the end
+        of a size crossfade, so the generator is consumed in the same order as a
+        purely per-sample render and the crossfade's sizes stay fixed within it.
+        An auto-scan segment's offsets are rendered as a block. */
+    template <typename Modes>
+    int renderScanOffsets(const Modes& modes, float* offsets, float* sizes, float* spreads, int maxSamples)
+    {
+        beginSizeTransitionIfNeeded();
+        if (isSizeCrossfading())
+            maxSamples = juce::jmin(maxSamples, sizeCrossfadeSamplesRemaining);
+
+        int count = 0;
+        if (!latchEnabled && !modes.tape && isAutoScanning())
+        {
+            count = renderAutoScanOffsets(offsets, maxSamples);
+            for (int i = 0; i < count; ++i)
+                sizes[i] = advanceSizeGlide();
+        }
+        else
+        {
+            do
             {
-                switch (mode)
-                {
-                    case FeedbackMode::Collect:
-                        break;
-                    case FeedbackMode::Feed:
-                        // Feed mode recirculates the processed playback (no dry mix).
-                        feedbackSourceLeft = effectLeft;
-                        feedbackSourceRight = effectRight;
-                        break;
-                    case FeedbackMode::Closed:
-                        // Closed mode feeds the full output (mix + modifiers) for accumulation.
-                        feedbackSourceLeft = outLeft;
-                        feedbackSourceRight = outRight;
-                        break;
-                }
+                offsets[count] = latchEnabled ? latchedOffset : getNextScanOffset(modes);
+                sizes[count] = advanceSizeGlide();
+                ++count;
             }
+            while (count < maxSamples && !scanDrawsRandomOnNextSample(modes));
+        }
+
+        spread.fill(spreads, count);
+        return count;
+    }
+
+    /** Starts a transition towards sizeSecondsTarget unless one is already heading
+        there.  A running crossfade always finishes first.  The read delay moves by
+        up to (1 + spread) times the size change; if that can slew at
+        kSizeGlideMaxSlope within kSizeGlideMaxSeconds the size glides, otherwise
+        the old and new sizes are crossfaded. */
+    void beginSizeTransitionIfNeeded()
+    {
+        if (isSizeCrossfading() || sizeSecondsTarget == sizeTransitionTargetSeconds)
+            return;
+
+        sizeTransitionTargetSeconds = sizeSecondsTarget;
+        const float delayJumpSeconds = std::abs(sizeSecondsTarget - sizeSecondsCurrent)
+                                       * (1.0f + spread.getCurrentValue());
+        const float glideSeconds = delayJumpSeconds / kSizeGlideMaxSlope;
+
+        if (glideSeconds <= kSizeGlideMaxSeconds)
+        {
+            sizeGlideSamplesRemaining = juce::jmax(1, static_cast<int>(sampleRate * juce::jmax(kSizeGlideMinSeconds,
+                                                                                              glideSeconds)));
+            sizeGlideIncrement = (sizeSecondsTarget - sizeSecondsCurrent) / static_cast<float>(sizeGlideSamplesRemaining);
+            return;
+        }
+
+        sizeGlideSamplesRemaining = 0;
+        sizeSecondsPrevious = sizeSecondsCurrent;
+        sizeSecondsCurrent = sizeSecondsTarget;
+        sizeCrossfadeSamplesTotal = juce::jmax(1, static_cast<int>(sampleRate * kSizeCrossfadeSeconds));
+        sizeCrossfadeSamplesRemaining = sizeCrossfadeSamplesTotal;
+        updateSpreadSeconds();
+        primary.setMaxDelaySeconds(sizeSecondsCurrent);
+        secondary.setMaxDelaySeconds(sizeSecondsCurrent);
+    }
 
-            float feedbackLeft = feedback * feedbackSourceLeft;
-            float feedbackRight = feedback * feedbackSourceRight;
+    /** Returns the size to read the current sample at and steps any glide. */
+    float advanceSizeGlide()
+    {
+        const float size = sizeSecondsCurrent;
+        if (sizeGlideSamplesRemaining <= 0)
+            return size;
 
-            applyModifierBanks(RoutingMode::Feed, feedbackLeft, feedbackRight);
+        if (--sizeGlideSamplesRemaining > 0)
+        {
+            sizeSecondsCurrent += sizeGlideIncrement;
+            return size;
+        }
 
-            writeLeft += feedbackLeft;
-            writeRight += feedbackRight;
+        sizeSecondsCurrent = sizeTransitionTargetSeconds;
+        updateSpreadSeconds();
+        primary.setMaxDelaySeconds(sizeSecondsCurrent);
+        secondary.setMaxDelaySeconds(sizeSecondsCurrent);
+        return size;
+    }
+
+    bool isSizeCrossfading() const
+    {
+        return sizeCrossfadeSamplesRemaining > 0 && sizeCrossfadeSamplesTotal > 0;
+    }
 
-            if (mode == FeedbackMode::Collect)
+    /** Jumps straight to sizeSecondsTarget, cancelling any glide or crossfade. */
+    void settleSizeAtTarget()
+    {
+        sizeSecondsCurrent = sizeSecondsTarget;
+        sizeSecondsPrevious = sizeSecondsTarget;
+        sizeTransitionTargetSeconds = sizeSecondsTarget;
+        sizeCrossfadeSamplesRemaining = 0;
+        sizeCrossfadeSamplesTotal = 0;
+        sizeGlideSamplesRemaining = 0;
+        sizeGlideIncrement = 0.0f;
+        primary.setMaxDelaySeconds(sizeSecondsCurrent);
+        secondary.setMaxDelaySeconds(sizeSecondsCurrent);
+        updateSpreadSeconds();
+    }
+
+    /** Computes the segment's playhead delays and, if no read depends on a frame
+        written during the segment, reads all heads as blocks into readScratch.
+        Set 0 reads at the per-sample sizes from renderScanOffsets(); while a
+        crossfade runs, set 1 reads at the size being faded out.  Returns false
+        when the reads have to be made per sample instead. */
+    bool readSegmentBlock(bool writing, int readChannelLeft, int readChannelRight, int numSamples)
+    {
+        const int numSizeSets = isSizeCrossfading() ? 2 : 1;
+        const float* offsets = readScratch.offsets.data();
+        const float* sizes = readScratch.sizes.data();
+        const float* spreads = readScratch.spreads.data();
+
+        for (int set = 0; set < numSizeSets; ++set)
+        {
+            auto* primaryDelays = readScratch.primaryDelays[static_cast<size_t>(set)].data();
+            auto* secondaryDelays = readScratch.secondaryDelays[static_cast<size_t>(set)].data();
+            if (set == 0)
             {
-                const int writeIndex = buffer.getWritePosition();
-                const float existingLeft = buffer.getSample(0, writeIndex);
-                const float existingRight = buffer.getSample(1, writeIndex);
-                writeLeft = existingLeft * kCollectDecay + writeLeft;
-                writeRight = existingRight * kCollectDecay + writeRight;
+                primary.computeDelays(offsets, sizes, numSamples, sampleRate, 0.0f, primaryDelays);
+                secondary.computeDelays(offsets, sizes, spreads, numSamples, sampleRate, secondaryDelays);
             }
+            else
+            {
+                float* previousSizes = readScratch.previousSizes.data();
+                std::fill(previousSizes, previousSizes + numSamples, sizeSecondsPrevious);
+                primary.computeDelays(offsets, numSamples, sampleRate, sizeSecondsPrevious, 0.0f, primaryDelays);
+                secondary.computeDelays(offsets, previousSizes, spreads, numSamples, sampleRate, secondaryDelays);
+            }
+
+            if (writing && (!readsAvoidSegmentWrites(primaryDelays, numSamples)
+                            || !readsAvoidSegmentWrites(secondaryDelays, numSamples)))
+                return false;
+        }
 
-            writeLeft = std::tanh(writeLeft);
-            writeRight = std::tanh(writeRight);
+        StorageType* primaryHead = readScratch.head.data();
+        for (int set = 0; set < numSizeSets; ++set)
+        {
+            const auto* primaryDelays = readScratch.primaryDelays[static_cast<size_t>(set)].data();
+            const auto* secondaryDelays = readScratch.secondaryDelays[static_cast<size_t>(set)].data();
+            const int channels[2] = { readChannelLeft, readChannelRight };
 
-            writeToMemory(writeLeft, writeRight);
+            for (int output = 0; output < 2; ++output)
+            {
+                StorageType* raw = readScratch.raw[static_cast<size_t>(set * 2 + output)].data();
+                primary.readBlock(channels[output], primaryDelays, primaryHead, numSamples, writing);
+                secondary.readBlock(channels[output], secondaryDelays, raw, numSamples, writing);
+                for (int i = 0; i < numSamples; ++i)
+                    raw[i] = 0.5f * (primaryHead[i] + raw[i]);
+            }
         }
 
-        const int index = visualWriteIndex.load();
-        visualEnergy[static_cast<size_t>(index)].store(energySum / static_cast<float>(juce::jmax(1, numSamples)));
-        visualWriteIndex.store((index + 1) % kVisualBins);
+        return true;
+    }
 
-        const float spreadNorm = spreadNormalized;
-        visualPrimary.store(lastOffset);
-        visualSecondary.store(juce::jlimit(0.0f, 1.0f, lastOffset + spreadNorm));
+    /** A read at delay d for the i-th sample of a segment touches a frame written
+        earlier in that segment when 0 < d <= i + 1.  Delays are exact fixed-point
+        phases, so no rounding margin is needed. */
+    static bool readsAvoidSegmentWrites(const Phase* delays, int numSamples)
+    {
+        for (int i = 1; i < numSamples; ++i)
+        {
+            const auto delay = delays[i];
+            if (delay > 0 && delay <= static_cast<Phase>(i + 1) * SimdInterpolator::kPhaseOne)
+                return false;
+        }
+
+        return true;
     }
 
-    void getVisualSnapshot(VisualSnapshot& snapshot) const
+    void takeBlockReadWithCrossfade(int index, SampleType& rawLeft, SampleType& rawRight)
     {
-        for (size_t i = 0; i < snapshot.energy.size(); ++i)
-            snapshot.energy[i] = visualEnergy[i].load();
+        const auto i = static_cast<size_t>(index);
+        if (!isSizeCrossfading())
+        {
+            rawLeft = readScratch.raw[0][i];
+            rawRight = readScratch.raw[1][i];
+            return;
+        }
 
-        snapshot.primaryPosition = visualPrimary.load();
-        snapshot.secondaryPosition = visualSecondary.load();
-        snapshot.writeIndex = visualWriteIndex.load();
+        const auto rawALeft = static_cast<SampleType>(readScratch.raw[2][i]);
+        const auto rawARight = static_cast<SampleType>(readScratch.raw[3][i]);
+        const auto rawBLeft = static_cast<SampleType>(readScratch.raw[0][i]);
+        const auto rawBRight = static_cast<SampleType>(readScratch.raw[1][i]);
+        const float progress = advanceSizeCrossfade();
+        rawLeft = rawALeft + (rawBLeft - rawALeft) * progress;
+        rawRight = rawARight + (rawBRight - rawARight) * progress;
     }
 
-    int getMaxSamples() const { return buffer.getBufferSize(); }
-    int getWriteIndex() const { return buffer.getWritePosition(); }
-    float debugGetMemorySample(int channel, int index) const { return buffer.getSample(channel, index); }
+    void computeRawEffectWithCrossfade(int readChannelLeft, int readChannelRight, float sizeSecondsForRead,
+                                       float spreadRatio, SampleType& rawLeft, SampleType& rawRight)
+    {
+        if (!isSizeCrossfading())
+        {
+            computeRawEffect(readChannelLeft, readChannelRight, sizeSecondsForRead, spreadRatio, rawLeft, rawRight);
+            return;
+        }
 
-private:
-    float getNextScanOffset()
+        SampleType rawALeft = 0;
+        SampleType rawARight = 0;
+        SampleType rawBLeft = 0;
+        SampleType rawBRight = 0;
+        computeRawEffect(readChannelLeft, readChannelRight, sizeSecondsPrevious, spreadRatio, rawALeft, rawARight);
+        computeRawEffect(readChannelLeft, readChannelRight, sizeSecondsForRead, spreadRatio, rawBLeft, rawBRight);
+        const float progress = advanceSizeCrossfade();
+        rawLeft = rawALeft + (rawBLeft - rawALeft) * progress;
+        rawRight = rawARight + (rawBRight - rawARight) * progress;
+    }
+
+    /** Returns the crossfade progress for the current sample and steps the
+        crossfade, dropping the faded-out size when it completes. */
+    float advanceSizeCrossfade()
     {
-        if (tapeMode)
+        const float progress = 1.0f - (static_cast<float>(sizeCrossfadeSamplesRemaining)
+                                       / static_cast<float>(sizeCrossfadeSamplesTotal));
+
+        --sizeCrossfadeSamplesRemaining;
+        if (sizeCrossfadeSamplesRemaining <= 0)
+        {
+            sizeSecondsPrevious = sizeSecondsCurrent;
+            sizeCrossfadeSamplesTotal = 0;
+        }
+
+        return progress;
+    }
+
+    void accumulateEnergy(int numSamples, float& energySum) const
+    {
+        const SampleType* effectLeft = effectScratchLeft.data();
+        const SampleType* effectRight = effectScratchRight.data();
+        for (int sample = 0; sample < numSamples; ++sample)
+            energySum += static_cast<float>(0.5f * (std::abs(effectLeft[sample]) + std::abs(effectRight[sample])));
+    }
+
+    /** Replaces the input in left/right with the final output for the chunk.
+        The output mode is resolved once, so each branch is a plain loop. */
+    void mixOutput(const BlockSettings& settings, SampleType* left, SampleType* right, int numSamples) const
+    {
+        const SampleType* effectLeft = effectScratchLeft.data();
+        const SampleType* effectRight = effectScratchRight.data();
+        const float* dryMix = settings.dryMix;
+        const float* wetMix = settings.wetMix;
+
+        switch (settings.outputMode)
+        {
+            case OutputMode::Wipe:
+                for (int sample = 0; sample < numSamples; ++sample)
+                {
+                    left[sample] = wetMix[sample] * effectLeft[sample];
+                    right[sample] = wetMix[sample] * effectRight[sample];
+                }
+                break;
+            case OutputMode::BypassTrails:
+                if (settings.trailsKeepDry)
+                {
+                    for (int sample = 0; sample < numSamples; ++sample)
+                    {
+                        left[sample] = left[sample] + wetMix[sample] * effectLeft[sample];
+                        right[sample] = right[sample] + wetMix[sample] * effectRight[sample];
+                    }
+                }
+                else
+                {
+                    for (int sample = 0; sample < numSamples; ++sample)
+                    {
+                        left[sample] = 0.0f + wetMix[sample] * effectLeft[sample];
+                        right[sample] = 0.0f + wetMix[sample] * effectRight[sample];
+                    }
+                }
+                break;
+            case OutputMode::BypassDry:
+                break;
+            case OutputMode::Normal:
+                for (int sample = 0; sample < numSamples; ++sample)
+                {
+                    left[sample] = dryMix[sample] * left[sample] + wetMix[sample] * effectLeft[sample];
+                    right[sample] = dryMix[sample] * right[sample] + wetMix[sample] * effectRight[sample];
+                }
+                break;
+        }
+    }
+
+    /** The scan offset of the next sample for a tape or manual scan; an
+        auto-scan renders its offsets with renderAutoScanOffsets(). */
+    template <typename Modes>
+    float getNextScanOffset(const Modes& modes)
+    {
+        if (modes.tape)
             return getTapeOffset();
 
-        if (scanMode == ScanMode::Manual || autoScanRateHz <= 0.0f)
-            return manualScan;
+        return manualScan;
+    }
 
-        const int samplesPerCycle = juce::jmax(1, static_cast<int>(sampleRate / autoScanRateHz));
+    bool isAutoScanning() const { return scanMode == ScanMode::Auto && autoScanRateHz > 0.0f; }
+
+    /** Writes auto-scan offsets for up to maxSamples samples and returns how
+        many were written: the rest of the current cycle at most, starting a
+        new cycle towards a random target first if the last one is done.  Each
+        cycle runs the band-limited triangle in autoScanShape from zero up to
+        the target and back. */
+    int renderAutoScanOffsets(float* offsets, int maxSamples)
+    {
+        const int samplesPerCycle = getAutoScanSamplesPerCycle();
         if (autoScanSamplesRemaining <= 0 || samplesPerCycle != autoScanSamplesTotal)
         {
             autoScanSamplesTotal = samplesPerCycle;
@@ -522,12 +1248,43 @@ private:
             autoScanTarget = random.nextFloat01() * manualScan;
         }
 
-        const float phase = 1.0f - (static_cast<float>(autoScanSamplesRemaining)
-                                    / static_cast<float>(autoScanSamplesTotal));
-        const float triangle = (phase <= 0.5f) ? (phase * 2.0f) : (2.0f - phase * 2.0f);
-        autoScanOffset = triangle * autoScanTarget;
-        --autoScanSamplesRemaining;
-        return juce::jlimit(0.0f, 1.0f, autoScanOffset);
+        const int count = juce::jmin(maxSamples, autoScanSamplesRemaining);
+        autoScanShape.render(offsets, autoScanSamplesTotal - autoScanSamplesRemaining,
+                             1.0 / static_cast<double>(autoScanSamplesTotal), count);
+        for (int i = 0; i < count; ++i)
+            offsets[i] = juce::jlimit(0.0f, 1.0f, offsets[i] * autoScanTarget);
+
+        autoScanOffset = offsets[count - 1];
+        autoScanSamplesRemaining -= count;
+        return count;
+    }
+
+    /** True when the next sample's scan offset will draw from the random
+        generator (a new auto-scan cycle, a tape jump or a new tape hold). */
+    template <typename Modes>
+    bool scanDrawsRandomOnNextSample(const Modes& modes) const
+    {
+        if (latchEnabled)
+            return false;
+
+        if (modes.tape)
+        {
+            if (sizeSecondsCurrent <= 0.0f)
+                return false;
+            if (tapeSlewSamplesRemaining > 0)
+                return tapeSlewSamplesRemaining == 1;
+            return tapeHoldSamplesRemaining <= 0;
+        }
+
+        if (!isAutoScanning())
+            return false;
+
+        return autoScanSamplesRemaining <= 0 || getAutoScanSamplesPerCycle() != autoScanSamplesTotal;
+    }
+
+    int getAutoScanSamplesPerCycle() const
+    {
+        return juce::jmax(1, static_cast<int>(sampleRate / autoScanRateHz));
     }
 
     void updateRandomSeedIfNeeded()
@@ -535,24 +1292,28 @@ private:
         if (!requestReseed)
             return;
 
-        uint32_t combinedSeed = 0x6d2b79f5u;
-        combinedSeed ^= userSeed + 0x9e3779b9u + (combinedSeed << 6) + (combinedSeed >> 2);
+        uint32_t combinedSeed = RandomGenerator::combineSeed(0x6d2b79f5u, userSeed);
 
         if (transportSample >= 0)
         {
             const uint32_t low = static_cast<uint32_t>(transportSample & 0xffffffff);
             const uint32_t high = static_cast<uint32_t>((transportSample >> 32) & 0xffffffff);
-            combinedSeed ^= low + 0x9e3779b9u + (combinedSeed << 6) + (combinedSeed >> 2);
-            combinedSeed ^= high + 0x9e3779b9u + (combinedSeed << 6) + (combinedSeed >> 2);
+            combinedSeed = RandomGenerator::combineSeed(combinedSeed, low);
+            combinedSeed = RandomGenerator::combineSeed(combinedSeed, high);
         }
 
+        // The modifier banks draw from streams of their own, so block and
+        // per-sample processing consume the same values
         random.setSeed(combinedSeed);
+        modifierBankA.setSeed(RandomGenerator::combineSeed(combinedSeed, 1u));
+        modifierBankB.setSeed(RandomGenerator::combineSeed(combinedSeed, 2u));
         requestReseed = false;
     }
 
-    int getReadChannel(int outputChannel) const
+    template <typename Modes>
+    static int getReadChannel(const Modes& modes, int outputChannel)
     {
-        switch (stereoMode)
+        switch (modes.stereo)
         {
             case StereoMode::Independent:
                 return outputChannel;
@@ -565,34 +1326,52 @@ private:
         return outputChannel;
     }
 
-    void computeRawEffect(int readChannelLeft, int readChannelRight, float sizeSecondsForRead,
-                          float& rawLeft, float& rawRight) const
+    void computeRawEffect(int readChannelLeft, int readChannelRight, float sizeSecondsForRead, float spreadRatio,
+                          SampleType& rawLeft, SampleType& rawRight) const
     {
-        const float spreadSeconds = spreadNormalized * sizeSecondsForRead;
-        const float primaryLeft = primary.readSample(readChannelLeft, sampleRate, sizeSecondsForRead, 0.0f);
-        const float primaryRight = primary.readSample(readChannelRight, sampleRate, sizeSecondsForRead, 0.0f);
-        const float secondaryLeft = secondary.readSample(readChannelLeft, sampleRate, sizeSecondsForRead, spreadSeconds);
-        const float secondaryRight = secondary.readSample(readChannelRight, sampleRate, sizeSecondsForRead, spreadSeconds);
+        const float spreadSeconds = spreadRatio * sizeSecondsForRead;
+        const StorageType primaryLeft = primary.readSample(readChannelLeft, sampleRate, sizeSecondsForRead, 0.0f);
+        const StorageType primaryRight = primary.readSample(readChannelRight, sampleRate, sizeSecondsForRead, 0.0f);
+        const StorageType secondaryLeft = secondary.readSample(readChannelLeft, sampleRate, sizeSecondsForRead, spreadSeconds);
+        const StorageType secondaryRight = secondary.readSample(readChannelRight, sampleRate, sizeSecondsForRead, spreadSeconds);
         rawLeft = 0.5f * (primaryLeft + secondaryLeft);
         rawRight = 0.5f * (primaryRight + secondaryRight);
     }
 
-    void writeToMemory(float left, float right)
+    template <typename Modes>
+    void writeToMemory(const Modes& modes, SampleType left, SampleType right)
     {
-        switch (stereoMode)
+        if (modes.stereo == StereoMode::Linked)
         {
-            case StereoMode::Independent:
-                buffer.writeSample(left, right);
-                break;
-            case StereoMode::Linked:
-            {
-                const float mono = 0.5f * (left + right);
-                buffer.writeSample(mono, mono);
-                break;
-            }
-            case StereoMode::Cross:
-                buffer.writeSample(left, right);
-                break;
+            const auto mono = static_cast<StorageType>(0.5f * (left + right));
+            buffer.writeSample(mono, mono);
+            return;
+        }
+
+        buffer.writeSample(static_cast<StorageType>(left), static_cast<StorageType>(right));
+    }
+
+    /** Records a block of saturated frames, as writeToMemory() would one at a
+        time.  Linked mode builds the mono frames in place in left. */
+    template <typename Modes>
+    void writeBlockToMemory(const Modes& modes, SampleType* left, SampleType* right, int numSamples)
+    {
+        const bool linked = modes.stereo == StereoMode::Linked;
+        if (linked)
+        {
+            for (int i = 0; i < numSamples; ++i)
+                left[i] = 0.5f * (left[i] + right[i]);
+        }
+
+        if constexpr (std::is_same_v<SampleType, StorageType>)
+        {
+            buffer.writeBlock(left, linked ? left : right, numSamples);
+        }
+        else
+        {
+            const SampleType* second = linked ? left : right;
+            for (int i = 0; i < numSamples; ++i)
+                buffer.writeSample(static_cast<StorageType>(left[i]), static_cast<StorageType>(second[i]));
         }
     }
 
@@ -603,28 +1382,228 @@ private:
         visualWriteIndex.store(0);
         visualPrimary.store(0.0f);
         visualSecondary.store(0.0f);
+        for (auto& delay : playheadDelays)
+            delay.store(0.0);
+    }
+
+    /** Runs the banks routed to routing over a frame; the Feed routing, inside
+        the feedback loop, and Out with per-sample reads go through here. */
+    template <typename Modes>
+    void applyModifierBanks(const Modes& modes, RoutingMode routing, SampleType& left, SampleType& right)
+    {
+        if (modes.routingA == routing)
+        {
+            left = modifierBankA.processSample(left, 0);
+            right = modifierBankA.processSample(right, 1);
+        }
+        if (modes.routingB == routing)
+        {
+            left = modifierBankB.processSample(left, 0);
+            right = modifierBankB.processSample(right, 1);
+        }
+    }
+
+    /** Runs the banks routed to routing over numSamples frames in place. */
+    template <typename Modes>
+    void applyModifierBanks(const Modes& modes, RoutingMode routing, SampleType* const* channels, int numSamples)
+    {
+        if (modes.routingA == routing)
+            modifierBankA.processBlock(channels, 2, numSamples);
+        if (modes.routingB == routing)
+            modifierBankB.processBlock(channels, 2, numSamples);
+    }
+
+    /** The longest delay a head can read at the current, pending or outgoing
+        size: the scan offset and the spread can each add one size. */
+    float getReachableSeconds() const
+    {
+        const float size = juce::jmax(juce::jmax(sizeSecondsTarget, sizeSecondsCurrent),
+                                      juce::jmax(sizeSecondsPrevious, sizeTransitionTargetSeconds));
+        return 2.0f * size;
+    }
+
+    /** The memory length prepare() sets up for maxBufferSeconds. */
+    float getMemorySeconds(float maxBufferSeconds) const
+    {
+        return juce::jmax(kMemorySeconds, maxBufferSeconds, extendedMemorySeconds);
+    }
+
+    float getMaxSizeSeconds() const
+    {
+        return extendedMemorySeconds > 0.0f ? 0.5f * bufferMaxSeconds : juce::jmin(kMaxSizeSeconds, bufferMaxSeconds);
     }
 
-    void applyModifierBanks(RoutingMode routing, float& left, float& right)
+    /** Sets a prefetch window per head over the frames it can read in the
+        next kPrefetchSeconds.  A head's read position follows the write head
+        less its delay, and the delay moves with the scan: it stays put for a
+        manual or latched scan, runs along the auto-scan triangle towards its
+        target (or, when a cycle ends, up from zero towards the next one) and
+        slews towards the tape jump target, or anywhere a jump can land once a
+        hold is about to end.  Each window is cut to kPrefetchMaxSeconds around
+        where its head reads now. */
+    void updatePrefetchWindows(float offset)
     {
-        if (routingModeA == routing)
+        float lowOffset = offset;
+        float highOffset = offset;
+        const float horizonSamples = kPrefetchSeconds * static_cast<float>(sampleRate);
+        if (latchEnabled)
+        {
+            // A latched head stays where it is
+        }
+        else if (tapeMode)
+        {
+            if (tapeSlewSamplesRemaining > 0 && sizeSecondsCurrent > 0.0f)
+            {
+                const float target = tapeOffsetSecondsTarget / sizeSecondsCurrent;
+                lowOffset = juce::jmin(lowOffset, target);
+                highOffset = juce::jmax(highOffset, target);
+            }
+            else if (static_cast<float>(tapeHoldSamplesRemaining) < horizonSamples)
+            {
+                lowOffset = juce::jmin(lowOffset, kTapeDeepMinRatio);
+                highOffset = juce::jmax(highOffset, kTapeNearMaxRatio);
+            }
+        }
+        else if (isAutoScanning())
         {
-            left = modifierBankA.processSample(left, 0, random);
-            right = modifierBankA.processSample(right, 1, random);
+            const float reach = autoScanShape.getMaxSlope() * autoScanRateHz * kPrefetchSeconds;
+            lowOffset = juce::jmax(0.0f, offset - reach * autoScanTarget);
+            highOffset = juce::jmin(autoScanTarget, offset + reach * autoScanTarget);
+            if (static_cast<float>(autoScanSamplesRemaining) < horizonSamples)
+                highOffset = juce::jmax(highOffset, juce::jmin(manualScan, reach * manualScan));
         }
-        if (routingModeB == routing)
+
+        const double minSize = juce::jmin(sizeSecondsCurrent, sizeSecondsTarget) * sampleRate;
+        const double maxSize = juce::jmax(sizeSecondsCurrent, sizeSecondsTarget) * sampleRate;
+        const double spreadRatio = spread.getCurrentValue();
+        const auto written = static_cast<double>(buffer.getWrittenFrames());
+        const double margin = MemoryBufferTypes::kPageFrames;
+        const double maxFrames = kPrefetchMaxSeconds * sampleRate;
+        for (int head = 0; head < MemoryBufferTypes::kMaxPrefetchWindows; ++head)
         {
-            left = modifierBankB.processSample(left, 0, random);
-            right = modifierBankB.processSample(right, 1, random);
+            const double headSpread = head == 0 ? 0.0 : spreadRatio;
+            const double position = written - (offset + headSpread) * sizeSecondsCurrent * sampleRate;
+            double firstFrame = written - (highOffset + headSpread) * maxSize - margin;
+            double endFrame = written + static_cast<double>(horizonSamples) - (lowOffset + headSpread) * minSize
+                              + margin;
+            firstFrame = juce::jmax(firstFrame, position - 0.5 * maxFrames);
+            endFrame = juce::jmin(endFrame, position + 0.5 * maxFrames);
+            buffer.setPrefetchWindow(head, static_cast<std::int64_t>(std::floor(firstFrame)),
+                                     static_cast<std::int64_t>(std::ceil(endFrame)));
         }
     }
 
     void updateSpreadSeconds()
     {
-        const float spreadSeconds = spreadNormalized * sizeSecondsCurrent;
+        const float spreadSeconds = spread.getCurrentValue() * sizeSecondsCurrent;
         secondary.setSpread(spreadSeconds);
     }
 
+    void setModifierValues(int bank, float mod1, float mod2, float mod3)
+    {
+        auto* values = modifierValues.data() + bank * 3;
+        values[0].setTarget(juce::jlimit(-1.0f, 1.0f, mod1));
+        values[1].setTarget(juce::jlimit(-1.0f, 1.0f, mod2));
+        values[2].setTarget(juce::jlimit(-1.0f, 1.0f, mod3));
+    }
+
+    void prepareSmoothedParameters()
+    {
+        mix.prepare(sampleRate, kGainRampSeconds, SmoothedParameter::Curve::Linear);
+        feedback.prepare(sampleRate, kGainRampSeconds, SmoothedParameter::Curve::Linear);
+        spread.prepare(sampleRate, kSpreadRampSeconds, SmoothedParameter::Curve::Linear);
+        character.prepare(sampleRate, kModifierRampSeconds, SmoothedParameter::Curve::Exponential);
+        for (auto& value : modifierValues)
+            value.prepare(sampleRate, kModifierRampSeconds, SmoothedParameter::Curve::Exponential);
+        snapParametersOnNextBlock = true;
+    }
+
+    /** Picks up the parameter targets for this block.  Straight after prepare()
+        or reset() they are taken as they are; after that each change starts a
+        ramp, and a change to the modifier settings starts control-rate updates. */
+    void beginParameterBlock()
+    {
+        if (snapParametersOnNextBlock)
+        {
+            mix.snapToTarget();
+            feedback.snapToTarget();
+            spread.snapToTarget();
+            character.snapToTarget();
+            for (auto& value : modifierValues)
+                value.snapToTarget();
+
+            snapParametersOnNextBlock = false;
+            modifierSettingsRamping = false;
+            controlSamplesRemaining = 0;
+            updateSpreadSeconds();
+            applyModifierSettings();
+            return;
+        }
+
+        mix.beginBlock();
+        feedback.beginBlock();
+        if (spread.beginBlock())
+            updateSpreadSeconds();
+
+        bool modifiersRamping = character.beginBlock();
+        for (auto& value : modifierValues)
+            modifiersRamping = value.beginBlock() || modifiersRamping;
+
+        modifierSettingsRamping = modifierSettingsRamping || modifiersRamping;
+    }
+
+    /** Once per control period of kControlIntervalSamples, while the character or
+        modifier values ramp, steps their ramps by a period and recomputes the
+        modifier coefficients; the rest of the time the modifiers are untouched. */
+    void updateModifiersAtControlRate()
+    {
+        if (!modifierSettingsRamping || controlSamplesRemaining > 0)
+            return;
+
+        character.skip(kControlIntervalSamples);
+        bool stillRamping = character.isRamping();
+        for (auto& value : modifierValues)
+        {
+            value.skip(kControlIntervalSamples);
+            stillRamping = value.isRamping() || stillRamping;
+        }
+
+        applyModifierSettings();
+        modifierSettingsRamping = stillRamping;
+        controlSamplesRemaining = stillRamping ? kControlIntervalSamples : 0;
+    }
+
+    void applyModifierSettings()
+    {
+        modifierBankA.setCharacter(character.getCurrentValue());
+        modifierBankB.setCharacter(character.getCurrentValue());
+        modifierBankA.setModValues(modifierValues[0].getCurrentValue(), modifierValues[1].getCurrentValue(),
+                                   modifierValues[2].getCurrentValue());
+        modifierBankB.setModValues(modifierValues[3].getCurrentValue(), modifierValues[4].getCurrentValue(),
+                                   modifierValues[5].getCurrentValue());
+        modifierBankA.updateSettings();
+        modifierBankB.updateSettings();
+    }
+
+    /** Renders the chunk's mix and feedback ramps; with dry kill the dry gain
+        stays at zero. */
+    void renderParameterRamps(int numSamples)
+    {
+        float* dryMix = parameterScratch.dryMix.data();
+        float* wetMix = parameterScratch.wetMix.data();
+        mix.fill(wetMix, numSamples);
+        feedback.fill(parameterScratch.feedback.data(), numSamples);
+
+        if (dryKill)
+        {
+            std::fill(dryMix, dryMix + numSamples, 0.0f);
+            return;
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+            dryMix[i] = 1.0f - wetMix[i];
+    }
+
     float getTapeOffset()
     {
         if (sizeSecondsCurrent <= 0.0f)
@@ -702,8 +1681,22 @@ private:
     static constexpr float kMinSizeSeconds = 0.05f;
     static constexpr float kMaxSizeSeconds = 60.0f;
     static constexpr float kMemorySeconds = 180.0f;
+    // RAM an extended memory keeps behind the write head; reads within a tape
+    // window never go to the scratch file
+    static constexpr float kExtendedResidentSeconds = 60.0f;
+    static constexpr float kPrefetchSeconds = 2.0f;
+    static constexpr float kPrefetchMaxSeconds = 20.0f;
     static constexpr float kSizeCrossfadeSeconds = 0.05f;
+    // Fastest a glide may move the read delay, in seconds per second: the
+    // playback speed stays within 4%, about two thirds of a semitone
+    static constexpr float kSizeGlideMaxSlope = 0.04f;
+    static constexpr float kSizeGlideMinSeconds = 0.01f;
+    static constexpr float kSizeGlideMaxSeconds = 0.25f;
     static constexpr float kSizeEpsilon = 1.0e-4f;
+    static constexpr float kGainRampSeconds = 0.02f;
+    static constexpr float kSpreadRampSeconds = 0.05f;
+    static constexpr float kModifierRampSeconds = 0.05f;
+    static constexpr int kControlIntervalSamples = 32;
     static constexpr float kTapeFeedback = 0.65f;
     static constexpr float kTapeMaxWindowSeconds = 30.0f;
     static constexpr float kTapeDefaultWindowSeconds = 3.0f;
@@ -715,33 +1708,54 @@ private:
     static constexpr float kTapeHoldMinSeconds = 2.0f;
     static constexpr float kTapeHoldMaxSeconds = 6.0f;
     static constexpr float kTapeSlewSeconds = 0.25f;
+    static constexpr int kAutoScanHarmonics = 8;
 
     double sampleRate { 44100.0 };
     int maxBlock { 512 };
     float bufferMaxSeconds { kMemorySeconds };
+    bool lazyAllocation { false };
+    float extendedMemorySeconds { 0.0f };
     float sizeSecondsTarget { 1.0f };
     float sizeSecondsCurrent { 1.0f };
     float sizeSecondsPrevious { 1.0f };
     int sizeCrossfadeSamplesRemaining { 0 };
     int sizeCrossfadeSamplesTotal { 0 };
-
-    MemoryBuffer buffer;
-    Playhead primary;
-    Playhead secondary;
-    ModifierChain modifierBankA;
-    ModifierChain modifierBankB;
+    float sizeTransitionTargetSeconds { 1.0f };
+    float sizeGlideIncrement { 0.0f };
+    int sizeGlideSamplesRemaining { 0 };
+
+    MemoryBuffer<StorageType> buffer;
+    // Saves and restores the memory with the plug-in state
+    MemorySnapshotter<StorageType> snapshotter;
+    Playhead<StorageType> primary;
+    Playhead<StorageType> secondary;
+    ModifierChain<SampleType> modifierBankA;
+    ModifierChain<SampleType> modifierBankB;
     RandomGenerator random;
+    std::vector<SampleType> effectScratchLeft;
+    std::vector<SampleType> effectScratchRight;
+    // The chunk's input after the In modifiers
+    std::vector<SampleType> inputScratchLeft;
+    std::vector<SampleType> inputScratchRight;
+    ReadScratch readScratch;
+    ParameterScratch parameterScratch;
+
+    SmoothedParameter mix { 0.5f };
+    SmoothedParameter feedback { 0.0f };
+    SmoothedParameter spread { 0.0f };
+    SmoothedParameter character { 0.0f };
+    std::array<SmoothedParameter, 6> modifierValues;
+    bool snapParametersOnNextBlock { true };
+    bool modifierSettingsRamping { false };
+    int controlSamplesRemaining { 0 };
 
-    float mix { 0.5f };
     float manualScan { 0.0f };
     float autoScanRateHz { 0.0f };
     float autoScanOffset { 0.0f };
     float autoScanTarget { 0.0f };
     int autoScanSamplesTotal { 0 };
     int autoScanSamplesRemaining { 0 };
-    float spreadNormalized { 0.0f };
-    float feedback { 0.0f };
-    float character { 0.0f };
+    LfoWavetable autoScanShape { LfoWavetable::makeTriangle(kAutoScanHarmonics) };
 
     StereoMode stereoMode { StereoMode::Independent };
     FeedbackMode mode { FeedbackMode::Feed };
@@ -759,6 +1773,8 @@ private:
     float latchedOffset { 0.0f };
     bool lastLatchEnabled { false };
     bool tapeMode { false };
+    bool specializedKernelsEnabled { true };
+    Saturator::Mode saturatorMode { Saturator::Mode::Exact };
     float tapeWindowSeconds { kTapeDefaultWindowSeconds };
     float tapeOffsetSecondsCurrent { 0.0f };
     float tapeOffsetSecondsStart { 0.0f };
@@ -777,4 +1793,6 @@ private:
     std::atomic<int> visualWriteIndex { 0 };
     std::atomic<float> visualPrimary { 0.0f };
     std::atomic<float> visualSecondary { 0.0f };
+    std::array<std::atomic<double>, 2> playheadDelays {};
+    std::atomic<bool> clearRequested { false };
 };
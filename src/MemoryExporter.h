@@ -0,0 +1,219 @@
+// MemoryExporter.h
+//
+// Bounces the memory to a WAV or FLAC file.  An export starts from a
+// MemorySnapshot rather than from the live buffer, so the audio thread does
+// nothing for it: the memory thread already keeps the completed pages
+// encoded, and the capture only adds the newest few (see MemorySnapshotter).
+// The exporter's own thread then decodes the snapshot a few blocks per time
+// slice into a juce::AudioFormatWriter::ThreadedWriter, whose FIFO the same
+// thread drains into the file.  Audio goes to a temporary file that replaces
+// the target once it is complete, so a cancelled or failed export leaves an
+// existing file as it was.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MemoryCodec.h"
+#include "MemorySnapshot.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class MemoryExporter : private juce::TimeSliceClient
+{
+public:
+    static constexpr int kBitsPerSample = 24;
+    // Blocks decoded per time slice at most, about a second at 48 kHz
+    static constexpr int kBlocksPerSlice = 12;
+    // Frames the ThreadedWriter queues before write() refuses more
+    static constexpr int kWriterBufferFrames = 1 << 16;
+
+    enum class State
+    {
+        Idle,
+        Exporting,
+        Finished,
+        Failed
+    };
+
+    /** A cue point in a WAV file, frame frames from its start. */
+    struct Marker
+    {
+        juce::String label;
+        std::int64_t frame { 0 };
+    };
+
+    MemoryExporter() = default;
+    ~MemoryExporter() override { cancel(); }
+
+    /** Starts writing snapshot to file in the background, as FLAC if the
+        file's extension is .flac and as WAV otherwise, 24 bits at the
+        snapshot's sample rate.  Markers become WAV cue points; the FLAC
+        writer has no metadata for them.  Cancels any export still running.
+        Returns false if the snapshot is empty or the file cannot be written.
+        Call from the message thread. */
+    bool start(std::shared_ptr<const MemorySnapshot> snapshotToWrite, const juce::File& file,
+               const std::vector<Marker>& markers = {})
+    {
+        cancel();
+        if (snapshotToWrite == nullptr || snapshotToWrite->numFrames == 0)
+            return false;
+
+        const bool flac = file.hasFileExtension("flac");
+        std::unique_ptr<juce::AudioFormat> format;
+        if (flac)
+            format = std::make_unique<juce::FlacAudioFormat>();
+        else
+            format = std::make_unique<juce::WavAudioFormat>();
+
+        temporary = std::make_unique<juce::TemporaryFile>(file);
+        auto stream = std::make_unique<juce::FileOutputStream>(temporary->getFile());
+        if (!stream->openedOk())
+            return fail();
+
+        const auto metadata = flac ? juce::StringPairArray() : createCueMetadata(markers, snapshotToWrite->numFrames);
+        std::unique_ptr<juce::AudioFormatWriter> fileWriter(format->createWriterFor(
+            stream.get(), snapshotToWrite->sampleRate, 2, kBitsPerSample, metadata, 0));
+        if (fileWriter == nullptr)
+            return fail();
+
+        // The file writer owns the stream from here on
+        stream.release();
+        writer = std::make_unique<juce::AudioFormatWriter::ThreadedWriter>(fileWriter.release(), thread,
+                                                                            kWriterBufferFrames);
+        snapshot = std::move(snapshotToWrite);
+        left.assign(static_cast<size_t>(MemoryCodec::kMaxBlockFrames), 0.0f);
+        right.assign(static_cast<size_t>(MemoryCodec::kMaxBlockFrames), 0.0f);
+        offset = 0;
+        pendingFrames = 0;
+        decodedFrames = 0;
+        progress.store(0.0f);
+        state.store(State::Exporting);
+
+        thread.addTimeSliceClient(this);
+        if (!thread.isThreadRunning())
+            thread.startThread();
+        return true;
+    }
+
+    /** Stops a running export and deletes what it wrote.  Call from the
+        message thread. */
+    void cancel()
+    {
+        thread.removeTimeSliceClient(this);
+        writer.reset();
+        temporary.reset();
+        snapshot.reset();
+        if (state.load() == State::Exporting)
+            state.store(State::Idle);
+    }
+
+    State getState() const { return state.load(); }
+    bool isExporting() const { return state.load() == State::Exporting; }
+
+    /** Share of the snapshot handed to the writer, 0 to 1. */
+    float getProgress() const { return progress.load(); }
+
+    /** WAV metadata with a cue point and a label for each marker that lies
+        within a file of numFrames frames. */
+    static juce::StringPairArray createCueMetadata(const std::vector<Marker>& markers, std::uint64_t numFrames)
+    {
+        juce::StringPairArray metadata;
+        int numCues = 0;
+        for (const auto& marker : markers)
+        {
+            if (marker.frame < 0 || static_cast<std::uint64_t>(marker.frame) > numFrames)
+                continue;
+
+            const juce::String cue = "Cue" + juce::String(numCues);
+            const juce::String label = "CueLabel" + juce::String(numCues);
+            const juce::String identifier(numCues + 1);
+            metadata.set(cue + "Identifier", identifier);
+            metadata.set(cue + "Offset", juce::String(marker.frame));
+            metadata.set(label + "Identifier", identifier);
+            metadata.set(label + "Text", marker.label);
+            ++numCues;
+        }
+
+        if (numCues > 0)
+        {
+            metadata.set("NumCuePoints", juce::String(numCues));
+            metadata.set("NumCueLabels", juce::String(numCues));
+        }
+        return metadata;
+    }
+
+private:
+    static constexpr int kIdleIntervalMs = 250;
+    static constexpr int kFullIntervalMs = 5;
+
+    int useTimeSlice() override
+    {
+        if (state.load() != State::Exporting)
+            return kIdleIntervalMs;
+
+        for (int block = 0; block < kBlocksPerSlice; ++block)
+        {
+            if (pendingFrames == 0)
+            {
+                if (decodedFrames == snapshot->numFrames)
+                    return finish();
+
+                pendingFrames = snapshot->decodeBlock(offset, left.data(), right.data());
+                if (pendingFrames == 0)
+                {
+                    fail();
+                    return kIdleIntervalMs;
+                }
+                decodedFrames += static_cast<std::uint64_t>(pendingFrames);
+            }
+
+            // A full FIFO keeps the block for the next slice, once the
+            // writer has drained some of it
+            const float* const channels[] = { left.data(), right.data() };
+            if (!writer->write(channels, pendingFrames))
+                return kFullIntervalMs;
+
+            pendingFrames = 0;
+            progress.store(static_cast<float>(static_cast<double>(decodedFrames)
+                                              / static_cast<double>(snapshot->numFrames)));
+        }
+        return 0;
+    }
+
+    int finish()
+    {
+        // Destroying the writer flushes its FIFO and closes the file
+        writer.reset();
+        const bool moved = temporary->overwriteTargetFileWithTemporary();
+        temporary.reset();
+        snapshot.reset();
+        state.store(moved ? State::Finished : State::Failed);
+        return kIdleIntervalMs;
+    }
+
+    bool fail()
+    {
+        writer.reset();
+        temporary.reset();
+        snapshot.reset();
+        state.store(State::Failed);
+        return false;
+    }
+
+    // Declared first so it outlives the writer, which is one of its clients
+    juce::TimeSliceThread thread { "Echoform export" };
+    std::unique_ptr<juce::TemporaryFile> temporary;
+    std::unique_ptr<juce::AudioFormatWriter::ThreadedWriter> writer;
+    std::shared_ptr<const MemorySnapshot> snapshot;
+    std::vector<float> left;
+    std::vector<float> right;
+    size_t offset { 0 };
+    int pendingFrames { 0 };  // decoded but not yet taken by the writer
+    std::uint64_t decodedFrames { 0 };
+    std::atomic<float> progress { 0.0f };
+    std::atomic<State> state { State::Idle };
+
+    JUCE_DECLARE_NON_COPYABLE(MemoryExporter)
+};
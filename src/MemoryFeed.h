@@ -0,0 +1,122 @@
+// MemoryFeed.h
+//
+// Carries audio produced on one thread into the memory from another: an
+// import converts a file on its own thread and writes the frames here, and
+// the memory thread reads them and records them behind the write head (see
+// MemorySnapshotter::beginFeed()).  A single-producer, single-consumer ring
+// of stereo frames at the memory's sample rate; after construction neither
+// side allocates or waits for the other.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class MemoryFeed
+{
+public:
+    static constexpr int kDefaultCapacityFrames = 1 << 17;
+
+    /** A feed of numFrames frames in all at sampleRate, the rate of the
+        memory it goes into. */
+    MemoryFeed(std::uint64_t numFrames, double sampleRate, int capacityFrames = kDefaultCapacityFrames)
+        : totalFrames(numFrames),
+          rate(sampleRate),
+          capacity(capacityFrames),
+          left(static_cast<size_t>(capacityFrames)),
+          right(static_cast<size_t>(capacityFrames))
+    {
+        jassert(capacityFrames > 0);
+    }
+
+    std::uint64_t getNumFrames() const { return totalFrames; }
+    double getSampleRate() const { return rate; }
+
+    /** Frames write() would take now.  Producer only. */
+    int getFreeFrames() const
+    {
+        return capacity - static_cast<int>(written.load(std::memory_order_relaxed)
+                                           - consumed.load(std::memory_order_acquire));
+    }
+
+    /** Appends up to numFrames frames and returns how many fit.  Producer
+        only. */
+    int write(const float* sourceLeft, const float* sourceRight, int numFrames)
+    {
+        const auto end = written.load(std::memory_order_relaxed);
+        const int count = std::min(numFrames, getFreeFrames());
+        for (int i = 0; i < count; ++i)
+        {
+            const auto slot = static_cast<size_t>((end + static_cast<std::uint64_t>(i)) % capacity);
+            left[slot] = sourceLeft[i];
+            right[slot] = sourceRight[i];
+        }
+        written.store(end + static_cast<std::uint64_t>(count), std::memory_order_release);
+        return count;
+    }
+
+    /** Marks the end of the feed; the consumer finishes once it has read
+        what was written.  Producer only. */
+    void finish() { finished.store(true, std::memory_order_release); }
+
+    /** Stops the feed from either side: the producer gives up, or the
+        consumer cannot take the frames any more. */
+    void cancel() { cancelled.store(true, std::memory_order_release); }
+    bool isCancelled() const { return cancelled.load(std::memory_order_acquire); }
+
+    /** Moves up to maxFrames frames into destLeft and destRight and returns
+        how many.  Consumer only. */
+    template <typename Sample>
+    int read(Sample* destLeft, Sample* destRight, int maxFrames)
+    {
+        const auto start = consumed.load(std::memory_order_relaxed);
+        const int count = std::min(maxFrames, static_cast<int>(written.load(std::memory_order_acquire) - start));
+        for (int i = 0; i < count; ++i)
+        {
+            const auto slot = static_cast<size_t>((start + static_cast<std::uint64_t>(i)) % capacity);
+            destLeft[i] = static_cast<Sample>(left[slot]);
+            destRight[i] = static_cast<Sample>(right[slot]);
+        }
+        consumed.store(start + static_cast<std::uint64_t>(count), std::memory_order_release);
+        return count;
+    }
+
+    /** True once the producer has finished or either side cancelled, and
+        everything written has been read.  Consumer only. */
+    bool isDrained() const
+    {
+        if (isCancelled())
+            return true;
+        // Checked before the counts, so frames written just before finish() are seen
+        const bool done = finished.load(std::memory_order_acquire);
+        return done && consumed.load(std::memory_order_relaxed) == written.load(std::memory_order_acquire);
+    }
+
+    /** True once the consumer has read every frame of the feed.  Safe from
+        any thread. */
+    bool isComplete() const { return consumed.load(std::memory_order_acquire) == totalFrames; }
+
+    /** Share of the feed the consumer has read, 0 to 1.  Safe from any thread. */
+    float getProgress() const
+    {
+        return totalFrames == 0 ? 1.0f
+                                : static_cast<float>(static_cast<double>(consumed.load(std::memory_order_relaxed))
+                                                     / static_cast<double>(totalFrames));
+    }
+
+private:
+    const std::uint64_t totalFrames;
+    const double rate;
+    const int capacity;
+    std::vector<float> left;
+    std::vector<float> right;
+    std::atomic<std::uint64_t> written { 0 };
+    std::atomic<std::uint64_t> consumed { 0 };
+    std::atomic<bool> finished { false };
+    std::atomic<bool> cancelled { false };
+
+    JUCE_DECLARE_NON_COPYABLE(MemoryFeed)
+};
@@ -0,0 +1,213 @@
+// MemoryImporter.h
+//
+// Preloads the memory from an audio file, such as a field recording for the
+// playheads to wander through.  WAV and AIFF files are read through a
+// juce::MemoryMappedAudioFormatReader that maps a window of the file at a
+// time, and other formats stream from disk, so even a file of gigabytes is
+// never held in memory: only as much of its start as the memory can hold is
+// read, a block per time slice on the importer's own thread.  Each block is
+// converted to the memory's sample rate (MemoryResampler's streaming mode)
+// and handed to the memory thread through a MemoryFeed, which records it
+// behind the write head as it arrives, so playback carries on throughout and
+// the first pages are audible long before the file is done.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MemoryFeed.h"
+#include "MemoryResampler.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class MemoryImporter : private juce::TimeSliceClient
+{
+public:
+    // Frames read and converted per time slice
+    static constexpr int kReadFrames = 1 << 14;
+    // Frames of the file mapped at once, about 20 s at 48 kHz
+    static constexpr juce::int64 kMapFrames = juce::int64 { 1 } << 20;
+
+    enum class State
+    {
+        Idle,
+        Importing,
+        Finished,
+        // The file could not be read, or the memory stopped taking the feed
+        // before all of it was recorded: the engine was replaced (a new
+        // sample rate) or a later restore or import took over.
+        Failed
+    };
+
+    MemoryImporter() { formats.registerBasicFormats(); }
+    ~MemoryImporter() override { cancel(); }
+
+    /** Opens file and starts converting as much of it, from its start, as
+        fits in maxFrames frames at sampleRate.  Returns the feed to record it
+        from (see MemoryDelayEngine::feedMemory()), or nullptr if the file
+        cannot be read.  Cancels any import still running.  Call from the
+        message thread. */
+    std::shared_ptr<MemoryFeed> start(const juce::File& file, double sampleRate, int maxFrames)
+    {
+        cancel();
+        if (!openReader(file) || reader->sampleRate <= 0.0 || reader->lengthInSamples <= 0 || maxFrames <= 0)
+        {
+            closeReader();
+            state.store(State::Failed);
+            return nullptr;
+        }
+
+        // Enough of the file for maxFrames frames once converted, and no more
+        const auto wantedFrames = static_cast<juce::int64>(std::ceil(maxFrames * reader->sampleRate / sampleRate));
+        inputFrames = juce::jmin(reader->lengthInSamples, wantedFrames);
+        readFrames = 0;
+        resampler.prepare(reader->sampleRate, sampleRate);
+        const auto numFrames = resampler.beginStream(static_cast<std::uint64_t>(inputFrames));
+
+        block.setSize(2, kReadFrames);
+        pendingLeft.clear();
+        pendingRight.clear();
+        pendingOffset = 0;
+        feed = std::make_shared<MemoryFeed>(numFrames, sampleRate);
+        progress.store(0.0f);
+        state.store(State::Importing);
+
+        thread.addTimeSliceClient(this);
+        if (!thread.isThreadRunning())
+            thread.startThread();
+        return feed;
+    }
+
+    /** Stops a running import; what was recorded so far stays in the
+        memory.  Call from the message thread. */
+    void cancel()
+    {
+        thread.removeTimeSliceClient(this);
+        if (feed != nullptr)
+            feed->cancel();
+        feed.reset();
+        closeReader();
+        if (state.load() == State::Importing)
+            state.store(State::Idle);
+    }
+
+    State getState() const { return state.load(); }
+
+    /** True until the whole import is recorded in the memory, or it fails or
+        is cancelled. */
+    bool isImporting() const { return state.load() == State::Importing; }
+
+    /** Share of the file's frames read and converted, 0 to 1. */
+    float getProgress() const { return progress.load(); }
+
+private:
+    static constexpr int kIdleIntervalMs = 250;
+    static constexpr int kFullIntervalMs = 5;
+
+    bool openReader(const juce::File& file)
+    {
+        if (auto* format = formats.findFormatForFileExtension(file.getFileExtension()))
+        {
+            mappedReader = format->createMemoryMappedReader(file);
+            if (mappedReader != nullptr)
+            {
+                reader.reset(mappedReader);
+                return true;
+            }
+        }
+
+        reader.reset(formats.createReaderFor(file));
+        return reader != nullptr;
+    }
+
+    void closeReader()
+    {
+        mappedReader = nullptr;
+        reader.reset();
+    }
+
+    int useTimeSlice() override
+    {
+        if (state.load() != State::Importing)
+            return kIdleIntervalMs;
+
+        const bool handedOver = handOverPending();
+        if (handedOver && readFrames == inputFrames)
+        {
+            // Done once the memory thread has taken every frame
+            feed->finish();
+            if (feed->isComplete())
+                return stop(State::Finished);
+        }
+
+        // A replaced or cancelled feed is not recorded any more.
+        if (feed->isCancelled())
+            return stop(State::Failed);
+        if (!handedOver || readFrames == inputFrames)
+            return kFullIntervalMs;
+
+        const int count = static_cast<int>(juce::jmin(static_cast<juce::int64>(kReadFrames), inputFrames - readFrames));
+        const juce::Range<juce::int64> section(readFrames, readFrames + count);
+        if (mappedReader != nullptr && !mappedReader->getMappedSection().contains(section))
+        {
+            const juce::Range<juce::int64> window(readFrames, juce::jmin(inputFrames, readFrames + kMapFrames));
+            if (!mappedReader->mapSectionOfFile(window))
+                return stop(State::Failed);
+        }
+
+        // A mono file goes to both channels
+        if (!reader->read(&block, 0, count, readFrames, true, true))
+            return stop(State::Failed);
+        readFrames += count;
+        resampler.processStream(block.getReadPointer(0), block.getReadPointer(1), count, pendingLeft,
+                                pendingRight);
+        handOverPending();
+
+        progress.store(static_cast<float>(static_cast<double>(readFrames) / static_cast<double>(inputFrames)));
+        return 0;
+    }
+
+    /** Writes converted frames into the feed; returns false if some are
+        still waiting for room. */
+    bool handOverPending()
+    {
+        const int numPending = static_cast<int>(pendingLeft.size()) - pendingOffset;
+        pendingOffset += feed->write(pendingLeft.data() + pendingOffset, pendingRight.data() + pendingOffset,
+                                     numPending);
+        if (pendingOffset < static_cast<int>(pendingLeft.size()))
+            return false;
+
+        pendingLeft.clear();
+        pendingRight.clear();
+        pendingOffset = 0;
+        return true;
+    }
+
+    int stop(State finalState)
+    {
+        closeReader();
+        state.store(finalState);
+        return kIdleIntervalMs;
+    }
+
+    juce::TimeSliceThread thread { "Echoform import" };
+    juce::AudioFormatManager formats;
+    std::unique_ptr<juce::AudioFormatReader> reader;
+    // reader, when the format can be memory mapped
+    juce::MemoryMappedAudioFormatReader* mappedReader { nullptr };
+    MemoryResampler<float> resampler;
+    juce::AudioBuffer<float> block;
+    // Converted frames the feed has not taken yet, from pendingOffset on
+    std::vector<float> pendingLeft;
+    std::vector<float> pendingRight;
+    int pendingOffset { 0 };
+    std::shared_ptr<MemoryFeed> feed;
+    juce::int64 inputFrames { 0 };
+    juce::int64 readFrames { 0 };
+    std::atomic<float> progress { 0.0f };
+    std::atomic<State> state { State::Idle };
+
+    JUCE_DECLARE_NON_COPYABLE(MemoryImporter)
+};
@@ -0,0 +1,442 @@
+// MemoryResampler.h
+//
+// Converts a recorded MemoryBuffer to another sample rate, so a sample-rate
+// change keeps the memory instead of wiping it.  The rate ratio is reduced to
+// L/M and the conversion is a polyphase windowed-sinc filter: L phases of a
+// Kaiser-windowed sinc, low-passed just below the lower of the two Nyquist
+// frequencies, and each output frame is the dot product of one phase with the
+// input around it (SSE2, AVX2 or NEON for float memory).  Frames keep their
+// delay in seconds, so every playhead reads the same audio after the change.
+// A full buffer takes a noticeable fraction of a second and the filter
+// allocates, so this runs on the memory thread (see EngineSlot).  The same
+// filter also converts audio that arrives in blocks, such as a file being
+// imported (see beginStream()).
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MemoryBuffer.h"
+#include "SimdConfig.h"
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
+template <typename StorageType = float>
+class MemoryResampler
+{
+public:
+    using Memory = MemoryBuffer<StorageType>;
+
+    // Sinc zero crossings on each side of the centre tap, at the source rate
+    // when upsampling and proportionally more when downsampling.
+    static constexpr int kZeroCrossings = 16;
+    // Rate pairs whose reduced ratio needs more phases use this many and take
+    // the nearest phase to each output's exact position.
+    static constexpr int kMaxPhases = 1024;
+    // Passband edge as a fraction of the lower Nyquist frequency.
+    static constexpr double kCutoff = 0.95;
+    // Kaiser window shape; about 85 dB of stopband rejection.
+    static constexpr double kKaiserBeta = 8.0;
+
+    /** Designs the filter for converting sourceRate to targetRate.  Allocates. */
+    void prepare(double sourceRate, double targetRate)
+    {
+        jassert(sourceRate > 0.0 && targetRate > 0.0);
+        reduceRatio(sourceRate, targetRate);
+
+        if (isIdentity())
+        {
+            numTaps = 0;
+            coefficients.clear();
+            return;
+        }
+
+        const double cutoff = kCutoff * juce::jmin(1.0, upFactor / step);
+        halfTaps = static_cast<int>(std::ceil(kZeroCrossings / cutoff));
+        numTaps = (2 * halfTaps + kTapAlignment - 1) / kTapAlignment * kTapAlignment;
+        coefficients.assign(static_cast<size_t>(upFactor) * static_cast<size_t>(numTaps), StorageType {});
+
+        const double windowNorm = besselI0(kKaiserBeta);
+        std::vector<double> phase(static_cast<size_t>(numTaps));
+        for (int p = 0; p < upFactor; ++p)
+        {
+            // Tap k weighs input frame i - halfTaps + 1 + k for an output at
+            // i + p / L, halfTaps - 1 - k + p / L frames after it.
+            double sum = 0.0;
+            for (int k = 0; k < numTaps; ++k)
+            {
+                const double t = static_cast<double>(k - halfTaps + 1) - static_cast<double>(p) / upFactor;
+                const double u = t / halfTaps;
+                double value = 0.0;
+                if (k < 2 * halfTaps && std::abs(u) <= 1.0)
+                {
+                    const double x = juce::MathConstants<double>::pi * cutoff * t;
+                    const double sinc = (x == 0.0) ? 1.0 : std::sin(x) / x;
+                    value = sinc * besselI0(kKaiserBeta * std::sqrt(1.0 - u * u)) / windowNorm;
+                }
+                phase[static_cast<size_t>(k)] = value;
+                sum += value;
+            }
+
+            // Unity gain at DC for every phase, so a constant stays constant.
+            auto* row = coefficients.data() + static_cast<size_t>(p) * static_cast<size_t>(numTaps);
+            for (int k = 0; k < numTaps; ++k)
+                row[k] = static_cast<StorageType>(phase[static_cast<size_t>(k)] / sum);
+        }
+    }
+
+    bool isIdentity() const { return step == upFactor; }
+    int getNumPhases() const { return upFactor; }
+    int getNumTaps() const { return numTaps; }
+
+    /** Records source's memory into target, converted to target's sample
+        rate.  target must be freshly prepared, with its allocation and retained
+        span set, and not in use on another thread.  Afterwards frame d behind
+        target's write head holds what source held d * sourceRate / targetRate
+        frames behind its own, for as far back as both buffers keep.  Returns
+        the number of frames written. */
+    int process(const Memory& source, Memory& target)
+    {
+        const auto recorded = static_cast<std::int64_t>(juce::jmin(
+            source.getWrittenFrames(), static_cast<std::uint64_t>(source.getRecallableFrames())));
+        if (recorded == 0 || target.getBufferSize() == 0)
+            return 0;
+
+        // Input frame m is recorded - m frames behind source's write head, so
+        // m == recorded is the write head itself.  Output frame j of numOutput
+        // sits numOutput - j frames behind target's, at input position
+        // recorded - (numOutput - j) * M / L, kept in units of 1 / L.  With a
+        // reduced ratio M is an integer and every position is exact.
+        const int numOutput = static_cast<int>(juce::jmin(
+            static_cast<double>(target.getRecallableFrames()), std::floor(recorded * upFactor / step)));
+        const auto positionOf = [&](int frame)
+        {
+            return recorded * upFactor - std::llround(static_cast<double>(numOutput - frame) * step);
+        };
+        const int sourceStart = wrap(source.getWritePosition() - static_cast<int>(recorded), source.getBufferSize());
+        const bool lazy = target.getAllocation() != MemoryBufferTypes::Allocation::Eager;
+        for (auto& channel : output)
+            channel.resize(static_cast<size_t>(kChunkFrames));
+
+        for (int done = 0; done < numOutput;)
+        {
+            const int count = juce::jmin(kChunkFrames, numOutput - done);
+            if (isIdentity())
+            {
+                for (int channel = 0; channel < Memory::kNumChannels; ++channel)
+                    source.readFrames(channel, wrap(sourceStart + static_cast<int>(positionOf(done) / upFactor),
+                                                    source.getBufferSize()),
+                                      output[channel].data(), count);
+            }
+            else
+            {
+                const auto first = positionOf(done) / upFactor - halfTaps + 1;
+                const auto last = positionOf(done + count - 1) / upFactor - halfTaps + numTaps;
+                for (int channel = 0; channel < Memory::kNumChannels; ++channel)
+                    gatherInput(source, channel, sourceStart, recorded, first, static_cast<int>(last - first + 1),
+                                input[channel]);
+
+                // An exact ratio steps by whole frames and phases; otherwise
+                // each position is rounded from the exact one.
+                auto position = positionOf(done);
+                auto offset = static_cast<size_t>(position / upFactor - halfTaps + 1 - first);
+                auto phase = static_cast<int>(position % upFactor);
+                for (int i = 0; i < count; ++i)
+                {
+                    const auto* row = coefficients.data() + static_cast<size_t>(phase) * static_cast<size_t>(numTaps);
+                    convolve(row, input[0].data() + offset, input[1].data() + offset, numTaps,
+                             output[0][static_cast<size_t>(i)], output[1][static_cast<size_t>(i)]);
+
+                    if (exactStep > 0)
+                    {
+                        offset += static_cast<size_t>(exactStep / upFactor);
+                        phase += exactStep % upFactor;
+                        if (phase >= upFactor)
+                        {
+                            phase -= upFactor;
+                            ++offset;
+                        }
+                    }
+                    else
+                    {
+                        position = positionOf(done + i + 1);
+                        offset = static_cast<size_t>(position / upFactor - halfTaps + 1 - first);
+                        phase = static_cast<int>(position % upFactor);
+                    }
+                }
+            }
+
+            target.writeBlock(output[0].data(), output[1].data(), count);
+            if (lazy)
+                target.servicePages();
+            done += count;
+        }
+
+        return numOutput;
+    }
+
+    /** Starts converting a stream of numInputFrames frames that arrives in
+        blocks through processStream().  Output frame j is input position
+        j * sourceRate / targetRate, so the stream keeps its timing; returns
+        how many output frames the whole stream gives.  Allocates. */
+    std::uint64_t beginStream(std::uint64_t numInputFrames)
+    {
+        streamInputFrames = numInputFrames;
+        streamReceivedFrames = 0;
+        streamOutputFrame = 0;
+        streamOutputFrames = isIdentity() ? numInputFrames
+                                          : static_cast<std::uint64_t>(std::floor(
+                                                static_cast<double>(numInputFrames) * upFactor / step));
+
+        // Silence before the first frame, for the taps that reach back past it
+        streamBase = isIdentity() ? 0 : -static_cast<std::int64_t>(numTaps);
+        for (auto& channel : history)
+            channel.assign(static_cast<size_t>(streamBase < 0 ? -streamBase : 0), StorageType {});
+        return streamOutputFrames;
+    }
+
+    /** Takes the next numFrames frames of the stream and appends every output
+        frame they complete to outLeft and outRight, returning how many.  Output
+        does not depend on how the input is split into blocks.  Once the last
+        frame is in, the rest of the output follows, with the frames past the
+        end extrapolated as process() does at the write head. */
+    int processStream(const StorageType* left, const StorageType* right, int numFrames,
+                      std::vector<StorageType>& outLeft, std::vector<StorageType>& outRight)
+    {
+        jassert(streamReceivedFrames + static_cast<std::uint64_t>(numFrames) <= streamInputFrames);
+        history[0].insert(history[0].end(), left, left + numFrames);
+        history[1].insert(history[1].end(), right, right + numFrames);
+        streamReceivedFrames += static_cast<std::uint64_t>(numFrames);
+        if (streamReceivedFrames == streamInputFrames && !isIdentity())
+        {
+            for (auto& channel : history)
+            {
+                const size_t newestIndex = channel.size() - 1;
+                const StorageType newest = channel[newestIndex];
+                for (size_t k = 1; k <= static_cast<size_t>(numTaps); ++k)
+                    channel.push_back(newest + (newest - channel[newestIndex - k]));
+            }
+        }
+
+        const auto available = streamBase + static_cast<std::int64_t>(history[0].size());
+        int produced = 0;
+        for (; streamOutputFrame < streamOutputFrames; ++streamOutputFrame, ++produced)
+        {
+            StorageType outputLeft {};
+            StorageType outputRight {};
+            if (isIdentity())
+            {
+                const auto frame = static_cast<std::int64_t>(streamOutputFrame);
+                if (frame >= available)
+                    break;
+                outputLeft = history[0][static_cast<size_t>(frame - streamBase)];
+                outputRight = history[1][static_cast<size_t>(frame - streamBase)];
+            }
+            else
+            {
+                const auto position = getStreamPosition(streamOutputFrame);
+                const auto first = position / upFactor - halfTaps + 1;
+                if (first + numTaps > available)
+                    break;
+
+                const auto* row = coefficients.data()
+                                + static_cast<size_t>(position % upFactor) * static_cast<size_t>(numTaps);
+                const auto offset = static_cast<size_t>(first - streamBase);
+                convolve(row, history[0].data() + offset, history[1].data() + offset, numTaps, outputLeft,
+                         outputRight);
+            }
+            outLeft.push_back(outputLeft);
+            outRight.push_back(outputRight);
+        }
+
+        // Drop the frames no later output reaches back to, keeping a filter's
+        // length more for extrapolating past the end
+        auto needed = static_cast<std::int64_t>(streamOutputFrame);
+        if (!isIdentity())
+            needed = getStreamPosition(streamOutputFrame) / upFactor - halfTaps + 1 - numTaps;
+        const auto drop = static_cast<size_t>(juce::jlimit(std::int64_t { 0 },
+                                                           static_cast<std::int64_t>(history[0].size()),
+                                                           needed - streamBase));
+        for (auto& channel : history)
+            channel.erase(channel.begin(), channel.begin() + static_cast<std::ptrdiff_t>(drop));
+        streamBase += static_cast<std::int64_t>(drop);
+        return produced;
+    }
+
+private:
+    // One page of output per step keeps a lazy target's lookahead ahead of it.
+    static constexpr int kChunkFrames = Memory::kPageFrames;
+    static constexpr int kTapAlignment = 8;
+
+    void reduceRatio(double sourceRate, double targetRate)
+    {
+        const auto source = static_cast<std::int64_t>(sourceRate);
+        const auto target = static_cast<std::int64_t>(targetRate);
+        if (static_cast<double>(source) == sourceRate && static_cast<double>(target) == targetRate)
+        {
+            const auto divisor = std::gcd(source, target);
+            if (target / divisor <= kMaxPhases)
+            {
+                upFactor = static_cast<int>(target / divisor);
+                exactStep = static_cast<int>(source / divisor);
+                step = exactStep;
+                return;
+            }
+        }
+
+        upFactor = kMaxPhases;
+        exactStep = 0;
+        step = sourceRate / targetRate * kMaxPhases;
+    }
+
+    /** Fills dest with input frames [first, first + numFrames).  Frames before
+        the recording are silent; frames past the write head are extrapolated by
+        odd reflection about the newest frame, so the most recent audio is not
+        pulled towards silence. */
+    static void gatherInput(const Memory& source, int channel, int sourceStart, std::int64_t recorded,
+                            std::int64_t first, int numFrames, std::vector<StorageType>& dest)
+    {
+        dest.resize(static_cast<size_t>(numFrames));
+        const auto end = first + numFrames;
+        const auto readStart = juce::jmax(first, std::int64_t { 0 });
+        const auto readEnd = juce::jmin(end, recorded);
+
+        for (auto m = first; m < juce::jmin(readStart, end); ++m)
+            dest[static_cast<size_t>(m - first)] = StorageType {};
+
+        if (readEnd > readStart)
+            source.readFrames(channel, wrap(sourceStart + static_cast<int>(readStart), source.getBufferSize()),
+                              dest.data() + (readStart - first), static_cast<int>(readEnd - readStart));
+
+        if (end <= recorded)
+            return;
+
+        const auto frameAt = [&](std::int64_t m)
+        {
+            if (m < 0)
+                return StorageType {};
+            return source.getSample(channel, wrap(sourceStart + static_cast<int>(m), source.getBufferSize()));
+        };
+
+        const StorageType newest = frameAt(recorded - 1);
+        for (auto m = juce::jmax(first, recorded); m < end; ++m)
+            dest[static_cast<size_t>(m - first)] = newest + (newest - frameAt(2 * (recorded - 1) - m));
+    }
+
+    /** Dot products of one filter phase with both channels' input.  numTaps is
+        a multiple of kTapAlignment. */
+    static void convolve(const StorageType* row, const StorageType* left, const StorageType* right, int numTaps,
+                         StorageType& outLeft, StorageType& outRight)
+    {
+        if constexpr (std::is_same_v<StorageType, float>)
+        {
+#if ECHOFORM_SIMD_AVX
+            __m256 sumLeft = _mm256_setzero_ps();
+            __m256 sumRight = _mm256_setzero_ps();
+            for (int k = 0; k < numTaps; k += 8)
+            {
+                const __m256 taps = _mm256_loadu_ps(row + k);
+                sumLeft = _mm256_add_ps(sumLeft, _mm256_mul_ps(taps, _mm256_loadu_ps(left + k)));
+                sumRight = _mm256_add_ps(sumRight, _mm256_mul_ps(taps, _mm256_loadu_ps(right + k)));
+            }
+            outLeft = horizontalSum(_mm_add_ps(_mm256_castps256_ps128(sumLeft), _mm256_extractf128_ps(sumLeft, 1)));
+            outRight = horizontalSum(_mm_add_ps(_mm256_castps256_ps128(sumRight),
+                                                _mm256_extractf128_ps(sumRight, 1)));
+            return;
+#elif ECHOFORM_SIMD_SSE
+            __m128 sumLeft = _mm_setzero_ps();
+            __m128 sumRight = _mm_setzero_ps();
+            for (int k = 0; k < numTaps; k += 4)
+            {
+                const __m128 taps = _mm_loadu_ps(row + k);
+                sumLeft = _mm_add_ps(sumLeft, _mm_mul_ps(taps, _mm_loadu_ps(left + k)));
+                sumRight = _mm_add_ps(sumRight, _mm_mul_ps(taps, _mm_loadu_ps(right + k)));
+            }
+            outLeft = horizontalSum(sumLeft);
+            outRight = horizontalSum(sumRight);
+            return;
+#elif ECHOFORM_SIMD_NEON
+            float32x4_t sumLeft = vdupq_n_f32(0.0f);
+            float32x4_t sumRight = vdupq_n_f32(0.0f);
+            for (int k = 0; k < numTaps; k += 4)
+            {
+                const float32x4_t taps = vld1q_f32(row + k);
+                sumLeft = vaddq_f32(sumLeft, vmulq_f32(taps, vld1q_f32(left + k)));
+                sumRight = vaddq_f32(sumRight, vmulq_f32(taps, vld1q_f32(right + k)));
+            }
+            const float32x2_t pairLeft = vadd_f32(vget_low_f32(sumLeft), vget_high_f32(sumLeft));
+            const float32x2_t pairRight = vadd_f32(vget_low_f32(sumRight), vget_high_f32(sumRight));
+            outLeft = vget_lane_f32(vpadd_f32(pairLeft, pairLeft), 0);
+            outRight = vget_lane_f32(vpadd_f32(pairRight, pairRight), 0);
+            return;
+#endif
+        }
+
+        StorageType sumLeft {};
+        StorageType sumRight {};
+        for (int k = 0; k < numTaps; ++k)
+        {
+            sumLeft += row[k] * left[k];
+            sumRight += row[k] * right[k];
+        }
+        outLeft = sumLeft;
+        outRight = sumRight;
+    }
+
+#if ECHOFORM_SIMD_SSE
+    static float horizontalSum(__m128 sum)
+    {
+        sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+        sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+        return _mm_cvtss_f32(sum);
+    }
+#endif
+
+    /** Input position of stream output frame j, in units of 1 / L. */
+    std::int64_t getStreamPosition(std::uint64_t frame) const
+    {
+        if (exactStep > 0)
+            return static_cast<std::int64_t>(frame) * exactStep;
+        return std::llround(static_cast<double>(frame) * step);
+    }
+
+    static int wrap(int index, int size)
+    {
+        index %= size;
+        return index < 0 ? index + size : index;
+    }
+
+    /** Zeroth-order modified Bessel function of the first kind, for the
+        Kaiser window. */
+    static double besselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        const double quarterSquare = 0.25 * x * x;
+        for (int k = 1; k < 64 && term > 1.0e-12 * sum; ++k)
+        {
+            term *= quarterSquare / (static_cast<double>(k) * k);
+            sum += term;
+        }
+        return sum;
+    }
+
+    // L, and M as the input step per output in units of 1 / L
+    int upFactor { 1 };
+    double step { 1.0 };
+    int exactStep { 1 };  // M when the ratio reduced exactly, else 0
+    int halfTaps { 0 };
+    int numTaps { 0 };
+    std::vector<StorageType> coefficients;
+    std::vector<StorageType> input[Memory::kNumChannels];
+    std::vector<StorageType> output[Memory::kNumChannels];
+    // Streaming state: history[c][i] is input frame streamBase + i
+    std::vector<StorageType> history[Memory::kNumChannels];
+    std::int64_t streamBase { 0 };
+    std::uint64_t streamInputFrames { 0 };
+    std::uint64_t streamReceivedFrames { 0 };
+    std::uint64_t streamOutputFrame { 0 };
+    std::uint64_t streamOutputFrames { 0 };
+};
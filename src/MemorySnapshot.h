@@ -0,0 +1,620 @@
+// MemorySnapshot.h
+//
+// Saves the recorded memory with the plug-in state and brings it back on
+// load.  Only the frames the playheads can reach are kept (the retained span,
+// twice the size), compressed a page at a time with MemoryCodec.
+//
+// MemorySnapshotter keeps an encoded copy of every completed page in that
+// span.  A page behind the write head does not change until the head comes
+// round again or the memory is cleared, so each copy is tagged with the frame
+// it starts at and the clear epoch, and stays valid as long as both match.
+// The memory thread encodes new pages as the write head leaves them, and a
+// capture from the message thread only encodes what the memory thread has not
+// reached yet, then concatenates the copies.  Restoring decodes a few pages per
+// service call on the memory thread, writing them behind the write head of the
+// running engine, so setStateInformation() never waits for the decoder.
+// The same path records a MemoryFeed, audio an import converts on its own
+// thread, as it arrives.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "MemoryBuffer.h"
+#include "MemoryCodec.h"
+#include "MemoryFeed.h"
+#include "MemoryResampler.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/** The compressed memory of one engine: numFrames stereo frames, oldest
+    first, ending at the write head. */
+struct MemorySnapshot
+{
+    static constexpr std::uint32_t kMagic = 0x534d4645;  // "EFMS" in the stream
+    static constexpr std::uint32_t kVersion = 1;
+    // Magic, version, sample rate, frame and block counts.
+    static constexpr size_t kHeaderBytes = 4 + 4 + 8 + 8 + 4;
+    // Frame and byte count in front of each block.
+    static constexpr size_t kBlockHeaderBytes = 8;
+
+    double sampleRate { 0.0 };
+    std::uint64_t numFrames { 0 };
+    std::uint32_t numBlocks { 0 };
+    // Each block is its frame count and byte count, then the MemoryCodec data.
+    std::vector<unsigned char> blocks;
+
+    /** Appends the block of numBlockFrames frames encoded in data. */
+    void addBlock(int numBlockFrames, const std::vector<unsigned char>& data)
+    {
+        putWord(blocks, static_cast<std::uint32_t>(numBlockFrames));
+        putWord(blocks, static_cast<std::uint32_t>(data.size()));
+        blocks.insert(blocks.end(), data.begin(), data.end());
+        numFrames += static_cast<std::uint64_t>(numBlockFrames);
+        ++numBlocks;
+    }
+
+    size_t getSerialisedBytes() const { return kHeaderBytes + blocks.size(); }
+
+    /** Appends the snapshot in its stream format, little-endian throughout. */
+    void serialise(std::vector<unsigned char>& out) const
+    {
+        out.reserve(out.size() + getSerialisedBytes());
+        putWord(out, kMagic);
+        putWord(out, kVersion);
+        std::uint64_t rateBits = 0;
+        std::memcpy(&rateBits, &sampleRate, sizeof(rateBits));
+        putLong(out, rateBits);
+        putLong(out, numFrames);
+        putWord(out, numBlocks);
+        out.insert(out.end(), blocks.begin(), blocks.end());
+    }
+
+    /** Parses a snapshot written by serialise() from the start of data.
+        Returns nullptr unless it is well formed: the header, and every
+        block's size, within size bytes. */
+    static std::shared_ptr<MemorySnapshot> deserialise(const void* data, size_t size)
+    {
+        const auto* bytes = static_cast<const unsigned char*>(data);
+        if (size < kHeaderBytes || getWord(bytes) != kMagic || getWord(bytes + 4) != kVersion)
+            return nullptr;
+
+        auto snapshot = std::make_shared<MemorySnapshot>();
+        const std::uint64_t rateBits = getLong(bytes + 8);
+        std::memcpy(&snapshot->sampleRate, &rateBits, sizeof(rateBits));
+        const std::uint64_t numFrames = getLong(bytes + 16);
+        snapshot->numBlocks = getWord(bytes + 24);
+        if (!(snapshot->sampleRate > 0.0 && snapshot->sampleRate < 1.0e7))
+            return nullptr;
+
+        size_t offset = kHeaderBytes;
+        for (std::uint32_t block = 0; block < snapshot->numBlocks; ++block)
+        {
+            if (size - offset < kBlockHeaderBytes)
+                return nullptr;
+            const auto frames = getWord(bytes + offset);
+            const auto blockBytes = getWord(bytes + offset + 4);
+            offset += kBlockHeaderBytes;
+            if (frames == 0 || frames > static_cast<std::uint32_t>(MemoryCodec::kMaxBlockFrames)
+                || size - offset < blockBytes)
+                return nullptr;
+            offset += blockBytes;
+            snapshot->numFrames += frames;
+        }
+
+        if (snapshot->numFrames != numFrames)
+            return nullptr;
+
+        snapshot->blocks.assign(bytes + kHeaderBytes, bytes + offset);
+        return snapshot;
+    }
+
+    /** Decodes the block at offset into left and right, which have room for
+        MemoryCodec::kMaxBlockFrames frames, and moves offset on to the next
+        block.  Returns the block's frames, or 0 at the end or if the block
+        does not decode. */
+    template <typename Sample>
+    int decodeBlock(size_t& offset, Sample* left, Sample* right) const
+    {
+        if (blocks.size() - offset < kBlockHeaderBytes)
+            return 0;
+
+        const auto numBlockFrames = static_cast<int>(getWord(blocks.data() + offset));
+        const auto blockBytes = getWord(blocks.data() + offset + 4);
+        const unsigned char* data = blocks.data() + offset + kBlockHeaderBytes;
+        if (numBlockFrames <= 0 || numBlockFrames > MemoryCodec::kMaxBlockFrames
+            || blocks.size() - offset - kBlockHeaderBytes < blockBytes
+            || !MemoryCodec::decodeBlock(data, data + blockBytes, left, right, numBlockFrames))
+            return 0;
+
+        offset += kBlockHeaderBytes + blockBytes;
+        return numBlockFrames;
+    }
+
+    static void putWord(std::vector<unsigned char>& out, std::uint32_t value)
+    {
+        for (int shift = 0; shift < 32; shift += 8)
+            out.push_back(static_cast<unsigned char>(value >> shift));
+    }
+
+    static void putLong(std::vector<unsigned char>& out, std::uint64_t value)
+    {
+        putWord(out, static_cast<std::uint32_t>(value));
+        putWord(out, static_cast<std::uint32_t>(value >> 32));
+    }
+
+    static std::uint32_t getWord(const unsigned char* bytes)
+    {
+        return static_cast<std::uint32_t>(bytes[0]) | (static_cast<std::uint32_t>(bytes[1]) << 8)
+             | (static_cast<std::uint32_t>(bytes[2]) << 16) | (static_cast<std::uint32_t>(bytes[3]) << 24);
+    }
+
+    static std::uint64_t getLong(const unsigned char* bytes)
+    {
+        return static_cast<std::uint64_t>(getWord(bytes)) | (static_cast<std::uint64_t>(getWord(bytes + 4)) << 32);
+    }
+};
+
+/** Captures and restores MemorySnapshots of one MemoryBuffer.  capture(),
+    beginRestore() and isRestoring() are safe from any thread but the audio
+    thread; service() belongs to the thread that services the buffer's pages
+    and must run right after MemoryBuffer::servicePages(). */
+template <typename StorageType = float>
+class MemorySnapshotter
+{
+public:
+    using Memory = MemoryBuffer<StorageType>;
+
+    // Pages the memory thread encodes per service() call at most, newest first.
+    static constexpr int kEncodePagesPerService = 16;
+    // Pages restored per service() call, a few milliseconds of decoding.
+    static constexpr int kRestorePagesPerService = 32;
+
+    MemorySnapshotter() = default;
+
+    /** Cancels a feed still pending or being recorded, so its producer stops
+        rather than waiting for room that never comes; an engine replaced for
+        a new sample rate drops its memory thread's work this way. */
+    ~MemorySnapshotter()
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        dropPendingFeed();
+        dropRestore();
+    }
+
+    /** Whether service() keeps the encoded pages up to date.  Without it a
+        capture encodes everything itself. */
+    void setCaching(bool shouldCache) { caching.store(shouldCache, std::memory_order_relaxed); }
+
+    /** Forgets every encoded page and any restore.  Call when the buffer is
+        prepared again, while service() is not running. */
+    void reset()
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        cache.clear();
+        pendingRestore.reset();
+        dropPendingFeed();
+        dropRestore();
+    }
+
+    /** Returns the retained span behind buffer's write head, up to the page
+        the head is in.  While a restore is pending or under way it returns the
+        snapshot being restored, which is what the memory is about to hold.
+        Returns nullptr if the buffer is not prepared. */
+    std::shared_ptr<const MemorySnapshot> capture(const Memory& buffer) const
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        if (pendingRestore != nullptr)
+            return pendingRestore;
+        if (restore.snapshot != nullptr)
+            return restore.snapshot;
+        if (buffer.getBufferSize() == 0)
+            return nullptr;
+
+        // A clear while the pages are gathered would leave some of them from
+        // before it and some after, so gather them again.
+        std::shared_ptr<MemorySnapshot> snapshot;
+        for (int attempt = 0; attempt < kCaptureAttempts; ++attempt)
+        {
+            const auto epoch = buffer.getEpoch();
+            snapshot = std::make_shared<MemorySnapshot>();
+            snapshot->sampleRate = buffer.getSampleRate();
+            findRetainedPages(buffer);
+            // Oldest first: the oldest page is the next the write head reaches.
+            size_t bytes = 0;
+            for (auto span = retainedPages.rbegin(); span != retainedPages.rend(); ++span)
+            {
+                auto& entry = getEntry(buffer, span->page);
+                if (!isCurrent(entry, *span, epoch))
+                    encodePage(buffer, *span, entry);
+                bytes += MemorySnapshot::kBlockHeaderBytes + entry.bytes.size();
+            }
+
+            snapshot->blocks.reserve(bytes);
+            for (auto span = retainedPages.rbegin(); span != retainedPages.rend(); ++span)
+                snapshot->addBlock(span->numFrames, cache[static_cast<size_t>(span->page)].bytes);
+
+            if (buffer.getEpoch() == epoch)
+                break;
+        }
+        return snapshot;
+    }
+
+    /** Starts writing snapshot into the memory, behind the write head as it
+        is when the next service() call picks it up.  Frames beyond what the
+        buffer retains are dropped, and a snapshot taken at another sample rate
+        is resampled (see MemoryResampler). */
+    void beginRestore(std::shared_ptr<const MemorySnapshot> snapshot)
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        dropPendingFeed();
+        pendingRestore = std::move(snapshot);
+    }
+
+    /** Starts recording feed behind the write head as it is when the next
+        service() call picks it up, a few pages per call as the frames arrive.
+        The feed must be at the buffer's sample rate; it is cancelled if the
+        buffer is at another, or when a later restore or feed replaces it.
+        Frames beyond what the buffer retains are dropped, oldest first. */
+    void beginFeed(std::shared_ptr<MemoryFeed> feed)
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        pendingRestore.reset();
+        dropPendingFeed();
+        pendingFeed = std::move(feed);
+    }
+
+    bool isRestoring() const
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        return pendingRestore != nullptr || pendingFeed != nullptr || restore.snapshot != nullptr
+            || restore.feed != nullptr;
+    }
+
+    /** Restores the next few pages of a snapshot, or with caching on, encodes
+        pages the write head has left since the last call.  Returns true if it
+        did either.  Does nothing while a capture is running, so the memory
+        thread never waits for one. */
+    bool service(Memory& buffer)
+    {
+        const std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (!lock.owns_lock() || buffer.getBufferSize() == 0)
+            return false;
+
+        if (pendingRestore != nullptr)
+            startRestore(buffer);
+        else if (pendingFeed != nullptr)
+            startFeed(buffer);
+
+        if (restore.snapshot != nullptr)
+        {
+            continueRestore(buffer);
+            return true;
+        }
+        if (restore.feed != nullptr)
+        {
+            continueFeed(buffer);
+            return true;
+        }
+
+        if (!caching.load(std::memory_order_relaxed))
+            return false;
+
+        // Newest first, so the pages a capture would otherwise encode itself go first.
+        const auto epoch = buffer.getEpoch();
+        findRetainedPages(buffer);
+        int encoded = 0;
+        for (const auto& span : retainedPages)
+        {
+            auto& entry = getEntry(buffer, span.page);
+            if (isCurrent(entry, span, epoch))
+                continue;
+            encodePage(buffer, span, entry);
+            if (++encoded == kEncodePagesPerService)
+                break;
+        }
+
+        // Pages that left the retained span are not needed any more.
+        std::vector<bool> retained(cache.size(), false);
+        for (const auto& span : retainedPages)
+            retained[static_cast<size_t>(span.page)] = true;
+        for (size_t page = 0; page < cache.size(); ++page)
+            if (!retained[page] && !cache[page].bytes.empty())
+                cache[page] = {};
+
+        return encoded > 0;
+    }
+
+private:
+    static constexpr int kCaptureAttempts = 3;
+    static constexpr int kPageFrames = Memory::kPageFrames;
+
+    /** A completed page of the retained span. */
+    struct PageSpan
+    {
+        int page { 0 };
+        int numFrames { 0 };
+        std::int64_t firstFrame { 0 };  // in getWrittenFrames() terms; negative before prepare()
+    };
+
+    /** An encoded page, valid while the page still starts at firstFrame and
+        the memory has not been cleared since. */
+    struct Entry
+    {
+        std::int64_t firstFrame { 0 };
+        std::uint32_t epoch { 0 };
+        bool valid { false };
+        std::vector<unsigned char> bytes;
+    };
+
+    struct Restore
+    {
+        std::shared_ptr<const MemorySnapshot> snapshot;
+        std::shared_ptr<MemoryFeed> feed;  // instead of a snapshot
+        size_t offset { 0 };            // into snapshot->blocks
+        std::uint64_t decodedFrames { 0 };
+        std::uint64_t numFrames { 0 };  // frames to write, after any resampling
+        std::uint64_t skippedFrames { 0 };
+        std::uint64_t writtenFrames { 0 };
+        int endFrame { 0 };             // buffer index the restored frames end at
+        // Only when the snapshot's sample rate differs from the buffer's: the
+        // decoded snapshot, then the same converted to the buffer's rate.
+        std::unique_ptr<Memory> decoded;
+        std::unique_ptr<Memory> resampled;
+    };
+
+    static int getPageFrames(const Memory& buffer, int page)
+    {
+        return juce::jmin(kPageFrames, buffer.getBufferSize() - page * kPageFrames);
+    }
+
+    static int getNumPages(const Memory& buffer)
+    {
+        return (buffer.getBufferSize() + kPageFrames - 1) / kPageFrames;
+    }
+
+    /** The frames behind the write head that a restore may write without
+        reaching the page the write head is in. */
+    static int getWritableFrames(const Memory& buffer, int head)
+    {
+        return buffer.getBufferSize() - getPageFrames(buffer, head / kPageFrames);
+    }
+
+    /** Lists the completed pages of the retained span, newest first, as of
+        the last page the write head entered. */
+    void findRetainedPages(const Memory& buffer) const
+    {
+        retainedPages.clear();
+        const auto published = static_cast<std::int64_t>(buffer.getPublishedWrittenFrames());
+        const int head = static_cast<int>(published % buffer.getBufferSize());
+        const float seconds = buffer.getRetainedSeconds();
+        int wanted = getWritableFrames(buffer, head);
+        if (seconds >= 0.0f)
+            wanted = juce::jmin(wanted, static_cast<int>(std::ceil(static_cast<double>(seconds)
+                                                                    * buffer.getSampleRate())));
+
+        int page = head / kPageFrames;
+        std::int64_t end = published;
+        for (int covered = 0; covered < wanted;)
+        {
+            page = (page == 0 ? getNumPages(buffer) : page) - 1;
+            const int numFrames = getPageFrames(buffer, page);
+            end -= numFrames;
+            covered += numFrames;
+            retainedPages.push_back({ page, numFrames, end });
+        }
+    }
+
+    Entry& getEntry(const Memory& buffer, int page) const
+    {
+        if (cache.size() != static_cast<size_t>(getNumPages(buffer)))
+            cache.assign(static_cast<size_t>(getNumPages(buffer)), Entry {});
+        return cache[static_cast<size_t>(page)];
+    }
+
+    static bool isCurrent(const Entry& entry, const PageSpan& span, std::uint32_t epoch)
+    {
+        return entry.valid && entry.firstFrame == span.firstFrame && entry.epoch == epoch;
+    }
+
+    /** Encodes one page.  It stays invalid if the memory was cleared while
+        it was read, but its bytes are still what the page held. */
+    void encodePage(const Memory& buffer, const PageSpan& span, Entry& entry) const
+    {
+        const auto epoch = buffer.getEpoch();
+        const int start = span.page * kPageFrames;
+        buffer.readFrames(0, start, left.data(), span.numFrames);
+        buffer.readFrames(1, start, right.data(), span.numFrames);
+        entry.bytes.clear();
+        MemoryCodec::encodeBlock(left.data(), right.data(), span.numFrames, entry.bytes);
+        entry.firstFrame = span.firstFrame;
+        entry.epoch = epoch;
+        entry.valid = buffer.getEpoch() == epoch;
+    }
+
+    void startRestore(const Memory& buffer)
+    {
+        dropRestore();
+        restore.snapshot = std::move(pendingRestore);
+        for (auto& entry : cache)
+            entry.valid = false;
+
+        const auto head = static_cast<int>(buffer.getPublishedWrittenFrames() % buffer.getBufferSize());
+        restore.endFrame = head;
+        restore.numFrames = restore.snapshot->numFrames;
+        if (restore.snapshot->sampleRate != buffer.getSampleRate())
+        {
+            // Room for every frame, so the resampler sees the whole snapshot.
+            const auto seconds = static_cast<double>(restore.snapshot->numFrames + kPageFrames)
+                               / restore.snapshot->sampleRate;
+            restore.decoded = std::make_unique<Memory>();
+            restore.decoded->prepare(restore.snapshot->sampleRate, static_cast<float>(seconds));
+        }
+        else
+        {
+            restore.skippedFrames = skipFramesBeyond(buffer, restore.numFrames);
+        }
+    }
+
+    void startFeed(const Memory& buffer)
+    {
+        dropRestore();
+        if (pendingFeed->getSampleRate() != buffer.getSampleRate())
+        {
+            dropPendingFeed();
+            return;
+        }
+
+        restore.feed = std::move(pendingFeed);
+        for (auto& entry : cache)
+            entry.valid = false;
+
+        restore.endFrame = static_cast<int>(buffer.getPublishedWrittenFrames() % buffer.getBufferSize());
+        restore.numFrames = restore.feed->getNumFrames();
+        restore.skippedFrames = skipFramesBeyond(buffer, restore.numFrames);
+    }
+
+    /** Records what has arrived of the feed, up to a few pages. */
+    void continueFeed(Memory& buffer)
+    {
+        for (int page = 0; page < kRestorePagesPerService; ++page)
+        {
+            const auto remaining = restore.numFrames - restore.writtenFrames;
+            if (remaining == 0 || restore.feed->isDrained())
+            {
+                finishRestore();
+                return;
+            }
+
+            const auto wanted = juce::jmin(remaining, static_cast<std::uint64_t>(kPageFrames));
+            const int numFrames = restore.feed->read(left.data(), right.data(), static_cast<int>(wanted));
+            if (numFrames == 0)
+                return;
+            writeRestoredFrames(buffer, numFrames);
+        }
+    }
+
+    std::uint64_t skipFramesBeyond(const Memory& buffer, std::uint64_t numFrames) const
+    {
+        const auto writable = static_cast<std::uint64_t>(getWritableFrames(buffer, restore.endFrame));
+        return numFrames > writable ? numFrames - writable : 0;
+    }
+
+    void continueRestore(Memory& buffer)
+    {
+        const auto& snapshot = *restore.snapshot;
+        for (int page = 0; page < kRestorePagesPerService; ++page)
+        {
+            if (restore.decodedFrames < snapshot.numFrames)
+            {
+                const int numFrames = snapshot.decodeBlock(restore.offset, left.data(), right.data());
+                if (numFrames == 0)
+                {
+                    finishRestore();
+                    return;
+                }
+
+                restore.decodedFrames += static_cast<std::uint64_t>(numFrames);
+                if (restore.decoded != nullptr)
+                    restore.decoded->writeBlock(left.data(), right.data(), numFrames);
+                else
+                    writeRestoredFrames(buffer, numFrames);
+                continue;
+            }
+
+            if (restore.decoded != nullptr)
+            {
+                resampleRestoredFrames(buffer);
+                continue;
+            }
+
+            if (restore.resampled == nullptr || restore.writtenFrames == restore.numFrames)
+            {
+                finishRestore();
+                return;
+            }
+
+            // Copy the next page of the resampled snapshot into place.
+            const auto remaining = restore.numFrames - restore.writtenFrames;
+            const int numFrames = static_cast<int>(juce::jmin(remaining, static_cast<std::uint64_t>(kPageFrames)));
+            const auto& resampled = *restore.resampled;
+            const int start = wrap(resampled.getWritePosition() - static_cast<int>(remaining),
+                                   resampled.getBufferSize());
+            resampled.readFrames(0, start, left.data(), numFrames);
+            resampled.readFrames(1, start, right.data(), numFrames);
+            writeRestoredFrames(buffer, numFrames);
+        }
+    }
+
+    /** Converts the decoded snapshot to the buffer's sample rate in one go;
+        the copy into the buffer then goes a few pages per call again. */
+    void resampleRestoredFrames(const Memory& buffer)
+    {
+        const auto seconds = static_cast<double>(restore.decoded->getWrittenFrames() + kPageFrames)
+                           / restore.snapshot->sampleRate;
+        restore.resampled = std::make_unique<Memory>();
+        restore.resampled->prepare(buffer.getSampleRate(), static_cast<float>(seconds));
+
+        MemoryResampler<StorageType> resampler;
+        resampler.prepare(restore.snapshot->sampleRate, buffer.getSampleRate());
+        restore.numFrames = static_cast<std::uint64_t>(resampler.process(*restore.decoded, *restore.resampled));
+        restore.decoded.reset();
+        restore.skippedFrames = skipFramesBeyond(buffer, restore.numFrames);
+    }
+
+    /** Writes the next numFrames frames of the snapshot, held in left and
+        right, to where they belong behind the write head. */
+    void writeRestoredFrames(Memory& buffer, int numFrames)
+    {
+        const auto first = restore.writtenFrames;
+        restore.writtenFrames += static_cast<std::uint64_t>(numFrames);
+        if (restore.writtenFrames <= restore.skippedFrames)
+            return;
+
+        const int skip = static_cast<int>(first < restore.skippedFrames ? restore.skippedFrames - first : 0);
+        const auto behind = static_cast<int>(restore.numFrames - first) - skip;
+        const int start = wrap(restore.endFrame - behind, buffer.getBufferSize());
+        buffer.restoreFrames(start, left.data() + skip, right.data() + skip, numFrames - skip);
+    }
+
+    void finishRestore()
+    {
+        dropRestore();
+        for (auto& entry : cache)
+            entry.valid = false;
+    }
+
+    /** Ends any restore, telling a feed's producer to stop. */
+    void dropRestore()
+    {
+        if (restore.feed != nullptr)
+            restore.feed->cancel();
+        restore = {};
+    }
+
+    void dropPendingFeed()
+    {
+        if (pendingFeed != nullptr)
+            pendingFeed->cancel();
+        pendingFeed.reset();
+    }
+
+    static int wrap(int frame, int numFrames) { return ((frame % numFrames) + numFrames) % numFrames; }
+
+    mutable std::mutex mutex;
+    std::atomic<bool> caching { false };
+    // Everything below is guarded by mutex.
+    mutable std::vector<Entry> cache;
+    mutable std::vector<PageSpan> retainedPages;
+    mutable std::vector<StorageType> left = std::vector<StorageType>(static_cast<size_t>(kPageFrames));
+    mutable std::vector<StorageType> right = std::vector<StorageType>(static_cast<size_t>(kPageFrames));
+    std::shared_ptr<const MemorySnapshot> pendingRestore;
+    std::shared_ptr<MemoryFeed> pendingFeed;
+    Restore restore;
+
+    JUCE_DECLARE_NON_COPYABLE(MemorySnapshotter)
+};
@@ -0,0 +1,178 @@
+// MemorySpillFile.h
+//
+// Scratch storage for memory pages that have left RAM.  With
+// MemoryBufferTypes::Allocation::Spilled only the recent part of the memory
+// stays resident; older pages are written here as they leave the resident span
+// and read back when a playhead is about to need them.  The file is a
+// temporary file mapped with juce::MemoryMappedFile, one slot per page, so
+// storing and loading a page is a copy and the system's page cache does the
+// I/O.  Only the memory thread writes; any thread but the audio thread may
+// read, and a version stamp on each slot tells a reader that the copy changed
+// under it.  The audio thread never touches the file.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <vector>
+
+class MemorySpillFile
+{
+public:
+    // The first frame of a slot that holds nothing
+    static constexpr std::int64_t kNoFrame = std::numeric_limits<std::int64_t>::min();
+
+    /** What a slot holds: the page's contents from firstFrame on (counted as
+        MemoryBuffer::getWrittenFrames() counts), recorded in epoch. */
+    struct Stamp
+    {
+        std::int64_t firstFrame { kNoFrame };
+        std::uint32_t epoch { 0 };
+    };
+
+    MemorySpillFile() = default;
+    ~MemorySpillFile() { close(); }
+
+    /** Creates and maps a file of numPages slots of pageBytes each, replacing
+        any file already open.  Returns false, leaving the spill closed, if the
+        file cannot be created or mapped.  Allocates and does I/O. */
+    bool open(int numPages, size_t pageBytes)
+    {
+        close();
+        if (numPages <= 0 || pageBytes == 0)
+            return false;
+
+        const auto fileBytes = static_cast<juce::int64>(numPages) * static_cast<juce::int64>(pageBytes);
+        file = std::make_unique<juce::TemporaryFile>(".echoform-memory");
+        {
+            // Writing only the last byte sizes the file without writing the
+            // rest, which most file systems keep sparse until pages spill
+            juce::FileOutputStream stream(file->getFile());
+            if (!stream.openedOk() || !stream.setPosition(fileBytes - 1) || !stream.writeByte(0))
+            {
+                close();
+                return false;
+            }
+        }
+
+        mapping = std::make_unique<juce::MemoryMappedFile>(file->getFile(), juce::MemoryMappedFile::readWrite, true);
+        if (mapping->getData() == nullptr || static_cast<juce::int64>(mapping->getSize()) < fileBytes)
+        {
+            close();
+            return false;
+        }
+
+        slotBytes = pageBytes;
+        slots = std::vector<Slot>(static_cast<size_t>(numPages));
+        return true;
+    }
+
+    /** Unmaps and deletes the file. */
+    void close()
+    {
+        mapping.reset();
+        file.reset();
+        slots.clear();
+        slotBytes = 0;
+    }
+
+    bool isOpen() const { return mapping != nullptr; }
+
+    /** Bytes of address space the file takes; the disk holds only the slots
+        that were ever written. */
+    size_t getFileBytes() const { return slots.size() * slotBytes; }
+
+    Stamp getStamp(int page) const
+    {
+        const auto& slot = slots[static_cast<size_t>(page)];
+        return { slot.firstFrame.load(std::memory_order_acquire), slot.epoch.load(std::memory_order_acquire) };
+    }
+
+    /** True if the slot holds the page's contents from firstFrame on, as
+        recorded in epoch. */
+    bool holds(int page, std::int64_t firstFrame, std::uint32_t epoch) const
+    {
+        const auto stamp = getStamp(page);
+        return firstFrame != kNoFrame && stamp.firstFrame == firstFrame && stamp.epoch == epoch;
+    }
+
+    /** Copies a page into its slot.  Memory thread only. */
+    void store(int page, const unsigned char* source, std::int64_t firstFrame, std::uint32_t epoch)
+    {
+        std::memcpy(beginWrite(page), source, slotBytes);
+        endWrite(page, firstFrame, epoch);
+    }
+
+    /** Copies a slot into dest if it holds what holds() asks for, and returns
+        whether it did. */
+    bool load(int page, unsigned char* dest, std::int64_t firstFrame, std::uint32_t epoch) const
+    {
+        return read(page, firstFrame, epoch, [&](const unsigned char* slot) { std::memcpy(dest, slot, slotBytes); });
+    }
+
+    /** Calls readSlot with the slot's bytes if it holds what holds() asks
+        for, and returns true if it did and the slot was not rewritten
+        meanwhile; otherwise whatever readSlot produced must be discarded. */
+    template <typename Function>
+    bool read(int page, std::int64_t firstFrame, std::uint32_t epoch, Function&& readSlot) const
+    {
+        const auto& slot = slots[static_cast<size_t>(page)];
+        const auto version = slot.version.load(std::memory_order_acquire);
+        if ((version & 1u) != 0 || !holds(page, firstFrame, epoch))
+            return false;
+
+        readSlot(getSlotData(page));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return slot.version.load(std::memory_order_relaxed) == version;
+    }
+
+    /** Returns a slot to modify in place; readers discard what they read of
+        it until endWrite() stamps it.  Memory thread only. */
+    unsigned char* beginWrite(int page)
+    {
+        auto& slot = slots[static_cast<size_t>(page)];
+        slot.version.store(slot.version.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return getSlotData(page);
+    }
+
+    void endWrite(int page, std::int64_t firstFrame, std::uint32_t epoch)
+    {
+        auto& slot = slots[static_cast<size_t>(page)];
+        slot.firstFrame.store(firstFrame, std::memory_order_relaxed);
+        slot.epoch.store(epoch, std::memory_order_relaxed);
+        slot.version.store(slot.version.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /** Forgets what a slot holds.  Memory thread only. */
+    void invalidate(int page)
+    {
+        beginWrite(page);
+        endWrite(page, kNoFrame, 0);
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<std::uint32_t> version { 0 };  // odd while the slot is being written
+        std::atomic<std::int64_t> firstFrame { kNoFrame };
+        std::atomic<std::uint32_t> epoch { 0 };
+    };
+
+    unsigned char* getSlotData(int page) const
+    {
+        return static_cast<unsigned char*>(mapping->getData()) + static_cast<size_t>(page) * slotBytes;
+    }
+
+    // Declared before the mapping, which is released before the file is deleted
+    std::unique_ptr<juce::TemporaryFile> file;
+    std::unique_ptr<juce::MemoryMappedFile> mapping;
+    std::vector<Slot> slots;
+    size_t slotBytes { 0 };
+
+    JUCE_DECLARE_NON_COPYABLE(MemorySpillFile)
+};
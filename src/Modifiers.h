@@ -1,79 +1,125 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "Lfo.h"
 #include "RandomGenerator.h"
 #include <array>
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+// The modifiers are templated on the processing precision (float or double).
+// Audio and filter state use SampleType; control values such as intensity and
+// LFO phases stay float, as do the random draws.
+//
+// Each modifier processes either a block at a time (processBlock(), for
+// the In and Out routings) or a sample at a time (processSample(), inside
+// the feedback loop), with identical results.  processSample() takes the
+// channels of a frame in order, and the last prepared channel ends the frame;
+// processBlock() does numSamples frames of every channel in place.  A
+// modifier that draws random values owns its generator (see setSeed()), so
+// its draws do not depend on how its processing is interleaved with anything
+// else.
+//
+// Modifiers are composed statically by ModifierStages and called through
+// their own types, so Modifier only holds what they share and has no
+// virtual members.  A modifier does not test its own intensity: the caller
+// skips it while isActive() is false, which leaves its state untouched.
+
+template <typename SampleType>
 class Modifier
 {
 public:
-    virtual ~Modifier() = default;
-    virtual void prepare(double newSampleRate, int maxBlockSize, int numChannels) = 0;
-    virtual void reset() = 0;
-    virtual float processSample(float input, int channel, RandomGenerator& random) = 0;
-
-    virtual void setIntensity(float newIntensity)
+    void setIntensity(float newIntensity)
     {
         intensity = juce::jlimit(0.0f, 1.0f, newIntensity);
     }
 
-    virtual void setBipolar(float newValue)
+    void setBipolar(float newValue)
     {
         bipolar = juce::jlimit(-1.0f, 1.0f, newValue);
         setIntensity(std::abs(bipolar));
     }
 
+    /** Restarts the modifier's random draws from seed. */
+    void setSeed(uint32_t seed) { random.setSeed(seed); }
+
+    /** False while the intensity is too low for the modifier to be heard. */
+    bool isActive() const { return intensity > 0.0001f; }
+
 protected:
+    // Frames of per-frame control values a block pass works on at a time
+    static constexpr int kControlFrames = 64;
+
     float intensity { 0.0f };
     float bipolar { 0.0f };
+    RandomGenerator random;
 };
 
-class LowPassModifier final : public Modifier
+template <typename SampleType>
+class LowPassModifier final : public Modifier<SampleType>
 {
 public:
-    void prepare(double newSampleRate, int, int numChannels) override
+    using Modifier<SampleType>::intensity;
+    using Modifier<SampleType>::bipolar;
+
+    void prepare(double newSampleRate, int, int numChannels)
     {
         sampleRate = newSampleRate;
-        state.assign(static_cast<size_t>(numChannels), 0.0f);
+        state.assign(static_cast<size_t>(numChannels), SampleType {});
         updateCoefficient();
     }
 
-    void reset() override
+    void reset()
     {
-        std::fill(state.begin(), state.end(), 0.0f);
+        std::fill(state.begin(), state.end(), SampleType {});
     }
 
-    void setIntensity(float newIntensity) override
+    void setIntensity(float newIntensity)
     {
-        Modifier::setIntensity(newIntensity);
+        Modifier<SampleType>::setIntensity(newIntensity);
         updateCoefficient();
     }
 
-    void setBipolar(float newValue) override
+    void setBipolar(float newValue)
     {
-        Modifier::setBipolar(newValue);
+        Modifier<SampleType>::setBipolar(newValue);
         updateCoefficient();
     }
 
-    float processSample(float input, int channel, RandomGenerator&) override
+    SampleType processSample(SampleType input, int channel)
     {
-        if (intensity <= 0.0001f)
-            return input;
+        return filter(input, state[static_cast<size_t>(channel)]);
+    }
 
-        float output = (1.0f - coefficient) * input + coefficient * state[static_cast<size_t>(channel)];
-        state[static_cast<size_t>(channel)] = output;
+    void processBlock(SampleType* const* channels, int numChannels, int numSamples)
+    {
+        for (int channel = 0; channel < numChannels; ++channel)
+        {
+            SampleType* samples = channels[channel];
+            SampleType channelState = state[static_cast<size_t>(channel)];
+            for (int i = 0; i < numSamples; ++i)
+                samples[i] = filter(samples[i], channelState);
+            state[static_cast<size_t>(channel)] = channelState;
+        }
+    }
+
+private:
+    SampleType filter(SampleType input, SampleType& channelState) const
+    {
+        SampleType output = (1.0f - coefficient) * input + coefficient * channelState;
+        channelState = output;
 
         if (bipolar >= 0.0f)
             return output;
 
-        const float brighten = input + (input - output) * intensity;
+        const SampleType brighten = input + (input - output) * intensity;
         return brighten;
     }
 
-private:
     void updateCoefficient()
     {
         if (sampleRate <= 0.0)
@@ -87,303 +133,696 @@ private:
 
     double sampleRate { 44100.0 };
     float coefficient { 0.0f };
-    std::vector<float> state;
+    std::vector<SampleType> state;
 };
 
-class ModulatedDelayLine
+/** The delay a tape's wow and flutter put on the signal: two sine LFOs whose
+    rates and depth follow the intensity, and whose balance follows the sign
+    of the bipolar value.  The sines come from quadrature oscillators, so a
+    new rate takes effect at the oscillators' next block. */
+class WowFlutterTrajectory
 {
 public:
-    void prepare(double newSampleRate, float maxDelayMs, int numChannels)
+    void prepare(double newSampleRate)
     {
         sampleRate = newSampleRate;
-        const int maxSamples = juce::jmax(1, static_cast<int>(std::ceil(sampleRate * (maxDelayMs / 1000.0f))) + 2);
-        buffer.setSize(numChannels, maxSamples);
-        buffer.clear();
-        writePos = 0;
+        updateParameters();
     }
 
     void reset()
     {
-        buffer.clear();
-        writePos = 0;
+        wow.reset();
+        flutter.reset();
     }
 
-    float readSample(int channel, float delaySamples) const
+    void setShape(float newIntensity, float newBipolar)
     {
-        const int bufferSize = buffer.getNumSamples();
-        delaySamples = juce::jlimit(0.0f, static_cast<float>(bufferSize - 1), delaySamples);
-        float readPos = static_cast<float>(writePos) - delaySamples;
-        while (readPos < 0.0f)
-            readPos += bufferSize;
-        while (readPos >= bufferSize)
-            readPos -= bufferSize;
-        const int index1 = static_cast<int>(readPos);
-        int index2 = index1 + 1;
-        if (index2 >= bufferSize)
-            index2 -= bufferSize;
-        const float frac = readPos - static_cast<float>(index1);
-        const float* data = buffer.getReadPointer(channel);
-        const float s1 = data[index1];
-        const float s2 = data[index2];
-        return s1 + frac * (s2 - s1);
+        intensity = newIntensity;
+        bipolar = newBipolar;
+        updateParameters();
     }
 
-    void writeSample(int channel, float input)
+    /** Moves the LFOs on by a frame and returns the frame's delay in
+        samples. */
+    float getNextDelay()
     {
-        buffer.setSample(channel, writePos, input);
+        const float wowWeight = (bipolar >= 0.0f) ? 0.7f : 0.3f;
+        const float flutterWeight = 1.0f - wowWeight;
+        const float modMs = (wow.getNextSine() * wowWeight + flutter.getNextSine() * flutterWeight) * depthMs;
+        return (baseDelayMs + modMs) * static_cast<float>(sampleRate) / 1000.0f;
     }
 
-    void advance()
+private:
+    void updateParameters()
     {
-        if (++writePos >= buffer.getNumSamples())
-            writePos = 0;
+        const float wowRate = juce::jmap(intensity, 0.05f, (bipolar >= 0.0f) ? 0.6f : 0.4f);
+        const float flutterRate = juce::jmap(intensity, (bipolar >= 0.0f) ? 1.8f : 2.4f, 6.5f);
+        depthMs = juce::jmap(intensity, 0.0f, 3.5f);
+        baseDelayMs = 4.0f + depthMs;
+        wow.setFrequency(wowRate, sampleRate);
+        flutter.setFrequency(flutterRate, sampleRate);
     }
 
-private:
     double sampleRate { 44100.0 };
-    juce::AudioBuffer<float> buffer;
-    int writePos { 0 };
+    float intensity { 0.0f };
+    float bipolar { 0.0f };
+    QuadratureOscillator wow;
+    QuadratureOscillator flutter;
+    float depthMs { 0.0f };
+    float baseDelayMs { 4.0f };
 };
 
-class WowFlutterModifier final : public Modifier
+/** The delay of a slow random pitch drift: linear ramps to random targets
+    every 0.6 s, upwards, downwards or either way by the sign of the bipolar
+    value. */
+class PitchDriftTrajectory
 {
 public:
-    void prepare(double newSampleRate, int, int numChannels) override
+    void prepare(double newSampleRate)
     {
         sampleRate = newSampleRate;
+        reset();
+    }
+
+    void reset()
+    {
+        driftCurrentMs = 0.0f;
+        driftTargetMs = 0.0f;
+        driftStepMs = 0.0f;
+        driftSamplesRemaining = 0;
+    }
+
+    void setShape(float newIntensity, float newBipolar)
+    {
+        intensity = newIntensity;
+        bipolar = newBipolar;
+    }
+
+    /** Moves the drift on by a frame, starting a ramp to a target drawn from
+        random when the last one is done, and returns the frame's delay in
+        samples. */
+    float getNextDelay(RandomGenerator& random)
+    {
+        if (driftSamplesRemaining <= 0)
+        {
+            const float depthMs = juce::jmap(intensity, 0.0f, 2.2f);
+            const float randomValue = std::abs(random.nextFloatSigned());
+            if (bipolar > 0.05f)
+                driftTargetMs = randomValue * depthMs;
+            else if (bipolar < -0.05f)
+                driftTargetMs = -randomValue * depthMs;
+            else
+                driftTargetMs = random.nextFloatSigned() * depthMs;
+            const int rampSamples = juce::jmax(1, static_cast<int>(sampleRate * 0.6f));
+            driftStepMs = (driftTargetMs - driftCurrentMs) / static_cast<float>(rampSamples);
+            driftSamplesRemaining = rampSamples;
+        }
+
+        driftCurrentMs += driftStepMs;
+        --driftSamplesRemaining;
+        return (baseDelayMs + driftCurrentMs) * static_cast<float>(sampleRate) / 1000.0f;
+    }
+
+private:
+    double sampleRate { 44100.0 };
+    float intensity { 0.0f };
+    float bipolar { 0.0f };
+    float baseDelayMs { 3.0f };
+    float driftCurrentMs { 0.0f };
+    float driftTargetMs { 0.0f };
+    float driftStepMs { 0.0f };
+    int driftSamplesRemaining { 0 };
+};
+
+/** Wow and flutter and pitch drift on one delay line, the way a tape
+    transport combines them.
+
+    It replaces a wow and flutter modifier followed by a pitch drift modifier,
+    each on a delay line of its own (kept as the reference in
+    tests/ReferenceModifiers.h).  That pair adds up four paths,
+    each weighted by the two intensities: the dry input, the input delayed by
+    the wow alone, by the drift alone, and by both, where the wow delay is
+    the one in force when the drift's read position was written.  This
+    modifier writes each frame once and reads the three delayed paths from
+    the same buffer, at tap positions computed once per frame for every
+    channel.  A short history of the wow delay supplies the combined path,
+    so the result differs from the series pair only by interpolation error:
+    about -80 dB relative to the signal at 220 Hz and -45 dB at 1.9 kHz,
+    where the series pair's second interpolation is most of the difference
+    (see the tests).
+
+    It does not read one tap at the sum of the two delays: each modifier
+    blends its delayed signal with its input by its intensity, so below full
+    intensity the pair is not one delay, and a single tap would only match it
+    with both at full.  Three reads per frame keep the pair's sound at every
+    setting, and the saving is in writing once and computing the taps once
+    per frame, about 15% to 25% (see the benchmarks).
+
+    All three taps interpolate linearly, as the pair did.  The wow and drift
+    taps then filter the signal as the pair's did, and the combined tap,
+    which the pair interpolated twice, loses less treble than before rather
+    than more; a higher-order interpolator on that tap alone would change
+    the blend between the paths as the intensities move, and cost more in
+    the feedback loop, which runs this per sample.
+
+    The drift's random draws are the same as the pitch drift modifier's for
+    the same seed. */
+template <typename SampleType>
+class TapeTransportModifier final : public Modifier<SampleType>
+{
+public:
+    using Modifier<SampleType>::kControlFrames;
+
+    void prepare(double newSampleRate, int, int numChannels)
+    {
         channels = numChannels;
-        delayLine.prepare(sampleRate, 12.0f, numChannels);
-        updateParameters();
+
+        // Room for the longest wow delay (12 ms) and drift delay (8 ms) end to end
+        const int minSize = static_cast<int>(std::ceil(newSampleRate * 0.02)) + 2;
+        int size = 1;
+        while (size < minSize)
+            size <<= 1;
+        buffer.setSize(numChannels, size);
+        wowDelayHistory.assign(static_cast<size_t>(size), 0.0f);
+        mask = size - 1;
+
+        wowFlutter.prepare(newSampleRate);
+        pitchDrift.prepare(newSampleRate);
+        reset();
     }
 
-    void reset() override
+    void reset()
     {
-        delayLine.reset();
-        wowPhase = 0.0f;
-        flutterPhase = 0.0f;
+        buffer.clear();
+        std::fill(wowDelayHistory.begin(), wowDelayHistory.end(), 0.0f);
+        writePos = 0;
+        wowFlutter.reset();
+        pitchDrift.reset();
     }
 
-    void setIntensity(float newIntensity) override
+    /** Sets the wow and flutter from a bipolar value, -1 to 1: the magnitude
+        is the intensity and the sign shapes the modulation. */
+    void setWowFlutter(float newBipolar)
     {
-        Modifier::setIntensity(newIntensity);
-        updateParameters();
+        wowBipolar = juce::jlimit(-1.0f, 1.0f, newBipolar);
+        wowIntensity = std::abs(wowBipolar);
+        wowFlutter.setShape(wowIntensity, wowBipolar);
+        updateWeights();
     }
 
-    void setBipolar(float newValue) override
+    /** Sets the pitch drift from a bipolar value, as setWowFlutter(). */
+    void setPitchDrift(float newBipolar)
     {
-        Modifier::setBipolar(newValue);
-        updateParameters();
+        driftBipolar = juce::jlimit(-1.0f, 1.0f, newBipolar);
+        driftIntensity = std::abs(driftBipolar);
+        pitchDrift.setShape(driftIntensity, driftBipolar);
+        updateWeights();
     }
 
-    float processSample(float input, int channel, RandomGenerator&) override
+    SampleType processSample(SampleType input, int channel)
     {
-        if (intensity <= 0.0001f)
-            return input;
+        if (wowActive && driftActive)
+            return processSample<true, true>(input, channel);
+        if (wowActive)
+            return processSample<true, false>(input, channel);
+        return processSample<false, true>(input, channel);
+    }
 
+    void processBlock(SampleType* const* channelData, int numChannels, int numSamples)
+    {
+        jassert(numChannels == channels);
+        if (wowActive && driftActive)
+            processBlock<true, true>(channelData, numChannels, numSamples);
+        else if (wowActive)
+            processBlock<true, false>(channelData, numChannels, numSamples);
+        else
+            processBlock<false, true>(channelData, numChannels, numSamples);
+    }
+
+private:
+    using Modifier<SampleType>::random;
+
+    /** The reads of one delayed path for a run of frames, as a structure of
+        arrays: the two samples each frame interpolates between, and their
+        coefficients with the path's weight folded in. */
+    struct PathTaps
+    {
+        std::array<int, kControlFrames> index1 {};
+        std::array<int, kControlFrames> index2 {};
+        std::array<float, kControlFrames> frac {};
+        std::array<float, kControlFrames> gain1 {};
+        std::array<float, kControlFrames> gain2 {};
+    };
+
+    template <bool Wow, bool Drift>
+    SampleType processSample(SampleType input, int channel)
+    {
         if (channel == 0)
+            prepareFrames<Wow, Drift>(writePos, 1);
+
+        const SampleType output = mixFrame<Wow, Drift>(buffer.getReadPointer(channel), input, 0);
+        buffer.setSample(channel, writePos, input);
+
+        if (channel == channels - 1)
+            writePos = (writePos + 1) & mask;
+
+        return output;
+    }
+
+    template <bool Wow, bool Drift>
+    void processBlock(SampleType* const* channelData, int numChannels, int numSamples)
+    {
+        const int bufferMask = mask;
+        for (int start = 0; start < numSamples;)
         {
-            const float wow = std::sin(wowPhase);
-            const float flutter = std::sin(flutterPhase);
-            const float wowWeight = (bipolar >= 0.0f) ? 0.7f : 0.3f;
-            const float flutterWeight = 1.0f - wowWeight;
-            const float modMs = (wow * wowWeight + flutter * flutterWeight) * depthMs;
-            currentDelaySamples = (baseDelayMs + modMs) * static_cast<float>(sampleRate) / 1000.0f;
+            const int count = juce::jmin(kControlFrames, numSamples - start);
+            const int base = writePos;
+            prepareFrames<Wow, Drift>(base, count);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                SampleType* samples = channelData[channel] + start;
+                SampleType* data = buffer.getWritePointer(channel);
+                for (int i = 0; i < count; ++i)
+                {
+                    const SampleType input = samples[i];
+                    samples[i] = mixFrame<Wow, Drift>(data, input, i);
+                    data[(base + i) & bufferMask] = input;
+                }
+            }
+            writePos = (base + count) & bufferMask;
+            start += count;
         }
+    }
 
-        float delayed = delayLine.readSample(channel, currentDelaySamples);
-        delayLine.writeSample(channel, input);
+    /** Moves the trajectories on by count frames from position and sets the
+        taps of every path for them.  A frame without wow records a wow delay
+        of zero, so a combined path reading back into it sees the drift
+        alone, as the series pair would. */
+    template <bool Wow, bool Drift>
+    void prepareFrames(int position, int count)
+    {
+        for (int i = 0; i < count; ++i)
+        {
+            float wowDelay = 0.0f;
+            if (Wow)
+            {
+                wowDelay = wowFlutter.getNextDelay();
+                wowDelays[static_cast<size_t>(i)] = wowDelay;
+            }
+            if (Drift)
+                driftDelays[static_cast<size_t>(i)] = pitchDrift.getNextDelay(random);
+            wowDelayHistory[static_cast<size_t>((position + i) & mask)] = wowDelay;
+        }
 
-        if (channel == channels - 1)
+        if (Wow)
+            setPathTaps(wowTaps, position, wowDelays.data(), count, weights[1]);
+        if (Drift)
+            setPathTaps(driftTaps, position, driftDelays.data(), count, weights[2]);
+        if (Wow && Drift)
         {
-            delayLine.advance();
-            wowPhase += wowPhaseStep;
-            flutterPhase += flutterPhaseStep;
-            if (wowPhase > juce::MathConstants<float>::twoPi)
-                wowPhase -= juce::MathConstants<float>::twoPi;
-            if (flutterPhase > juce::MathConstants<float>::twoPi)
-                flutterPhase -= juce::MathConstants<float>::twoPi;
+            const float* history = wowDelayHistory.data();
+            for (int i = 0; i < count; ++i)
+            {
+                const auto n = static_cast<size_t>(i);
+                const float frac = driftTaps.frac[n];
+                const float earlierWowDelay = history[driftTaps.index1[n]] * (1.0f - frac)
+                                              + history[driftTaps.index2[n]] * frac;
+                bothDelays[n] = driftDelays[n] + earlierWowDelay;
+            }
+            setPathTaps(bothTaps, position, bothDelays.data(), count, weights[3]);
         }
+    }
 
-        return input + (delayed - input) * intensity;
+    /** Sets the taps of a path delayed by delays[i] at frame position + i.
+        Written without branches, so the compiler can vectorise it. */
+    void setPathTaps(PathTaps& taps, int position, const float* delays, int count, float weight)
+    {
+        const float maxDelay = static_cast<float>(mask - 1);
+        for (int i = 0; i < count; ++i)
+        {
+            const auto n = static_cast<size_t>(i);
+            const float delay = juce::jlimit(0.0f, maxDelay, delays[n]);
+            // A buffer length ahead, so that the read position is never negative
+            const float readPos = static_cast<float>(((position + i) & mask) + mask + 1) - delay;
+            const int index = static_cast<int>(readPos);
+            const float frac = readPos - static_cast<float>(index);
+            taps.index1[n] = index & mask;
+            taps.index2[n] = (index + 1) & mask;
+            taps.frac[n] = frac;
+            taps.gain1[n] = weight * (1.0f - frac);
+            taps.gain2[n] = weight * frac;
+        }
     }
 
-private:
-    void updateParameters()
+    template <bool Wow, bool Drift>
+    SampleType mixFrame(const SampleType* data, SampleType input, int frame) const
     {
-        const float wowRate = juce::jmap(intensity, 0.05f, (bipolar >= 0.0f) ? 0.6f : 0.4f);
-        const float flutterRate = juce::jmap(intensity, (bipolar >= 0.0f) ? 1.8f : 2.4f, 6.5f);
-        depthMs = juce::jmap(intensity, 0.0f, 3.5f);
-        baseDelayMs = 4.0f + depthMs;
-        wowPhaseStep = juce::MathConstants<float>::twoPi * wowRate / static_cast<float>(sampleRate);
-        flutterPhaseStep = juce::MathConstants<float>::twoPi * flutterRate / static_cast<float>(sampleRate);
+        const auto n = static_cast<size_t>(frame);
+        SampleType output = input * weights[0];
+        if (Wow)
+            output += data[wowTaps.index1[n]] * wowTaps.gain1[n] + data[wowTaps.index2[n]] * wowTaps.gain2[n];
+        if (Drift)
+            output += data[driftTaps.index1[n]] * driftTaps.gain1[n] + data[driftTaps.index2[n]] * driftTaps.gain2[n];
+        if (Wow && Drift)
+            output += data[bothTaps.index1[n]] * bothTaps.gain1[n] + data[bothTaps.index2[n]] * bothTaps.gain2[n];
+        return output;
+    }
+
+    void updateWeights()
+    {
+        wowActive = wowIntensity > 0.0001f;
+        driftActive = driftIntensity > 0.0001f;
+        const float wowAmount = wowActive ? wowIntensity : 0.0f;
+        const float driftAmount = driftActive ? driftIntensity : 0.0f;
+        weights = { (1.0f - wowAmount) * (1.0f - driftAmount), wowAmount * (1.0f - driftAmount),
+                    (1.0f - wowAmount) * driftAmount, wowAmount * driftAmount };
+
+        // The stage is active while either part is
+        Modifier<SampleType>::setIntensity(juce::jmax(wowAmount, driftAmount));
     }
 
-    double sampleRate { 44100.0 };
     int channels { 2 };
-    ModulatedDelayLine delayLine;
-    float wowPhase { 0.0f };
-    float flutterPhase { 0.0f };
-    float wowPhaseStep { 0.0f };
-    float flutterPhaseStep { 0.0f };
-    float depthMs { 0.0f };
-    float baseDelayMs { 4.0f };
-    float currentDelaySamples { 0.0f };
+    juce::AudioBuffer<SampleType> buffer;
+    std::vector<float> wowDelayHistory;
+    int mask { 0 };
+    int writePos { 0 };
+    WowFlutterTrajectory wowFlutter;
+    PitchDriftTrajectory pitchDrift;
+    float wowBipolar { 0.0f };
+    float wowIntensity { 0.0f };
+    float driftBipolar { 0.0f };
+    float driftIntensity { 0.0f };
+    bool wowActive { false };
+    bool driftActive { false };
+    // Of the dry input and the wow, drift and combined paths
+    std::array<float, 4> weights { 1.0f, 0.0f, 0.0f, 0.0f };
+    std::array<float, kControlFrames> wowDelays {};
+    std::array<float, kControlFrames> driftDelays {};
+    std::array<float, kControlFrames> bothDelays {};
+    PathTaps wowTaps;
+    PathTaps driftTaps;
+    PathTaps bothTaps;
 };
 
-class PitchDriftModifier final : public Modifier
+/** Brief drops in level, as when tape lifts off the head.  A dropout starts
+    on any frame with a probability set by the intensity, so the frames
+    between onsets are geometrically distributed: rather than drawing for
+    every frame, the modifier draws the wait to the next onset from the
+    equivalent exponential distribution and skips the frames in between
+    untouched.  A new probability rescales the remaining wait, which the
+    distribution's lack of memory allows.  The gain eases in and out of each
+    dropout over kEdgeSeconds. */
+template <typename SampleType>
+class DropoutModifier final : public Modifier<SampleType>
 {
 public:
-    void prepare(double newSampleRate, int, int numChannels) override
+    using Modifier<SampleType>::intensity;
+    using Modifier<SampleType>::bipolar;
+    using Modifier<SampleType>::kControlFrames;
+
+    void prepare(double newSampleRate, int, int numChannels)
     {
         sampleRate = newSampleRate;
         channels = numChannels;
-        delayLine.prepare(sampleRate, 8.0f, numChannels);
         reset();
     }
 
-    void reset() override
+    void reset()
     {
-        delayLine.reset();
-        driftCurrentMs = 0.0f;
-        driftTargetMs = 0.0f;
-        driftStepMs = 0.0f;
-        driftSamplesRemaining = 0;
+        dropoutSamplesRemaining = 0;
+        onsetScheduled = false;
     }
 
-    float processSample(float input, int channel, RandomGenerator& random) override
+    void setIntensity(float newIntensity)
     {
-        if (intensity <= 0.0001f)
-            return input;
+        Modifier<SampleType>::setIntensity(newIntensity);
+        updateOnsetRate();
+    }
 
+    void setBipolar(float newValue)
+    {
+        Modifier<SampleType>::setBipolar(newValue);
+        updateOnsetRate();
+    }
+
+    /** Restarts the random draws from seed, including the wait to the next
+        onset. */
+    void setSeed(uint32_t seed)
+    {
+        Modifier<SampleType>::setSeed(seed);
+        onsetScheduled = false;
+    }
+
+    SampleType processSample(SampleType input, int channel)
+    {
         if (channel == 0)
+            currentGain = getNextGain();
+
+        return input * currentGain;
+    }
+
+    void processBlock(SampleType* const* channelData, int numChannels, int numSamples)
+    {
+        jassert(numChannels == channels);
+        for (int start = 0; start < numSamples;)
         {
-            if (driftSamplesRemaining <= 0)
+            if (dropoutSamplesRemaining == 0)
             {
-                const float depthMs = juce::jmap(intensity, 0.0f, 2.2f);
-                const float randomValue = std::abs(random.nextFloatSigned());
-                if (bipolar > 0.05f)
-                    driftTargetMs = randomValue * depthMs;
-                else if (bipolar < -0.05f)
-                    driftTargetMs = -randomValue * depthMs;
-                else
-                    driftTargetMs = random.nextFloatSigned() * depthMs;
-                const int rampSamples = juce::jmax(1, static_cast<int>(sampleRate * 0.6f));
-                driftStepMs = (driftTargetMs - driftCurrentMs) / static_cast<float>(rampSamples);
-                driftSamplesRemaining = rampSamples;
+                // Frames before the next onset keep a gain of exactly one
+                start += skipToOnset(numSamples - start);
+                if (start == numSamples)
+                    break;
+                startDropout();
             }
 
-            driftCurrentMs += driftStepMs;
-            --driftSamplesRemaining;
-            currentDelaySamples = (baseDelayMs + driftCurrentMs) * static_cast<float>(sampleRate) / 1000.0f;
+            const int count = juce::jmin(kControlFrames, numSamples - start, dropoutSamplesRemaining);
+            renderEnvelope(gains.data(), count);
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                SampleType* samples = channelData[channel] + start;
+                for (int i = 0; i < count; ++i)
+                    samples[i] = samples[i] * gains[static_cast<size_t>(i)];
+            }
+            start += count;
         }
+    }
 
-        float delayed = delayLine.readSample(channel, currentDelaySamples);
-        delayLine.writeSample(channel, input);
+private:
+    using Modifier<SampleType>::random;
 
-        if (channel == channels - 1)
-            delayLine.advance();
+    static constexpr float kEdgeSeconds = 0.002f;
+
+    /** The gain of the next frame: one before an onset, the envelope within
+        a dropout. */
+    float getNextGain()
+    {
+        if (dropoutSamplesRemaining == 0)
+        {
+            if (skipToOnset(1) == 1)
+                return 1.0f;
+            startDropout();
+        }
 
-        return input + (delayed - input) * intensity;
+        float gain = 1.0f;
+        renderEnvelope(&gain, 1);
+        return gain;
+    }
+
+    /** Moves up to maxFrames frames towards the next onset, drawing the wait
+        first if none is pending, and returns how many frames passed without
+        one.  The wait counts whole frames down exactly, so it reaches the
+        onset at the same frame however the frames are split into calls. */
+    int skipToOnset(int maxFrames)
+    {
+        if (!onsetScheduled)
+        {
+            // An exponential draw of mean one, scaled by the onset rate
+            const float uniform = juce::jmin(random.nextFloat01(), 0.99999994f);
+            waitFrames = -std::log1p(-static_cast<double>(uniform)) / onsetRate;
+            onsetScheduled = true;
+        }
+
+        const int frames = waitFrames >= static_cast<double>(maxFrames) ? maxFrames : static_cast<int>(waitFrames);
+        waitFrames -= static_cast<double>(frames);
+        return frames;
+    }
+
+    void startDropout()
+    {
+        dropoutSamplesTotal = juce::jmax(1, static_cast<int>(sampleRate * random.nextFloatRange(0.01f, 0.08f)));
+        dropoutSamplesRemaining = dropoutSamplesTotal;
+        edgeSamples = juce::jmax(1, juce::jmin(static_cast<int>(sampleRate * kEdgeSeconds), dropoutSamplesTotal / 2));
+        dropoutGain = juce::jmap(intensity, 1.0f, minGain);
+        onsetScheduled = false;
+    }
+
+    /** Writes the gains of the next count frames of the dropout, easing from
+        one to dropoutGain over the first edgeSamples frames and back over the
+        last, and moves the dropout on. */
+    void renderEnvelope(float* dest, int count)
+    {
+        const int first = dropoutSamplesTotal - dropoutSamplesRemaining;
+        const float edgeScale = 1.0f / static_cast<float>(edgeSamples);
+        const float depth = dropoutGain - 1.0f;
+        for (int i = 0; i < count; ++i)
+        {
+            const int frame = first + i;
+            const float edge = juce::jmin(1.0f, static_cast<float>(frame + 1) * edgeScale,
+                                          static_cast<float>(dropoutSamplesTotal - frame) * edgeScale);
+            dest[i] = 1.0f + depth * edge * edge * (3.0f - 2.0f * edge);
+        }
+        dropoutSamplesRemaining -= count;
+    }
+
+    /** Sets the per-frame onset probability and the depth from the intensity
+        and the sign of the bipolar value, and rescales a pending wait to the
+        new rate. */
+    void updateOnsetRate()
+    {
+        float probability = juce::jmap(intensity, 0.0f, 0.0006f);
+        minGain = 0.2f;
+        if (bipolar < 0.0f)
+        {
+            probability *= 1.4f;
+            minGain = 0.5f;
+        }
+        else if (bipolar > 0.0f)
+        {
+            probability *= 0.8f;
+        }
+
+        // The rate of the exponential wait whose whole frames are
+        // geometric with this probability
+        const double newRate = -std::log1p(-static_cast<double>(probability));
+        if (newRate == onsetRate)
+            return;
+
+        if (onsetScheduled && newRate > 0.0 && onsetRate > 0.0)
+            waitFrames *= onsetRate / newRate;
+        else
+            onsetScheduled = false;
+        onsetRate = newRate;
     }
 
-private:
     double sampleRate { 44100.0 };
     int channels { 2 };
-    ModulatedDelayLine delayLine;
-    float baseDelayMs { 3.0f };
-    float driftCurrentMs { 0.0f };
-    float driftTargetMs { 0.0f };
-    float driftStepMs { 0.0f };
-    int driftSamplesRemaining { 0 };
-    float currentDelaySamples { 0.0f };
+    double onsetRate { 0.0 };
+    double waitFrames { 0.0 };
+    bool onsetScheduled { false };
+    float minGain { 0.2f };
+    int dropoutSamplesTotal { 0 };
+    int dropoutSamplesRemaining { 0 };
+    int edgeSamples { 1 };
+    float dropoutGain { 1.0f };
+    float currentGain { 1.0f };
+    std::array<float, kControlFrames> gains {};
 };
 
-class DropoutModifier final : public Modifier
+/** Modifiers run in series in the order of Stages, each called through its
+    own type so every stage inlines into the chain.  Which stages are active
+    is kept in a bit mask, bit i for the i-th stage, and an inactive stage is
+    skipped for a whole block rather than tested per sample; the owner calls
+    updateActiveStages() after changing any stage's intensity. */
+template <typename SampleType, typename... Stages>
+class ModifierStages
 {
 public:
-    void prepare(double newSampleRate, int, int numChannels) override
+    static_assert(sizeof...(Stages) <= 32, "the active-stage mask has one bit per stage");
+
+    void prepare(double newSampleRate, int maxBlockSize, int numChannels)
     {
-        sampleRate = newSampleRate;
-        channels = numChannels;
-        reset();
+        std::apply([&](auto&... stage) { (stage.prepare(newSampleRate, maxBlockSize, numChannels), ...); }, stages);
     }
 
-    void reset() override
+    void reset()
     {
-        dropoutSamplesRemaining = 0;
-        dropoutGain = 1.0f;
+        std::apply([](auto&... stage) { (stage.reset(), ...); }, stages);
     }
 
-    float processSample(float input, int channel, RandomGenerator& random) override
+    template <typename Stage>
+    Stage& get() { return std::get<Stage>(stages); }
+
+    void updateActiveStages() { activeStages = getActiveMask(StageIndices {}); }
+
+    uint32_t getActiveStages() const { return activeStages; }
+
+    SampleType processSample(SampleType input, int channel)
     {
-        if (intensity <= 0.0001f)
+        if (activeStages == 0)
             return input;
 
-        if (channel == 0)
-        {
-            if (dropoutSamplesRemaining <= 0)
-            {
-                float probability = juce::jmap(intensity, 0.0f, 0.0006f);
-                float minGain = 0.2f;
-                if (bipolar < 0.0f)
-                {
-                    probability *= 1.4f;
-                    minGain = 0.5f;
-                }
-                else if (bipolar > 0.0f)
-                {
-                    probability *= 0.8f;
-                    minGain = 0.2f;
-                }
+        return processSample(input, channel, StageIndices {});
+    }
 
-                probability = juce::jlimit(0.0f, 1.0f, probability);
-                if (random.nextFloat01() < probability)
-                {
-                    dropoutSamplesRemaining = juce::jmax(1, static_cast<int>(sampleRate * random.nextFloatRange(0.01f, 0.08f)));
-                    dropoutGain = juce::jmap(intensity, 1.0f, minGain);
-                }
-            }
-        }
+    void processBlock(SampleType* const* channels, int numChannels, int numSamples)
+    {
+        if (activeStages != 0)
+            processBlock(channels, numChannels, numSamples, StageIndices {});
+    }
 
-        const bool applyDropout = dropoutSamplesRemaining > 0;
-        const float output = applyDropout ? input * dropoutGain : input;
+private:
+    using StageIndices = std::index_sequence_for<Stages...>;
 
-        if (channel == channels - 1 && dropoutSamplesRemaining > 0)
-            --dropoutSamplesRemaining;
+    template <size_t... Index>
+    uint32_t getActiveMask(std::index_sequence<Index...>) const
+    {
+        return ((std::get<Index>(stages).isActive() ? (1u << Index) : 0u) | ... | 0u);
+    }
 
-        return output;
+    template <size_t... Index>
+    SampleType processSample(SampleType input, int channel, std::index_sequence<Index...>)
+    {
+        ((input = (activeStages & (1u << Index)) != 0 ? std::get<Index>(stages).processSample(input, channel) : input),
+         ...);
+        return input;
     }
 
-private:
-    double sampleRate { 44100.0 };
-    int channels { 2 };
-    int dropoutSamplesRemaining { 0 };
-    float dropoutGain { 1.0f };
+    template <size_t... Index>
+    void processBlock(SampleType* const* channels, int numChannels, int numSamples, std::index_sequence<Index...>)
+    {
+        (((activeStages & (1u << Index)) != 0 ? std::get<Index>(stages).processBlock(channels, numChannels, numSamples)
+                                               : void()),
+         ...);
+    }
+
+    std::tuple<Stages...> stages;
+    uint32_t activeStages { 0 };
 };
 
+/** The modifiers in series: the tape transport (wow and flutter with pitch
+    drift), dropout, low-pass.  setCharacter() and setModValues() only
+    record the new values; the modifiers' coefficients (filter cutoffs, LFO
+    rates) and the set of active stages are recomputed by updateSettings(),
+    which the engine calls at its control rate rather than on every
+    parameter change. */
+template <typename SampleType>
 class ModifierChain
 {
 public:
     void prepare(double newSampleRate, int maxBlockSize, int numChannels)
     {
-        lowPass.prepare(newSampleRate, maxBlockSize, numChannels);
-        pitchDrift.prepare(newSampleRate, maxBlockSize, numChannels);
-        wowFlutter.prepare(newSampleRate, maxBlockSize, numChannels);
-        dropout.prepare(newSampleRate, maxBlockSize, numChannels);
+        stages.prepare(newSampleRate, maxBlockSize, numChannels);
+        applySettings();
     }
 
     void reset()
     {
-        lowPass.reset();
-        pitchDrift.reset();
-        wowFlutter.reset();
-        dropout.reset();
+        stages.reset();
+    }
+
+    /** Restarts the random draws of the modifiers that make them, each from
+        its own seed derived from seed. */
+    void setSeed(uint32_t seed)
+    {
+        stages.template get<DropoutModifier<SampleType>>().setSeed(RandomGenerator::combineSeed(seed, 1u));
+        stages.template get<TapeTransportModifier<SampleType>>().setSeed(RandomGenerator::combineSeed(seed, 2u));
     }
 
     void setCharacter(float newCharacter)
     {
         character = juce::jlimit(0.0f, 1.0f, newCharacter);
-        applySettings();
+        settingsChanged = true;
     }
 
     void setModValues(float newMod1, float newMod2, float newMod3)
@@ -391,40 +830,60 @@ public:
         mod1 = juce::jlimit(-1.0f, 1.0f, newMod1);
         mod2 = juce::jlimit(-1.0f, 1.0f, newMod2);
         mod3 = juce::jlimit(-1.0f, 1.0f, newMod3);
-        applySettings();
+        settingsChanged = true;
     }
 
-    float processSample(float input, int channel, RandomGenerator& random)
+    /** Recomputes the modifiers from the latest character and mod values, if
+        either changed since the last call. */
+    void updateSettings()
     {
-        float output = input;
-        output = wowFlutter.processSample(output, channel, random);
-        output = dropout.processSample(output, channel, random);
-        output = lowPass.processSample(output, channel, random);
-        output = pitchDrift.processSample(output, channel, random);
-        return output;
+        if (settingsChanged)
+            applySettings();
+    }
+
+    /** The active-stage mask, bit i set when the i-th modifier in the order
+        above is active. */
+    uint32_t getActiveStages() const { return stages.getActiveStages(); }
+
+    SampleType processSample(SampleType input, int channel)
+    {
+        return stages.processSample(input, channel);
+    }
+
+    /** Runs the chain over numSamples frames in place, one modifier at a
+        time, with the same result as processSample() frame by frame. */
+    void processBlock(SampleType* const* channels, int numChannels, int numSamples)
+    {
+        stages.processBlock(channels, numChannels, numSamples);
     }
 
 private:
+    using Stages = ModifierStages<SampleType, TapeTransportModifier<SampleType>, DropoutModifier<SampleType>,
+                                  LowPassModifier<SampleType>>;
+
     void applySettings()
     {
+        settingsChanged = false;
         const float characterBoost = character * 0.35f;
         const float sign1 = (mod1 >= 0.0f) ? 1.0f : -1.0f;
         const float sign2 = (mod2 >= 0.0f) ? 1.0f : -1.0f;
         const float sign3 = (mod3 >= 0.0f) ? 1.0f : -1.0f;
         const float driftBoost = character * 0.15f;
 
-        wowFlutter.setBipolar(juce::jlimit(-1.0f, 1.0f, mod1 + sign1 * characterBoost));
-        dropout.setBipolar(juce::jlimit(-1.0f, 1.0f, mod2 + sign2 * characterBoost));
-        lowPass.setBipolar(juce::jlimit(-1.0f, 1.0f, mod3 + sign3 * characterBoost));
-        pitchDrift.setBipolar(juce::jlimit(-1.0f, 1.0f, mod1 * 0.3f + sign1 * driftBoost));
+        auto& transport = stages.template get<TapeTransportModifier<SampleType>>();
+        transport.setWowFlutter(juce::jlimit(-1.0f, 1.0f, mod1 + sign1 * characterBoost));
+        transport.setPitchDrift(juce::jlimit(-1.0f, 1.0f, mod1 * 0.3f + sign1 * driftBoost));
+        stages.template get<DropoutModifier<SampleType>>().setBipolar(
+            juce::jlimit(-1.0f, 1.0f, mod2 + sign2 * characterBoost));
+        stages.template get<LowPassModifier<SampleType>>().setBipolar(
+            juce::jlimit(-1.0f, 1.0f, mod3 + sign3 * characterBoost));
+        stages.updateActiveStages();
     }
 
-    LowPassModifier lowPass;
-    PitchDriftModifier pitchDrift;
-    WowFlutterModifier wowFlutter;
-    DropoutModifier dropout;
+    Stages stages;
     float mod1 { 0.0f };
     float mod2 { 0.0f };
     float mod3 { 0.0f };
     float character { 0.0f };
+    bool settingsChanged { false };
 };
@@ -0,0 +1,327 @@
+// PageArena.h
+//
+// A process-wide pool for memory-buffer pages, shared by every plug-in
+// instance.  Pages are carved out of 2 MB slabs, backed by huge pages where
+// the system offers them, and recycled between instances, so instances that
+// come and go reuse the same slabs instead of fragmenting the heap with
+// hundreds of page-sized allocations each.  Empty slabs are kept for reuse up
+// to a budget (see setMaxRetainedBytes()) and returned to the system beyond it.
+// The arena takes a lock and may map memory, so it is only used off the audio
+// thread (MemoryBuffer calls it from prepare() and servicePages()).
+
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#if JUCE_LINUX || JUCE_MAC
+ #include <sys/mman.h>
+#elif JUCE_WINDOWS
+ #include <windows.h>
+#endif
+
+class PageArena
+{
+public:
+    static constexpr size_t kSlabBytes = size_t { 2 } << 20;
+    static constexpr size_t kSystemPageBytes = 4096;
+    // About two eager 180 s buffers at 48 kHz
+    static constexpr size_t kDefaultMaxRetainedBytes = size_t { 128 } << 20;
+
+    struct Statistics
+    {
+        size_t pagesInUse { 0 };
+        size_t peakPagesInUse { 0 };
+        size_t bytesInUse { 0 };
+        size_t bytesReserved { 0 };
+        size_t slabs { 0 };
+        size_t emptySlabs { 0 };
+        size_t hugePageSlabs { 0 };  // mapped with, or advised to use, huge pages
+        size_t failedAcquires { 0 };  // acquire() calls the system had no memory for
+        // Share of the reserved bytes not holding a live page: free pages in
+        // partly used slabs, empty slabs kept for reuse and slab tails too
+        // short for a page.
+        double fragmentation { 0.0 };
+    };
+
+    /** Returns a page to the arena; the deleter of Page. */
+    struct Release
+    {
+        size_t bytes { 0 };
+        void operator()(unsigned char* page) const { getInstance().release(page, bytes); }
+    };
+
+    using Page = std::unique_ptr<unsigned char[], Release>;
+
+    /** The arena every MemoryBuffer draws from.  It is never destroyed, so
+        buffers in static storage may release their pages at exit. */
+    static PageArena& getInstance()
+    {
+        static PageArena* const instance = new PageArena();
+        return *instance;
+    }
+
+    /** Sets how many bytes of empty slabs are kept for reuse rather than
+        returned to the system, and returns any beyond it now. */
+    void setMaxRetainedBytes(size_t bytes)
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        maxRetainedBytes = bytes;
+        for (auto& sizeClass : sizeClasses)
+            for (size_t index = sizeClass.slabs.size(); index-- > 0;)
+                if (sizeClass.slabs[index]->live == 0 && emptySlabs * kSlabBytes > maxRetainedBytes)
+                {
+                    destroySlab(sizeClass, slabsByAddress.find(sizeClass.slabs[index]->base));
+                    --emptySlabs;
+                }
+    }
+
+    /** Returns a zeroed page of pageBytes (at most kSlabBytes), or a null
+        page if the system is out of memory; failures are counted in
+        Statistics::failedAcquires.  Never throws, so it is safe on the memory
+        thread, but never call it from the audio thread. */
+    Page acquire(size_t pageBytes)
+    {
+        jassert(pageBytes > 0 && pageBytes <= kSlabBytes);
+        const std::lock_guard<std::mutex> lock(mutex);
+        auto& sizeClass = getSizeClass(pageBytes);
+
+        Slab* slab = nullptr;
+        for (auto* candidate : sizeClass.slabs)
+            if (candidate->hasRoom())
+            {
+                slab = candidate;
+                break;
+            }
+
+        if (slab == nullptr)
+        {
+            slab = createSlab(sizeClass);
+            if (slab == nullptr)
+            {
+                ++failedAcquires;
+                return Page(nullptr, Release { pageBytes });
+            }
+        }
+        else if (slab->live == 0)
+            --emptySlabs;
+
+        unsigned char* page = nullptr;
+        if (!slab->freePages.empty())
+        {
+            page = slab->base + static_cast<size_t>(slab->freePages.back()) * pageBytes;
+            slab->freePages.pop_back();
+            std::memset(page, 0, pageBytes);
+        }
+        else
+        {
+            // Never handed out before, so still zero from the system
+            page = slab->base + static_cast<size_t>(slab->untouched++) * pageBytes;
+        }
+
+        ++slab->live;
+        ++pagesInUse;
+        bytesInUse += pageBytes;
+        peakPagesInUse = std::max(peakPagesInUse, pagesInUse);
+        return Page(page, Release { pageBytes });
+    }
+
+    Statistics getStatistics() const
+    {
+        const std::lock_guard<std::mutex> lock(mutex);
+        Statistics statistics;
+        statistics.pagesInUse = pagesInUse;
+        statistics.peakPagesInUse = peakPagesInUse;
+        statistics.bytesInUse = bytesInUse;
+        statistics.slabs = slabsByAddress.size();
+        statistics.emptySlabs = emptySlabs;
+        statistics.failedAcquires = failedAcquires;
+        statistics.bytesReserved = statistics.slabs * kSlabBytes;
+        for (const auto& entry : slabsByAddress)
+            if (entry.second->hugePages)
+                ++statistics.hugePageSlabs;
+
+        if (statistics.bytesReserved > 0)
+            statistics.fragmentation = 1.0 - static_cast<double>(bytesInUse)
+                                                 / static_cast<double>(statistics.bytesReserved);
+        return statistics;
+    }
+
+private:
+    struct Slab
+    {
+        unsigned char* base { nullptr };
+        int capacity { 0 };
+        int untouched { 0 };  // pages from here on have never been handed out
+        int live { 0 };
+        bool hugePages { false };
+        std::vector<int> freePages;
+
+        bool hasRoom() const { return untouched < capacity || !freePages.empty(); }
+    };
+
+    struct SizeClass
+    {
+        size_t pageBytes { 0 };
+        // Lowest address first: pages are taken from the earliest slab with
+        // room, so later slabs drain and can be returned.
+        std::vector<Slab*> slabs;
+    };
+
+    PageArena() = default;
+
+    void release(unsigned char* page, size_t pageBytes)
+    {
+        if (page == nullptr)
+            return;
+
+        const std::lock_guard<std::mutex> lock(mutex);
+        auto found = slabsByAddress.upper_bound(page);
+        jassert(found != slabsByAddress.begin());
+        --found;
+        Slab& slab = *found->second;
+        jassert(page < slab.base + kSlabBytes);
+
+        slab.freePages.push_back(static_cast<int>(static_cast<size_t>(page - slab.base) / pageBytes));
+        --slab.live;
+        --pagesInUse;
+        bytesInUse -= pageBytes;
+
+        if (slab.live == 0)
+        {
+            if ((emptySlabs + 1) * kSlabBytes <= maxRetainedBytes)
+                ++emptySlabs;
+            else
+                destroySlab(getSizeClass(pageBytes), found);
+        }
+    }
+
+    SizeClass& getSizeClass(size_t pageBytes)
+    {
+        for (auto& sizeClass : sizeClasses)
+            if (sizeClass.pageBytes == pageBytes)
+                return sizeClass;
+
+        sizeClasses.push_back({ pageBytes, {} });
+        return sizeClasses.back();
+    }
+
+    /** Maps a new slab for sizeClass, or returns nullptr if the system is
+        out of memory. */
+    Slab* createSlab(SizeClass& sizeClass)
+    {
+        std::unique_ptr<Slab> slab(new (std::nothrow) Slab());
+        if (slab == nullptr)
+            return nullptr;
+
+        slab->base = mapSlab(slab->hugePages);
+        if (slab->base == nullptr)
+            return nullptr;
+
+        // Touch every page now, so the audio thread never takes the fault on
+        // its first write
+        for (size_t offset = 0; offset < kSlabBytes; offset += kSystemPageBytes)
+            slab->base[offset] = 0;
+
+        slab->capacity = static_cast<int>(kSlabBytes / sizeClass.pageBytes);
+        slab->freePages.reserve(static_cast<size_t>(slab->capacity));
+
+        Slab* created = slab.get();
+        slabsByAddress.emplace(created->base, std::move(slab));
+        sizeClass.slabs.insert(std::upper_bound(sizeClass.slabs.begin(), sizeClass.slabs.end(), created,
+                                                [](const Slab* a, const Slab* b) { return a->base < b->base; }),
+                               created);
+        return created;
+    }
+
+    void destroySlab(SizeClass& sizeClass, std::map<unsigned char*, std::unique_ptr<Slab>>::iterator found)
+    {
+        Slab* slab = found->second.get();
+        sizeClass.slabs.erase(std::find(sizeClass.slabs.begin(), sizeClass.slabs.end(), slab));
+        unmapSlab(slab->base);
+        slabsByAddress.erase(found);
+    }
+
+    /** Maps a zeroed slab, with huge pages if the system grants them. */
+    static unsigned char* mapSlab(bool& hugePages)
+    {
+        hugePages = false;
+       #if JUCE_LINUX
+        void* memory = mmap(nullptr, kSlabBytes, PROT_READ | PROT_WRITE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED)
+        {
+            hugePages = true;
+            return static_cast<unsigned char*>(memory);
+        }
+
+        // No reserved huge pages: ask for transparent ones instead.  They can
+        // only back a 2 MB-aligned range, so map a slab too many and trim
+        // the slack on either side of the aligned one.
+        memory = mmap(nullptr, 2 * kSlabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return nullptr;
+
+        auto* mapped = static_cast<unsigned char*>(memory);
+        const auto address = reinterpret_cast<std::uintptr_t>(mapped);
+        const size_t lead = (kSlabBytes - address % kSlabBytes) % kSlabBytes;
+        if (lead > 0)
+            munmap(mapped, lead);
+        munmap(mapped + lead + kSlabBytes, kSlabBytes - lead);
+
+        unsigned char* base = mapped + lead;
+        hugePages = madvise(base, kSlabBytes, MADV_HUGEPAGE) == 0;
+        return base;
+       #elif JUCE_MAC
+        void* memory = mmap(nullptr, kSlabBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANON, -1, 0);
+        return memory != MAP_FAILED ? static_cast<unsigned char*>(memory) : nullptr;
+       #elif JUCE_WINDOWS
+        // Large pages need the lock-pages privilege, which most users lack
+        const SIZE_T largePage = GetLargePageMinimum();
+        if (largePage != 0 && kSlabBytes % largePage == 0)
+        {
+            if (void* memory = VirtualAlloc(nullptr, kSlabBytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES,
+                                            PAGE_READWRITE))
+            {
+                hugePages = true;
+                return static_cast<unsigned char*>(memory);
+            }
+        }
+
+        return static_cast<unsigned char*>(VirtualAlloc(nullptr, kSlabBytes, MEM_RESERVE | MEM_COMMIT,
+                                                        PAGE_READWRITE));
+       #else
+        return new (std::nothrow) unsigned char[kSlabBytes]();
+       #endif
+    }
+
+    static void unmapSlab(unsigned char* base)
+    {
+       #if JUCE_LINUX || JUCE_MAC
+        munmap(base, kSlabBytes);
+       #elif JUCE_WINDOWS
+        VirtualFree(base, 0, MEM_RELEASE);
+       #else
+        delete[] base;
+       #endif
+    }
+
+    mutable std::mutex mutex;
+    std::vector<SizeClass> sizeClasses;
+    std::map<unsigned char*, std::unique_ptr<Slab>> slabsByAddress;
+    size_t pagesInUse { 0 };
+    size_t peakPagesInUse { 0 };
+    size_t bytesInUse { 0 };
+    size_t emptySlabs { 0 };  // handed out pages before, none live now
+    size_t failedAcquires { 0 };
+    size_t maxRetainedBytes { kDefaultMaxRetainedBytes };
+
+    JUCE_DECLARE_NON_COPYABLE(PageArena)
+};
@@ -8,6 +8,7 @@
 
 #include <JuceHeader.h>
 #include "MemoryBuffer.h"
+#include <algorithm>
 
 /**
     A read head that returns samples from a MemoryBuffer.  The head
@@ -15,16 +16,20 @@
     delay (reading the most recently recorded sample) and 1 means the
     maximum delay (furthest point in the buffer).  An additional
     spread parameter allows offsetting the head relative to another
-    head.
+    head.  StorageType matches the MemoryBuffer it reads.
 */
+template <typename StorageType = float>
 class Playhead
 {
 public:
+    using Memory = MemoryBuffer<StorageType>;
+    using Phase = MemoryBufferTypes::Phase;
+
     Playhead() = default;
     ~Playhead() = default;
 
     /** Assigns the memory buffer to read from. */
-    void setMemoryBuffer(const MemoryBuffer* mem) { memory = mem; }
+    void setMemoryBuffer(const Memory* mem) { memory = mem; }
 
     /** Sets the current offset parameter (0..1). */
     void setOffsetNormalized(float newOffset) { offsetNormalized = juce::jlimit(0.0f, 1.0f, newOffset); }
@@ -39,41 +44,108 @@ public:
     void setMaxDelaySeconds(float seconds) { maxDelaySeconds = seconds; }
 
     /** Reads a single sample from the buffer for the given channel. */
-    float readSample(int channel, double sampleRate) const
+    StorageType readSample(int channel, double sampleRate) const
+    {
+        return readSample(channel, sampleRate, maxDelaySeconds, spreadSeconds);
+    }
+
+    StorageType readSample(int channel, double sampleRate, float maxDelaySecondsOverride,
+                           float spreadSecondsOverride) const
     {
         if (memory == nullptr)
-            return 0.0f;
-        // compute delay in samples = base offset * maxDelay + spread
-        float totalDelaySeconds = offsetNormalized * maxDelaySeconds + spreadSeconds;
-        if (totalDelaySeconds < 0.0f)
-            totalDelaySeconds = 0.0f;
-        float delaySamples = totalDelaySeconds * static_cast<float>(sampleRate);
-        // clamp to buffer length
-        float maxSamples = static_cast<float>(memory->getBufferSize());
-        if (delaySamples > maxSamples - 1.0f)
-            delaySamples = maxSamples - 1.0f;
-        return memory->read(channel, delaySamples);
+            return StorageType {};
+
+        return memory->readPhase(channel, computeDelay(offsetNormalized, sampleRate, maxDelaySecondsOverride,
+                                                       spreadSecondsOverride));
+    }
+
+    /** Returns the read delay for a normalized offset as a 32.32 fixed-point
+        phase: base offset * max delay + spread, converted to samples in double
+        precision and clamped to the buffer.  Every read path goes through here,
+        so block and per-sample reads agree exactly. */
+    Phase computeDelay(float offset, double sampleRate, float maxDelaySecondsOverride,
+                                     float spreadSecondsOverride) const
+    {
+        const double totalDelaySeconds = static_cast<double>(juce::jlimit(0.0f, 1.0f, offset))
+                                             * static_cast<double>(maxDelaySecondsOverride)
+                                         + static_cast<double>(spreadSecondsOverride);
+        const auto delay = SimdInterpolator::toPhase(totalDelaySeconds * sampleRate);
+        return (memory != nullptr) ? memory->clampPhase(delay) : 0;
+    }
+
+    /** Fills delays with the read delay for each normalized offset.  Runs of
+        equal offsets (a manual or latched scan) reuse the previous result, so a
+        steady head costs one conversion per segment; the write head's advance is
+        applied by the block read itself. */
+    void computeDelays(const float* offsets, int numSamples, double sampleRate, float maxDelaySecondsOverride,
+                       float spreadSecondsOverride, Phase* delays) const
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (i > 0 && offsets[i] == offsets[i - 1])
+                delays[i] = delays[i - 1];
+            else
+                delays[i] = computeDelay(offsets[i], sampleRate, maxDelaySecondsOverride, spreadSecondsOverride);
+        }
+    }
+
+    /** As above with a per-sample maximum delay (a gliding size); the spread is
+        spreadRatio times each sample's size. */
+    void computeDelays(const float* offsets, const float* maxDelaySeconds, int numSamples, double sampleRate,
+                       float spreadRatio, Phase* delays) const
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (i > 0 && offsets[i] == offsets[i - 1] && maxDelaySeconds[i] == maxDelaySeconds[i - 1])
+                delays[i] = delays[i - 1];
+            else
+                delays[i] = computeDelay(offsets[i], sampleRate, maxDelaySeconds[i], spreadRatio * maxDelaySeconds[i]);
+        }
+    }
+
+    /** As above with a per-sample spread ratio too, for a spread that is ramping. */
+    void computeDelays(const float* offsets, const float* maxDelaySeconds, const float* spreadRatios, int numSamples,
+                       double sampleRate, Phase* delays) const
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            if (i > 0 && offsets[i] == offsets[i - 1] && maxDelaySeconds[i] == maxDelaySeconds[i - 1]
+                && spreadRatios[i] == spreadRatios[i - 1])
+                delays[i] = delays[i - 1];
+            else
+                delays[i] = computeDelay(offsets[i], sampleRate, maxDelaySeconds[i], spreadRatios[i] * maxDelaySeconds[i]);
+        }
     }
 
-    float readSample(int channel, double sampleRate, float maxDelaySecondsOverride, float spreadSecondsOverride) const
+    /** Reads a block for one channel at per-sample delays from computeDelays(). */
+    void readBlock(int channel, const Phase* delays, StorageType* dest, int numSamples,
+                   bool writeAdvancing) const
     {
         if (memory == nullptr)
-            return 0.0f;
+        {
+            std::fill(dest, dest + numSamples, StorageType {});
+            return;
+        }
 
-        float totalDelaySeconds = offsetNormalized * maxDelaySecondsOverride + spreadSecondsOverride;
-        if (totalDelaySeconds < 0.0f)
-            totalDelaySeconds = 0.0f;
+        memory->readBlock(channel, delays, dest, numSamples, writeAdvancing);
+    }
 
-        float delaySamples = totalDelaySeconds * static_cast<float>(sampleRate);
-        const float maxSamples = static_cast<float>(memory->getBufferSize());
-        if (delaySamples > maxSamples - 1.0f)
-            delaySamples = maxSamples - 1.0f;
+    /** Reads a block for one channel at the current offset and spread; the block
+        form of readSample(). */
+    void readBlock(int channel, double sampleRate, StorageType* dest, int numSamples, bool writeAdvancing) const
+    {
+        if (memory == nullptr)
+        {
+            std::fill(dest, dest + numSamples, StorageType {});
+            return;
+        }
 
-        return memory->read(channel, delaySamples);
+        const auto delay = computeDelay(offsetNormalized, sampleRate, maxDelaySeconds, spreadSeconds);
+        memory->readBlock(channel, delay, 0, dest, numSamples, writeAdvancing);
     }
 
 private:
-    const MemoryBuffer* memory { nullptr };
+    const Memory* memory { nullptr };
     float offsetNormalized { 0.0f };
     float spreadSeconds { 0.0f };
     float maxDelaySeconds { 1.0f };
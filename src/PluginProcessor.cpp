@@ -1,11 +1,19 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include <array>
+#include <cmath>
 #include <memory>
 #include <vector>
 #include "MemoryDelayEngine.h"
 
 namespace {
 constexpr float kBufferSeconds = 180.0f;
+// Longest stretch the engine renders at once.
+constexpr int kMaxSubBlockSamples = 128;
+// How often the memory thread allocates pages ahead of the write head.
+constexpr int kMemoryServiceIntervalMs = 20;
+// State tree property recording whether the memory is saved with the state.
+const juce::Identifier kSaveMemoryProperty { "saveMemory" };
 // Free function to create the parameter layout.  This uses
 // std::make_unique to create AudioParameter instances, which is the
 // recommended pattern for JUCE 6+.  See JUCE forum discussion on
@@ -34,11 +42,20 @@ StereoMemoryDelayAudioProcessor::StereoMemoryDelayAudioProcessor()
     ),
     parameters (*this, nullptr, juce::Identifier("PARAMS"), createParameterLayout())
 {
-    // create DSP engine
-    engine = std::make_unique<MemoryDelayEngine>();
+    // Memory pages follow the write head and the configured size instead of
+    // holding the whole buffer resident
+    engine.setLazyMemoryAllocation(true);
+    engine.setConfigure([this](MemoryDelayEngine<float>& target) { configureEngine(target); });
+    doubleEngine.setLazyMemoryAllocation(true);
+    doubleEngine.setConfigure([this](MemoryDelayEngine<double, float>& target) { configureEngine(target); });
+    memoryThread.startThread();
 }
 
-StereoMemoryDelayAudioProcessor::~StereoMemoryDelayAudioProcessor() {}
+StereoMemoryDelayAudioProcessor::~StereoMemoryDelayAudioProcessor()
+{
+    memoryThread.removeTimeSliceClient(this);
+    memoryThread.stopThread(1000);
+}
 
 const juce::String StereoMemoryDelayAudioProcessor::getName() const { return JucePlugin_Name; }
 
@@ -59,19 +76,81 @@ void StereoMemoryDelayAudioProcessor::changeProgramName (int, const juce::String
 
 void StereoMemoryDelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
 {
-    // Allocate DSP engine and prepare resources
-    engine->prepare(sampleRate, samplesPerBlock, kBufferSeconds);
+    // Engines are only swapped while the memory thread is not servicing them
+    // and no other thread is using one
+    memoryThread.removeTimeSliceClient(this);
+    const juce::ScopedLock lock(engineLock);
+
+    // Keep the engine for the host's precision, and its memory, if the sample
+    // rate is unchanged; otherwise the memory thread builds a new one and
+    // resamples the memory into it (offline renders do both here so no block
+    // is missed).  The other precision's memory is dropped.
+    const bool buildNow = isNonRealtime();
+    if (isUsingDoublePrecision())
+    {
+        doubleEngine.prepare(sampleRate, samplesPerBlock, kBufferSeconds, buildNow);
+        engine.release();
+    }
+    else
+    {
+        engine.prepare(sampleRate, samplesPerBlock, kBufferSeconds, buildNow);
+        doubleEngine.release();
+    }
+
+    automation.prepare(AutomationSplitter::kDefaultMaxEvents);
+    automation.setMaxSubBlockSize(kMaxSubBlockSamples);
+    memoryThread.addTimeSliceClient(this);
+}
+
+int StereoMemoryDelayAudioProcessor::useTimeSlice()
+{
+    engine.service();
+    doubleEngine.service();
+
+    // Restores loaded memory once an engine is running; it is written back a
+    // few pages per service() from here on
+    const juce::ScopedLock lock(snapshotLock);
+    if (pendingSnapshot != nullptr)
+    {
+        if (auto* target = engine.get())
+            target->restoreMemorySnapshot(std::move(pendingSnapshot));
+        else if (auto* doubleTarget = doubleEngine.get())
+            doubleTarget->restoreMemorySnapshot(std::move(pendingSnapshot));
+    }
+    return kMemoryServiceIntervalMs;
+}
+
+template <typename Engine>
+void StereoMemoryDelayAudioProcessor::configureEngine (Engine& target)
+{
     // Set initial parameter values
-    engine->setMix(*parameters.getRawParameterValue("mix"));
-    engine->setTapeMode(true);
-    engine->setTapeWindowSeconds(*parameters.getRawParameterValue("time"));
+    target.setMix(*parameters.getRawParameterValue("mix"));
+    target.setTapeMode(true);
+    target.setTapeWindowSeconds(*parameters.getRawParameterValue("time"));
+    // Completed pages are compressed ahead of getStateInformation()
+    target.setMemorySnapshotCaching(saveMemoryWithState.load());
 }
 
 void StereoMemoryDelayAudioProcessor::releaseResources()
 {
-    // Release resources
-    engine.reset();
-    engine = std::make_unique<MemoryDelayEngine>();
+    // The engines and their memory are kept for the next prepareToPlay()
+    memoryThread.removeTimeSliceClient(this);
+    const juce::ScopedLock lock(engineLock);
+}
+
+void StereoMemoryDelayAudioProcessor::reset()
+{
+    // Clearing the memory is constant time, so hosts may call this from the
+    // audio thread
+    if (isUsingDoublePrecision())
+    {
+        if (auto* target = doubleEngine.get())
+            target->reset();
+    }
+    else if (auto* target = engine.get())
+    {
+        target->reset();
+    }
 }
 
 bool StereoMemoryDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) const
@@ -91,8 +170,28 @@ bool StereoMemoryDelayAudioProcessor::isBusesLayoutSupported (const BusesLayout&
 
 void StereoMemoryDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, juce::MidiBuffer& midiMessages)
 {
-    juce::ScopedNoDenormals noDenormals;
     juce::ignoreUnused(midiMessages);
+    // Silent until the engine for a new sample rate is built: the input
+    // alone would ignore mix
+    if (auto* target = engine.acquire())
+        renderBlock(buffer, *target);
+    else
+        buffer.clear();
+}
+
+void StereoMemoryDelayAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, juce::MidiBuffer& midiMessages)
+{
+    juce::ignoreUnused(midiMessages);
+    if (auto* target = doubleEngine.acquire())
+        renderBlock(buffer, *target);
+    else
+        buffer.clear();
+}
+
+template <typename SampleType, typename Engine>
+void StereoMemoryDelayAudioProcessor::renderBlock (juce::AudioBuffer<SampleType>& buffer, Engine& target)
+{
+    juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
     auto totalNumOutputChannels = getTotalNumOutputChannels();
 
@@ -100,13 +199,16 @@ void StereoMemoryDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& bu
     for (auto i = totalNumInputChannels; i < totalNumOutputChannels; ++i)
         buffer.clear (i, 0, buffer.getNumSamples());
 
-    // Update engine parameters from APVTS
-    engine->setMix(*parameters.getRawParameterValue("mix"));
-    engine->setTapeWindowSeconds(*parameters.getRawParameterValue("time"));
+    // Queue engine parameters from APVTS.  The value tree holds one value per
+    // host block and JUCE gives no offsets for changes within it, so these
+    // apply at the block's start and automation follows the host buffer size;
+    // the splitter only bounds the sub-blocks the engine renders.
+    automation.addParameterChange(0, AutomationSplitter::Parameter::Mix, *parameters.getRawParameterValue("mix"));
+    automation.addParameterChange(0, AutomationSplitter::Parameter::TapeWindow, *parameters.getRawParameterValue("time"));
     bool hostBypassed = false;
     if (auto* bypassParam = getBypassParameter())
         hostBypassed = bypassParam->getValue() > 0.5f;
-    engine->setBypassed(hostBypassed);
+    automation.addParameterChange(0, AutomationSplitter::Parameter::Bypass, hostBypassed ? 1.0f : 0.0f);
 
     int64_t transportSamples = -1;
     bool isPlaying = false;
@@ -133,9 +235,9 @@ void StereoMemoryDelayAudioProcessor::processBlock (juce::AudioBuffer<float>& bu
             }
         }
     }
-    engine->setTransportPosition(transportSamples, isPlaying);
+    automation.setBlockTransport(transportSamples, isPlaying);
     // Process audio
-    engine->processBlock(buffer);
+    automation.process(target, buffer);
 }
 
 bool StereoMemoryDelayAudioProcessor::hasEditor() const { return true; }
@@ -151,23 +253,141 @@ juce::AudioProcessorEditor* StereoMemoryDelayAudioProcessor::createEditor()
 
 void StereoMemoryDelayAudioProcessor::getStateInformation (juce::MemoryBlock& destData)
 {
-    // TODO: store state using parameters
+    // The parameters, then optionally the memory as a MemorySnapshot chunk.
+    // Builds that predate the chunk read the parameters and ignore the rest.
     juce::MemoryOutputStream stream(destData, true);
-    parameters.state.writeToStream(stream);
+    auto state = parameters.copyState();
+    state.setProperty(kSaveMemoryProperty, saveMemoryWithState.load(), nullptr);
+    state.writeToStream(stream);
+
+    if (!saveMemoryWithState.load())
+        return;
+
+    // Memory still waiting to be restored is saved as it was loaded
+    std::shared_ptr<const MemorySnapshot> snapshot;
+    {
+        const juce::ScopedLock lock(snapshotLock);
+        snapshot = pendingSnapshot;
+    }
+    if (snapshot == nullptr)
+    {
+        // Hosts may save from any thread, so the engine is held against prepareToPlay()
+        const juce::ScopedLock lock(engineLock);
+        if (auto* target = engine.get())
+            snapshot = target->captureMemorySnapshot();
+        else if (auto* doubleTarget = doubleEngine.get())
+            snapshot = doubleTarget->captureMemorySnapshot();
+    }
+
+    if (snapshot != nullptr)
+    {
+        std::vector<unsigned char> chunk;
+        snapshot->serialise(chunk);
+        stream.write(chunk.data(), chunk.size());
+    }
 }
 
 void StereoMemoryDelayAudioProcessor::setStateInformation (const void* data, int sizeInBytes)
 {
-    // TODO: restore state using parameters
-    juce::ValueTree tree = juce::ValueTree::readFromData(data, sizeInBytes);
-    if (tree.isValid())
-        parameters.state = tree;
+    juce::MemoryInputStream stream(data, static_cast<size_t>(sizeInBytes), false);
+    juce::ValueTree tree = juce::ValueTree::readFromStream(stream);
+    if (!tree.isValid())
+        return;
+
+    setMemorySavedWithState(tree.getProperty(kSaveMemoryProperty, true));
+    tree.removeProperty(kSaveMemoryProperty, nullptr);
+    parameters.replaceState(tree);
+
+    // Only checked here; the memory thread decodes it into the engine
+    const auto position = static_cast<size_t>(stream.getPosition());
+    auto snapshot = MemorySnapshot::deserialise(static_cast<const unsigned char*>(data) + position,
+                                                static_cast<size_t>(sizeInBytes) - position);
+    const juce::ScopedLock lock(snapshotLock);
+    pendingSnapshot = std::move(snapshot);
+}
+
+void StereoMemoryDelayAudioProcessor::setMemorySavedWithState (bool shouldSave)
+{
+    saveMemoryWithState.store(shouldSave);
+    const juce::ScopedLock lock(engineLock);
+    if (auto* target = engine.get())
+        target->setMemorySnapshotCaching(shouldSave);
+    if (auto* doubleTarget = doubleEngine.get())
+        doubleTarget->setMemorySnapshotCaching(shouldSave);
+}
+
+bool StereoMemoryDelayAudioProcessor::exportMemory (const juce::File& file, bool withPlayheadMarkers)
+{
+    std::shared_ptr<const MemorySnapshot> snapshot;
+    std::array<double, 2> delays {};
+    {
+        const juce::ScopedLock lock(engineLock);
+        if (auto* target = engine.get())
+        {
+            delays = target->getPlayheadSnapshotDelays();
+            snapshot = target->captureMemorySnapshot();
+        }
+        else if (auto* doubleTarget = doubleEngine.get())
+        {
+            delays = doubleTarget->getPlayheadSnapshotDelays();
+            snapshot = doubleTarget->captureMemorySnapshot();
+        }
+    }
+    if (snapshot == nullptr)
+        return false;
+
+    std::vector<MemoryExporter::Marker> markers;
+    if (withPlayheadMarkers)
+    {
+        const auto end = static_cast<std::int64_t>(snapshot->numFrames);
+        markers.push_back({ "Playhead A", end - static_cast<std::int64_t>(std::llround(delays[0])) });
+        markers.push_back({ "Playhead B", end - static_cast<std::int64_t>(std::llround(delays[1])) });
+    }
+    return exporter.start(std::move(snapshot), file, markers);
+}
+
+bool StereoMemoryDelayAudioProcessor::importMemory (const juce::File& file)
+{
+    std::shared_ptr<MemoryFeed> feed;
+    const juce::ScopedLock lock(engineLock);
+    if (auto* target = engine.get())
+    {
+        feed = importer.start(file, target->getSampleRate(), target->getMaxSamples());
+        if (feed != nullptr)
+            target->feedMemory(feed);
+    }
+    else if (auto* doubleTarget = doubleEngine.get())
+    {
+        feed = importer.start(file, doubleTarget->getSampleRate(), doubleTarget->getMaxSamples());
+        if (feed != nullptr)
+            doubleTarget->feedMemory(feed);
+    }
+    return feed != nullptr;
+}
+
+void StereoMemoryDelayAudioProcessor::getVisualSnapshot(MemoryDelayEngineTypes::VisualSnapshot& snapshot) const
+{
+    const juce::ScopedLock lock(engineLock);
+    if (isUsingDoublePrecision())
+    {
+        if (auto* target = doubleEngine.get())
+            target->getVisualSnapshot(snapshot);
+    }
+    else if (auto* target = engine.get())
+    {
+        target->getVisualSnapshot(snapshot);
+    }
 }
 
-void StereoMemoryDelayAudioProcessor::getVisualSnapshot(MemoryDelayEngine::VisualSnapshot& snapshot) const
+size_t StereoMemoryDelayAudioProcessor::getMemoryResidentBytes() const
 {
-    if (engine != nullptr)
-        engine->getVisualSnapshot(snapshot);
+    size_t bytes = 0;
+    const juce::ScopedLock lock(engineLock);
+    if (auto* target = engine.get())
+        bytes += target->getMemoryResidentBytes();
+    if (auto* target = doubleEngine.get())
+        bytes += target->getMemoryResidentBytes();
+    return bytes;
 }
 
 juce::AudioProcessor* JUCE_CALLTYPE createPluginFilter()
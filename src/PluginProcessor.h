@@ -1,13 +1,18 @@
 #pragma once
 
 #include <JuceHeader.h>
+#include "AutomationSplitter.h"
+#include "EngineSlot.h"
 #include "MemoryDelayEngine.h"
+#include "MemoryExporter.h"
+#include "MemoryImporter.h"
 
 //==============================================================================
 /**
     Basic skeleton of the audio processor class for the Stereo Memory Delay plugin.
 */
-class StereoMemoryDelayAudioProcessor  : public juce::AudioProcessor
+class StereoMemoryDelayAudioProcessor  : public juce::AudioProcessor,
+                                         private juce::TimeSliceClient
 {
 public:
     StereoMemoryDelayAudioProcessor();
@@ -16,10 +21,13 @@ public:
     //==============================================================================
     void prepareToPlay (double sampleRate, int samplesPerBlock) override;
     void releaseResources() override;
+    void reset() override;
 
     bool isBusesLayoutSupported (const BusesLayout& layouts) const override;
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override { return true; }
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -48,13 +56,67 @@ public:
     juce::AudioProcessorValueTreeState& getParameters() { return parameters; }
     const juce::AudioProcessorValueTreeState& getParameters() const { return parameters; }
 
-    void getVisualSnapshot(MemoryDelayEngine::VisualSnapshot& snapshot) const;
+    void getVisualSnapshot(MemoryDelayEngineTypes::VisualSnapshot& snapshot) const;
+
+    // Bytes of delay memory currently allocated by this instance
+    size_t getMemoryResidentBytes() const;
+
+    // Whether getStateInformation() stores the delay memory, compressed, after
+    // the parameters.  On by default; saved with the state.
+    void setMemorySavedWithState (bool shouldSave);
+    bool isMemorySavedWithState() const { return saveMemoryWithState.load(); }
+
+    // Writes what the playheads can reach of the memory to a WAV or FLAC file
+    // on a background thread, optionally with the playheads as cue points.
+    // Returns false if there is no memory yet or the file cannot be written.
+    bool exportMemory (const juce::File& file, bool withPlayheadMarkers);
+    const MemoryExporter& getMemoryExporter() const { return exporter; }
+
+    // Preloads the memory from an audio file, as much of its start as the
+    // memory holds, converted on a background thread and recorded behind the
+    // write head as it arrives while playback carries on.  Returns false if no
+    // engine is running or the file cannot be read.  The import goes to the
+    // engine running now: if a sample-rate change replaces it first, the rest
+    // of the file is dropped and getMemoryImporter() reports Failed.
+    bool importMemory (const juce::File& file);
+    const MemoryImporter& getMemoryImporter() const { return importer; }
 
 private:
+    // Shared body of both processBlock overloads
+    template <typename SampleType, typename Engine>
+    void renderBlock (juce::AudioBuffer<SampleType>& buffer, Engine& target);
+    template <typename Engine>
+    void configureEngine (Engine& target);
+
+    // Builds engines for a new sample rate and allocates and releases memory
+    // pages on the memory thread
+    int useTimeSlice() override;
+
     // AudioProcessorValueTreeState manages plug‑in parameters
     juce::AudioProcessorValueTreeState parameters;
-    // Core DSP engine
-    std::unique_ptr<MemoryDelayEngine> engine;
+    // Core DSP engines; only the one matching the host's processing precision
+    // is prepared.  The double engine keeps a float memory.  Both outlive
+    // releaseResources(), so the memory survives a host restart.
+    EngineSlot<MemoryDelayEngine<float>> engine;
+    EngineSlot<MemoryDelayEngine<double, float>> doubleEngine;
+    // Held by prepareToPlay() and releaseResources() while they swap engines,
+    // and by everything that uses an engine from outside the audio and
+    // memory threads (state, export, import, the editor's queries), so
+    // none is deleted or re-prepared under them
+    juce::CriticalSection engineLock;
+    // Slices each host block at parameter and transport events
+    AutomationSplitter automation;
+    // Background thread for engine builds and lazy memory allocation
+    juce::TimeSliceThread memoryThread { "Echoform memory" };
+    // Memory loaded by setStateInformation(), handed to the engine by the
+    // memory thread once there is one to restore it into
+    std::shared_ptr<const MemorySnapshot> pendingSnapshot;
+    juce::CriticalSection snapshotLock;
+    std::atomic<bool> saveMemoryWithState { true };
+    // Encodes memory exports on its own thread
+    MemoryExporter exporter;
+    // Reads and converts memory imports on its own thread
+    MemoryImporter importer;
 
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (StereoMemoryDelayAudioProcessor)
 };
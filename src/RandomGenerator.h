@@ -12,6 +12,13 @@ public:
         state = (seed == 0u) ? 0x6d2b79f5u : seed;
     }
 
+    /** Mixes value into seed (as boost::hash_combine does), for deriving the
+        seeds of independent streams from one seed. */
+    static uint32_t combineSeed(uint32_t seed, uint32_t value)
+    {
+        return seed ^ (value + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+    }
+
     uint32_t nextUInt()
     {
         uint32_t x = state;
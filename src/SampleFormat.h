@@ -0,0 +1,375 @@
+// SampleFormat.h
+//
+// Encodings for the samples held in the memory buffer.  Everything written to
+// memory has been through the saturator, so it lies in [-1, 1] and can be kept
+// in fewer bits than a float: IEEE half, 16-bit integers with TPDF dither, or
+// packed 24-bit integers.  Each codec converts single samples and blocks; the
+// block forms use F16C, SSE2 or NEON when the compiler targets them.
+// kPrefersBlockDecode marks codecs whose block decode beats decoding gathered
+// samples one at a time (only half, with hardware conversion).  Every
+// conversion is exact or correctly rounded, so the scalar and vector forms
+// produce identical bits.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SimdConfig.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+/** Stores samples in their own type (float or double). */
+template <typename Type>
+struct NativeSampleCodec
+{
+    using Raw = Type;
+    using Value = Type;
+    static constexpr int kBytes = static_cast<int>(sizeof(Type));
+    static constexpr bool kPrefersBlockDecode = false;
+
+    static Raw load(const unsigned char* page, int index)
+    {
+        Raw raw;
+        std::memcpy(&raw, page + static_cast<size_t>(index) * kBytes, sizeof(Raw));
+        return raw;
+    }
+
+    static void store(unsigned char* page, int index, Raw raw)
+    {
+        std::memcpy(page + static_cast<size_t>(index) * kBytes, &raw, sizeof(Raw));
+    }
+
+    static Value decode(Raw raw) { return raw; }
+
+    static void decodeBlock(const Raw* raw, Value* dest, int numSamples)
+    {
+        std::copy(raw, raw + numSamples, dest);
+    }
+
+    static Raw encode(Value value, std::uint64_t, int) { return value; }
+
+    static void encodeBlock(const Value* source, Raw* raw, int numSamples, std::uint64_t, int)
+    {
+        std::copy(source, source + numSamples, raw);
+    }
+};
+
+/** IEEE 754 binary16, rounded to nearest even: 11 significant bits. */
+struct HalfSampleCodec
+{
+    using Raw = std::uint16_t;
+    using Value = float;
+    static constexpr int kBytes = 2;
+#if ECHOFORM_SIMD_F16C || ECHOFORM_SIMD_NEON64
+    static constexpr bool kPrefersBlockDecode = true;
+#else
+    static constexpr bool kPrefersBlockDecode = false;
+#endif
+
+    static Raw load(const unsigned char* page, int index)
+    {
+        Raw raw;
+        std::memcpy(&raw, page + static_cast<size_t>(index) * kBytes, sizeof(Raw));
+        return raw;
+    }
+
+    static void store(unsigned char* page, int index, Raw raw)
+    {
+        std::memcpy(page + static_cast<size_t>(index) * kBytes, &raw, sizeof(Raw));
+    }
+
+    /** Exact conversion, including subnormal halves. */
+    static Value decode(Raw raw)
+    {
+        const std::uint32_t sign = static_cast<std::uint32_t>(raw & 0x8000u) << 16;
+        const std::uint32_t exponent = (raw >> 10) & 0x1fu;
+        std::uint32_t mantissa = raw & 0x3ffu;
+        std::uint32_t bits = sign;
+
+        if (exponent == 0x1fu)
+        {
+            bits |= 0x7f800000u | (mantissa << 13);
+        }
+        else if (exponent != 0)
+        {
+            bits |= ((exponent + 112u) << 23) | (mantissa << 13);
+        }
+        else if (mantissa != 0)
+        {
+            std::uint32_t normalized = 113;
+            while ((mantissa & 0x400u) == 0)
+            {
+                mantissa <<= 1;
+                --normalized;
+            }
+            bits |= (normalized << 23) | ((mantissa & 0x3ffu) << 13);
+        }
+
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    static void decodeBlock(const Raw* raw, Value* dest, int numSamples)
+    {
+        int i = 0;
+#if ECHOFORM_SIMD_F16C
+        for (; i + 4 <= numSamples; i += 4)
+            _mm_storeu_ps(dest + i, _mm_cvtph_ps(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(raw + i))));
+#elif ECHOFORM_SIMD_NEON64
+        for (; i + 4 <= numSamples; i += 4)
+            vst1q_f32(dest + i, vcvt_f32_f16(vreinterpret_f16_u16(vld1_u16(raw + i))));
+#endif
+        for (; i < numSamples; ++i)
+            dest[i] = decode(raw[i]);
+    }
+
+    /** Rounds to the nearest half, ties to even, as the F16C and NEON
+        instructions do; values beyond the half range become infinity. */
+    static Raw encode(Value value, std::uint64_t, int)
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+        const auto sign = static_cast<std::uint32_t>((bits >> 16) & 0x8000u);
+        const std::uint32_t magnitude = bits & 0x7fffffffu;
+
+        if (magnitude > 0x7f800000u)
+            return static_cast<Raw>(sign | 0x7e00u | ((magnitude >> 13) & 0x3ffu));
+        if (magnitude >= 0x477ff000u)
+            return static_cast<Raw>(sign | 0x7c00u);
+
+        if (magnitude >= 0x38800000u)
+        {
+            // Rebias the exponent, then round away the low 13 mantissa bits.
+            std::uint32_t rebiased = magnitude - 0x38000000u;
+            rebiased += 0x0fffu + ((rebiased >> 13) & 1u);
+            return static_cast<Raw>(sign | (rebiased >> 13));
+        }
+
+        if (magnitude <= 0x33000000u)
+            return static_cast<Raw>(sign);
+
+        // Subnormal half: the value in units of 2^-24, rounded to nearest even.
+        const std::uint32_t mantissa = (magnitude & 0x7fffffu) | 0x800000u;
+        const std::uint32_t shift = 126u - (magnitude >> 23);
+        std::uint32_t result = mantissa >> shift;
+        const std::uint32_t remainder = mantissa & ((1u << shift) - 1u);
+        const std::uint32_t halfway = 1u << (shift - 1u);
+        if (remainder > halfway || (remainder == halfway && (result & 1u) != 0))
+            ++result;
+        return static_cast<Raw>(sign | result);
+    }
+
+    static void encodeBlock(const Value* source, Raw* raw, int numSamples, std::uint64_t, int)
+    {
+        int i = 0;
+#if ECHOFORM_SIMD_F16C
+        for (; i + 4 <= numSamples; i += 4)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(raw + i),
+                             _mm_cvtps_ph(_mm_loadu_ps(source + i), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC));
+#elif ECHOFORM_SIMD_NEON64
+        for (; i + 4 <= numSamples; i += 4)
+            vst1_u16(raw + i, vreinterpret_u16_f16(vcvt_f16_f32(vld1q_f32(source + i))));
+#endif
+        for (; i < numSamples; ++i)
+            raw[i] = encode(source[i], 0, 0);
+    }
+};
+
+/** Shared by the integer codecs: value * 2^Bits, clamped and rounded to
+    nearest even (the default rounding mode), with an optional offset in
+    LSBs added before rounding. */
+template <int Bits, typename RawType>
+struct IntegerSampleCodec
+{
+    using Raw = RawType;
+    using Value = float;
+
+    static constexpr float kScale = static_cast<float>(1 << Bits);
+    static constexpr float kInverseScale = 1.0f / kScale;
+    static constexpr float kMin = -kScale;
+    static constexpr float kMax = kScale - 1.0f;
+    static constexpr bool kPrefersBlockDecode = false;
+
+    static Value decode(Raw raw) { return static_cast<float>(raw) * kInverseScale; }
+
+    static void decodeBlock(const Raw* raw, Value* dest, int numSamples)
+    {
+        int i = 0;
+#if ECHOFORM_SIMD_SSE
+        const __m128 scale = _mm_set1_ps(kInverseScale);
+        for (; i + 4 <= numSamples; i += 4)
+            _mm_storeu_ps(dest + i, _mm_mul_ps(_mm_cvtepi32_ps(loadWide(raw + i)), scale));
+#elif ECHOFORM_SIMD_NEON
+        const float32x4_t scale = vdupq_n_f32(kInverseScale);
+        for (; i + 4 <= numSamples; i += 4)
+            vst1q_f32(dest + i, vmulq_f32(vcvtq_f32_s32(loadWide(raw + i)), scale));
+#endif
+        for (; i < numSamples; ++i)
+            dest[i] = decode(raw[i]);
+    }
+
+    static Raw quantize(float value, float offset)
+    {
+        const float scaled = juce::jlimit(kMin, kMax, value * kScale + offset);
+        return static_cast<Raw>(std::lrint(scaled));
+    }
+
+    static void quantizeBlock(const float* source, const float* offsets, Raw* raw, int numSamples)
+    {
+        int i = 0;
+#if ECHOFORM_SIMD_SSE
+        const __m128 scale = _mm_set1_ps(kScale);
+        const __m128 low = _mm_set1_ps(kMin);
+        const __m128 high = _mm_set1_ps(kMax);
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const __m128 scaled = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(source + i), scale), _mm_loadu_ps(offsets + i));
+            storeNarrow(raw + i, _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(scaled, low), high)));
+        }
+#elif ECHOFORM_SIMD_NEON64
+        const float32x4_t scale = vdupq_n_f32(kScale);
+        const float32x4_t low = vdupq_n_f32(kMin);
+        const float32x4_t high = vdupq_n_f32(kMax);
+        for (; i + 4 <= numSamples; i += 4)
+        {
+            const float32x4_t scaled = vaddq_f32(vmulq_f32(vld1q_f32(source + i), scale), vld1q_f32(offsets + i));
+            storeNarrow(raw + i, vcvtnq_s32_f32(vminq_f32(vmaxq_f32(scaled, low), high)));
+        }
+#endif
+        for (; i < numSamples; ++i)
+            raw[i] = quantize(source[i], offsets[i]);
+    }
+
+private:
+#if ECHOFORM_SIMD_SSE
+    static __m128i loadWide(const Raw* raw)
+    {
+        if constexpr (sizeof(Raw) == 2)
+        {
+            const __m128i packed = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(raw));
+            return _mm_srai_epi32(_mm_unpacklo_epi16(packed, packed), 16);
+        }
+        else
+        {
+            return _mm_loadu_si128(reinterpret_cast<const __m128i*>(raw));
+        }
+    }
+
+    static void storeNarrow(Raw* raw, __m128i values)
+    {
+        if constexpr (sizeof(Raw) == 2)
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(raw), _mm_packs_epi32(values, values));
+        else
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(raw), values);
+    }
+#elif ECHOFORM_SIMD_NEON
+    static int32x4_t loadWide(const Raw* raw)
+    {
+        if constexpr (sizeof(Raw) == 2)
+            return vmovl_s16(vld1_s16(raw));
+        else
+            return vld1q_s32(raw);
+    }
+
+    static void storeNarrow(Raw* raw, int32x4_t values)
+    {
+        if constexpr (sizeof(Raw) == 2)
+            vst1_s16(raw, vqmovn_s32(values));
+        else
+            vst1q_s32(raw, values);
+    }
+#endif
+};
+
+/** 16-bit integers with triangular (TPDF) dither of +/-1 LSB.  The dither is
+    a hash of the frame counter and channel, so it does not depend on how the
+    writes are batched and repeats exactly for the same recording. */
+struct Int16SampleCodec : IntegerSampleCodec<15, std::int16_t>
+{
+    static constexpr int kBytes = 2;
+
+    static Raw load(const unsigned char* page, int index)
+    {
+        Raw raw;
+        std::memcpy(&raw, page + static_cast<size_t>(index) * kBytes, sizeof(Raw));
+        return raw;
+    }
+
+    static void store(unsigned char* page, int index, Raw raw)
+    {
+        std::memcpy(page + static_cast<size_t>(index) * kBytes, &raw, sizeof(Raw));
+    }
+
+    static Raw encode(Value value, std::uint64_t frame, int channel)
+    {
+        return quantize(value, getDither(frame, channel));
+    }
+
+    static void encodeBlock(const Value* source, Raw* raw, int numSamples, std::uint64_t firstFrame, int channel)
+    {
+        constexpr int kChunk = 64;
+        float dither[kChunk];
+        for (int start = 0; start < numSamples; start += kChunk)
+        {
+            const int count = juce::jmin(kChunk, numSamples - start);
+            for (int i = 0; i < count; ++i)
+                dither[i] = getDither(firstFrame + static_cast<std::uint64_t>(start + i), channel);
+            quantizeBlock(source + start, dither, raw + start, count);
+        }
+    }
+
+    /** The sum of two uniform values in [-0.5, 0.5) LSB. */
+    static float getDither(std::uint64_t frame, int channel)
+    {
+        const std::uint64_t bits = hash((frame << 1) | static_cast<std::uint64_t>(channel));
+        constexpr float kUnit = 1.0f / 16777216.0f;
+        const float first = static_cast<float>(static_cast<std::uint32_t>(bits) >> 8) * kUnit;
+        const float second = static_cast<float>(static_cast<std::uint32_t>(bits >> 32) >> 8) * kUnit;
+        return first + second - 1.0f;
+    }
+
+private:
+    // splitmix64 finaliser.
+    static std::uint64_t hash(std::uint64_t value)
+    {
+        value += 0x9e3779b97f4a7c15ull;
+        value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+        value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+        return value ^ (value >> 31);
+    }
+};
+
+/** 24-bit integers packed into three little-endian bytes. */
+struct Packed24SampleCodec : IntegerSampleCodec<23, std::int32_t>
+{
+    static constexpr int kBytes = 3;
+
+    static Raw load(const unsigned char* page, int index)
+    {
+        const unsigned char* bytes = page + static_cast<size_t>(index) * kBytes;
+        const auto value = static_cast<std::uint32_t>(bytes[0]) | (static_cast<std::uint32_t>(bytes[1]) << 8)
+                           | (static_cast<std::uint32_t>(bytes[2]) << 16);
+        return static_cast<Raw>(value << 8) >> 8;
+    }
+
+    static void store(unsigned char* page, int index, Raw raw)
+    {
+        unsigned char* bytes = page + static_cast<size_t>(index) * kBytes;
+        const auto value = static_cast<std::uint32_t>(raw);
+        bytes[0] = static_cast<unsigned char>(value);
+        bytes[1] = static_cast<unsigned char>(value >> 8);
+        bytes[2] = static_cast<unsigned char>(value >> 16);
+    }
+
+    static Raw encode(Value value, std::uint64_t, int) { return quantize(value, 0.0f); }
+
+    static void encodeBlock(const Value* source, Raw* raw, int numSamples, std::uint64_t, int)
+    {
+        constexpr int kChunk = 64;
+        static constexpr float kNoOffsets[kChunk] {};
+        for (int start = 0; start < numSamples; start += kChunk)
+            quantizeBlock(source + start, kNoOffsets, raw + start, juce::jmin(kChunk, numSamples - start));
+    }
+};
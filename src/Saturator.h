@@ -0,0 +1,404 @@
+// Saturator.h
+//
+// The soft clipper applied to every frame recorded into memory.  Exact mode
+// is std::tanh; the fast modes approximate it with a bounded error and have
+// SSE2 and AArch64 NEON kernels that take a stereo pair or a block of samples
+// at a time.  Each fast mode performs the same operations in the same order in
+// its scalar and vector forms, one operation per statement so that compilers
+// which only contract within an expression cannot fuse them, so a mode gives
+// bit-identical results however it is called.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SimdConfig.h"
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if ECHOFORM_SIMD_SSE || ECHOFORM_SIMD_NEON64
+ #define ECHOFORM_SATURATOR_SIMD 1
+#endif
+
+class Saturator
+{
+public:
+    enum class Mode
+    {
+        Exact = 0,   // std::tanh
+        Rational,    // 7/6 continued-fraction approximant, clamped to [-1, 1]
+        Polynomial,  // tanh from a degree-5 polynomial exp2 and one division
+        Table        // 2048-segment linear lookup over [0, 8]
+    };
+
+    /** Largest absolute difference from tanh over all finite inputs, measured
+        against double-precision tanh on a 1e-5 grid over [-10, 10] (beyond that
+        every mode is flat). */
+    static constexpr float kRationalMaxError = 1.0e-4f;
+    static constexpr float kPolynomialMaxError = 2.0e-7f;
+    static constexpr float kTableMaxError = 2.0e-6f;
+
+    static float getMaxError(Mode mode)
+    {
+        switch (mode)
+        {
+            case Mode::Exact:      return 0.0f;
+            case Mode::Rational:   return kRationalMaxError;
+            case Mode::Polynomial: return kPolynomialMaxError;
+            case Mode::Table:      return kTableMaxError;
+        }
+
+        return 0.0f;
+    }
+
+    /** Builds the lookup table.  The table is also built on first use, but
+        calling this from prepare() keeps that work off the audio thread. */
+    static void prepare() { getTable(); }
+
+    static float process(Mode mode, float x)
+    {
+        switch (mode)
+        {
+            case Mode::Exact:      return std::tanh(x);
+            case Mode::Rational:   return rational(x);
+            case Mode::Polynomial: return polynomial(x);
+            case Mode::Table:      return table(x);
+        }
+
+        return x;
+    }
+
+    /** Saturates one stereo frame, both channels in one vector where possible. */
+    static void processStereo(Mode mode, float& left, float& right)
+    {
+#if ECHOFORM_SATURATOR_SIMD
+        if (mode != Mode::Exact)
+        {
+            alignas(16) float lanes[4] = { left, right, 0.0f, 0.0f };
+            processFour(mode, lanes);
+            left = lanes[0];
+            right = lanes[1];
+            return;
+        }
+#endif
+
+        left = process(mode, left);
+        right = process(mode, right);
+    }
+
+    /** Saturates numSamples frames in place. */
+    static void processBlock(Mode mode, float* left, float* right, int numSamples)
+    {
+        processChannel(mode, left, numSamples);
+        processChannel(mode, right, numSamples);
+    }
+
+    /** Double-precision forms for the double engine.  Exact mode is std::tanh
+        in double; the fast modes run in float, as their error bounds are far
+        above float resolution anyway. */
+    static double process(Mode mode, double x)
+    {
+        if (mode == Mode::Exact)
+            return std::tanh(x);
+        return static_cast<double>(process(mode, static_cast<float>(x)));
+    }
+
+    static void processStereo(Mode mode, double& left, double& right)
+    {
+        left = process(mode, left);
+        right = process(mode, right);
+    }
+
+    static void processBlock(Mode mode, double* left, double* right, int numSamples)
+    {
+        for (int i = 0; i < numSamples; ++i)
+        {
+            left[i] = process(mode, left[i]);
+            right[i] = process(mode, right[i]);
+        }
+    }
+
+private:
+    static constexpr float kRationalLimit = 5.0f;
+    static constexpr float kMinusTwoLog2e = -2.8853900817779268f;
+    static constexpr float kExp2Floor = -126.0f;
+    static constexpr int kTableSegments = 2048;
+    static constexpr float kTableRange = 8.0f;
+    static constexpr float kTableScale = static_cast<float>(kTableSegments) / kTableRange;
+    static constexpr float kTableEnd = static_cast<float>(kTableSegments);
+
+    // 2^f on [0, 1), relative error below 2e-7.
+    static constexpr float kExp2C0 = 9.9999994e-1f;
+    static constexpr float kExp2C1 = 6.9315308e-1f;
+    static constexpr float kExp2C2 = 2.4015361e-1f;
+    static constexpr float kExp2C3 = 5.5826318e-2f;
+    static constexpr float kExp2C4 = 8.9893397e-3f;
+    static constexpr float kExp2C5 = 1.8775767e-3f;
+
+    // tanh at kTableSegments + 1 points, plus a repeat of the last so the top
+    // segment can interpolate.
+    using Table = std::array<float, kTableSegments + 2>;
+
+    static const Table& getTable()
+    {
+        static const Table values = []
+        {
+            Table entries {};
+            for (int i = 0; i <= kTableSegments; ++i)
+                entries[static_cast<size_t>(i)] = static_cast<float>(std::tanh(static_cast<double>(i) / static_cast<double>(kTableScale)));
+            entries[kTableSegments + 1] = entries[kTableSegments];
+            return entries;
+        }();
+        return values;
+    }
+
+    static void processChannel(Mode mode, float* data, int numSamples)
+    {
+        int sample = 0;
+
+#if ECHOFORM_SATURATOR_SIMD
+        if (mode != Mode::Exact)
+            for (; sample + 4 <= numSamples; sample += 4)
+                processFour(mode, data + sample);
+#endif
+
+        for (; sample < numSamples; ++sample)
+            data[sample] = process(mode, data[sample]);
+    }
+
+    static float rational(float x)
+    {
+        x = (x > -kRationalLimit) ? x : -kRationalLimit;
+        x = (x < kRationalLimit) ? x : kRationalLimit;
+        const float x2 = x * x;
+
+        float numerator = x2 + 378.0f;
+        numerator = numerator * x2;
+        numerator = numerator + 17325.0f;
+        numerator = numerator * x2;
+        numerator = numerator + 135135.0f;
+        numerator = numerator * x;
+
+        float denominator = x2 * 28.0f;
+        denominator = denominator + 3150.0f;
+        denominator = denominator * x2;
+        denominator = denominator + 62370.0f;
+        denominator = denominator * x2;
+        denominator = denominator + 135135.0f;
+
+        float y = numerator / denominator;
+        y = (y < 1.0f) ? y : 1.0f;
+        y = (y > -1.0f) ? y : -1.0f;
+        return y;
+    }
+
+    static float polynomial(float x)
+    {
+        // tanh|x| = (1 - e) / (1 + e) with e = 2^(-2|x| log2 e).
+        float y = std::fabs(x) * kMinusTwoLog2e;
+        y = (y > kExp2Floor) ? y : kExp2Floor;
+        int whole = static_cast<int>(y);
+        if (static_cast<float>(whole) > y)
+            whole -= 1;
+        const float fraction = y - static_cast<float>(whole);
+
+        float power = kExp2C5 * fraction;
+        power = power + kExp2C4;
+        power = power * fraction;
+        power = power + kExp2C3;
+        power = power * fraction;
+        power = power + kExp2C2;
+        power = power * fraction;
+        power = power + kExp2C1;
+        power = power * fraction;
+        power = power + kExp2C0;
+
+        uint32_t bits = 0;
+        std::memcpy(&bits, &power, sizeof(bits));
+        bits += static_cast<uint32_t>(whole) << 23;
+        float e = 0.0f;
+        std::memcpy(&e, &bits, sizeof(e));
+
+        const float numerator = 1.0f - e;
+        const float denominator = 1.0f + e;
+        return std::copysign(numerator / denominator, x);
+    }
+
+    static float table(float x)
+    {
+        float position = std::fabs(x) * kTableScale;
+        position = (position < kTableEnd) ? position : kTableEnd;
+        const int index = static_cast<int>(position);
+        const float fraction = position - static_cast<float>(index);
+        return std::copysign(lookup(index, fraction), x);
+    }
+
+    static float lookup(int index, float fraction)
+    {
+        const Table& values = getTable();
+        const float lower = values[static_cast<size_t>(index)];
+        const float upper = values[static_cast<size_t>(index + 1)];
+        const float step = upper - lower;
+        const float offset = fraction * step;
+        return lower + offset;
+    }
+
+#if ECHOFORM_SIMD_SSE
+    static void processFour(Mode mode, float* data)
+    {
+        const __m128 x = _mm_loadu_ps(data);
+        const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(static_cast<int>(0x80000000u)));
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        if (mode == Mode::Rational)
+        {
+            __m128 clamped = _mm_max_ps(x, _mm_set1_ps(-kRationalLimit));
+            clamped = _mm_min_ps(clamped, _mm_set1_ps(kRationalLimit));
+            const __m128 x2 = _mm_mul_ps(clamped, clamped);
+
+            __m128 numerator = _mm_add_ps(x2, _mm_set1_ps(378.0f));
+            numerator = _mm_mul_ps(numerator, x2);
+            numerator = _mm_add_ps(numerator, _mm_set1_ps(17325.0f));
+            numerator = _mm_mul_ps(numerator, x2);
+            numerator = _mm_add_ps(numerator, _mm_set1_ps(135135.0f));
+            numerator = _mm_mul_ps(numerator, clamped);
+
+            __m128 denominator = _mm_mul_ps(x2, _mm_set1_ps(28.0f));
+            denominator = _mm_add_ps(denominator, _mm_set1_ps(3150.0f));
+            denominator = _mm_mul_ps(denominator, x2);
+            denominator = _mm_add_ps(denominator, _mm_set1_ps(62370.0f));
+            denominator = _mm_mul_ps(denominator, x2);
+            denominator = _mm_add_ps(denominator, _mm_set1_ps(135135.0f));
+
+            __m128 y = _mm_div_ps(numerator, denominator);
+            y = _mm_min_ps(y, one);
+            y = _mm_max_ps(y, _mm_set1_ps(-1.0f));
+            _mm_storeu_ps(data, y);
+            return;
+        }
+
+        const __m128 magnitude = _mm_andnot_ps(signMask, x);
+
+        if (mode == Mode::Polynomial)
+        {
+            __m128 y = _mm_mul_ps(magnitude, _mm_set1_ps(kMinusTwoLog2e));
+            y = _mm_max_ps(y, _mm_set1_ps(kExp2Floor));
+            __m128i whole = _mm_cvttps_epi32(y);
+            whole = _mm_add_epi32(whole, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(whole), y)));
+            const __m128 fraction = _mm_sub_ps(y, _mm_cvtepi32_ps(whole));
+
+            __m128 power = _mm_mul_ps(_mm_set1_ps(kExp2C5), fraction);
+            power = _mm_add_ps(power, _mm_set1_ps(kExp2C4));
+            power = _mm_mul_ps(power, fraction);
+            power = _mm_add_ps(power, _mm_set1_ps(kExp2C3));
+            power = _mm_mul_ps(power, fraction);
+            power = _mm_add_ps(power, _mm_set1_ps(kExp2C2));
+            power = _mm_mul_ps(power, fraction);
+            power = _mm_add_ps(power, _mm_set1_ps(kExp2C1));
+            power = _mm_mul_ps(power, fraction);
+            power = _mm_add_ps(power, _mm_set1_ps(kExp2C0));
+
+            const __m128 e = _mm_castsi128_ps(_mm_add_epi32(_mm_castps_si128(power), _mm_slli_epi32(whole, 23)));
+            const __m128 t = _mm_div_ps(_mm_sub_ps(one, e), _mm_add_ps(one, e));
+            _mm_storeu_ps(data, _mm_or_ps(t, _mm_and_ps(x, signMask)));
+            return;
+        }
+
+        __m128 position = _mm_mul_ps(magnitude, _mm_set1_ps(kTableScale));
+        position = _mm_min_ps(position, _mm_set1_ps(kTableEnd));
+        const __m128i index = _mm_cvttps_epi32(position);
+        alignas(16) int indices[4];
+        alignas(16) float fractions[4];
+        alignas(16) float signs[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(indices), index);
+        _mm_store_ps(fractions, _mm_sub_ps(position, _mm_cvtepi32_ps(index)));
+        _mm_store_ps(signs, x);
+        for (int lane = 0; lane < 4; ++lane)
+            data[lane] = std::copysign(lookup(indices[lane], fractions[lane]), signs[lane]);
+    }
+#elif ECHOFORM_SIMD_NEON64
+    static float32x4_t select(uint32x4_t mask, float32x4_t ifTrue, float32x4_t ifFalse)
+    {
+        return vbslq_f32(mask, ifTrue, ifFalse);
+    }
+
+    static void processFour(Mode mode, float* data)
+    {
+        const float32x4_t x = vld1q_f32(data);
+        const uint32x4_t signMask = vdupq_n_u32(0x80000000u);
+        const float32x4_t one = vdupq_n_f32(1.0f);
+
+        if (mode == Mode::Rational)
+        {
+            const float32x4_t lower = vdupq_n_f32(-kRationalLimit);
+            const float32x4_t upper = vdupq_n_f32(kRationalLimit);
+            float32x4_t clamped = select(vcgtq_f32(x, lower), x, lower);
+            clamped = select(vcltq_f32(clamped, upper), clamped, upper);
+            const float32x4_t x2 = vmulq_f32(clamped, clamped);
+
+            float32x4_t numerator = vaddq_f32(x2, vdupq_n_f32(378.0f));
+            numerator = vmulq_f32(numerator, x2);
+            numerator = vaddq_f32(numerator, vdupq_n_f32(17325.0f));
+            numerator = vmulq_f32(numerator, x2);
+            numerator = vaddq_f32(numerator, vdupq_n_f32(135135.0f));
+            numerator = vmulq_f32(numerator, clamped);
+
+            float32x4_t denominator = vmulq_f32(x2, vdupq_n_f32(28.0f));
+            denominator = vaddq_f32(denominator, vdupq_n_f32(3150.0f));
+            denominator = vmulq_f32(denominator, x2);
+            denominator = vaddq_f32(denominator, vdupq_n_f32(62370.0f));
+            denominator = vmulq_f32(denominator, x2);
+            denominator = vaddq_f32(denominator, vdupq_n_f32(135135.0f));
+
+            const float32x4_t minusOne = vdupq_n_f32(-1.0f);
+            float32x4_t y = vdivq_f32(numerator, denominator);
+            y = select(vcltq_f32(y, one), y, one);
+            y = select(vcgtq_f32(y, minusOne), y, minusOne);
+            vst1q_f32(data, y);
+            return;
+        }
+
+        const float32x4_t magnitude = vabsq_f32(x);
+
+        if (mode == Mode::Polynomial)
+        {
+            const float32x4_t floorValue = vdupq_n_f32(kExp2Floor);
+            float32x4_t y = vmulq_f32(magnitude, vdupq_n_f32(kMinusTwoLog2e));
+            y = select(vcgtq_f32(y, floorValue), y, floorValue);
+            int32x4_t whole = vcvtq_s32_f32(y);
+            whole = vaddq_s32(whole, vreinterpretq_s32_u32(vcgtq_f32(vcvtq_f32_s32(whole), y)));
+            const float32x4_t fraction = vsubq_f32(y, vcvtq_f32_s32(whole));
+
+            float32x4_t power = vmulq_f32(vdupq_n_f32(kExp2C5), fraction);
+            power = vaddq_f32(power, vdupq_n_f32(kExp2C4));
+            power = vmulq_f32(power, fraction);
+            power = vaddq_f32(power, vdupq_n_f32(kExp2C3));
+            power = vmulq_f32(power, fraction);
+            power = vaddq_f32(power, vdupq_n_f32(kExp2C2));
+            power = vmulq_f32(power, fraction);
+            power = vaddq_f32(power, vdupq_n_f32(kExp2C1));
+            power = vmulq_f32(power, fraction);
+            power = vaddq_f32(power, vdupq_n_f32(kExp2C0));
+
+            const float32x4_t e = vreinterpretq_f32_s32(vaddq_s32(vreinterpretq_s32_f32(power), vshlq_n_s32(whole, 23)));
+            const float32x4_t t = vdivq_f32(vsubq_f32(one, e), vaddq_f32(one, e));
+            vst1q_f32(data, vbslq_f32(signMask, x, t));
+            return;
+        }
+
+        const float32x4_t end = vdupq_n_f32(kTableEnd);
+        float32x4_t position = vmulq_f32(magnitude, vdupq_n_f32(kTableScale));
+        position = select(vcltq_f32(position, end), position, end);
+        const int32x4_t index = vcvtq_s32_f32(position);
+        int32_t indices[4];
+        float fractions[4];
+        float signs[4];
+        vst1q_s32(indices, index);
+        vst1q_f32(fractions, vsubq_f32(position, vcvtq_f32_s32(index)));
+        vst1q_f32(signs, x);
+        for (int lane = 0; lane < 4; ++lane)
+            data[lane] = std::copysign(lookup(indices[lane], fractions[lane]), signs[lane]);
+    }
+#endif
+};
@@ -0,0 +1,32 @@
+// SimdConfig.h
+//
+// Detects the vector instruction sets the compiler targets and pulls in their
+// intrinsics.  ECHOFORM_SIMD_AVX, ECHOFORM_SIMD_SSE and ECHOFORM_SIMD_NEON are
+// defined to 1 when the corresponding kernels can be compiled; code falls back
+// to scalar loops otherwise.  ECHOFORM_SIMD_NEON64 marks AArch64, which adds
+// vector division.  ECHOFORM_SIMD_F16C marks the x86 half-precision
+// conversions.
+
+#pragma once
+
+#if defined(__AVX2__)
+ #define ECHOFORM_SIMD_AVX 1
+#endif
+
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+ #define ECHOFORM_SIMD_F16C 1
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+ #define ECHOFORM_SIMD_SSE 1
+ #include <emmintrin.h>
+ #if ECHOFORM_SIMD_AVX || ECHOFORM_SIMD_F16C
+  #include <immintrin.h>
+ #endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+ #define ECHOFORM_SIMD_NEON 1
+ #include <arm_neon.h>
+ #if defined(__aarch64__) || defined(_M_ARM64)
+  #define ECHOFORM_SIMD_NEON64 1
+ #endif
+#endif
@@ -0,0 +1,230 @@
+// SimdInterpolator.h
+//
+// Vector kernels for linearly interpolated reads from a circular buffer.
+// Delays arrive as 32.32 fixed-point phases.  Read indices and fractions are
+// computed in 32-bit integer lanes with AVX2, SSE2 or NEON when the compiler
+// targets them, and with the scalar loop otherwise.  The index arithmetic is
+// exact, so a block read is bit-identical to the same reads made one sample
+// at a time, at any buffer length.  Double-precision buffers use the scalar
+// loop with the full 32-bit fraction.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SimdConfig.h"
+#include <cstdint>
+#include <type_traits>
+
+struct SimdInterpolator
+{
+    /** A delay in samples as 32.32 fixed point: the upper 32 bits hold whole
+        samples, the lower 32 bits the fraction. */
+    using Phase = std::uint64_t;
+
+    static constexpr int kPhaseFractionBits = 32;
+    static constexpr Phase kPhaseOne = Phase { 1 } << kPhaseFractionBits;
+
+    /** Converts a delay in samples to a phase, truncating below 2^-32 samples.
+        Negative delays map to zero. */
+    static Phase toPhase(double delayInSamples)
+    {
+        if (!(delayInSamples > 0.0))
+            return 0;
+        return static_cast<Phase>(delayInSamples * static_cast<double>(kPhaseOne));
+    }
+
+    /** Reads numSamples interpolated values from a circular buffer of bufferSize
+        frames.  Output i is read delays[i] behind a write head at
+        writeBase + i * writeStep.  source(n) returns sample n of the buffer, so
+        any addressing (planar, interleaved, paged, encoded) shares the same
+        kernels; only the final loads go through it.  When Source::kGathers is
+        true the vector paths fetch their lanes with source.gather(indices,
+        dest, n), which stores source(indices[i]) in dest[i] and can convert
+        them as a block.  The caller splits requests so that the
+        write position does not wrap inside the span, and keeps every delay within
+        [0, bufferSize - 1] samples. */
+    template <typename Source, typename SampleType>
+    static void readSpan(const Source& source, int bufferSize, int writeBase, int writeStep, const Phase* delays,
+                         SampleType* dest, int numSamples)
+    {
+        int sample = 0;
+
+        if constexpr (std::is_same_v<SampleType, float>)
+        {
+#if ECHOFORM_SIMD_AVX
+            {
+                const __m256i sizeInt = _mm256_set1_epi32(bufferSize);
+                const __m256i zero = _mm256_setzero_si256();
+                const __m256i one = _mm256_set1_epi32(1);
+                const __m256 fractionScale = _mm256_set1_ps(kFractionScale);
+                const __m256i stepRamp = _mm256_setr_epi32(0, writeStep, 2 * writeStep, 3 * writeStep,
+                                                           4 * writeStep, 5 * writeStep, 6 * writeStep, 7 * writeStep);
+                alignas(32) int index1[8];
+                alignas(32) int index2[8];
+                alignas(32) float frac[8];
+
+                for (; sample + 8 <= numSamples; sample += 8)
+                {
+                    // Split eight 64-bit phases into fraction and whole-sample lanes.
+                    const __m256 low = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(delays + sample)));
+                    const __m256 high = _mm256_castsi256_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(delays + sample + 4)));
+                    const __m256i fraction = _mm256_permute4x64_epi64(
+                        _mm256_castps_si256(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0))), _MM_SHUFFLE(3, 1, 2, 0));
+                    const __m256i whole = _mm256_permute4x64_epi64(
+                        _mm256_castps_si256(_mm256_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1))), _MM_SHUFFLE(3, 1, 2, 0));
+
+                    const __m256i write = _mm256_add_epi32(_mm256_set1_epi32(writeBase + sample * writeStep), stepRamp);
+                    // Borrow one whole sample, then return it where the fraction is zero.
+                    __m256i first = _mm256_sub_epi32(_mm256_sub_epi32(_mm256_sub_epi32(write, whole), one),
+                                                     _mm256_cmpeq_epi32(fraction, zero));
+                    first = _mm256_add_epi32(first, _mm256_and_si256(_mm256_cmpgt_epi32(zero, first), sizeInt));
+                    __m256i second = _mm256_add_epi32(first, one);
+                    second = _mm256_andnot_si256(_mm256_cmpeq_epi32(second, sizeInt), second);
+
+                    const __m256i readFraction = _mm256_srli_epi32(_mm256_sub_epi32(zero, fraction), 8);
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(index1), first);
+                    _mm256_store_si256(reinterpret_cast<__m256i*>(index2), second);
+                    _mm256_store_ps(frac, _mm256_mul_ps(_mm256_cvtepi32_ps(readFraction), fractionScale));
+                    gatherAndInterpolate(source, index1, index2, frac, dest + sample, 8);
+                }
+            }
+#endif
+
+#if ECHOFORM_SIMD_SSE
+            {
+                const __m128i sizeInt = _mm_set1_epi32(bufferSize);
+                const __m128i zero = _mm_setzero_si128();
+                const __m128i one = _mm_set1_epi32(1);
+                const __m128 fractionScale = _mm_set1_ps(kFractionScale);
+                const __m128i stepRamp = _mm_setr_epi32(0, writeStep, 2 * writeStep, 3 * writeStep);
+                alignas(16) int index1[4];
+                alignas(16) int index2[4];
+                alignas(16) float frac[4];
+
+                for (; sample + 4 <= numSamples; sample += 4)
+                {
+                    // Split four 64-bit phases into fraction and whole-sample lanes.
+                    const __m128 low = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(delays + sample)));
+                    const __m128 high = _mm_castsi128_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(delays + sample + 2)));
+                    const __m128i fraction = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0)));
+                    const __m128i whole = _mm_castps_si128(_mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1)));
+
+                    const __m128i write = _mm_add_epi32(_mm_set1_epi32(writeBase + sample * writeStep), stepRamp);
+                    // Borrow one whole sample, then return it where the fraction is zero.
+                    __m128i first = _mm_sub_epi32(_mm_sub_epi32(_mm_sub_epi32(write, whole), one),
+                                                  _mm_cmpeq_epi32(fraction, zero));
+                    first = _mm_add_epi32(first, _mm_and_si128(_mm_cmplt_epi32(first, zero), sizeInt));
+                    __m128i second = _mm_add_epi32(first, one);
+                    second = _mm_andnot_si128(_mm_cmpeq_epi32(second, sizeInt), second);
+
+                    const __m128i readFraction = _mm_srli_epi32(_mm_sub_epi32(zero, fraction), 8);
+                    _mm_store_si128(reinterpret_cast<__m128i*>(index1), first);
+                    _mm_store_si128(reinterpret_cast<__m128i*>(index2), second);
+                    _mm_store_ps(frac, _mm_mul_ps(_mm_cvtepi32_ps(readFraction), fractionScale));
+                    gatherAndInterpolate(source, index1, index2, frac, dest + sample, 4);
+                }
+            }
+#elif ECHOFORM_SIMD_NEON
+            {
+                const int32x4_t sizeInt = vdupq_n_s32(bufferSize);
+                const int32x4_t zero = vdupq_n_s32(0);
+                const int32x4_t one = vdupq_n_s32(1);
+                const int32_t rampValues[4] = { 0, writeStep, 2 * writeStep, 3 * writeStep };
+                const int32x4_t stepRamp = vld1q_s32(rampValues);
+                int32_t index1[4];
+                int32_t index2[4];
+                float frac[4];
+
+                for (; sample + 4 <= numSamples; sample += 4)
+                {
+                    // vld2 splits four 64-bit phases into fraction and whole-sample lanes.
+                    const uint32x4x2_t split = vld2q_u32(reinterpret_cast<const uint32_t*>(delays + sample));
+                    const uint32x4_t fraction = split.val[0];
+                    const int32x4_t whole = vreinterpretq_s32_u32(split.val[1]);
+
+                    const int32x4_t write = vaddq_s32(vdupq_n_s32(writeBase + sample * writeStep), stepRamp);
+                    // A nonzero fraction borrows one whole sample (vtst yields -1 there).
+                    int32x4_t first = vaddq_s32(vsubq_s32(write, whole),
+                                                vreinterpretq_s32_u32(vtstq_u32(fraction, fraction)));
+                    first = vaddq_s32(first, vandq_s32(vreinterpretq_s32_u32(vcltq_s32(first, zero)), sizeInt));
+                    int32x4_t second = vaddq_s32(first, one);
+                    second = vbslq_s32(vceqq_s32(second, sizeInt), zero, second);
+
+                    const uint32x4_t readFraction = vshrq_n_u32(vsubq_u32(vdupq_n_u32(0), fraction), 8);
+                    vst1q_s32(index1, first);
+                    vst1q_s32(index2, second);
+                    vst1q_f32(frac, vmulq_f32(vcvtq_f32_u32(readFraction), vdupq_n_f32(kFractionScale)));
+                    gatherAndInterpolate(source, index1, index2, frac, dest + sample, 4);
+                }
+            }
+#endif
+        }
+
+        for (; sample < numSamples; ++sample)
+            dest[sample] = readOne(source, bufferSize, writeBase + sample * writeStep, delays[sample]);
+    }
+
+    /** Scalar form of the kernel, used by MemoryBuffer::read() and for the tail
+        of each span.  The write head sits at writePosition; the delay is at most
+        bufferSize - 1 samples, so one conditional wrap suffices. */
+    template <typename Source>
+    static auto readOne(const Source& source, int bufferSize, int writePosition, Phase delay)
+    {
+        using SampleType = std::decay_t<decltype(source(0))>;
+        const auto whole = static_cast<int>(delay >> kPhaseFractionBits);
+        const auto fraction = static_cast<std::uint32_t>(delay);
+        int index1 = writePosition - whole - (fraction != 0 ? 1 : 0);
+        if (index1 < 0)
+            index1 += bufferSize;
+        int index2 = index1 + 1;
+        if (index2 == bufferSize)
+            index2 = 0;
+        return interpolate(source(index1), source(index2), getReadFraction<SampleType>(fraction));
+    }
+
+    /** The interpolation step shared by every path.  It is kept as scalar code so
+        the compiler treats it identically (including any FMA contraction) in
+        MemoryBuffer::read() and in the block kernels. */
+    template <typename SampleType>
+    static SampleType interpolate(SampleType s1, SampleType s2, SampleType frac)
+    {
+        return s1 + frac * (s2 - s1);
+    }
+
+private:
+    // The read fraction keeps its top 24 bits, which convert to float exactly;
+    // doubles keep all 32.
+    static constexpr float kFractionScale = 1.0f / 16777216.0f;
+    static constexpr double kDoubleFractionScale = 1.0 / 4294967296.0;
+
+    /** The weight of the older sample for a delay whose fractional part is
+        fraction. */
+    template <typename SampleType>
+    static SampleType getReadFraction(std::uint32_t fraction)
+    {
+        if constexpr (std::is_same_v<SampleType, float>)
+            return static_cast<float>((0u - fraction) >> 8) * kFractionScale;
+        else
+            return static_cast<SampleType>(static_cast<double>(0u - fraction) * kDoubleFractionScale);
+    }
+
+    template <typename Source>
+    static void gatherAndInterpolate(const Source& source, const int* index1, const int* index2, const float* frac,
+                                     float* dest, int numLanes)
+    {
+        if constexpr (Source::kGathers)
+        {
+            float first[8];
+            float second[8];
+            source.gather(index1, first, numLanes);
+            source.gather(index2, second, numLanes);
+            for (int lane = 0; lane < numLanes; ++lane)
+                dest[lane] = interpolate(first[lane], second[lane], frac[lane]);
+        }
+        else
+        {
+            for (int lane = 0; lane < numLanes; ++lane)
+                dest[lane] = interpolate(source(index1[lane]), source(index2[lane]), frac[lane]);
+        }
+    }
+};
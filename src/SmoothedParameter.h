@@ -0,0 +1,218 @@
+// SmoothedParameter.h
+//
+// Lock-free parameter smoothing for the engine.  A setter stores a target from
+// any thread; the audio thread picks it up at the start of a block and renders
+// a linear or exponential ramp towards it.  Ramps are measured in samples from
+// the point the change was picked up, so once a ramp has started, how the rest
+// of the audio is split into blocks does not change its values.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "SimdConfig.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+
+class SmoothedParameter
+{
+public:
+    enum class Curve
+    {
+        Linear = 0,   // equal steps; reaches the target after the ramp length
+        Exponential   // covers 60 dB of the distance in the ramp length, then lands
+    };
+
+    static_assert(std::atomic<float>::is_always_lock_free, "parameter targets must be lock-free");
+
+    explicit SmoothedParameter(float initialValue = 0.0f)
+        : target(initialValue),
+          current(initialValue),
+          rampTarget(initialValue)
+    {
+    }
+
+    /** Sets the ramp length and shape and jumps to the target.  Call while audio
+        is stopped. */
+    void prepare(double sampleRate, float rampSeconds, Curve newCurve)
+    {
+        curve = newCurve;
+        rampSamples = juce::jmax(1, static_cast<int>(sampleRate * static_cast<double>(rampSeconds)));
+
+        const double multiplier = std::pow(kExponentialResidual, 1.0 / static_cast<double>(rampSamples));
+        for (size_t lane = 0; lane < multipliers.size(); ++lane)
+            multipliers[lane] = static_cast<float>(std::pow(multiplier, static_cast<double>(lane + 1)));
+
+        snapToTarget();
+    }
+
+    /** Sets the value to ramp towards.  Safe from any thread. */
+    void setTarget(float newTarget) { target.store(newTarget, std::memory_order_relaxed); }
+
+    float getTarget() const { return target.load(std::memory_order_relaxed); }
+
+    /** Jumps to the latest target, cancelling any ramp.  Audio thread, or while
+        audio is stopped. */
+    void snapToTarget()
+    {
+        rampTarget = getTarget();
+        current = rampTarget;
+        position = rampSamples;
+    }
+
+    /** Picks up the latest target, starting a ramp from the current value if it
+        has moved.  Call on the audio thread at the start of each block; returns
+        true while a ramp is running. */
+    bool beginBlock()
+    {
+        const float newTarget = getTarget();
+        if (newTarget != rampTarget)
+        {
+            rampStart = current;
+            rampTarget = newTarget;
+            step = (rampTarget - rampStart) / static_cast<float>(rampSamples);
+            anchor = rampStart - rampTarget;
+            position = 0;
+        }
+
+        return isRamping();
+    }
+
+    bool isRamping() const { return position < rampSamples; }
+
+    /** The value of the most recently rendered sample. */
+    float getCurrentValue() const { return current; }
+
+    /** Writes the next numSamples values into dest and advances the ramp. */
+    void fill(float* dest, int numSamples)
+    {
+        const int rampCount = isRamping() ? juce::jmin(numSamples, rampSamples - position) : 0;
+        if (rampCount > 0)
+        {
+            if (curve == Curve::Linear)
+                fillLinear(dest, rampCount);
+            else
+                fillExponential(dest, rampCount);
+
+            position += rampCount;
+            if (position == rampSamples)
+                dest[rampCount - 1] = rampTarget;
+            current = dest[rampCount - 1];
+        }
+
+        std::fill(dest + rampCount, dest + numSamples, current);
+    }
+
+    /** Advances the ramp by numSamples without writing the values, for
+        parameters that are only applied at control rate. */
+    void skip(int numSamples)
+    {
+        float discarded[kSkipChunk];
+        while (numSamples > 0 && isRamping())
+        {
+            const int count = juce::jmin(kSkipChunk, numSamples);
+            fill(discarded, count);
+            numSamples -= count;
+        }
+    }
+
+private:
+    static constexpr double kExponentialResidual = 0.001;
+    static constexpr int kSkipChunk = 32;
+
+    /** Ramp sample p (counted from 1) is rampStart + step * p, computed directly
+        rather than accumulated, so it is the same however the ramp is split. */
+    void fillLinear(float* dest, int numSamples) const
+    {
+        int i = 0;
+
+#if ECHOFORM_SIMD_SSE
+        {
+            const __m128 start = _mm_set1_ps(rampStart);
+            const __m128 increment = _mm_set1_ps(step);
+            const __m128 four = _mm_set1_ps(4.0f);
+            const auto first = static_cast<float>(position);
+            __m128 index = _mm_setr_ps(first + 1.0f, first + 2.0f, first + 3.0f, first + 4.0f);
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                _mm_storeu_ps(dest + i, _mm_add_ps(start, _mm_mul_ps(increment, index)));
+                index = _mm_add_ps(index, four);
+            }
+        }
+#elif ECHOFORM_SIMD_NEON
+        {
+            const float32x4_t start = vdupq_n_f32(rampStart);
+            const float32x4_t increment = vdupq_n_f32(step);
+            const float32x4_t four = vdupq_n_f32(4.0f);
+            const auto first = static_cast<float>(position);
+            const float indexValues[4] = { first + 1.0f, first + 2.0f, first + 3.0f, first + 4.0f };
+            float32x4_t index = vld1q_f32(indexValues);
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                vst1q_f32(dest + i, vaddq_f32(start, vmulq_f32(increment, index)));
+                index = vaddq_f32(index, four);
+            }
+        }
+#endif
+
+        for (; i < numSamples; ++i)
+            dest[i] = rampStart + step * static_cast<float>(position + i + 1);
+    }
+
+    /** Ramp samples are taken in groups of four counted from the ramp start:
+        sample k of a group is rampTarget + anchor * m^(k + 1), and anchor steps by
+        m^4 per group.  A group cut by a block boundary is finished one sample at a
+        time with the same arithmetic, so split and unsplit ramps agree. */
+    void fillExponential(float* dest, int numSamples)
+    {
+        int i = 0;
+        for (; i < numSamples && ((position + i) & 3) != 0; ++i)
+            dest[i] = exponentialSample(position + i);
+
+#if ECHOFORM_SIMD_SSE
+        {
+            const __m128 targetVector = _mm_set1_ps(rampTarget);
+            const __m128 laneMultipliers = _mm_loadu_ps(multipliers.data());
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                _mm_storeu_ps(dest + i, _mm_add_ps(targetVector, _mm_mul_ps(_mm_set1_ps(anchor), laneMultipliers)));
+                anchor = anchor * multipliers[3];
+            }
+        }
+#elif ECHOFORM_SIMD_NEON
+        {
+            const float32x4_t targetVector = vdupq_n_f32(rampTarget);
+            const float32x4_t laneMultipliers = vld1q_f32(multipliers.data());
+            for (; i + 4 <= numSamples; i += 4)
+            {
+                vst1q_f32(dest + i, vaddq_f32(targetVector, vmulq_f32(vdupq_n_f32(anchor), laneMultipliers)));
+                anchor = anchor * multipliers[3];
+            }
+        }
+#endif
+
+        for (; i < numSamples; ++i)
+            dest[i] = exponentialSample(position + i);
+    }
+
+    float exponentialSample(int rampIndex)
+    {
+        const int lane = rampIndex & 3;
+        const float value = rampTarget + anchor * multipliers[static_cast<size_t>(lane)];
+        if (lane == 3)
+            anchor = anchor * multipliers[3];
+        return value;
+    }
+
+    std::atomic<float> target;
+    Curve curve { Curve::Linear };
+    int rampSamples { 1 };
+    int position { 1 };
+    float current { 0.0f };
+    float rampStart { 0.0f };
+    float rampTarget { 0.0f };
+    float step { 0.0f };
+    float anchor { 0.0f };
+    std::array<float, 4> multipliers { { 1.0f, 1.0f, 1.0f, 1.0f } };
+};
@@ -0,0 +1,896 @@
+#include <JuceHeader.h>
+#include "EngineSlot.h"
+#include "Lfo.h"
+#include "MemoryDelayEngine.h"
+#include "MemoryResampler.h"
+#include "MemorySnapshot.h"
+#include "Modifiers.h"
+#include "PageArena.h"
+#include "RandomGenerator.h"
+#include "ReferenceModifiers.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+namespace {
+constexpr double kSampleRate = 48000.0;
+constexpr float kBufferSeconds = 180.0f;
+constexpr int kBlockSize = 256;
+constexpr int kNumBlocks = 4000;
+
+// Results are folded in here so the optimiser cannot drop the measured work.
+volatile float benchmarkSink = 0.0f;
+
+const char* getLayoutName(MemoryBuffer<>::Layout layout)
+{
+    return layout == MemoryBuffer<>::Layout::Interleaved ? "interleaved" : "planar";
+}
+
+template <typename Body>
+double measureNanosecondsPerFrame(Body&& body)
+{
+    // One untimed pass warms the caches and the branch predictors.
+    body();
+    const auto start = std::chrono::steady_clock::now();
+    body();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const double nanoseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    return nanoseconds / static_cast<double>(kBlockSize * kNumBlocks);
+}
+
+void fillMemory(MemoryBuffer<>& memory)
+{
+    for (int i = 0; i < memory.getBufferSize(); ++i)
+        memory.writeSample(std::sin(0.001f * static_cast<float>(i)), std::cos(0.0013f * static_cast<float>(i)));
+}
+
+/** Stereo blocks for timing modifiers, copied from a precomputed signal so
+    filling one costs little next to the modifiers. */
+struct ModifierBlocks
+{
+    ModifierBlocks()
+    {
+        for (size_t i = 0; i < source.size(); ++i)
+            source[i] = std::sin(0.011f * static_cast<float>(i));
+    }
+
+    void fill(int block)
+    {
+        const float* start = source.data() + block % kBlockSize;
+        std::copy(start, start + kBlockSize, left.begin());
+        std::transform(start, start + kBlockSize, right.begin(), [](float x) { return -0.5f * x; });
+    }
+
+    std::vector<float> source = std::vector<float>(2 * kBlockSize);
+    std::vector<float> left = std::vector<float>(kBlockSize);
+    std::vector<float> right = std::vector<float>(kBlockSize);
+    float* const channels[2] { left.data(), right.data() };
+};
+
+/** Records one frame and reads numHeads playheads (both channels each) per
+    sample, the way the engine does outside a size crossfade (two heads) and
+    during one (four heads). */
+void benchmarkPerSampleReads(MemoryBuffer<>::Layout layout, int numHeads, const char* label)
+{
+    MemoryBuffer<> memory;
+    memory.setLayout(layout);
+    memory.prepare(kSampleRate, kBufferSeconds);
+    fillMemory(memory);
+
+    std::vector<float> headDelays(static_cast<size_t>(numHeads));
+    for (int head = 0; head < numHeads; ++head)
+        headDelays[static_cast<size_t>(head)] = static_cast<float>(kSampleRate) * (20.0f + 37.0f * static_cast<float>(head)) + 0.37f;
+
+    float sink = 0.0f;
+    const double perFrame = measureNanosecondsPerFrame([&]
+    {
+        for (int block = 0; block < kNumBlocks; ++block)
+        {
+            for (int i = 0; i < kBlockSize; ++i)
+            {
+                float left = 0.0f;
+                float right = 0.0f;
+                for (int head = 0; head < numHeads; ++head)
+                {
+                    const float delay = headDelays[static_cast<size_t>(head)] + 0.001f * static_cast<float>(i);
+                    left += memory.read(0, delay);
+                    right += memory.read(1, delay);
+                }
+                memory.writeSample(0.5f * left, 0.5f * right);
+                sink += left;
+            }
+        }
+    });
+
+    benchmarkSink = benchmarkSink + sink;
+    std::printf("  %-28s %-12s %8.2f ns/frame\n", label, getLayoutName(layout), perFrame);
+}
+
+/** The same workload through MemoryBuffer<>::readBlock(), one block per head
+    and channel, followed by the block's writes. */
+void benchmarkBlockReads(MemoryBuffer<>::Layout layout, int numHeads, const char* label)
+{
+    MemoryBuffer<> memory;
+    memory.setLayout(layout);
+    memory.prepare(kSampleRate, kBufferSeconds);
+    fillMemory(memory);
+
+    std::vector<float> left(kBlockSize);
+    std::vector<float> right(kBlockSize);
+    std::vector<float> scratch(kBlockSize);
+
+    float sink = 0.0f;
+    const double perFrame = measureNanosecondsPerFrame([&]
+    {
+        for (int block = 0; block < kNumBlocks; ++block)
+        {
+            std::fill(left.begin(), left.end(), 0.0f);
+            std::fill(right.begin(), right.end(), 0.0f);
+            for (int head = 0; head < numHeads; ++head)
+            {
+                const auto delay = SimdInterpolator::toPhase(kSampleRate * (20.0 + 37.0 * static_cast<double>(head)) + 0.37);
+                const auto increment = static_cast<std::int64_t>(SimdInterpolator::toPhase(0.001));
+                memory.readBlock(0, delay, increment, scratch.data(), kBlockSize, true);
+                for (int i = 0; i < kBlockSize; ++i)
+                    left[static_cast<size_t>(i)] += scratch[static_cast<size_t>(i)];
+                memory.readBlock(1, delay, increment, scratch.data(), kBlockSize, true);
+                for (int i = 0; i < kBlockSize; ++i)
+                    right[static_cast<size_t>(i)] += scratch[static_cast<size_t>(i)];
+            }
+            for (int i = 0; i < kBlockSize; ++i)
+                memory.writeSample(0.5f * left[static_cast<size_t>(i)], 0.5f * right[static_cast<size_t>(i)]);
+            sink += left[0];
+        }
+    });
+
+    benchmarkSink = benchmarkSink + sink;
+    std::printf("  %-28s %-12s %8.2f ns/frame\n", label, getLayoutName(layout), perFrame);
+}
+
+void runLayoutBenchmarks()
+{
+    std::printf("MemoryBuffer layout, %.0f s at %.0f Hz, %d-sample blocks\n",
+                static_cast<double>(kBufferSeconds), kSampleRate, kBlockSize);
+
+    for (const auto layout : { MemoryBuffer<>::Layout::Planar, MemoryBuffer<>::Layout::Interleaved })
+    {
+        benchmarkPerSampleReads(layout, 2, "two playheads, per sample");
+        benchmarkPerSampleReads(layout, 4, "size crossfade, per sample");
+        benchmarkBlockReads(layout, 2, "two playheads, readBlock");
+        benchmarkBlockReads(layout, 4, "size crossfade, readBlock");
+    }
+}
+/** Renders 60 s through the engine at 48 kHz with the size held, automated
+    continuously (a slow sweep updated every block), and stepped by large jumps
+    every 100 ms, which forces back-to-back crossfades. */
+void runSizeAutomationBenchmarks()
+{
+    constexpr int kEngineBlockSize = 512;
+    constexpr int kEngineBlocks = static_cast<int>(60.0 * kSampleRate) / kEngineBlockSize;
+
+    std::printf("Size automation, 60 s at %.0f Hz, %d-sample blocks\n", kSampleRate, kEngineBlockSize);
+
+    const char* labels[] = { "static size", "continuous automation", "large jumps" };
+    for (int scenario = 0; scenario < 3; ++scenario)
+    {
+        MemoryDelayEngine<> engine;
+        engine.prepare(kSampleRate, kEngineBlockSize, 10.0f);
+        engine.setMix(0.5f);
+        engine.setFeedback(0.4f);
+        engine.setScan(0.7f);
+        engine.setSpread(0.3f);
+        engine.setSize(4.0f);
+
+        juce::AudioBuffer<float> block(2, kEngineBlockSize);
+        int crossfadeBlocks = 0;
+        float sink = 0.0f;
+
+        const auto start = std::chrono::steady_clock::now();
+        for (int index = 0; index < kEngineBlocks; ++index)
+        {
+            for (int i = 0; i < kEngineBlockSize; ++i)
+            {
+                const float value = std::sin(0.01f * static_cast<float>(i + index));
+                block.setSample(0, i, value);
+                block.setSample(1, i, value);
+            }
+
+            const float time = static_cast<float>(index * kEngineBlockSize) / static_cast<float>(kSampleRate);
+            if (scenario == 1)
+                engine.setSize(4.0f + 1.5f * std::sin(0.2f * time));
+            else if (scenario == 2 && index % 10 == 0)
+                engine.setSize((index / 10) % 2 == 0 ? 2.0f : 6.0f);
+
+            engine.processBlock(block);
+            crossfadeBlocks += engine.debugIsSizeCrossfading() ? 1 : 0;
+            sink += block.getSample(0, 0);
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        benchmarkSink = benchmarkSink + sink;
+        const double nanoseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        std::printf("  %-28s %8.2f ns/frame, crossfading after %d of %d blocks\n", labels[scenario],
+                    nanoseconds / static_cast<double>(kEngineBlocks * kEngineBlockSize), crossfadeBlocks, kEngineBlocks);
+    }
+}
+
+/** Times Saturator::processBlock() on a stereo block, and one engine render
+    per mode with writes saturated on the recording path. */
+void runSaturatorBenchmarks()
+{
+    std::printf("Saturator, %d-sample stereo blocks\n", kBlockSize);
+    Saturator::prepare();
+
+    const char* labels[] = { "exact (std::tanh)", "rational", "polynomial", "table" };
+    std::vector<float> left(kBlockSize);
+    std::vector<float> right(kBlockSize);
+    for (int mode = 0; mode < 4; ++mode)
+    {
+        float sink = 0.0f;
+        const double perFrame = measureNanosecondsPerFrame([&]
+        {
+            for (int block = 0; block < kNumBlocks; ++block)
+            {
+                for (int i = 0; i < kBlockSize; ++i)
+                {
+                    const float x = 0.013f * static_cast<float>(i + block) - 3.0f;
+                    left[static_cast<size_t>(i)] = x;
+                    right[static_cast<size_t>(i)] = -0.7f * x;
+                }
+                Saturator::processBlock(static_cast<Saturator::Mode>(mode), left.data(), right.data(), kBlockSize);
+                sink += left[0] + right[kBlockSize - 1];
+            }
+        });
+
+        benchmarkSink = benchmarkSink + sink;
+        std::printf("  %-28s %8.2f ns/frame\n", labels[mode], perFrame);
+    }
+
+    constexpr int kEngineBlockSize = 512;
+    constexpr int kEngineBlocks = static_cast<int>(20.0 * kSampleRate) / kEngineBlockSize;
+    for (int mode = 0; mode < 4; ++mode)
+    {
+        MemoryDelayEngine<> engine;
+        engine.prepare(kSampleRate, kEngineBlockSize, 10.0f);
+        engine.setMix(0.5f);
+        engine.setFeedback(0.6f);
+        engine.setSize(2.0f);
+        engine.setSaturatorMode(mode);
+
+        juce::AudioBuffer<float> block(2, kEngineBlockSize);
+        float sink = 0.0f;
+        const auto start = std::chrono::steady_clock::now();
+        for (int index = 0; index < kEngineBlocks; ++index)
+        {
+            for (int i = 0; i < kEngineBlockSize; ++i)
+            {
+                const float value = 1.5f * std::sin(0.01f * static_cast<float>(i + index));
+                block.setSample(0, i, value);
+                block.setSample(1, i, value);
+            }
+            engine.processBlock(block);
+            sink += block.getSample(0, 0);
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+
+        benchmarkSink = benchmarkSink + sink;
+        const double nanoseconds = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        std::printf("  engine, %-20s %8.2f ns/frame\n", labels[mode],
+                    nanoseconds / static_cast<double>(kEngineBlocks * kEngineBlockSize));
+    }
+}
+/** Reports the memory held per engine with eager and lazy allocation, after
+    10 s of audio at each sample rate and size, so that recycled pages have
+    settled into the steady-state footprint. */
+void runResidentMemoryReport()
+{
+    std::printf("Resident memory per engine, %.0f s buffer\n", static_cast<double>(kBufferSeconds));
+
+    for (const double sampleRate : { 48000.0, 192000.0 })
+    {
+        for (const float size : { 3.0f, 60.0f })
+        {
+            double megabytes[2] = {};
+            for (int lazy = 0; lazy < 2; ++lazy)
+            {
+                MemoryDelayEngine<> engine;
+                engine.setLazyMemoryAllocation(lazy != 0);
+                engine.setSize(size);
+                engine.prepare(sampleRate, kBlockSize, kBufferSeconds);
+
+                juce::AudioBuffer<float> block(2, kBlockSize);
+                const int numBlocks = static_cast<int>(10.0 * sampleRate) / kBlockSize;
+                for (int index = 0; index < numBlocks; ++index)
+                {
+                    block.clear();
+                    engine.processBlock(block);
+                    engine.serviceMemory();
+                }
+
+                megabytes[lazy] = static_cast<double>(engine.getMemoryResidentBytes()) / (1024.0 * 1024.0);
+            }
+
+            std::printf("  %6.0f Hz, size %4.0f s        eager %7.1f MB, lazy %7.1f MB\n", sampleRate,
+                        static_cast<double>(size), megabytes[0], megabytes[1]);
+        }
+    }
+}
+
+const char* getFormatName(MemoryBuffer<>::Format format)
+{
+    switch (format)
+    {
+        case MemoryBuffer<>::Format::Half:     return "half";
+        case MemoryBuffer<>::Format::Int16:    return "int16 + TPDF";
+        case MemoryBuffer<>::Format::Packed24: return "packed 24-bit";
+        case MemoryBuffer<>::Format::Native:
+        default:                               return "float";
+    }
+}
+
+/** Times the memory traffic of each storage format: recording blocks with
+    writeBlock(), and two playheads of readBlock() per channel.  Bandwidth is
+    the bytes of memory each frame touches (one stereo frame written, or two
+    interpolated reads per channel) over the time per frame. */
+void runFormatBenchmarks()
+{
+    std::printf("Memory formats, %.0f s at %.0f Hz, %d-sample blocks\n", static_cast<double>(kBufferSeconds),
+                kSampleRate, kBlockSize);
+
+    using Format = MemoryBuffer<>::Format;
+    for (const auto format : { Format::Native, Format::Half, Format::Int16, Format::Packed24 })
+    {
+        MemoryBuffer<> memory;
+        memory.setFormat(format);
+        memory.prepare(kSampleRate, kBufferSeconds);
+        fillMemory(memory);
+
+        std::vector<float> left(kBlockSize);
+        std::vector<float> right(kBlockSize);
+        for (int i = 0; i < kBlockSize; ++i)
+        {
+            left[static_cast<size_t>(i)] = 0.8f * std::sin(0.01f * static_cast<float>(i));
+            right[static_cast<size_t>(i)] = 0.8f * std::cos(0.013f * static_cast<float>(i));
+        }
+
+        const double writeTime = measureNanosecondsPerFrame([&]
+        {
+            for (int block = 0; block < kNumBlocks; ++block)
+                memory.writeBlock(left.data(), right.data(), kBlockSize);
+        });
+
+        float sink = 0.0f;
+        const double readTime = measureNanosecondsPerFrame([&]
+        {
+            for (int block = 0; block < kNumBlocks; ++block)
+            {
+                for (int head = 0; head < 2; ++head)
+                {
+                    const auto delay = SimdInterpolator::toPhase(kSampleRate * (20.0 + 37.0 * static_cast<double>(head)) + 0.37);
+                    const auto increment = static_cast<std::int64_t>(SimdInterpolator::toPhase(0.001));
+                    for (int channel = 0; channel < 2; ++channel)
+                    {
+                        memory.readBlock(channel, delay, increment, left.data(), kBlockSize, false);
+                        sink += left[0];
+                    }
+                }
+            }
+        });
+
+        benchmarkSink = benchmarkSink + sink;
+        const int bytesPerSample = MemoryBuffer<>::getBytesPerSample(format);
+        const double writeBytes = 2.0 * bytesPerSample;
+        const double readBytes = 8.0 * bytesPerSample;
+        std::printf("  %-14s %d B/sample %6.1f MB   write %6.2f ns/frame (%5.2f GB/s)   "
+                    "read %6.2f ns/frame (%5.2f GB/s)\n",
+                    getFormatName(format), bytesPerSample,
+                    static_cast<double>(memory.getResidentBytes()) / (1024.0 * 1024.0), writeTime,
+                    writeBytes / writeTime, readTime, readBytes / readTime);
+    }
+}
+
+/** Times prepareToPlay() as the processor does it: a cold prepare builds the
+    engine, a restart at the same sample rate only re-prepares the block-size
+    state and keeps the recorded memory. */
+void runPrepareBenchmarks()
+{
+    std::printf("prepareToPlay, %.0f s buffer at %.0f Hz\n", static_cast<double>(kBufferSeconds), kSampleRate);
+
+    using Clock = std::chrono::steady_clock;
+    constexpr int numRestarts = 32;
+    for (int lazy = 0; lazy < 2; ++lazy)
+    {
+        EngineSlot<MemoryDelayEngine<>> slot;
+        slot.setLazyMemoryAllocation(lazy != 0);
+
+        auto start = Clock::now();
+        slot.prepare(kSampleRate, kBlockSize, kBufferSeconds, true);
+        const double coldMicroseconds = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+
+        start = Clock::now();
+        for (int restart = 0; restart < numRestarts; ++restart)
+            slot.prepare(kSampleRate, restart % 2 == 0 ? 2 * kBlockSize : kBlockSize, kBufferSeconds, false);
+        const double warmMicroseconds = std::chrono::duration<double, std::micro>(Clock::now() - start).count()
+                                      / numRestarts;
+
+        std::printf("  %-6s  cold %10.1f us, same-rate restart %8.2f us\n", lazy != 0 ? "lazy" : "eager",
+                    coldMicroseconds, warmMicroseconds);
+    }
+}
+
+/** Times converting a full memory to a new sample rate, as a host rate change
+    does on the memory thread. */
+void runResampleBenchmarks()
+{
+    constexpr double sourceRate = 44100.0;
+    constexpr double targetRate = 96000.0;
+    std::printf("Memory resampling, %.0f s from %.0f Hz to %.0f Hz\n", static_cast<double>(kBufferSeconds),
+                sourceRate, targetRate);
+
+    MemoryBuffer<> source;
+    source.prepare(sourceRate, kBufferSeconds);
+    fillMemory(source);
+    MemoryBuffer<> target;
+    target.prepare(targetRate, kBufferSeconds);
+
+    MemoryResampler<> resampler;
+    resampler.prepare(sourceRate, targetRate);
+    const auto start = std::chrono::steady_clock::now();
+    const int numFrames = resampler.process(source, target);
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    benchmarkSink = benchmarkSink + target.getSample(0, numFrames / 2);
+
+    std::printf("  %d phases x %d taps   %.0f ms   %.1f ns/frame   %.0fx realtime\n", resampler.getNumPhases(),
+                resampler.getNumTaps(), seconds * 1000.0, seconds * 1.0e9 / numFrames,
+                static_cast<double>(kBufferSeconds) / seconds);
+}
+
+/** Creates and destroys engines the way a session does as instances come and
+    go, and reports how long each creation takes and what the shared
+    PageArena holds afterwards. */
+void runArenaReport()
+{
+    constexpr int numInstances = 8;
+    constexpr int numRounds = 4;
+    std::printf("Page arena, %d instances created and destroyed %d times, %.0f s eager buffers at %.0f Hz\n",
+                numInstances, numRounds, static_cast<double>(kBufferSeconds), kSampleRate);
+
+    using Clock = std::chrono::steady_clock;
+    for (int round = 0; round < numRounds; ++round)
+    {
+        std::vector<std::unique_ptr<MemoryDelayEngine<>>> instances;
+        const auto start = Clock::now();
+        for (int index = 0; index < numInstances; ++index)
+        {
+            instances.push_back(std::make_unique<MemoryDelayEngine<>>());
+            instances.back()->prepare(kSampleRate, kBlockSize, kBufferSeconds);
+        }
+        const double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+        const auto statistics = PageArena::getInstance().getStatistics();
+        std::printf("  round %d   %6.1f ms per instance   %zu pages in use, %zu slabs (%zu huge), "
+                    "fragmentation %.1f%%\n",
+                    round + 1, milliseconds / numInstances, statistics.pagesInUse, statistics.slabs,
+                    statistics.hugePageSlabs, statistics.fragmentation * 100.0);
+    }
+
+    const auto statistics = PageArena::getInstance().getStatistics();
+    std::printf("  after the last round   %zu pages in use, peak %zu, %.1f MB reserved\n", statistics.pagesInUse,
+                statistics.peakPagesInUse, static_cast<double>(statistics.bytesReserved) / (1024.0 * 1024.0));
+}
+/** Times saving and loading the memory with the plug-in state: capturing a
+    full size window with and without the memory thread's page cache, the
+    compressed size, and restoring it a few pages per service call at the
+    same and at another sample rate. */
+void runSnapshotBenchmarks()
+{
+    constexpr float sizeSeconds = 60.0f;
+    std::printf("Memory snapshots, %.0f s size (%.0f s retained) at %.0f Hz\n", static_cast<double>(sizeSeconds),
+                2.0 * static_cast<double>(sizeSeconds), kSampleRate);
+
+    using Clock = std::chrono::steady_clock;
+    const auto prepareEngine = [](MemoryDelayEngine<>& engine, double sampleRate, bool caching)
+    {
+        engine.prepare(sampleRate, kBlockSize, kBufferSeconds);
+        engine.setSize(sizeSeconds);
+        engine.setMix(1.0f);
+        engine.setFeedback(0.0f);
+        engine.setMemorySnapshotCaching(caching);
+    };
+
+    std::shared_ptr<const MemorySnapshot> snapshot;
+    for (int caching = 0; caching < 2; ++caching)
+    {
+        // Two detuned partials under a slow swell, with noise 60 dB down
+        MemoryDelayEngine<> engine;
+        prepareEngine(engine, kSampleRate, caching != 0);
+        RandomGenerator random;
+        random.setSeed(1);
+        juce::AudioBuffer<float> block(2, kBlockSize);
+        const int numBlocks = static_cast<int>(2.0 * sizeSeconds * kSampleRate) / kBlockSize;
+        for (int b = 0, frame = 0; b < numBlocks; ++b)
+        {
+            for (int i = 0; i < kBlockSize; ++i, ++frame)
+            {
+                const float t = static_cast<float>(frame) / static_cast<float>(kSampleRate);
+                const float swell = 0.25f + 0.2f * std::sin(0.7f * t);
+                block.setSample(0, i, swell * std::sin(1382.3f * t) + 0.001f * random.nextFloatSigned());
+                block.setSample(1, i, swell * std::sin(1390.1f * t) + 0.001f * random.nextFloatSigned());
+            }
+            engine.processBlock(block);
+            if (b % 16 == 0)
+                engine.serviceMemory();
+        }
+
+        const auto start = Clock::now();
+        snapshot = engine.captureMemorySnapshot();
+        const double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::printf("  capture, %-9s %8.1f ms\n", caching != 0 ? "cached" : "uncached", milliseconds);
+    }
+
+    std::vector<unsigned char> chunk;
+    auto start = Clock::now();
+    snapshot->serialise(chunk);
+    const double serialiseMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    start = Clock::now();
+    const auto loaded = MemorySnapshot::deserialise(chunk.data(), chunk.size());
+    const double loadMilliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    const double rawBytes = static_cast<double>(snapshot->numFrames) * 2.0 * sizeof(float);
+    std::printf("  %.1f MB serialised in %.1f ms, checked in %.2f ms, %.1f%% of the float memory\n",
+                static_cast<double>(chunk.size()) / (1024.0 * 1024.0), serialiseMilliseconds, loadMilliseconds,
+                100.0 * static_cast<double>(chunk.size()) / rawBytes);
+
+    for (const double targetRate : { kSampleRate, 44100.0 })
+    {
+        MemoryDelayEngine<> target;
+        prepareEngine(target, targetRate, true);
+        target.restoreMemorySnapshot(loaded);
+
+        int calls = 0;
+        double longestMilliseconds = 0.0;
+        start = Clock::now();
+        while (target.isRestoringMemory())
+        {
+            const auto callStart = Clock::now();
+            target.serviceMemory();
+            longestMilliseconds = std::max(longestMilliseconds,
+                                           std::chrono::duration<double, std::milli>(Clock::now() - callStart).count());
+            ++calls;
+        }
+        const double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        benchmarkSink = benchmarkSink + target.debugGetMemorySample(0, target.getMaxSamples() / 2);
+        std::printf("  restore at %.0f Hz  %8.1f ms in %d service calls, longest %.2f ms\n", targetRate,
+                    milliseconds, calls, longestMilliseconds);
+    }
+}
+
+/** The modifier chain as it was before its stages were composed statically:
+    the four modifiers held by value and called directly, in the same order,
+    each testing its own intensity on every call. */
+class DirectModifierChain
+{
+public:
+    void prepare(double sampleRate, int maxBlockSize, int numChannels)
+    {
+        wowFlutter.prepare(sampleRate, maxBlockSize, numChannels);
+        dropout.prepare(sampleRate, maxBlockSize, numChannels);
+        lowPass.prepare(sampleRate, maxBlockSize, numChannels);
+        pitchDrift.prepare(sampleRate, maxBlockSize, numChannels);
+    }
+
+    void setBipolars(const float* values)
+    {
+        wowFlutter.setBipolar(values[0]);
+        dropout.setBipolar(values[1]);
+        lowPass.setBipolar(values[2]);
+        pitchDrift.setBipolar(values[3]);
+    }
+
+    float processSample(float input, int channel)
+    {
+        float output = input;
+        output = processSample(wowFlutter, output, channel);
+        output = processSample(dropout, output, channel);
+        output = processSample(lowPass, output, channel);
+        output = processSample(pitchDrift, output, channel);
+        return output;
+    }
+
+    void processBlock(float* const* channels, int numChannels, int numSamples)
+    {
+        processBlock(wowFlutter, channels, numChannels, numSamples);
+        processBlock(dropout, channels, numChannels, numSamples);
+        processBlock(lowPass, channels, numChannels, numSamples);
+        processBlock(pitchDrift, channels, numChannels, numSamples);
+    }
+
+private:
+    // The intensity test each modifier made first thing in its own processing
+    template <typename Stage>
+    static float processSample(Stage& stage, float input, int channel)
+    {
+        return stage.isActive() ? stage.processSample(input, channel) : input;
+    }
+
+    template <typename Stage>
+    static void processBlock(Stage& stage, float* const* channels, int numChannels, int numSamples)
+    {
+        if (stage.isActive())
+            stage.processBlock(channels, numChannels, numSamples);
+    }
+
+    WowFlutterModifier<float> wowFlutter;
+    DropoutModifier<float> dropout;
+    LowPassModifier<float> lowPass;
+    PitchDriftModifier<float> pitchDrift;
+};
+
+/** Times the statically composed modifier stages against the direct chain
+    with no stage, one stage (the low-pass) and all four active, a block at a
+    time (the In and Out routings) and a sample at a time (the feedback loop). */
+void runModifierChainBenchmarks()
+{
+    std::printf("Modifier chain, %d-sample stereo blocks\n", kBlockSize);
+
+    using Stages = ModifierStages<float, WowFlutterModifier<float>, DropoutModifier<float>, LowPassModifier<float>,
+                                  PitchDriftModifier<float>>;
+    const char* labels[] = { "none active", "one active", "all active" };
+    const float bipolars[][4] = { { 0.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.6f, 0.0f }, { 0.6f, 0.5f, 0.6f, 0.2f } };
+
+    ModifierBlocks blocks;
+    auto& left = blocks.left;
+    auto& right = blocks.right;
+
+    for (int scenario = 0; scenario < 3; ++scenario)
+    {
+        const float* values = bipolars[scenario];
+        Stages stages;
+        stages.prepare(kSampleRate, kBlockSize, 2);
+        stages.get<WowFlutterModifier<float>>().setBipolar(values[0]);
+        stages.get<DropoutModifier<float>>().setBipolar(values[1]);
+        stages.get<LowPassModifier<float>>().setBipolar(values[2]);
+        stages.get<PitchDriftModifier<float>>().setBipolar(values[3]);
+        stages.updateActiveStages();
+
+        DirectModifierChain direct;
+        direct.prepare(kSampleRate, kBlockSize, 2);
+        direct.setBipolars(values);
+
+        float sink = 0.0f;
+        const double staticBlock = measureNanosecondsPerFrame([&]
+        {
+            for (int block = 0; block < kNumBlocks; ++block)
+            {
+                blocks.fill(block);
+                stages.processBlock(blocks.channels, 2, kBlockSize);
+                sink += left[0] + right[kBlockSize - 1];
+            }
+        });
+        const double directBlock = measureNanosecondsPerFrame([&]
+        {
+            for (int block = 0; block < kNumBlocks; ++block)
+            {
+                blocks.fill(block);
+                direct.processBlock(blocks.channels, 2, kBlockSize);
+                sink += left[0] + right[kBlockSize - 1];
+            }
+        });
+        const double staticSample = measureNanosecondsPerFrame([&]
+        {
+            for (int block = 0; block < kNumBlocks; ++block)
+            {
+                blocks.fill(block);
+                for (int i = 0; i < kBlockSize; ++i)
+                {
+                    left[static_cast<size_t>(i)] = stages.processSample(left[static_cast<size_t>(i)], 0);
+                    right[static_cast<size_t>(i)] = stages.processSample(right[static_cast<size_t>(i)], 1);
+                }
+                sink += left[0] + right[kBlockSize - 1];
+            }
+        });
+        const double directSample = measureNanosecondsPerFrame([&]
+        {
+            for (int block = 0; block < kNumBlocks; ++block)
+            {
+                blocks.fill(block);
+                for (int i = 0; i < kBlockSize; ++i)
+                {
+                    left[static_cast<size_t>(i)] = direct.processSample(left[static_cast<size_t>(i)], 0);
+                    right[static_cast<size_t>(i)] = direct.processSample(right[static_cast<size_t>(i)], 1);
+                }
+                sink += left[0] + right[kBlockSize - 1];
+            }
+        });
+
+        benchmarkSink = benchmarkSink + sink;
+        std::printf("  %-12s block  static %7.2f, direct %7.2f ns/frame   "
+                    "sample  static %7.2f, direct %7.2f ns/frame\n",
+                    labels[scenario], staticBlock, directBlock, staticSample, directSample);
+    }
+}
+
+/** Times TapeTransportModifier against WowFlutterModifier and
+    PitchDriftModifier in series, with wow alone and with both active, a
+    block at a time and a sample at a time. */
+void runTapeTransportBenchmarks()
+{
+    std::printf("Tape transport, %d-sample stereo blocks\n", kBlockSize);
+
+    using Series = ModifierStages<float, WowFlutterModifier<float>, PitchDriftModifier<float>>;
+    const char* labels[] = { "wow only", "wow and drift" };
+    const float bipolars[][2] = { { 0.6f, 0.0f }, { 0.6f, 0.2f } };
+
+    ModifierBlocks blocks;
+    auto& left = blocks.left;
+    auto& right = blocks.right;
+
+    for (int scenario = 0; scenario < 2; ++scenario)
+    {
+        Series series;
+        series.prepare(kSampleRate, kBlockSize, 2);
+        series.get<WowFlutterModifier<float>>().setBipolar(bipolars[scenario][0]);
+        series.get<PitchDriftModifier<float>>().setBipolar(bipolars[scenario][1]);
+        series.updateActiveStages();
+
+        TapeTransportModifier<float> transport;
+        transport.prepare(kSampleRate, kBlockSize, 2);
+        transport.setWowFlutter(bipolars[scenario][0]);
+        transport.setPitchDrift(bipolars[scenario][1]);
+
+        float sink = 0.0f;
+        const auto timeBlocks = [&](auto& modifier)
+        {
+            return measureNanosecondsPerFrame([&]
+            {
+                for (int block = 0; block < kNumBlocks; ++block)
+                {
+                    blocks.fill(block);
+                    modifier.processBlock(blocks.channels, 2, kBlockSize);
+                    sink += left[0] + right[kBlockSize - 1];
+                }
+            });
+        };
+        const auto timeSamples = [&](auto& modifier)
+        {
+            return measureNanosecondsPerFrame([&]
+            {
+                for (int block = 0; block < kNumBlocks; ++block)
+                {
+                    blocks.fill(block);
+                    for (int i = 0; i < kBlockSize; ++i)
+                    {
+                        left[static_cast<size_t>(i)] = modifier.processSample(left[static_cast<size_t>(i)], 0);
+                        right[static_cast<size_t>(i)] = modifier.processSample(right[static_cast<size_t>(i)], 1);
+                    }
+                    sink += left[0] + right[kBlockSize - 1];
+                }
+            });
+        };
+
+        const double seriesBlock = timeBlocks(series);
+        const double transportBlock = timeBlocks(transport);
+        const double seriesSample = timeSamples(series);
+        const double transportSample = timeSamples(transport);
+
+        benchmarkSink = benchmarkSink + sink;
+        std::printf("  %-14s block  series %7.2f, transport %7.2f ns/frame   "
+                    "sample  series %7.2f, transport %7.2f ns/frame\n",
+                    labels[scenario], seriesBlock, transportBlock, seriesSample, transportSample);
+    }
+}
+
+/** Times a frame of wow and flutter modulation from two quadrature
+    oscillators against two std::sin calls with wrapped phases, as
+    WowFlutterModifier computed it before. */
+void runLfoBenchmarks()
+{
+    std::printf("Wow and flutter LFOs\n");
+    const double wowIncrement = 2.0 * 3.141592653589793 * 0.45 / kSampleRate;
+    const double flutterIncrement = 2.0 * 3.141592653589793 * 4.1 / kSampleRate;
+
+    float sink = 0.0f;
+    float wowPhase = 0.0f;
+    float flutterPhase = 0.0f;
+    const double sinePerFrame = measureNanosecondsPerFrame([&]
+    {
+        for (int frame = 0; frame < kBlockSize * kNumBlocks; ++frame)
+        {
+            sink += 0.7f * std::sin(wowPhase) + 0.3f * std::sin(flutterPhase);
+            wowPhase += static_cast<float>(wowIncrement);
+            flutterPhase += static_cast<float>(flutterIncrement);
+            if (wowPhase > juce::MathConstants<float>::twoPi)
+                wowPhase -= juce::MathConstants<float>::twoPi;
+            if (flutterPhase > juce::MathConstants<float>::twoPi)
+                flutterPhase -= juce::MathConstants<float>::twoPi;
+        }
+    });
+
+    QuadratureOscillator wow;
+    QuadratureOscillator flutter;
+    wow.setFrequency(0.45, kSampleRate);
+    flutter.setFrequency(4.1, kSampleRate);
+    wow.reset();
+    flutter.reset();
+    const double oscillatorPerFrame = measureNanosecondsPerFrame([&]
+    {
+        for (int frame = 0; frame < kBlockSize * kNumBlocks; ++frame)
+            sink += 0.7f * wow.getNextSine() + 0.3f * flutter.getNextSine();
+    });
+
+    benchmarkSink = benchmarkSink + sink;
+    std::printf("  std::sin %7.2f ns/frame, quadrature oscillators %7.2f ns/frame\n", sinePerFrame,
+                oscillatorPerFrame);
+}
+
+/** Times DropoutModifier a block and a sample at a time, against the draw
+    per frame that deciding each onset separately used to cost. */
+void runDropoutBenchmarks()
+{
+    std::printf("Dropout, %d-sample stereo blocks\n", kBlockSize);
+
+    std::vector<float> left(kBlockSize, 0.5f);
+    std::vector<float> right(kBlockSize, -0.5f);
+    float* const channels[] = { left.data(), right.data() };
+    DropoutModifier<float> dropout;
+    dropout.prepare(kSampleRate, kBlockSize, 2);
+    dropout.setBipolar(0.5f);
+
+    float sink = 0.0f;
+    const double blockPerFrame = measureNanosecondsPerFrame([&]
+    {
+        for (int block = 0; block < kNumBlocks; ++block)
+        {
+            std::fill(left.begin(), left.end(), 0.5f);
+            std::fill(right.begin(), right.end(), -0.5f);
+            dropout.processBlock(channels, 2, kBlockSize);
+            sink += left[0] + right[kBlockSize - 1];
+        }
+    });
+    const double samplePerFrame = measureNanosecondsPerFrame([&]
+    {
+        for (int block = 0; block < kNumBlocks; ++block)
+        {
+            for (int i = 0; i < kBlockSize; ++i)
+            {
+                left[static_cast<size_t>(i)] = dropout.processSample(0.5f, 0);
+                right[static_cast<size_t>(i)] = dropout.processSample(-0.5f, 1);
+            }
+            sink += left[0] + right[kBlockSize - 1];
+        }
+    });
+
+    RandomGenerator random;
+    int onsets = 0;
+    const double drawPerFrame = measureNanosecondsPerFrame([&]
+    {
+        for (int frame = 0; frame < kBlockSize * kNumBlocks; ++frame)
+            onsets += random.nextFloat01() < 0.0003f ? 1 : 0;
+    });
+
+    benchmarkSink = benchmarkSink + sink + static_cast<float>(onsets);
+    std::printf("  block %7.2f ns/frame, sample %7.2f ns/frame; a draw per frame alone %7.2f ns/frame\n",
+                blockPerFrame, samplePerFrame, drawPerFrame);
+}
+} // namespace
+
+int main()
+{
+    runLayoutBenchmarks();
+    runSizeAutomationBenchmarks();
+    runSaturatorBenchmarks();
+    runModifierChainBenchmarks();
+    runTapeTransportBenchmarks();
+    runLfoBenchmarks();
+    runDropoutBenchmarks();
+    runResidentMemoryReport();
+    runFormatBenchmarks();
+    runPrepareBenchmarks();
+    runResampleBenchmarks();
+    runArenaReport();
+    runSnapshotBenchmarks();
+    return 0;
+}
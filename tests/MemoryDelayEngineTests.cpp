@@ -1,23 +1,42 @@
 #include <JuceHeader.h>
+#include "AutomationSplitter.h"
+#include "EngineSlot.h"
+#include "Lfo.h"
 #include "MemoryDelayEngine.h"
+#include "MemoryExporter.h"
+#include "MemoryCodec.h"
+#include "MemoryFeed.h"
+#include "MemoryImporter.h"
+#include "MemoryResampler.h"
+#include "MemorySnapshot.h"
+#include "PageArena.h"
+#include "ReferenceModifiers.h"
 
+#include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace {
 void testWraparoundDsp()
 {
-    ::MemoryDelayEngine engine;
+    ::MemoryDelayEngine<> engine;
     engine.prepare(10.0, 16, 1.0f);
     engine.setMix(1.0f);
     engine.setFeedback(0.0f);
     engine.setAutoScanRate(0.0f);
     engine.setScan(1.0f);
-    engine.setScanMode(static_cast<int>(::MemoryDelayEngine::ScanMode::Manual));
+    engine.setScanMode(static_cast<int>(::MemoryDelayEngine<>::ScanMode::Manual));
     engine.setSpread(0.0f);
     engine.setSize(1.0f);
     engine.setCharacter(0.0f);
-    engine.setMode(static_cast<int>(::MemoryDelayEngine::FeedbackMode::Collect));
+    engine.setMode(static_cast<int>(::MemoryDelayEngine<>::FeedbackMode::Collect));
 
     constexpr int numSamples = 25;
     juce::AudioBuffer<float> buffer(2, numSamples);
@@ -49,14 +68,14 @@ void testWraparoundDsp()
 
 void testCollectOverdub()
 {
-    ::MemoryDelayEngine engine;
+    ::MemoryDelayEngine<> engine;
     engine.prepare(1.0, 1, 0.1f);
     engine.setMix(1.0f);
     engine.setFeedback(0.0f);
     engine.setScan(0.0f);
-    engine.setScanMode(static_cast<int>(::MemoryDelayEngine::ScanMode::Manual));
+    engine.setScanMode(static_cast<int>(::MemoryDelayEngine<>::ScanMode::Manual));
     engine.setSize(0.05f);
-    engine.setMode(static_cast<int>(::MemoryDelayEngine::FeedbackMode::Collect));
+    engine.setMode(static_cast<int>(::MemoryDelayEngine<>::FeedbackMode::Collect));
 
     juce::AudioBuffer<float> buffer(2, 1);
     buffer.setSample(0, 0, 0.1f);
@@ -70,11 +89,2344 @@ void testCollectOverdub()
 
     assert(secondLeft > firstLeft);
 }
+
+template <typename Engine>
+void setBlockTestParameters(Engine& engine)
+{
+    engine.setMix(0.6f);
+    engine.setFeedback(0.5f);
+    engine.setScan(0.02f);
+    engine.setScanMode(static_cast<int>(::MemoryDelayEngine<>::ScanMode::Manual));
+    engine.setSpread(0.3f);
+    engine.setSize(0.5f);
+    engine.setCharacter(0.5f);
+    engine.setModifierBankA(0.4f, 0.6f, -0.3f);
+    engine.setModifierBankB(-0.2f, 0.3f, 0.5f);
+    engine.setMode(static_cast<int>(::MemoryDelayEngine<>::FeedbackMode::Closed));
+    engine.setRandomSeed(99);
+}
+
+template <typename Engine>
+void configureBlockTestEngine(Engine& engine, int maxBlockSize)
+{
+    engine.prepare(8000.0, maxBlockSize, 2.0f);
+    setBlockTestParameters(engine);
+}
+
+void testBlockSizeDoesNotChangeOutput()
+{
+    constexpr int numSamples = 600;
+    juce::AudioBuffer<float> input(2, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        input.setSample(0, i, std::sin(0.05f * static_cast<float>(i)));
+        input.setSample(1, i, 0.5f * std::sin(0.031f * static_cast<float>(i)));
+    }
+
+    // One oversized block exercises the chunked path against many small blocks.
+    ::MemoryDelayEngine<> whole;
+    configureBlockTestEngine(whole, 64);
+    juce::AudioBuffer<float> wholeBuffer;
+    wholeBuffer.makeCopyOf(input);
+    whole.processBlock(wholeBuffer);
+
+    ::MemoryDelayEngine<> split;
+    configureBlockTestEngine(split, 64);
+    constexpr int blockSize = 50;
+    for (int start = 0; start < numSamples; start += blockSize)
+    {
+        juce::AudioBuffer<float> block(2, blockSize);
+        for (int ch = 0; ch < 2; ++ch)
+            block.copyFrom(ch, 0, input, ch, start, blockSize);
+
+        split.processBlock(block);
+
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                assert(block.getSample(ch, i) == wholeBuffer.getSample(ch, start + i));
+    }
+}
+
+/** Renders the block test signal through an engine of the given precisions. */
+template <typename SampleType, typename StorageType>
+std::vector<double> renderAtPrecision(int numSamples)
+{
+    ::MemoryDelayEngine<SampleType, StorageType> engine;
+    configureBlockTestEngine(engine, 64);
+    juce::AudioBuffer<SampleType> buffer(2, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        buffer.setSample(0, i, static_cast<SampleType>(std::sin(0.05f * static_cast<float>(i))));
+        buffer.setSample(1, i, static_cast<SampleType>(0.5f * std::sin(0.031f * static_cast<float>(i))));
+    }
+
+    engine.processBlock(buffer);
+
+    std::vector<double> output;
+    for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            output.push_back(static_cast<double>(buffer.getSample(ch, i)));
+    return output;
+}
+
+void testDoublePrecisionTracksFloat()
+{
+    constexpr int numSamples = 600;
+    const auto reference = renderAtPrecision<float, float>(numSamples);
+    const auto floatMemory = renderAtPrecision<double, float>(numSamples);
+    const auto doubleMemory = renderAtPrecision<double, double>(numSamples);
+
+    double floatMemoryError = 0.0;
+    double doubleMemoryError = 0.0;
+    double peak = 0.0;
+    for (size_t i = 0; i < reference.size(); ++i)
+    {
+        floatMemoryError = std::max(floatMemoryError, std::abs(floatMemory[i] - reference[i]));
+        doubleMemoryError = std::max(doubleMemoryError, std::abs(doubleMemory[i] - reference[i]));
+        peak = std::max(peak, std::abs(reference[i]));
+    }
+
+    assert(peak > 0.1);
+    assert(floatMemoryError < 1.0e-5);
+    assert(doubleMemoryError < 1.0e-5);
+}
+
+void testLazyMemoryMatchesEager()
+{
+    constexpr int blockSize = 64;
+    constexpr int numBlocks = 800;
+
+    // Heads at the far end of the size and spread read 3 s back, the most the
+    // retained span has to cover.
+    ::MemoryDelayEngine<> eager;
+    ::MemoryDelayEngine<> lazy;
+    lazy.setLazyMemoryAllocation(true);
+    for (auto* engine : { &eager, &lazy })
+    {
+        configureBlockTestEngine(*engine, blockSize);
+        engine->setScan(1.0f);
+        engine->setSpread(1.0f);
+        engine->setSize(1.5f);
+    }
+
+    bool pagesChanged = false;
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        juce::AudioBuffer<float> eagerBuffer(2, blockSize);
+        juce::AudioBuffer<float> lazyBuffer(2, blockSize);
+        for (int i = 0; i < blockSize; ++i)
+        {
+            const float value = std::sin(0.05f * static_cast<float>(block * blockSize + i));
+            for (int ch = 0; ch < 2; ++ch)
+            {
+                eagerBuffer.setSample(ch, i, value);
+                lazyBuffer.setSample(ch, i, value);
+            }
+        }
+
+        eager.processBlock(eagerBuffer);
+        lazy.processBlock(lazyBuffer);
+        pagesChanged = lazy.serviceMemory() || pagesChanged;
+
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < blockSize; ++i)
+                assert(lazyBuffer.getSample(ch, i) == eagerBuffer.getSample(ch, i));
+    }
+
+    // 6.4 s at 8 kHz: pages were recycled behind the write head, none was
+    // missing when written, and only a few seconds stay resident.
+    assert(pagesChanged);
+    assert(lazy.getMissedMemoryWrites() == 0);
+    assert(lazy.getMemoryResidentBytes() * 20 < eager.getMemoryResidentBytes());
+}
+
+void testExtendedMemoryMatchesEager()
+{
+    constexpr int blockSize = 256;
+    constexpr int numBlocks = 2800;
+
+    // 90 s at 8 kHz with the heads 50 s and 70 s back: the second one reads
+    // pages that left the 60 s kept in RAM, which the prefetch brings back
+    // ahead of the heads, for a fixed scan and for one the auto scan moves
+    // (with the heads a full size apart, so the far one stays beyond 60 s).
+    // The memory is serviced about once a second, so the prefetch has to
+    // cover where the heads go meanwhile.
+    for (int autoScan = 0; autoScan < 2; ++autoScan)
+    {
+        ::MemoryDelayEngine<> eager;
+        ::MemoryDelayEngine<> extended;
+        extended.setExtendedMemorySeconds(200.0f);
+        for (auto* engine : { &eager, &extended })
+        {
+            configureBlockTestEngine(*engine, blockSize);
+            engine->setMix(1.0f);
+            engine->setScan(1.0f);
+            engine->setSpread(0.4f);
+            engine->setSize(50.0f);
+            if (autoScan != 0)
+            {
+                engine->setScanMode(static_cast<int>(::MemoryDelayEngine<>::ScanMode::Auto));
+                engine->setAutoScanRate(0.05f);
+                engine->setSpread(1.0f);
+            }
+            // Prepared at the full size, with no glide towards it
+            engine->prepare(8000.0, blockSize, 200.0f);
+        }
+        assert(eager.getMemorySpillBytes() == 0);
+        assert(extended.getMemorySpillBytes() > 0);
+
+        // Input for the first 10 s only, so with a fixed scan the output from
+        // 72 s to 78 s is what the far head reads from beyond the 60 s.
+        float farPeak = 0.0f;
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            const int start = block * blockSize;
+            juce::AudioBuffer<float> eagerBuffer(2, blockSize);
+            juce::AudioBuffer<float> extendedBuffer(2, blockSize);
+            for (int i = 0; i < blockSize; ++i)
+            {
+                const float value = start + i < 10 * 8000 ? std::sin(0.05f * static_cast<float>(start + i)) : 0.0f;
+                for (int ch = 0; ch < 2; ++ch)
+                {
+                    eagerBuffer.setSample(ch, i, value);
+                    extendedBuffer.setSample(ch, i, value);
+                }
+            }
+
+            eager.processBlock(eagerBuffer);
+            extended.processBlock(extendedBuffer);
+            if (block % 32 == 0)
+                extended.serviceMemory();
+
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < blockSize; ++i)
+                {
+                    assert(extendedBuffer.getSample(ch, i) == eagerBuffer.getSample(ch, i));
+                    if (start > 72 * 8000 && start < 78 * 8000)
+                        farPeak = std::max(farPeak, std::abs(eagerBuffer.getSample(ch, i)));
+                }
+        }
+
+        // Nothing was missed, and RAM holds the resident span and the
+        // prefetched pages rather than 200 s.
+        assert(autoScan != 0 || farPeak > 0.1f);
+        assert(extended.getMissedMemoryWrites() == 0);
+        assert(extended.getMemoryResidentBytes() * 2 < eager.getMemoryResidentBytes());
+    }
+}
+
+void testSpecializedKernelsMatchGenericPath()
+{
+    constexpr int blockSize = 96;
+    constexpr int numBlocks = 6;
+
+    for (int stereoMode = 0; stereoMode < 3; ++stereoMode)
+        for (int feedbackMode = 0; feedbackMode < 3; ++feedbackMode)
+            for (int routingA = 0; routingA < 3; ++routingA)
+                for (int routingB = 0; routingB < 3; ++routingB)
+                    for (int tape = 0; tape < 2; ++tape)
+                    {
+                        ::MemoryDelayEngine<> specialized;
+                        ::MemoryDelayEngine<> generic;
+                        generic.setSpecializedKernelsEnabled(false);
+
+                        for (auto* engine : { &specialized, &generic })
+                        {
+                            engine->prepare(4000.0, blockSize, 2.0f);
+                            engine->setMix(0.7f);
+                            engine->setFeedback(0.6f);
+                            engine->setScan(0.3f);
+                            engine->setScanMode(static_cast<int>(::MemoryDelayEngine<>::ScanMode::Auto));
+                            engine->setAutoScanRate(2.0f);
+                            engine->setSpread(0.2f);
+                            engine->setSize(0.25f);
+                            engine->setCharacter(0.6f);
+                            engine->setModifierBankA(0.5f, 0.9f, -0.4f);
+                            engine->setModifierBankB(-0.3f, 0.7f, 0.6f);
+                            engine->setRandomSeed(7);
+                            if (tape != 0)
+                            {
+                                engine->setTapeMode(true);
+                                engine->setTapeWindowSeconds(0.2f);
+                            }
+                            engine->setStereoMode(stereoMode);
+                            engine->setMode(feedbackMode);
+                            engine->setRoutingModeA(routingA);
+                            engine->setRoutingModeB(routingB);
+                        }
+
+                        for (int block = 0; block < numBlocks; ++block)
+                        {
+                            juce::AudioBuffer<float> specializedBuffer(2, blockSize);
+                            for (int i = 0; i < blockSize; ++i)
+                            {
+                                const float phase = static_cast<float>(block * blockSize + i);
+                                specializedBuffer.setSample(0, i, std::sin(0.07f * phase));
+                                specializedBuffer.setSample(1, i, 0.8f * std::sin(0.045f * phase));
+                            }
+
+                            juce::AudioBuffer<float> genericBuffer;
+                            genericBuffer.makeCopyOf(specializedBuffer);
+
+                            specialized.processBlock(specializedBuffer);
+                            generic.processBlock(genericBuffer);
+
+                            for (int ch = 0; ch < 2; ++ch)
+                                for (int i = 0; i < blockSize; ++i)
+                                    assert(specializedBuffer.getSample(ch, i) == genericBuffer.getSample(ch, i));
+                        }
+                    }
+}
+
+/** Runs a chain a block at a time and a copy of it a sample at a time, over
+    blocks of uneven length and a settings change, and checks they agree bit
+    for bit: the engine uses one form for the In and Out routings and the
+    other inside the feedback loop. */
+template <typename SampleType>
+void testModifierBlockMatchesSample()
+{
+    constexpr int numSamples = 96000;
+    const float settings[][4] = { { 0.8f, 0.9f, -0.6f, 0.5f }, { -0.7f, -0.5f, 0.8f, 1.0f }, { 0.0f, 0.3f, 0.0f, 0.0f } };
+    for (const auto& values : settings)
+    {
+        ModifierChain<SampleType> blockChain;
+        ModifierChain<SampleType> sampleChain;
+        for (auto* chain : { &blockChain, &sampleChain })
+        {
+            chain->prepare(48000.0, 512, 2);
+            chain->setSeed(1234u);
+            chain->setModValues(values[0], values[1], values[2]);
+            chain->setCharacter(values[3]);
+            chain->updateSettings();
+        }
+
+        std::vector<SampleType> left(numSamples);
+        std::vector<SampleType> right(numSamples);
+        for (int i = 0; i < numSamples; ++i)
+        {
+            left[static_cast<size_t>(i)] = static_cast<SampleType>(std::sin(0.011 * i));
+            right[static_cast<size_t>(i)] = static_cast<SampleType>(0.5 * std::sin(0.037 * i));
+        }
+        std::vector<SampleType> blockLeft = left;
+        std::vector<SampleType> blockRight = right;
+
+        int count = 0;
+        for (int start = 0; start < numSamples; start += count)
+        {
+            count = std::min(numSamples - start, 1 + (start * 7 + 13) % 300);
+            if (start > numSamples / 2 && start - count <= numSamples / 2)
+                for (auto* chain : { &blockChain, &sampleChain })
+                {
+                    chain->setModValues(values[1], values[2], values[0]);
+                    chain->updateSettings();
+                }
+
+            SampleType* const channels[] = { blockLeft.data() + start, blockRight.data() + start };
+            blockChain.processBlock(channels, 2, count);
+            for (int i = start; i < start + count; ++i)
+            {
+                left[static_cast<size_t>(i)] = sampleChain.processSample(left[static_cast<size_t>(i)], 0);
+                right[static_cast<size_t>(i)] = sampleChain.processSample(right[static_cast<size_t>(i)], 1);
+            }
+        }
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            assert(blockLeft[static_cast<size_t>(i)] == left[static_cast<size_t>(i)]);
+            assert(blockRight[static_cast<size_t>(i)] == right[static_cast<size_t>(i)]);
+        }
+    }
+}
+
+/** Checks the chain's active-stage mask follows the settings, and that a chain
+    with no stage active passes its input through untouched. */
+void testModifierChainSkipsInactiveStages()
+{
+    ModifierChain<float> chain;
+    chain.prepare(48000.0, 512, 2);
+    assert(chain.getActiveStages() == 0u);
+
+    std::vector<float> left(512);
+    std::vector<float> right(512);
+    for (size_t i = 0; i < left.size(); ++i)
+    {
+        left[i] = std::sin(0.013f * static_cast<float>(i));
+        right[i] = -left[i];
+    }
+    const std::vector<float> input = left;
+    float* const channels[] = { left.data(), right.data() };
+    chain.processBlock(channels, 2, 512);
+    for (size_t i = 0; i < left.size(); ++i)
+    {
+        assert(left[i] == input[i]);
+        assert(right[i] == -input[i]);
+        const float sampleLeft = chain.processSample(input[i], 0);
+        const float sampleRight = chain.processSample(input[i], 1);
+        assert(sampleLeft == input[i]);
+        assert(sampleRight == input[i]);
+    }
+
+    // Bits follow the chain order: tape transport, dropout, low-pass.
+    chain.setModValues(0.0f, 0.0f, -0.5f);
+    assert(chain.getActiveStages() == 0u);
+    chain.updateSettings();
+    assert(chain.getActiveStages() == 0x4u);
+
+    chain.setModValues(0.5f, 0.2f, 0.0f);
+    chain.updateSettings();
+    assert(chain.getActiveStages() == 0x3u);
+
+    // Character lifts every stage off zero.
+    chain.setModValues(0.0f, 0.0f, 0.0f);
+    chain.setCharacter(0.5f);
+    chain.updateSettings();
+    assert(chain.getActiveStages() == 0x7u);
+
+    chain.setCharacter(0.0f);
+    chain.updateSettings();
+    assert(chain.getActiveStages() == 0u);
+}
+
+/** Runs the tape transport against WowFlutterModifier and PitchDriftModifier
+    in series, with the same settings and seed, on sines of the given
+    frequency.  Returns the error power relative to the signal power for the
+    worst of the settings. */
+template <typename SampleType>
+double measureTapeTransportError(double frequency)
+{
+    constexpr int numSamples = 96000;
+    constexpr int blockSize = 256;
+    const float settings[][2] = { { 0.8f, 0.0f }, { 0.0f, 0.6f }, { 0.7f, 0.3f }, { -1.0f, -0.45f }, { 1.0f, 1.0f } };
+    double worst = 0.0;
+    for (const auto& values : settings)
+    {
+        ModifierStages<SampleType, WowFlutterModifier<SampleType>, PitchDriftModifier<SampleType>> series;
+        series.prepare(48000.0, blockSize, 2);
+        series.template get<PitchDriftModifier<SampleType>>().setSeed(77u);
+        series.template get<WowFlutterModifier<SampleType>>().setBipolar(values[0]);
+        series.template get<PitchDriftModifier<SampleType>>().setBipolar(values[1]);
+        series.updateActiveStages();
+
+        TapeTransportModifier<SampleType> transport;
+        transport.prepare(48000.0, blockSize, 2);
+        transport.setSeed(77u);
+        transport.setWowFlutter(values[0]);
+        transport.setPitchDrift(values[1]);
+
+        double errorPower = 0.0;
+        double signalPower = 0.0;
+        std::vector<SampleType> seriesData(2 * blockSize);
+        std::vector<SampleType> transportData(2 * blockSize);
+        for (int start = 0; start < numSamples; start += blockSize)
+        {
+            for (int i = 0; i < blockSize; ++i)
+            {
+                const double phase = 2.0 * 3.141592653589793 * frequency * static_cast<double>(start + i) / 48000.0;
+                seriesData[static_cast<size_t>(i)] = static_cast<SampleType>(0.5 * std::sin(phase));
+                seriesData[static_cast<size_t>(blockSize + i)] = static_cast<SampleType>(0.5 * std::cos(0.7 * phase));
+            }
+            transportData = seriesData;
+
+            SampleType* const seriesChannels[] = { seriesData.data(), seriesData.data() + blockSize };
+            SampleType* const transportChannels[] = { transportData.data(), transportData.data() + blockSize };
+            series.processBlock(seriesChannels, 2, blockSize);
+            transport.processBlock(transportChannels, 2, blockSize);
+
+            // The first 0.1 s is left out: the cosine starts with a step, which the
+            // two forms interpolate differently.
+            for (size_t i = 0; i < seriesData.size() && start >= 4800; ++i)
+            {
+                const double error = static_cast<double>(transportData[i]) - static_cast<double>(seriesData[i]);
+                errorPower += error * error;
+                signalPower += static_cast<double>(seriesData[i]) * static_cast<double>(seriesData[i]);
+            }
+        }
+        worst = std::max(worst, errorPower / signalPower);
+    }
+    return worst;
+}
+
+/** The paths through one delay alone match exactly; the path through both is
+    read once rather than twice, so it loses less to interpolation at high
+    frequencies. */
+void testTapeTransportMatchesSeries()
+{
+    assert(measureTapeTransportError<float>(220.0) < 1.0e-7);
+    assert(measureTapeTransportError<float>(1870.0) < 1.0e-4);
+    assert(measureTapeTransportError<double>(220.0) < 1.0e-7);
+    assert(measureTapeTransportError<double>(1870.0) < 1.0e-4);
+}
+
+/** The recursive oscillator stays on std::sin over ten minutes, and a new
+    frequency continues from the current phase at the next block. */
+void testQuadratureOscillatorTracksSine()
+{
+    constexpr double sampleRate = 48000.0;
+    for (const double frequency : { 0.05, 0.6, 6.5 })
+    {
+        QuadratureOscillator oscillator;
+        oscillator.setFrequency(frequency, sampleRate);
+        oscillator.reset();
+        const double increment = 2.0 * 3.141592653589793 * frequency / sampleRate;
+        float maxError = 0.0f;
+        for (int i = 0; i < static_cast<int>(600.0 * sampleRate); ++i)
+        {
+            const float expected = static_cast<float>(std::sin(increment * static_cast<double>(i)));
+            maxError = std::max(maxError, std::abs(oscillator.getNextSine() - expected));
+        }
+        assert(maxError < 1.0e-6f);
+    }
+
+    QuadratureOscillator oscillator;
+    oscillator.setFrequency(2.0, sampleRate);
+    oscillator.reset();
+    constexpr int blockFrames = QuadratureOscillator::kBlockFrames;
+    for (int i = 0; i < 10 * blockFrames; ++i)
+        oscillator.getNextSine();
+    oscillator.setFrequency(5.0, sampleRate);
+    const double phase = 2.0 * 3.141592653589793 * 2.0 * 10.0 * blockFrames / sampleRate;
+    for (int i = 0; i < blockFrames; ++i)
+    {
+        const double expected = std::sin(phase + 2.0 * 3.141592653589793 * 5.0 * i / sampleRate);
+        assert(std::abs(oscillator.getNextSine() - expected) < 1.0e-6);
+    }
+}
+
+/** The auto-scan triangle starts and peaks exactly, is symmetric, stays
+    close to an exact triangle and renders the same in pieces as whole. */
+void testLfoWavetableTriangle()
+{
+    const LfoWavetable triangle = LfoWavetable::makeTriangle(8);
+    assert(triangle.getValue(0.0) == 0.0f);
+    assert(triangle.getValue(0.5) == 1.0f);
+    assert(triangle.getMaxSlope() >= 2.0f && triangle.getMaxSlope() < 2.25f);
+    for (int i = 0; i <= 100; ++i)
+    {
+        const double phase = 0.005 * i;
+        const float exact = static_cast<float>(2.0 * phase);
+        assert(std::abs(triangle.getValue(phase) - triangle.getValue(1.0 - phase)) < 1.0e-5f);
+        assert(std::abs(triangle.getValue(phase) - exact) < 0.05f);
+    }
+
+    constexpr int cycle = 1000;
+    std::vector<float> whole(cycle);
+    std::vector<float> pieces(cycle);
+    triangle.render(whole.data(), 0, 1.0 / cycle, cycle);
+    for (int start = 0, count = 1; start < cycle; start += count, count = count * 3 % 97 + 1)
+        triangle.render(pieces.data() + start, start, 1.0 / cycle, std::min(count, cycle - start));
+    assert(whole == pieces);
+}
+
+/** Runs a dropout over a minute of a constant signal, in blocks of varying
+    size, and returns the gains it applied. */
+std::vector<float> renderDropoutGains(uint32_t seed, float bipolar)
+{
+    constexpr int numSamples = 48000 * 60;
+    DropoutModifier<float> dropout;
+    dropout.prepare(48000.0, 512, 2);
+    dropout.setSeed(seed);
+    dropout.setBipolar(bipolar);
+
+    std::vector<float> left(numSamples, 1.0f);
+    std::vector<float> right(numSamples, -1.0f);
+    int count = 0;
+    for (int start = 0; start < numSamples; start += count)
+    {
+        count = std::min(numSamples - start, 1 + (start * 7 + 13) % 500);
+        float* const channels[] = { left.data() + start, right.data() + start };
+        dropout.processBlock(channels, 2, count);
+    }
+    for (int i = 0; i < numSamples; ++i)
+        assert(right[static_cast<size_t>(i)] == -left[static_cast<size_t>(i)]);
+    return left;
+}
+
+/** Scheduled onsets arrive as often as per-frame draws with the same
+    probability would start them, edges ease in and out, and the gains
+    depend only on the seed. */
+void testDropoutSchedulesOnsets()
+{
+    for (const float bipolar : { 1.0f, -0.5f })
+    {
+        const std::vector<float> gains = renderDropoutGains(99u, bipolar);
+        int onsets = 0;
+        float maxStep = 0.0f;
+        for (size_t i = 1; i < gains.size(); ++i)
+        {
+            if (gains[i - 1] == 1.0f && gains[i] < 1.0f)
+                ++onsets;
+            maxStep = std::max(maxStep, std::abs(gains[i] - gains[i - 1]));
+        }
+
+        // Frames between onsets are geometric; dropouts last 45 ms on average.
+        const double probability = 0.0006 * std::abs(bipolar) * (bipolar > 0.0f ? 0.8 : 1.4);
+        const double expected = static_cast<double>(gains.size()) / ((1.0 - probability) / probability + 0.045 * 48000.0);
+        assert(std::abs(onsets - expected) < 0.1 * expected);
+
+        // A 2 ms smoothstep edge, rather than a step to the dropout gain
+        assert(maxStep < 0.02f);
+    }
+
+    assert(renderDropoutGains(7u, 0.8f) == renderDropoutGains(7u, 0.8f));
+    assert(renderDropoutGains(7u, 0.8f) != renderDropoutGains(8u, 0.8f));
+}
+
+void testReadBlockMatchesRead(MemoryBuffer<>::Layout layout, MemoryBuffer<>::Format format)
+{
+    MemoryBuffer<> memory;
+    memory.setLayout(layout);
+    memory.setFormat(format);
+    memory.prepare(100.0, 1.0f);
+    const int bufferSize = memory.getBufferSize();
+
+    // Fill past the end so the write head has wrapped.
+    for (int i = 0; i < bufferSize + 37; ++i)
+        memory.writeSample(std::sin(0.37f * static_cast<float>(i)), std::cos(0.21f * static_cast<float>(i)));
+
+    // Mix fractional and whole-sample delays so both sides of the borrow are covered.
+    constexpr int numSamples = 150;
+    MemoryBuffer<>::Phase delays[numSamples];
+    for (int i = 0; i < numSamples; ++i)
+    {
+        const double delay = std::fmod(13.7 * static_cast<double>(i) + 0.25, static_cast<double>(bufferSize - 1));
+        delays[i] = SimdInterpolator::toPhase((i % 3 == 0) ? std::floor(delay) : delay);
+    }
+
+    for (int channel = 0; channel < 2; ++channel)
+    {
+        float block[numSamples];
+
+        // Static write head.
+        memory.readBlock(channel, delays, block, numSamples, false);
+        for (int i = 0; i < numSamples; ++i)
+            assert(block[i] == memory.readPhase(channel, delays[i]));
+
+        // Advancing write head: crosses the wrap point inside the request.  The
+        // reference rewrites each frame to move its head, which re-dithers
+        // 16-bit samples, so that format checks the other cases only.
+        memory.readBlock(channel, delays, block, numSamples, true);
+        MemoryBuffer<> advanced = memory;
+        for (int i = 0; format != MemoryBuffer<>::Format::Int16 && i < numSamples; ++i)
+        {
+            assert(block[i] == advanced.readPhase(channel, delays[i]));
+            const int writeIndex = advanced.getWritePosition();
+            advanced.writeSample(advanced.getSample(0, writeIndex), advanced.getSample(1, writeIndex));
+        }
+
+        // Linear delay ramp.
+        const auto rampStart = SimdInterpolator::toPhase(20.5);
+        const auto rampStep = static_cast<std::int64_t>(SimdInterpolator::toPhase(0.1));
+        memory.readBlock(channel, rampStart, rampStep, block, numSamples, false);
+        for (int i = 0; i < numSamples; ++i)
+            assert(block[i] == memory.readPhase(channel, rampStart + static_cast<MemoryBuffer<>::Phase>(i) * static_cast<MemoryBuffer<>::Phase>(rampStep)));
+    }
+}
+
+void testLongBufferKeepsFraction()
+{
+    // Past 2^22 frames a float read position only resolves half samples.
+    MemoryBuffer<> memory;
+    memory.prepare(48000.0, 4200000.0f / 48000.0f);
+    const int bufferSize = memory.getBufferSize();
+    for (int i = 0; i < bufferSize - 3; ++i)
+        memory.writeSample(static_cast<float>(i % 1024) / 1024.0f, 0.0f);
+
+    const int newest = (memory.getWritePosition() - 1) % 1024;
+    assert(newest >= 1);
+
+    for (const double fraction : { 0.1, 0.3, 0.7, 0.9 })
+    {
+        // One and a bit samples back lands between the two newest ramp values.
+        const float expected = (static_cast<float>(newest) - static_cast<float>(fraction)) / 1024.0f;
+        assert(std::abs(memory.read(0, static_cast<float>(1.0 + fraction)) - expected) < 1.0e-6f);
+        assert(std::abs(memory.readPhase(0, SimdInterpolator::toPhase(1.0 + fraction)) - expected) < 1.0e-6f);
+    }
+}
+
+void testSizeAutomationGlides()
+{
+    ::MemoryDelayEngine<> engine;
+    engine.prepare(48000.0, 256, 4.0f);
+    engine.setMix(0.5f);
+    engine.setScan(0.8f);
+    engine.setSpread(0.3f);
+    engine.setSize(1.0f);
+
+    // Slow continuous automation moves the size a little every block: it
+    // glides, so the engine never pays for the two-size crossfade.
+    juce::AudioBuffer<float> block(2, 256);
+    for (int index = 0; index < 400; ++index)
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            const float value = std::sin(0.01f * static_cast<float>(index * 256 + i));
+            block.setSample(0, i, value);
+            block.setSample(1, i, value);
+        }
+
+        engine.setSize(1.0f + 0.25f * std::sin(0.0006f * static_cast<float>(index)));
+        engine.processBlock(block);
+        assert(!engine.debugIsSizeCrossfading());
+        for (int i = 0; i < 256; ++i)
+            assert(std::isfinite(block.getSample(0, i)) && std::isfinite(block.getSample(1, i)));
+    }
+
+    // A jump too large to glide still crossfades.
+    engine.setSize(3.5f);
+    engine.processBlock(block);
+    assert(engine.debugIsSizeCrossfading());
+}
+
+void testSizeGlideBoundsReadRate()
+{
+    constexpr int blockSize = 64;
+    ::MemoryDelayEngine<> engine;
+    engine.prepare(48000.0, blockSize, 4.0f);
+    engine.setAutoScanRate(0.0f);
+    engine.setScanMode(static_cast<int>(::MemoryDelayEngine<>::ScanMode::Manual));
+    engine.setScan(0.8f);
+    engine.setSpread(0.3f);
+    engine.setSize(1.0f);
+
+    juce::AudioBuffer<float> block(2, blockSize);
+    block.clear();
+    int written = 0;
+    for (int index = 0; index < 750; ++index, written += blockSize)
+        engine.processBlock(block);
+
+    // Sweep the size fast enough that only the turns can glide.  Outside a
+    // crossfade each head's delay may move by at most 4% of real time, so
+    // playback never bends by a semitone (a ratio of 1.0595).
+    const auto headDelays = [&engine, &written]
+    {
+        const auto delays = engine.getPlayheadSnapshotDelays();
+        const double framesIntoPage = written % MemoryBuffer<>::kPageFrames;
+        return std::array<double, 2> { delays[0] + framesIntoPage, delays[1] + framesIntoPage };
+    };
+
+    auto previous = headDelays();
+    double maxGlideRate = 0.0;
+    int crossfadeBlocks = 0;
+    for (int index = 0; index < 4000; ++index)
+    {
+        const float time = static_cast<float>(index * blockSize) / 48000.0f;
+        engine.setSize(1.0f + 0.25f * std::sin(1.2f * time));
+        engine.processBlock(block);
+        written += blockSize;
+
+        const auto current = headDelays();
+        if (engine.debugIsSizeCrossfading())
+            ++crossfadeBlocks;
+        else
+            for (size_t head = 0; head < 2; ++head)
+                maxGlideRate = juce::jmax(maxGlideRate, std::abs(current[head] - previous[head]) / blockSize);
+        previous = current;
+    }
+
+    assert(crossfadeBlocks > 0);
+    assert(maxGlideRate > 0.01);
+    assert(maxGlideRate <= 0.04 + 1.0e-3);
+    assert(1.0 + maxGlideRate < std::pow(2.0, 1.0 / 12.0));
+}
+
+void testSmoothedParameterRamps()
+{
+    for (const auto curve : { ::SmoothedParameter::Curve::Linear, ::SmoothedParameter::Curve::Exponential })
+    {
+        constexpr int rampSamples = 100;
+        constexpr int numSamples = 160;
+        ::SmoothedParameter whole(0.25f);
+        ::SmoothedParameter split(0.25f);
+        whole.prepare(1000.0, 0.1f, curve);
+        split.prepare(1000.0, 0.1f, curve);
+        whole.setTarget(0.75f);
+        split.setTarget(0.75f);
+        assert(whole.beginBlock() && split.beginBlock());
+
+        float wholeValues[numSamples];
+        float splitValues[numSamples];
+        whole.fill(wholeValues, numSamples);
+        for (int start = 0, chunk = 1; start < numSamples; start += chunk, chunk = chunk % 6 + 1)
+            split.fill(splitValues + start, juce::jmin(chunk, numSamples - start));
+
+        // The ramp is a function of the sample count alone, rises steadily, and
+        // lands exactly on the target.
+        float previous = 0.25f;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            assert(wholeValues[i] == splitValues[i]);
+            assert(wholeValues[i] >= previous && wholeValues[i] <= 0.75f);
+            previous = wholeValues[i];
+        }
+        assert(wholeValues[rampSamples - 1] == 0.75f);
+        assert(wholeValues[rampSamples - 2] < 0.75f);
+        assert(!whole.isRamping());
+        if (curve == ::SmoothedParameter::Curve::Linear)
+            assert(std::abs(wholeValues[49] - 0.5f) < 1.0e-6f);
+        else
+            assert(wholeValues[49] > 0.7f);
+
+        // A new target mid-ramp turns around from the value reached so far.
+        ::SmoothedParameter retargeted(0.25f);
+        retargeted.prepare(1000.0, 0.1f, curve);
+        retargeted.setTarget(0.75f);
+        retargeted.beginBlock();
+        retargeted.fill(splitValues, 30);
+        assert(retargeted.getCurrentValue() == wholeValues[29]);
+        retargeted.setTarget(0.0f);
+        assert(retargeted.beginBlock());
+        retargeted.fill(splitValues, 1);
+        assert(splitValues[0] < wholeValues[29] && splitValues[0] > wholeValues[29] - 0.1f);
+    }
+}
+
+void testParameterChangesRamp()
+{
+    // At 1 kHz with a 1 s delay the memory is silent for the first second, so
+    // the output is the dry path alone and shows the mix ramp directly.
+    ::MemoryDelayEngine<> engine;
+    engine.prepare(1000.0, 64, 2.0f);
+    engine.setMix(0.0f);
+    engine.setFeedback(0.0f);
+    engine.setScan(1.0f);
+    engine.setSize(1.0f);
+
+    juce::AudioBuffer<float> block(2, 64);
+    for (int i = 0; i < 64; ++i)
+    {
+        block.setSample(0, i, 1.0f);
+        block.setSample(1, i, 1.0f);
+    }
+    engine.processBlock(block);
+    assert(block.getSample(0, 63) == 1.0f);
+
+    engine.setMix(1.0f);
+    for (int i = 0; i < 64; ++i)
+    {
+        block.setSample(0, i, 1.0f);
+        block.setSample(1, i, 1.0f);
+    }
+    engine.processBlock(block);
+    float previous = 1.0f;
+    for (int i = 0; i < 64; ++i)
+    {
+        const float value = block.getSample(0, i);
+        assert(value < previous && previous - value < 0.06f);
+        previous = value;
+        if (value == 0.0f)
+            break;
+    }
+    assert(block.getSample(0, 63) == 0.0f);
+
+    // After changes to every smoothed parameter, rendering the ramps in one
+    // block or in small ones gives the same audio.
+    constexpr int numSamples = 500;
+    juce::AudioBuffer<float> input(2, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        input.setSample(0, i, std::sin(0.05f * static_cast<float>(i)));
+        input.setSample(1, i, 0.5f * std::sin(0.031f * static_cast<float>(i)));
+    }
+
+    ::MemoryDelayEngine<> whole;
+    ::MemoryDelayEngine<> split;
+    for (auto* target : { &whole, &split })
+    {
+        configureBlockTestEngine(*target, 64);
+        juce::AudioBuffer<float> warmUp;
+        warmUp.makeCopyOf(input);
+        target->processBlock(warmUp);
+        target->setMix(0.2f);
+        target->setFeedback(0.8f);
+        target->setSpread(0.5f);
+        target->setCharacter(0.9f);
+        target->setModifierBankA(-0.6f, 0.1f, 0.8f);
+    }
+
+    juce::AudioBuffer<float> wholeBuffer;
+    wholeBuffer.makeCopyOf(input);
+    whole.processBlock(wholeBuffer);
+
+    for (int start = 0; start < numSamples; start += 7)
+    {
+        const int count = juce::jmin(7, numSamples - start);
+        juce::AudioBuffer<float> chunk(2, count);
+        for (int ch = 0; ch < 2; ++ch)
+            chunk.copyFrom(ch, 0, input, ch, start, count);
+        split.processBlock(chunk);
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < count; ++i)
+                assert(chunk.getSample(ch, i) == wholeBuffer.getSample(ch, start + i));
+    }
+}
+
+/** Renders a scripted automation pass in host blocks of hostBlockSize. */
+std::vector<float> renderAutomation(int hostBlockSize)
+{
+    struct ScriptedChange
+    {
+        int sample;
+        ::AutomationSplitter::Parameter parameter;
+        float value;
+    };
+
+    const ScriptedChange script[] = { { 700, ::AutomationSplitter::Parameter::Mix, 0.9f },
+                                      { 1501, ::AutomationSplitter::Parameter::Spread, 0.6f },
+                                      { 2222, ::AutomationSplitter::Parameter::Size, 0.8f },
+                                      { 3000, ::AutomationSplitter::Parameter::Character, 0.2f },
+                                      { 4100, ::AutomationSplitter::Parameter::Feedback, 0.2f },
+                                      { 5000, ::AutomationSplitter::Parameter::Bypass, 1.0f },
+                                      { 5600, ::AutomationSplitter::Parameter::Bypass, 0.0f },
+                                      { 7003, ::AutomationSplitter::Parameter::Scan, 0.3f },
+                                      { 9001, ::AutomationSplitter::Parameter::Size, 1.5f } };
+    constexpr int numSamples = 3 * 4096;
+    constexpr int loopSample = 8000;
+    constexpr int loopTarget = 100;
+    const auto transportAt = [](int sample) { return static_cast<int64_t>(sample < loopSample ? sample : loopTarget + sample - loopSample); };
+
+    ::MemoryDelayEngine<> engine;
+    configureBlockTestEngine(engine, 512);
+    engine.setScanMode(static_cast<int>(::MemoryDelayEngine<>::ScanMode::Auto));
+    engine.setAutoScanRate(3.0f);
+    ::AutomationSplitter splitter;
+    splitter.setMaxSubBlockSize(96);
+
+    std::vector<float> output;
+    juce::AudioBuffer<float> block(2, hostBlockSize);
+    for (int start = 0; start < numSamples; start += hostBlockSize)
+    {
+        for (int i = 0; i < hostBlockSize; ++i)
+        {
+            const auto phase = static_cast<float>(start + i);
+            block.setSample(0, i, std::sin(0.05f * phase));
+            block.setSample(1, i, 0.5f * std::sin(0.031f * phase));
+        }
+
+        for (const auto& change : script)
+            if (change.sample >= start && change.sample < start + hostBlockSize)
+                splitter.addParameterChange(change.sample - start, change.parameter, change.value);
+        if (loopSample > start && loopSample < start + hostBlockSize)
+            splitter.addTransportJump(loopSample - start, loopTarget, true);
+
+        splitter.setBlockTransport(transportAt(start), true);
+        splitter.process(engine, block);
+        for (int i = 0; i < hostBlockSize; ++i)
+        {
+            output.push_back(block.getSample(0, i));
+            output.push_back(block.getSample(1, i));
+        }
+    }
+
+    return output;
+}
+
+void testAutomationIsIndependentOfHostBlockSize()
+{
+    const auto reference = renderAutomation(32);
+    assert(renderAutomation(512) == reference);
+    assert(renderAutomation(4096) == reference);
+}
+
+void testSaturatorErrorBounds()
+{
+    const ::Saturator::Mode modes[] = { ::Saturator::Mode::Rational, ::Saturator::Mode::Polynomial,
+                                        ::Saturator::Mode::Table };
+    for (const auto mode : modes)
+    {
+        const double bound = static_cast<double>(::Saturator::getMaxError(mode));
+        for (int i = -100000; i <= 100000; ++i)
+        {
+            const float x = static_cast<float>(i) * 1.0e-4f;
+            const float y = ::Saturator::process(mode, x);
+            assert(std::abs(static_cast<double>(y) - std::tanh(static_cast<double>(x))) <= bound);
+            assert(y == -::Saturator::process(mode, -x));
+        }
+
+        for (const float x : { 12.0f, 1.0e4f, 1.0e30f, std::numeric_limits<float>::infinity() })
+        {
+            assert(std::abs(static_cast<double>(::Saturator::process(mode, x)) - 1.0) <= bound);
+            assert(std::abs(static_cast<double>(::Saturator::process(mode, -x)) + 1.0) <= bound);
+        }
+    }
+}
+
+void testSaturatorDeterminism()
+{
+    // Golden hashes of each fast mode over a fixed grid.  A build whose floating
+    // point differs (for example by fusing multiply-adds) fails here rather than
+    // silently recording different audio.
+    const std::pair<::Saturator::Mode, uint32_t> golden[] = { { ::Saturator::Mode::Rational, 0x5e597de7u },
+                                                              { ::Saturator::Mode::Polynomial, 0xa058f05fu },
+                                                              { ::Saturator::Mode::Table, 0x6d824927u } };
+    for (const auto& [mode, expectedHash] : golden)
+    {
+        uint32_t hash = 2166136261u;
+        for (int i = -4000; i <= 4000; ++i)
+        {
+            const float y = ::Saturator::process(mode, static_cast<float>(i) * 0.00237f);
+            uint32_t bits = 0;
+            std::memcpy(&bits, &y, sizeof(bits));
+            hash = (hash ^ bits) * 16777619u;
+        }
+        assert(hash == expectedHash);
+
+        // Scalar, stereo-pair and block forms agree bit for bit.
+        constexpr int numSamples = 203;
+        float left[numSamples];
+        float right[numSamples];
+        for (int i = 0; i < numSamples; ++i)
+        {
+            left[i] = 0.061f * static_cast<float>(i - 100);
+            right[i] = -0.017f * static_cast<float>(i * 3 - 250);
+        }
+
+        float blockLeft[numSamples];
+        float blockRight[numSamples];
+        std::copy(left, left + numSamples, blockLeft);
+        std::copy(right, right + numSamples, blockRight);
+        ::Saturator::processBlock(mode, blockLeft, blockRight, numSamples);
+
+        for (int i = 0; i < numSamples; ++i)
+        {
+            float pairLeft = left[i];
+            float pairRight = right[i];
+            ::Saturator::processStereo(mode, pairLeft, pairRight);
+            assert(pairLeft == ::Saturator::process(mode, left[i]));
+            assert(pairRight == ::Saturator::process(mode, right[i]));
+            assert(blockLeft[i] == pairLeft);
+            assert(blockRight[i] == pairRight);
+        }
+
+        // The engine queues and block-saturates writes in some segments and not
+        // others; the split must not change what is recorded.
+        constexpr int numEngineSamples = 600;
+        juce::AudioBuffer<float> input(2, numEngineSamples);
+        for (int i = 0; i < numEngineSamples; ++i)
+        {
+            input.setSample(0, i, 1.5f * std::sin(0.05f * static_cast<float>(i)));
+            input.setSample(1, i, 0.9f * std::sin(0.031f * static_cast<float>(i)));
+        }
+
+        ::MemoryDelayEngine<> whole;
+        configureBlockTestEngine(whole, 64);
+        whole.setSaturatorMode(static_cast<int>(mode));
+        juce::AudioBuffer<float> wholeBuffer;
+        wholeBuffer.makeCopyOf(input);
+        whole.processBlock(wholeBuffer);
+
+        ::MemoryDelayEngine<> split;
+        configureBlockTestEngine(split, 64);
+        split.setSaturatorMode(static_cast<int>(mode));
+        for (int start = 0; start < numEngineSamples; start += 37)
+        {
+            const int count = juce::jmin(37, numEngineSamples - start);
+            juce::AudioBuffer<float> block(2, count);
+            for (int ch = 0; ch < 2; ++ch)
+                block.copyFrom(ch, 0, input, ch, start, count);
+            split.processBlock(block);
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < count; ++i)
+                    assert(block.getSample(ch, i) == wholeBuffer.getSample(ch, start + i));
+        }
+    }
+}
+
+void testMemoryLayoutsMatch()
+{
+    MemoryBuffer<> planar;
+    planar.prepare(100.0, 1.0f);
+    for (int i = 0; i < 137; ++i)
+        planar.writeSample(0.01f * static_cast<float>(i), -0.02f * static_cast<float>(i));
+
+    // Switching layout keeps the recorded frames.
+    MemoryBuffer<> interleaved = planar;
+    interleaved.setLayout(MemoryBuffer<>::Layout::Interleaved);
+    for (int channel = 0; channel < 2; ++channel)
+        for (int i = 0; i < planar.getBufferSize(); ++i)
+            assert(interleaved.getSample(channel, i) == planar.getSample(channel, i));
+
+    constexpr int numSamples = 700;
+    juce::AudioBuffer<float> input(2, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        input.setSample(0, i, std::sin(0.043f * static_cast<float>(i)));
+        input.setSample(1, i, 0.7f * std::sin(0.017f * static_cast<float>(i)));
+    }
+
+    ::MemoryDelayEngine<> planarEngine;
+    configureBlockTestEngine(planarEngine, 128);
+    juce::AudioBuffer<float> planarBuffer;
+    planarBuffer.makeCopyOf(input);
+    planarEngine.processBlock(planarBuffer);
+
+    ::MemoryDelayEngine<> interleavedEngine;
+    interleavedEngine.setMemoryLayout(MemoryBuffer<>::Layout::Interleaved);
+    configureBlockTestEngine(interleavedEngine, 128);
+    juce::AudioBuffer<float> interleavedBuffer;
+    interleavedBuffer.makeCopyOf(input);
+    interleavedEngine.processBlock(interleavedBuffer);
+
+    for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < numSamples; ++i)
+            assert(interleavedBuffer.getSample(ch, i) == planarBuffer.getSample(ch, i));
+}
+
+void testMemoryFormatQuality()
+{
+    // A 0.9 amplitude sine recorded in each format and read back, against the
+    // exact values: half keeps 11 significant bits, 16-bit with TPDF dither
+    // sits near 92 dB and packed 24-bit near 145 dB.
+    using Format = MemoryBuffer<>::Format;
+    const std::pair<Format, double> minimumSnrs[] = {
+        { Format::Half, 60.0 }, { Format::Int16, 85.0 }, { Format::Packed24, 130.0 }
+    };
+
+    for (const auto& [format, minimumSnr] : minimumSnrs)
+    {
+        MemoryBuffer<> memory;
+        memory.setFormat(format);
+        memory.prepare(48000.0, 1.0f);
+        const int numFrames = memory.getBufferSize();
+
+        std::vector<float> left(static_cast<size_t>(numFrames));
+        std::vector<float> right(static_cast<size_t>(numFrames));
+        for (int i = 0; i < numFrames; ++i)
+        {
+            left[static_cast<size_t>(i)] = 0.9f * std::sin(0.1305f * static_cast<float>(i));
+            right[static_cast<size_t>(i)] = 0.9f * std::cos(0.0417f * static_cast<float>(i));
+        }
+        memory.writeBlock(left.data(), right.data(), numFrames);
+
+        for (int channel = 0; channel < 2; ++channel)
+        {
+            const auto& expected = (channel == 0) ? left : right;
+            double signal = 0.0;
+            double noise = 0.0;
+            for (int i = 0; i < numFrames; ++i)
+            {
+                const double value = expected[static_cast<size_t>(i)];
+                const double error = static_cast<double>(memory.getSample(channel, i)) - value;
+                signal += value * value;
+                noise += error * error;
+            }
+
+            assert(noise > 0.0);
+            assert(10.0 * std::log10(signal / noise) > minimumSnr);
+        }
+
+        assert(memory.getResidentBytes() < MemoryBuffer<>().getResidentBytes() + static_cast<size_t>(numFrames) * 8);
+    }
+}
+
+void testMemoryFormatBlockWrites()
+{
+    using Format = MemoryBuffer<>::Format;
+    for (const auto format : { Format::Native, Format::Half, Format::Int16, Format::Packed24 })
+    {
+        for (const auto layout : { MemoryBuffer<>::Layout::Planar, MemoryBuffer<>::Layout::Interleaved })
+        {
+            // Blocks that straddle page boundaries and the wrap point record the
+            // same bits, dither included, as frame-by-frame writes.
+            MemoryBuffer<> blockWritten;
+            MemoryBuffer<> sampleWritten;
+            for (auto* memory : { &blockWritten, &sampleWritten })
+            {
+                memory->setLayout(layout);
+                memory->setFormat(format);
+                memory->prepare(8000.0, 1.3f);
+            }
+
+            const int bufferSize = blockWritten.getBufferSize();
+            std::vector<float> left(static_cast<size_t>(bufferSize + 500));
+            std::vector<float> right(left.size());
+            for (size_t i = 0; i < left.size(); ++i)
+            {
+                left[i] = std::sin(0.0123f * static_cast<float>(i));
+                right[i] = 0.5f * std::sin(0.31f * static_cast<float>(i)) - 0.25f;
+            }
+
+            int written = 0;
+            for (int block = 0; written < static_cast<int>(left.size()); ++block)
+            {
+                const int count = juce::jmin(97 + (block * 1013) % 3000, static_cast<int>(left.size()) - written);
+                blockWritten.writeBlock(left.data() + written, right.data() + written, count);
+                for (int i = written; i < written + count; ++i)
+                    sampleWritten.writeSample(left[static_cast<size_t>(i)], right[static_cast<size_t>(i)]);
+                written += count;
+            }
+
+            assert(blockWritten.getWritePosition() == sampleWritten.getWritePosition());
+            for (int channel = 0; channel < 2; ++channel)
+                for (int i = 0; i < bufferSize; ++i)
+                    assert(blockWritten.getSample(channel, i) == sampleWritten.getSample(channel, i));
+
+            // Converting native memory matches recording in the format directly
+            // (16-bit dither differs, being keyed to when a frame was written).
+            if (format == Format::Half || format == Format::Packed24)
+            {
+                MemoryBuffer<> converted;
+                converted.setLayout(layout);
+                converted.prepare(8000.0, 1.3f);
+                converted.writeBlock(left.data(), right.data(), static_cast<int>(left.size()));
+                converted.setFormat(format);
+                for (int channel = 0; channel < 2; ++channel)
+                    for (int i = 0; i < bufferSize; ++i)
+                        assert(converted.getSample(channel, i) == blockWritten.getSample(channel, i));
+            }
+        }
+    }
+
+    // The engine records its queued writes as blocks; every format follows the
+    // float memory closely.
+    constexpr int numSamples = 3000;
+    juce::AudioBuffer<float> input(2, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        input.setSample(0, i, 0.8f * std::sin(0.043f * static_cast<float>(i)));
+        input.setSample(1, i, 0.6f * std::sin(0.017f * static_cast<float>(i)));
+    }
+
+    juce::AudioBuffer<float> reference;
+    for (const auto format : { Format::Native, Format::Half, Format::Int16, Format::Packed24 })
+    {
+        ::MemoryDelayEngine<> engine;
+        engine.setMemoryFormat(format);
+        configureBlockTestEngine(engine, 256);
+        assert(engine.getMemoryFormat() == format);
+
+        juce::AudioBuffer<float> buffer;
+        buffer.makeCopyOf(input);
+        for (int start = 0; start < numSamples; start += 256)
+        {
+            juce::AudioBuffer<float> block(buffer.getArrayOfWritePointers(), 2, start, juce::jmin(256, numSamples - start));
+            engine.processBlock(block);
+        }
+
+        if (format == Format::Native)
+        {
+            reference.makeCopyOf(buffer);
+            continue;
+        }
+
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < numSamples; ++i)
+                assert(std::abs(buffer.getSample(ch, i) - reference.getSample(ch, i)) < 2.0e-3f);
+    }
+}
+
+void testMemoryClearIsLazy()
+{
+    MemoryBuffer<> memory;
+    memory.prepare(8000.0, 3.0f);
+    const int bufferSize = memory.getBufferSize();
+    constexpr int pageFrames = MemoryBuffer<>::kPageFrames;
+    for (int i = 0; i < bufferSize + 100; ++i)
+        memory.writeSample(0.5f + 0.25f * std::sin(0.01f * static_cast<float>(i)), -0.5f);
+
+    // Everything recorded before the clear reads as silence, including the
+    // rest of the page under the write head and pages the write head enters.
+    memory.clear();
+    assert(memory.getEpoch() == 1);
+    const int clearedAt = memory.getWritePosition();
+    const int written = pageFrames + 10;
+    for (int i = 0; i < written; ++i)
+        memory.writeSample(0.125f, 0.25f);
+
+    const auto isNew = [&](int index)
+    {
+        return ((index - clearedAt + bufferSize) % bufferSize) < written;
+    };
+
+    for (int channel = 0; channel < 2; ++channel)
+        for (int i = 0; i < bufferSize; ++i)
+            assert(memory.getSample(channel, i) == (isNew(i) ? (channel == 0 ? 0.125f : 0.25f) : 0.0f));
+
+    // Reads across the clear point interpolate towards silence.
+    constexpr int numSamples = 64;
+    MemoryBuffer<>::Phase delays[numSamples];
+    for (int i = 0; i < numSamples; ++i)
+        delays[i] = SimdInterpolator::toPhase(static_cast<double>(written) - 20.0 + 0.7 * static_cast<double>(i));
+    float block[numSamples];
+    memory.readBlock(0, delays, block, numSamples, false);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        assert(block[i] == memory.readPhase(0, delays[i]));
+        assert(block[i] >= 0.0f && block[i] <= 0.125f);
+    }
+    assert(block[0] == 0.125f && block[numSamples - 1] == 0.0f);
+
+    // The background service zeroes the stale pages, and a copy keeps the
+    // stamps; neither brings old audio back.
+    memory.servicePages();
+    const MemoryBuffer<> copy = memory;
+    for (int i = written; i < bufferSize; ++i)
+        memory.writeSample(0.0f, 0.0f);
+    for (int channel = 0; channel < 2; ++channel)
+        for (int i = 0; i < bufferSize; ++i)
+        {
+            assert(copy.getSample(channel, i) == (isNew(i) ? (channel == 0 ? 0.125f : 0.25f) : 0.0f));
+            assert(memory.getSample(channel, i) == (isNew(i) ? (channel == 0 ? 0.125f : 0.25f) : 0.0f));
+        }
+
+    // Lazy allocation: pages allocated after the clear start current.
+    MemoryBuffer<> lazy;
+    lazy.setAllocation(MemoryBuffer<>::Allocation::Lazy);
+    lazy.setRetainedSeconds(0.5f);
+    lazy.prepare(8000.0, 3.0f);
+    for (int round = 0; round < 3; ++round)
+    {
+        for (int i = 0; i < bufferSize / 2; ++i)
+        {
+            lazy.writeSample(1.0f, 1.0f);
+            if (i % 512 == 0)
+                lazy.servicePages();
+        }
+        lazy.clear();
+    }
+    assert(lazy.getMissedWrites() == 0);
+    for (int i = 0; i < bufferSize; ++i)
+        assert(lazy.getSample(0, i) == 0.0f);
+}
+
+void testEngineResetAndClear()
+{
+    constexpr int blockSize = 128;
+    constexpr int numBlocks = 60;
+    const auto fill = [](juce::AudioBuffer<float>& buffer, int block, float amplitude)
+    {
+        for (int i = 0; i < blockSize; ++i)
+        {
+            const auto t = static_cast<float>(block * blockSize + i);
+            buffer.setSample(0, i, amplitude * std::sin(0.031f * t));
+            buffer.setSample(1, i, amplitude * std::sin(0.019f * t));
+        }
+    };
+
+    const auto renderSilence = [](::MemoryDelayEngine<>& engine)
+    {
+        for (int block = 0; block < numBlocks; ++block)
+        {
+            juce::AudioBuffer<float> buffer(2, blockSize);
+            buffer.clear();
+            engine.processBlock(buffer);
+            for (int ch = 0; ch < 2; ++ch)
+                for (int i = 0; i < blockSize; ++i)
+                    assert(buffer.getSample(ch, i) == 0.0f);
+        }
+    };
+
+    ::MemoryDelayEngine<> engine;
+    configureBlockTestEngine(engine, blockSize);
+    engine.setMix(1.0f);
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        fill(buffer, block, 0.9f);
+        engine.processBlock(buffer);
+    }
+
+    // reset() silences the memory without moving the write head.
+    const int writeIndex = engine.getWriteIndex();
+    engine.reset();
+    assert(engine.getWriteIndex() == writeIndex);
+    for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < engine.getMaxSamples(); ++i)
+            assert(engine.debugGetMemorySample(ch, i) == 0.0f);
+    renderSilence(engine);
+
+    // clearMemory() does the same at the start of the next block.
+    for (int block = 0; block < numBlocks; ++block)
+    {
+        juce::AudioBuffer<float> buffer(2, blockSize);
+        fill(buffer, block, 0.9f);
+        engine.processBlock(buffer);
+    }
+    assert(engine.debugGetMemorySample(0, (engine.getWriteIndex() + engine.getMaxSamples() - 1) % engine.getMaxSamples()) != 0.0f);
+    engine.clearMemory();
+    renderSilence(engine);
+}
+
+void testPageArenaRecyclesPages()
+{
+    auto& arena = PageArena::getInstance();
+    const auto before = arena.getStatistics();
+
+    // Pages a buffer releases go back to the arena, and the next buffer of the
+    // same format reuses them, zeroed, without reserving another slab.
+    auto first = std::make_unique<MemoryBuffer<>>();
+    first->prepare(8000.0, 4.0f);
+    for (int i = 0; i < first->getBufferSize(); ++i)
+        first->writeSample(0.5f, -0.5f);
+
+    const auto numPages = static_cast<size_t>((first->getBufferSize() + MemoryBuffer<>::kPageFrames - 1)
+                                              / MemoryBuffer<>::kPageFrames);
+    const auto filled = arena.getStatistics();
+    assert(filled.pagesInUse == before.pagesInUse + numPages);
+    assert(filled.peakPagesInUse >= filled.pagesInUse);
+    assert(filled.bytesReserved >= filled.bytesInUse);
+    assert(filled.fragmentation >= 0.0 && filled.fragmentation < 1.0);
+    assert(filled.failedAcquires == before.failedAcquires);
+
+    first.reset();
+    assert(arena.getStatistics().pagesInUse == before.pagesInUse);
+
+    MemoryBuffer<> second;
+    second.prepare(8000.0, 4.0f);
+    const auto reused = arena.getStatistics();
+    assert(reused.pagesInUse == filled.pagesInUse);
+    assert(reused.bytesReserved == filled.bytesReserved);
+    assert(reused.peakPagesInUse == filled.peakPagesInUse);
+    for (int channel = 0; channel < 2; ++channel)
+        for (int i = 0; i < second.getBufferSize(); ++i)
+            assert(second.getSample(channel, i) == 0.0f);
+
+    // A lazy buffer hands its released pages back as the write head moves on.
+    MemoryBuffer<> lazy;
+    lazy.setAllocation(MemoryBuffer<>::Allocation::Lazy);
+    lazy.setRetainedSeconds(0.5f);
+    lazy.prepare(8000.0, 60.0f);
+    const auto lazyPages = static_cast<size_t>(lazy.getBufferSize() / MemoryBuffer<>::kPageFrames);
+    for (int block = 0; block < 200; ++block)
+    {
+        for (int i = 0; i < 1024; ++i)
+            lazy.writeSample(0.25f, 0.25f);
+        lazy.servicePages();
+        assert(arena.getStatistics().pagesInUse - reused.pagesInUse < lazyPages / 8);
+    }
+    assert(lazy.getMissedWrites() == 0);
+
+    // Empty slabs are kept up to the retention budget, then returned.
+    auto third = std::make_unique<MemoryBuffer<>>();
+    third->prepare(8000.0, 120.0f);
+    third.reset();
+    assert(arena.getStatistics().emptySlabs > 0);
+    arena.setMaxRetainedBytes(0);
+    assert(arena.getStatistics().emptySlabs == 0);
+    arena.setMaxRetainedBytes(PageArena::kDefaultMaxRetainedBytes);
+}
+
+void testSpilledMemoryPrefetches()
+{
+    constexpr double sampleRate = 8000.0;
+    const auto valueAt = [](int frame) { return static_cast<float>(frame % 4096) / 4096.0f; };
+
+    // 38 s recorded with 2 s resident: older pages wait in the spill file.
+    MemoryBuffer<> memory;
+    memory.setAllocation(MemoryBuffer<>::Allocation::Spilled);
+    memory.setResidentSeconds(2.0f);
+    memory.prepare(sampleRate, 40.0f);
+    assert(memory.getSpillFileBytes() > 0);
+    const int recorded = 38 * 8000;
+    for (int i = 0; i < recorded; ++i)
+    {
+        memory.writeSample(valueAt(i), -valueAt(i));
+        if (i % 512 == 0)
+            memory.servicePages();
+    }
+    memory.servicePages();
+    assert(memory.getMissedWrites() == 0);
+    assert(memory.getResidentBytes() * 4 < static_cast<size_t>(memory.getBufferSize()) * 2 * sizeof(float));
+
+    // The audio thread's reads stay in RAM, so a spilled page reads silence
+    // until a prefetch window asks for it; readFrames() goes to the file.
+    constexpr int oldFrame = 8000;
+    assert(memory.getSample(0, oldFrame) == 0.0f);
+    std::vector<float> spilled(1000);
+    memory.readFrames(1, oldFrame, spilled.data(), 1000);
+    for (int i = 0; i < 1000; ++i)
+        assert(spilled[static_cast<size_t>(i)] == -valueAt(oldFrame + i));
+
+    memory.setPrefetchWindow(0, oldFrame, oldFrame + 1000);
+    memory.servicePages();
+    for (int i = 0; i < 1000; ++i)
+    {
+        assert(memory.getSample(0, oldFrame + i) == valueAt(oldFrame + i));
+        assert(memory.getSample(1, oldFrame + i) == -valueAt(oldFrame + i));
+    }
+
+    // Restored frames land in the file or in the prefetched page, which is
+    // spilled again once its window moves on, and a copy keeps them.
+    std::vector<float> restored(1000, 0.5f);
+    memory.restoreFrames(4000, restored.data(), restored.data(), 1000);
+    memory.restoreFrames(oldFrame, restored.data(), restored.data(), 1000);
+    memory.setPrefetchWindow(0, 0, 0);
+    memory.servicePages();
+    assert(memory.getSample(0, oldFrame) == 0.0f);
+    const MemoryBuffer<> copy = memory;
+    for (const auto* buffer : { static_cast<const MemoryBuffer<>*>(&memory), &copy })
+        for (const int start : { 4000, oldFrame })
+        {
+            buffer->readFrames(0, start, spilled.data(), 1000);
+            for (int i = 0; i < 1000; ++i)
+                assert(spilled[static_cast<size_t>(i)] == 0.5f);
+        }
+
+    // Once the write head has come round, a page's old copy is not read for
+    // what it records now.
+    for (int i = recorded; i < recorded + memory.getBufferSize(); ++i)
+    {
+        memory.writeSample(0.25f, 0.25f);
+        if (i % 512 == 0)
+            memory.servicePages();
+    }
+    memory.servicePages();
+    memory.readFrames(0, oldFrame, spilled.data(), 1000);
+    for (int i = 0; i < 1000; ++i)
+        assert(spilled[static_cast<size_t>(i)] == 0.25f);
+
+    // A clear empties the file.
+    memory.clear();
+    memory.servicePages();
+    memory.readFrames(0, oldFrame, spilled.data(), 1000);
+    for (int i = 0; i < 1000; ++i)
+        assert(spilled[static_cast<size_t>(i)] == 0.0f);
+}
+
+/** Records a sine at one rate, resamples it to another and checks that every
+    delay, in seconds, still reads the same sine, away from the oldest and
+    newest frames where the filter runs off the recording. */
+void testMemoryResamplerKeepsDelays(double sourceRate, double targetRate, bool lazyTarget)
+{
+    constexpr double frequency = 1000.0;
+    const auto sineAt = [](double seconds)
+    {
+        return 0.5 * std::sin(2.0 * juce::MathConstants<double>::pi * frequency * seconds);
+    };
+
+    MemoryBuffer<> source;
+    source.prepare(sourceRate, 2.0f);
+    const int numRecorded = static_cast<int>(1.5 * sourceRate);
+    for (int i = 0; i < numRecorded; ++i)
+    {
+        const auto value = static_cast<float>(sineAt(i / sourceRate));
+        source.writeSample(value, -value);
+    }
+
+    MemoryBuffer<> target;
+    if (lazyTarget)
+    {
+        target.setAllocation(MemoryBuffer<>::Allocation::Lazy);
+        target.setRetainedSeconds(0.5f);
+    }
+    target.prepare(targetRate, 2.0f);
+
+    MemoryResampler<> resampler;
+    resampler.prepare(sourceRate, targetRate);
+    const int numWritten = resampler.process(source, target);
+    assert(target.getWritePosition() == numWritten);
+    assert(target.getMissedWrites() == 0);
+    if (lazyTarget)
+        assert(numWritten == target.getRecallableFrames());
+    else
+        assert(std::abs(numWritten - numRecorded * targetRate / sourceRate) <= 1.0);
+
+    // The write head is time numRecorded / sourceRate; delay d is d / targetRate before it.
+    const int edge = 40 * static_cast<int>(std::ceil(targetRate / sourceRate));
+    double signal = 0.0;
+    double error = 0.0;
+    for (int delay = edge; delay < numWritten - edge; ++delay)
+    {
+        const double expected = sineAt(numRecorded / sourceRate - delay / targetRate);
+        const int index = target.getWritePosition() - delay;
+        assert(target.getSample(1, index) == -target.getSample(0, index));
+        signal += expected * expected;
+        error += (target.getSample(0, index) - expected) * (target.getSample(0, index) - expected);
+    }
+    assert(10.0 * std::log10(signal / error) > 80.0);
+}
+
+void testMemoryCodecRoundTrip()
+{
+    constexpr int numFrames = MemoryCodec::kMaxBlockFrames;
+    std::vector<float> left(numFrames), right(numFrames), decodedLeft(numFrames), decodedRight(numFrames);
+    const auto roundTrip = [&](int length, double tolerance)
+    {
+        std::vector<unsigned char> encoded { 0x5a };
+        MemoryCodec::encodeBlock(left.data(), right.data(), length, encoded);
+        encoded.push_back(0xa5);
+
+        const unsigned char* data = encoded.data() + 1;
+        assert(MemoryCodec::decodeBlock(data, encoded.data() + encoded.size(), decodedLeft.data(),
+                                        decodedRight.data(), length));
+        assert(data == encoded.data() + encoded.size() - 1);
+        for (int i = 0; i < length; ++i)
+        {
+            assert(std::abs(decodedLeft[static_cast<size_t>(i)] - left[static_cast<size_t>(i)]) <= tolerance);
+            assert(std::abs(decodedRight[static_cast<size_t>(i)] - right[static_cast<size_t>(i)]) <= tolerance);
+        }
+
+        // A block cut short is rejected rather than read past its end.
+        data = encoded.data() + 1;
+        assert(!MemoryCodec::decodeBlock(data, encoded.data() + encoded.size() / 2, decodedLeft.data(),
+                                         decodedRight.data(), length) || encoded.size() < 8);
+        return encoded.size() - 2;
+    };
+
+    // Float memory comes back within half a 24-bit step, and a tone with a
+    // little noise packs into less than its 16-bit size.
+    RandomGenerator random;
+    random.setSeed(7);
+    for (int i = 0; i < numFrames; ++i)
+    {
+        const float tone = 0.6f * std::sin(0.02f * static_cast<float>(i));
+        left[static_cast<size_t>(i)] = tone + 0.001f * random.nextFloatSigned();
+        right[static_cast<size_t>(i)] = 0.8f * tone;
+    }
+    assert(roundTrip(numFrames, std::ldexp(1.0, -24)) < static_cast<size_t>(numFrames) * 3);
+
+    // 16-bit memory is exact; louder blocks keep 24 bits below their peak.
+    for (int i = 0; i < numFrames; ++i)
+    {
+        left[static_cast<size_t>(i)] = std::round(left[static_cast<size_t>(i)] * 32767.0f) / 32768.0f;
+        right[static_cast<size_t>(i)] = std::round(right[static_cast<size_t>(i)] * 32767.0f) / 32768.0f;
+    }
+    roundTrip(1000, 0.0);
+
+    // A louder block keeps 24 bits below its peak; non-finite samples are
+    // stored as silence.
+    left[17] = 3.0f;
+    right[99] = std::numeric_limits<float>::infinity();
+    std::vector<unsigned char> encoded;
+    MemoryCodec::encodeBlock(left.data(), right.data(), 200, encoded);
+    const unsigned char* data = encoded.data();
+    assert(MemoryCodec::decodeBlock(data, encoded.data() + encoded.size(), decodedLeft.data(), decodedRight.data(),
+                                    200));
+    assert(decodedRight[99] == 0.0f);
+    for (int i = 0; i < 200; ++i)
+    {
+        assert(std::abs(decodedLeft[static_cast<size_t>(i)] - left[static_cast<size_t>(i)]) <= std::ldexp(1.0, -22));
+        assert(i == 99 || std::abs(decodedRight[static_cast<size_t>(i)] - right[static_cast<size_t>(i)])
+                              <= std::ldexp(1.0, -22));
+    }
+
+    // Silence takes a single byte.
+    std::fill(left.begin(), left.end(), 0.0f);
+    std::fill(right.begin(), right.end(), 0.0f);
+    assert(roundTrip(numFrames, 0.0) == 1);
+}
+
+/** Records a buffer that wraps several times while the memory thread keeps
+    its encoded pages up to date, and checks that a capture always holds what
+    the buffer holds, including after a clear. */
+void testMemorySnapshotTracksWrites()
+{
+    MemoryBuffer<> buffer;
+    buffer.setRetainedSeconds(1.0f);
+    buffer.prepare(8000.0, 2.0f);
+    MemorySnapshotter<> snapshotter;
+    snapshotter.setCaching(true);
+
+    const auto checkCapture = [&]()
+    {
+        const auto snapshot = snapshotter.capture(buffer);
+        assert(snapshot != nullptr && snapshot->sampleRate == 8000.0);
+        assert(snapshot->numFrames >= 8000 && snapshot->numFrames < 8000 + MemoryBuffer<>::kPageFrames);
+
+        std::vector<unsigned char> stream;
+        snapshot->serialise(stream);
+        const auto parsed = MemorySnapshot::deserialise(stream.data(), stream.size());
+        assert(parsed != nullptr && parsed->blocks == snapshot->blocks && parsed->numFrames == snapshot->numFrames);
+        assert(MemorySnapshot::deserialise(stream.data(), stream.size() - 1) == nullptr);
+
+        // The snapshot ends at the last page boundary the write head crossed.
+        const int bufferSize = buffer.getBufferSize();
+        const auto end = static_cast<int>(buffer.getPublishedWrittenFrames() % static_cast<std::uint64_t>(bufferSize));
+        int frame = (end - static_cast<int>(snapshot->numFrames) + bufferSize) % bufferSize;
+        const unsigned char* data = snapshot->blocks.data();
+        std::vector<float> left(MemoryCodec::kMaxBlockFrames), right(MemoryCodec::kMaxBlockFrames);
+        for (std::uint32_t block = 0; block < snapshot->numBlocks; ++block)
+        {
+            const auto numFrames = static_cast<int>(MemorySnapshot::getWord(data));
+            data += MemorySnapshot::kBlockHeaderBytes;
+            assert(MemoryCodec::decodeBlock(data, snapshot->blocks.data() + snapshot->blocks.size(), left.data(),
+                                            right.data(), numFrames));
+            for (int i = 0; i < numFrames; ++i, frame = (frame + 1) % bufferSize)
+            {
+                assert(std::abs(left[static_cast<size_t>(i)] - buffer.getSample(0, frame)) <= 1.0e-7f);
+                assert(std::abs(right[static_cast<size_t>(i)] - buffer.getSample(1, frame)) <= 1.0e-7f);
+            }
+        }
+        assert(frame == end);
+    };
+
+    int written = 0;
+    for (int block = 0; block < 160; ++block)
+    {
+        for (int i = 0; i < 256; ++i, ++written)
+        {
+            const float value = 0.7f * std::sin(0.01f * static_cast<float>(written));
+            buffer.writeSample(value, value * static_cast<float>(block % 3) * 0.3f);
+        }
+        snapshotter.service(buffer);
+        if (block % 20 == 19)
+            checkCapture();
+    }
+    assert(written > 2 * buffer.getBufferSize());
+
+    // A clear silences pages the cache still holds.
+    buffer.clear();
+    for (int i = 0; i < 100; ++i)
+        buffer.writeSample(0.5f, 0.5f);
+    checkCapture();
+    const auto silent = snapshotter.capture(buffer);
+    assert(silent->blocks.size() == silent->numBlocks * (MemorySnapshot::kBlockHeaderBytes + 1));
+}
+
+/** Converts a second of a sine in blocks of two sizes through the streaming
+    resampler, and checks both give the same frames and still read the sine at
+    the new rate. */
+void testMemoryResamplerStreams(double sourceRate, double targetRate)
+{
+    constexpr double frequency = 1000.0;
+    const auto sineAt = [](double seconds)
+    {
+        return 0.5 * std::sin(2.0 * juce::MathConstants<double>::pi * frequency * seconds);
+    };
+
+    const int numInput = static_cast<int>(sourceRate);
+    std::vector<float> left(static_cast<size_t>(numInput)), right(left.size());
+    for (int i = 0; i < numInput; ++i)
+    {
+        left[static_cast<size_t>(i)] = static_cast<float>(sineAt(i / sourceRate));
+        right[static_cast<size_t>(i)] = -left[static_cast<size_t>(i)];
+    }
+
+    // Output is the same however the input is split up.
+    MemoryResampler<> resampler;
+    resampler.prepare(sourceRate, targetRate);
+    const auto convert = [&](int blockSize, std::vector<float>& outLeft, std::vector<float>& outRight)
+    {
+        const auto numOutput = resampler.beginStream(static_cast<std::uint64_t>(numInput));
+        int produced = 0;
+        for (int start = 0; start < numInput; start += blockSize)
+            produced += resampler.processStream(left.data() + start, right.data() + start,
+                                                juce::jmin(blockSize, numInput - start), outLeft, outRight);
+        assert(static_cast<std::uint64_t>(produced) == numOutput);
+        assert(outLeft.size() == numOutput && outRight.size() == numOutput);
+    };
+
+    std::vector<float> smallLeft, smallRight, largeLeft, largeRight;
+    convert(1000, smallLeft, smallRight);
+    convert(4096, largeLeft, largeRight);
+    assert(smallLeft == largeLeft && smallRight == largeRight);
+    assert(static_cast<double>(smallLeft.size()) == std::floor(numInput * targetRate / sourceRate));
+
+    // Output frame j is the input at j / targetRate seconds.
+    const int edge = resampler.isIdentity() ? 0 : 64;
+    double signal = 0.0;
+    double error = 0.0;
+    for (int j = edge; j < static_cast<int>(smallLeft.size()) - edge; ++j)
+    {
+        const double expected = sineAt(j / targetRate);
+        const double actual = smallLeft[static_cast<size_t>(j)];
+        if (resampler.isIdentity())
+            assert(actual == static_cast<float>(expected));
+        assert(smallRight[static_cast<size_t>(j)] == -smallLeft[static_cast<size_t>(j)]);
+        signal += expected * expected;
+        error += (actual - expected) * (actual - expected);
+    }
+    assert(resampler.isIdentity() || 10.0 * std::log10(signal / error) > 80.0);
+}
+
+/** Records a feed behind the write head while playback carries on, and
+    checks that feeds the engine cannot record are cancelled. */
+void testMemoryFeedRecordsBehindHead()
+{
+    constexpr int blockSize = 256;
+    ::MemoryDelayEngine<> engine;
+    engine.prepare(8000.0, blockSize, 4.0f);
+    engine.setSize(0.5f);
+    juce::AudioBuffer<float> block(2, blockSize);
+    const auto render = [&](int numBlocks)
+    {
+        for (int b = 0; b < numBlocks; ++b)
+        {
+            for (int i = 0; i < blockSize; ++i)
+            {
+                block.setSample(0, i, 0.25f);
+                block.setSample(1, i, -0.25f);
+            }
+            engine.processBlock(block);
+        }
+    };
+
+    // The head is 15872 frames in, so the feed ends at the page boundary at
+    // 12288; the small ring makes the producer wait for the memory thread.
+    render(62);
+    constexpr int numFrames = 6000;
+    constexpr int endFrame = 12288;
+    auto feed = std::make_shared<MemoryFeed>(numFrames, 8000.0, 1024);
+    engine.feedMemory(feed);
+    assert(engine.isRestoringMemory());
+
+    std::vector<float> left(700), right(700);
+    int written = 0;
+    for (int round = 0; round < 100 && engine.isRestoringMemory(); ++round)
+    {
+        const int count = juce::jmin(700, numFrames - written);
+        for (int i = 0; i < count; ++i)
+        {
+            left[static_cast<size_t>(i)] = std::sin(0.01f * static_cast<float>(written + i));
+            right[static_cast<size_t>(i)] = std::cos(0.01f * static_cast<float>(written + i));
+        }
+        const int accepted = feed->write(left.data(), right.data(), count);
+        assert(accepted <= 1024);
+        written += accepted;
+        if (written == numFrames)
+            feed->finish();
+
+        // Playback carries on while the feed is recorded.
+        render(1);
+        engine.serviceMemory();
+    }
+
+    assert(written == numFrames);
+    assert(!engine.isRestoringMemory());
+    assert(feed->getProgress() == 1.0f);
+    for (int i = 0; i < numFrames; ++i)
+    {
+        const int index = endFrame - numFrames + i;
+        assert(engine.debugGetMemorySample(0, index) == std::sin(0.01f * static_cast<float>(i)));
+        assert(engine.debugGetMemorySample(1, index) == std::cos(0.01f * static_cast<float>(i)));
+    }
+
+    // A feed at another rate cannot be recorded, and is cancelled for its producer.
+    auto mismatched = std::make_shared<MemoryFeed>(100, 16000.0);
+    engine.feedMemory(mismatched);
+    engine.serviceMemory();
+    assert(mismatched->isCancelled());
+    assert(!engine.isRestoringMemory());
+
+    // So is a feed a later one replaces.
+    auto replaced = std::make_shared<MemoryFeed>(100, 8000.0);
+    engine.feedMemory(replaced);
+    engine.serviceMemory();
+    engine.feedMemory(std::make_shared<MemoryFeed>(100, 8000.0));
+    engine.serviceMemory();
+    assert(replaced->isCancelled());
+}
+
+/** Imports a mono 16 kHz WAV into an 8 kHz memory: both channels hold the
+    file converted to the memory's rate.  Cancelling an import, or dropping
+    the engine it records into, stops the importer's thread. */
+void testMemoryImporterRecordsFile()
+{
+    constexpr double fileRate = 16000.0;
+    constexpr double memoryRate = 8000.0;
+    constexpr double frequency = 440.0;
+    constexpr int fileFrames = 30 * static_cast<int>(fileRate);
+    const auto toneAt = [](double seconds)
+    {
+        return 0.5 * std::sin(2.0 * juce::MathConstants<double>::pi * frequency * seconds);
+    };
+
+    const auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                          .getNonexistentChildFile("EchoformImport", ".wav");
+    {
+        juce::WavAudioFormat wav;
+        std::unique_ptr<juce::AudioFormatWriter> writer(
+            wav.createWriterFor(new juce::FileOutputStream(file), fileRate, 1, 24, {}, 0));
+        assert(writer != nullptr);
+        juce::AudioBuffer<float> tone(1, fileFrames);
+        for (int i = 0; i < fileFrames; ++i)
+            tone.setSample(0, i, static_cast<float>(toneAt(i / fileRate)));
+        const bool written = writer->writeFromAudioSampleBuffer(tone, 0, fileFrames);
+        assert(written);
+    }
+
+    const auto prepareEngine = [](::MemoryDelayEngine<>& engine) { engine.prepare(memoryRate, 256, 60.0f); };
+    const auto waitFor = [](const std::function<bool()>& done)
+    {
+        for (int i = 0; i < 4000 && !done(); ++i)
+            juce::Thread::sleep(5);
+    };
+
+    // The whole file fits, and is recorded behind the write head, which has
+    // not moved: its last frame is the newest in the memory.
+    MemoryImporter importer;
+    {
+        ::MemoryDelayEngine<> engine;
+        prepareEngine(engine);
+        const auto feed = importer.start(file, memoryRate, engine.getMaxSamples());
+        assert(feed != nullptr);
+        assert(feed->getNumFrames() == static_cast<std::uint64_t>(fileFrames / 2));
+        engine.feedMemory(feed);
+        waitFor([&]
+        {
+            engine.serviceMemory();
+            return !importer.isImporting() && !engine.isRestoringMemory();
+        });
+        assert(importer.getState() == MemoryImporter::State::Finished);
+        assert(importer.getProgress() == 1.0f);
+
+        const int numFrames = static_cast<int>(feed->getNumFrames());
+        const int bufferSize = engine.getMaxSamples();
+        double signal = 0.0;
+        double error = 0.0;
+        for (int j = 64; j < numFrames - 64; ++j)
+        {
+            const int index = (j - numFrames + bufferSize) % bufferSize;
+            const double expected = toneAt(j / memoryRate);
+            const double actual = engine.debugGetMemorySample(0, index);
+            assert(engine.debugGetMemorySample(1, index) == engine.debugGetMemorySample(0, index));
+            signal += expected * expected;
+            error += (actual - expected) * (actual - expected);
+        }
+        assert(10.0 * std::log10(signal / error) > 80.0);
+    }
+
+    // A cancelled import tells the memory thread to let go of its feed.
+    {
+        ::MemoryDelayEngine<> engine;
+        prepareEngine(engine);
+        const auto feed = importer.start(file, memoryRate, engine.getMaxSamples());
+        engine.feedMemory(feed);
+        engine.serviceMemory();
+        importer.cancel();
+        assert(importer.getState() == MemoryImporter::State::Idle);
+        assert(feed->isCancelled());
+        engine.serviceMemory();
+        assert(!engine.isRestoringMemory());
+    }
+
+    // Replacing the engine, as a sample-rate change does, cancels the feed
+    // whether or not the memory thread has started on it, and the import
+    // fails instead of waiting for room in the feed.  The feed holds less
+    // than the file, so the importer is still running when the engine goes.
+    assert(static_cast<int>(MemoryFeed::kDefaultCapacityFrames) < fileFrames / 2);
+    for (const bool started : { false, true })
+    {
+        auto engine = std::make_unique<::MemoryDelayEngine<>>();
+        prepareEngine(*engine);
+        const auto feed = importer.start(file, memoryRate, engine->getMaxSamples());
+        engine->feedMemory(feed);
+        if (started)
+            engine->serviceMemory();
+        engine.reset();
+        assert(feed->isCancelled());
+        waitFor([&] { return !importer.isImporting(); });
+        assert(importer.getState() == MemoryImporter::State::Failed);
+    }
+
+    // Unreadable files are refused.
+    const bool replaced = file.replaceWithText("not audio");
+    assert(replaced);
+    const auto refused = importer.start(file, memoryRate, 1000);
+    assert(refused == nullptr);
+    assert(importer.getState() == MemoryImporter::State::Failed);
+    const bool deleted = file.deleteFile();
+    assert(deleted);
+}
+
+/** The published playhead delays locate, in a capture, the frames the heads
+    are reading. */
+void testPlayheadSnapshotDelays()
+{
+    // Size 0.5 s at 8 kHz, scan at 0.9 and spread 0.1: the heads read 3600
+    // and 4000 frames behind the write head, which is 2560 frames past the
+    // page boundary a snapshot ends at.
+    ::MemoryDelayEngine<> engine;
+    engine.prepare(8000.0, 256, 4.0f);
+    engine.setSize(0.5f);
+    engine.setScan(0.9f);
+    engine.setSpread(0.1f);
+    juce::AudioBuffer<float> block(2, 256);
+    int written = 0;
+    for (int b = 0; b < 90; ++b, written += 256)
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            block.setSample(0, i, 0.5f * std::sin(0.05f * static_cast<float>(written + i)));
+            block.setSample(1, i, 0.3f * std::sin(0.11f * static_cast<float>(written + i)));
+        }
+        engine.processBlock(block);
+    }
+
+    const int framesIntoPage = written % MemoryBuffer<>::kPageFrames;
+    const auto delays = engine.getPlayheadSnapshotDelays();
+    assert(framesIntoPage == 2560);
+    assert(std::abs(delays[0] - (3600.0 - framesIntoPage)) < 1.0e-2);
+    assert(std::abs(delays[1] - (4000.0 - framesIntoPage)) < 1.0e-2);
+
+    // The primary head's frame in the snapshot holds what it reads.
+    const auto snapshot = engine.captureMemorySnapshot();
+    std::vector<float> left(static_cast<size_t>(snapshot->numFrames)), right(left.size());
+    size_t offset = 0;
+    for (size_t frame = 0; frame < left.size();)
+        frame += static_cast<size_t>(snapshot->decodeBlock(offset, left.data() + frame, right.data() + frame));
+    const auto marker = static_cast<size_t>(std::lround(static_cast<double>(snapshot->numFrames) - delays[0]));
+    assert(std::abs(left[marker] - engine.debugGetMemorySample(0, engine.getWriteIndex() - 3600)) < 1.0e-6f);
+
+    engine.reset();
+    assert(engine.getPlayheadSnapshotDelays()[0] == 0.0);
+}
+
+/** Exports a capture to WAV and FLAC and reads the files back: both hold the
+    snapshot to 24 bits and the WAV has a cue point per playhead.  A cancelled
+    export leaves the file it would have replaced as it was. */
+void testMemoryExporterWritesSnapshot()
+{
+    ::MemoryDelayEngine<> engine;
+    engine.prepare(8000.0, 256, 4.0f);
+    engine.setSize(0.5f);
+    engine.setScan(0.9f);
+    engine.setSpread(0.1f);
+    juce::AudioBuffer<float> block(2, 256);
+    for (int b = 0; b < 90; ++b)
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            block.setSample(0, i, 0.5f * std::sin(0.05f * static_cast<float>(b * 256 + i)));
+            block.setSample(1, i, 0.3f * std::sin(0.11f * static_cast<float>(b * 256 + i)));
+        }
+        engine.processBlock(block);
+    }
+
+    const auto snapshot = engine.captureMemorySnapshot();
+    const auto numFrames = static_cast<int>(snapshot->numFrames);
+    std::vector<float> left(static_cast<size_t>(numFrames)), right(left.size());
+    size_t offset = 0;
+    for (int frame = 0; frame < numFrames;)
+        frame += snapshot->decodeBlock(offset, left.data() + frame, right.data() + frame);
+
+    const auto delays = engine.getPlayheadSnapshotDelays();
+    const std::vector<MemoryExporter::Marker> markers {
+        { "Primary", std::llround(static_cast<double>(numFrames) - delays[0]) },
+        { "Secondary", std::llround(static_cast<double>(numFrames) - delays[1]) }
+    };
+
+    const auto waitUntilDone = [](const MemoryExporter& exporter)
+    {
+        for (int i = 0; i < 2000 && exporter.isExporting(); ++i)
+            juce::Thread::sleep(5);
+    };
+
+    const auto directory = juce::File::getSpecialLocation(juce::File::tempDirectory);
+    juce::AudioFormatManager formats;
+    formats.registerBasicFormats();
+    for (const char* extension : { ".wav", ".flac" })
+    {
+        const auto file = directory.getNonexistentChildFile("EchoformExport", extension);
+        MemoryExporter exporter;
+        const bool started = exporter.start(snapshot, file, markers);
+        assert(started);
+        waitUntilDone(exporter);
+        assert(exporter.getState() == MemoryExporter::State::Finished);
+        assert(exporter.getProgress() == 1.0f);
+
+        std::unique_ptr<juce::AudioFormatReader> reader(formats.createReaderFor(file));
+        assert(reader != nullptr);
+        assert(reader->sampleRate == 8000.0);
+        assert(reader->numChannels == 2);
+        assert(reader->bitsPerSample == MemoryExporter::kBitsPerSample);
+        assert(reader->lengthInSamples == numFrames);
+
+        juce::AudioBuffer<float> audio(2, numFrames);
+        const bool read = reader->read(&audio, 0, numFrames, 0, true, true);
+        assert(read);
+        for (int i = 0; i < numFrames; ++i)
+        {
+            assert(std::abs(audio.getSample(0, i) - left[static_cast<size_t>(i)]) < 1.0e-6f);
+            assert(std::abs(audio.getSample(1, i) - right[static_cast<size_t>(i)]) < 1.0e-6f);
+        }
+
+        if (file.hasFileExtension("wav"))
+        {
+            const auto& metadata = reader->metadataValues;
+            assert(metadata["NumCuePoints"] == "2");
+            assert(metadata["Cue0Offset"] == juce::String(markers[0].frame));
+            assert(metadata["Cue1Offset"] == juce::String(markers[1].frame));
+            assert(metadata["CueLabel0Text"] == "Primary");
+            assert(metadata["CueLabel1Text"] == "Secondary");
+        }
+
+        reader.reset();
+        const bool deleted = file.deleteFile();
+        assert(deleted);
+    }
+
+    // The same capture repeated for about half an hour, far more than the
+    // export can write before it is cancelled.
+    auto longSnapshot = std::make_shared<MemorySnapshot>();
+    longSnapshot->sampleRate = snapshot->sampleRate;
+    for (int repeat = 0; repeat < 400; ++repeat)
+    {
+        longSnapshot->blocks.insert(longSnapshot->blocks.end(), snapshot->blocks.begin(), snapshot->blocks.end());
+        longSnapshot->numFrames += snapshot->numFrames;
+        longSnapshot->numBlocks += snapshot->numBlocks;
+    }
+
+    const auto existing = directory.getNonexistentChildFile("EchoformExport", ".wav");
+    const bool written = existing.replaceWithText("an earlier export");
+    assert(written);
+    {
+        MemoryExporter exporter;
+        const bool started = exporter.start(longSnapshot, existing);
+        assert(started);
+        exporter.cancel();
+        assert(exporter.getState() == MemoryExporter::State::Idle);
+        assert(existing.loadFileAsString() == "an earlier export");
+    }
+    assert(existing.loadFileAsString() == "an earlier export");
+    const bool deleted = existing.deleteFile();
+    assert(deleted);
+
+    // Nothing to write
+    MemoryExporter exporter;
+    const bool startedEmpty = exporter.start(std::make_shared<MemorySnapshot>(), existing);
+    assert(!startedEmpty);
+    assert(!existing.exists());
+}
+
+/** Records into one engine, captures its memory, restores it into a fresh
+    engine at targetRate and checks that every delay reads the same audio. */
+void testMemorySnapshotRestoresMemory(double targetRate, bool lazyTarget)
+{
+    constexpr int blockSize = 256;
+    const auto prepareEngine = [](::MemoryDelayEngine<>& engine, double sampleRate)
+    {
+        engine.prepare(sampleRate, blockSize, 4.0f);
+        engine.setSize(0.5f);
+        engine.setMix(1.0f);
+        engine.setFeedback(0.0f);
+        engine.setMemorySnapshotCaching(true);
+    };
+
+    ::MemoryDelayEngine<> source;
+    prepareEngine(source, 8000.0);
+    juce::AudioBuffer<float> block(2, blockSize);
+    int written = 0;
+    for (int b = 0; b < 6 * MemoryBuffer<>::kPageFrames / blockSize; ++b)
+    {
+        for (int i = 0; i < blockSize; ++i, ++written)
+        {
+            block.setSample(0, i, 0.5f * std::sin(0.05f * static_cast<float>(written)));
+            block.setSample(1, i, 0.3f * std::sin(0.11f * static_cast<float>(written)));
+        }
+        source.processBlock(block);
+        source.serviceMemory();
+    }
+
+    // Twice the size is retained, and the write head sits on a page boundary.
+    const auto snapshot = source.captureMemorySnapshot();
+    assert(snapshot != nullptr && snapshot->numFrames >= 8000);
+
+    ::MemoryDelayEngine<> target;
+    target.setLazyMemoryAllocation(lazyTarget);
+    prepareEngine(target, targetRate);
+    target.restoreMemorySnapshot(snapshot);
+    assert(target.isRestoringMemory());
+    assert(target.captureMemorySnapshot() == snapshot);
+    for (int call = 0; call < 100 && target.isRestoringMemory(); ++call)
+        target.serviceMemory();
+    assert(!target.isRestoringMemory());
+
+    const double ratio = targetRate / 8000.0;
+    const int edge = ratio == 1.0 ? 0 : 64;
+    const int sourceHead = source.getWriteIndex();
+    const int targetSize = target.getMaxSamples();
+    double signal = 0.0;
+    double error = 0.0;
+    for (int delay = 1 + edge; delay <= 8000 - edge; ++delay)
+        for (int channel = 0; channel < 2; ++channel)
+        {
+            const double expected = source.debugGetMemorySample(channel, sourceHead - delay);
+            const int targetDelay = static_cast<int>(std::lround(delay * ratio));
+            const double actual = target.debugGetMemorySample(channel, (targetSize - targetDelay) % targetSize);
+            if (ratio == 1.0)
+                assert(std::abs(actual - expected) <= 1.0e-7);
+            signal += expected * expected;
+            error += (actual - expected) * (actual - expected);
+        }
+    assert(signal > 0.0);
+    assert(ratio == 1.0 || 10.0 * std::log10(signal / error) > 80.0);
+}
+
+void testEngineSlotKeepsMemoryAcrossPrepare()
+{
+    constexpr int numSamples = 2048;
+    juce::AudioBuffer<float> input(2, numSamples);
+    for (int i = 0; i < numSamples; ++i)
+    {
+        input.setSample(0, i, 0.7f * std::sin(0.013f * static_cast<float>(i)));
+        input.setSample(1, i, 0.5f * std::sin(0.029f * static_cast<float>(i)));
+    }
+
+    const auto render = [&input](::MemoryDelayEngine<>& engine, int start, int length)
+    {
+        juce::AudioBuffer<float> block(2, length);
+        for (int ch = 0; ch < 2; ++ch)
+            block.copyFrom(ch, 0, input, ch, start, length);
+        engine.processBlock(block);
+        return block;
+    };
+
+    ::MemoryDelayEngine<> reference;
+    configureBlockTestEngine(reference, 64);
+
+    // The slot prepares its engines itself and applies the same parameters.
+    EngineSlot<::MemoryDelayEngine<>> slot;
+    slot.setConfigure(setBlockTestParameters<::MemoryDelayEngine<>>);
+    const bool keptFirst = slot.prepare(8000.0, 64, 2.0f, true);
+    assert(!keptFirst);
+    auto* engine = slot.acquire();
+    assert(engine != nullptr && slot.get() == engine);
+
+    // A host restart with a new block size keeps the engine and its memory,
+    // and playback carries on as if it had never stopped.
+    int position = 0;
+    for (; position < numSamples / 2; position += 64)
+    {
+        const auto expected = render(reference, position, 64);
+        const auto actual = render(*engine, position, 64);
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < 64; ++i)
+                assert(actual.getSample(ch, i) == expected.getSample(ch, i));
+    }
+
+    const size_t residentBytes = engine->getMemoryResidentBytes();
+    const int writeIndex = engine->getWriteIndex();
+    const bool keptOnRestart = slot.prepare(8000.0, 256, 2.0f, false);
+    assert(keptOnRestart);
+    auto* const restarted = slot.acquire();
+    assert(restarted == engine);
+    assert(!slot.isBuildPending());
+    assert(engine->getWriteIndex() == writeIndex);
+    assert(engine->getMemoryResidentBytes() == residentBytes);
+
+    for (; position < numSamples; position += 256)
+    {
+        juce::AudioBuffer<float> expected(2, 256);
+        for (int offset = 0; offset < 256; offset += 64)
+        {
+            const auto part = render(reference, position + offset, 64);
+            for (int ch = 0; ch < 2; ++ch)
+                expected.copyFrom(ch, offset, part, ch, 0, 64);
+        }
+        const auto actual = render(*engine, position, 256);
+        for (int ch = 0; ch < 2; ++ch)
+            for (int i = 0; i < 256; ++i)
+                assert(actual.getSample(ch, i) == expected.getSample(ch, i));
+    }
+
+    // A new sample rate needs a new engine: nothing renders until service()
+    // has built it, with the recording resampled into it, then the audio
+    // thread picks it up.
+    std::vector<float> recorded;
+    for (int delay = 1; delay < numSamples; ++delay)
+        recorded.push_back(engine->debugGetMemorySample(0, engine->getWriteIndex() - delay));
+
+    const bool keptOnNewRate = slot.prepare(16000.0, 256, 2.0f, false);
+    assert(!keptOnNewRate);
+    auto* const building = slot.acquire();
+    assert(building == nullptr && slot.get() == nullptr);
+    assert(slot.isBuildPending());
+    const bool built = slot.service();
+    assert(built);
+    assert(slot.get() == nullptr);
+    engine = slot.acquire();
+    assert(engine != nullptr && slot.get() == engine);
+    assert(engine->getSampleRate() == 16000.0);
+    assert(!slot.isBuildPending());
+
+    assert(engine->getWriteIndex() == 2 * numSamples);
+    double signal = 0.0;
+    double error = 0.0;
+    for (int delay = 32; delay < numSamples - 32; ++delay)
+    {
+        const double expected = recorded[static_cast<size_t>(delay - 1)];
+        const double actual = engine->debugGetMemorySample(0, engine->getWriteIndex() - 2 * delay);
+        signal += expected * expected;
+        error += (actual - expected) * (actual - expected);
+    }
+    assert(10.0 * std::log10(signal / error) > 80.0);
+
+    slot.release();
+    auto* const released = slot.acquire();
+    assert(released == nullptr && slot.get() == nullptr);
+}
+
+void testWarmPrepareIsCheap()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto secondsSince = [](Clock::time_point start)
+    {
+        return std::chrono::duration<double>(Clock::now() - start).count();
+    };
+
+    // An eagerly allocated three-minute memory at 48 kHz: rebuilding it is
+    // what a restart used to cost.
+    EngineSlot<::MemoryDelayEngine<>> slot;
+    auto start = Clock::now();
+    slot.prepare(48000.0, 512, 180.0f, true);
+    const double coldSeconds = secondsSince(start);
+    auto* const engine = slot.acquire();
+    assert(engine != nullptr);
+
+    constexpr int numRestarts = 8;
+    int keptRestarts = 0;
+    start = Clock::now();
+    for (int restart = 0; restart < numRestarts; ++restart)
+        keptRestarts += slot.prepare(48000.0, restart % 2 == 0 ? 1024 : 512, 180.0f, false) ? 1 : 0;
+    const double warmSeconds = secondsSince(start) / numRestarts;
+    assert(keptRestarts == numRestarts);
+
+    assert(warmSeconds * 10.0 < coldSeconds);
+}
 } // namespace
 
 int main()
 {
     testWraparoundDsp();
     testCollectOverdub();
+    testBlockSizeDoesNotChangeOutput();
+    testSpecializedKernelsMatchGenericPath();
+    testModifierBlockMatchesSample<float>();
+    testModifierBlockMatchesSample<double>();
+    testModifierChainSkipsInactiveStages();
+    testTapeTransportMatchesSeries();
+    testQuadratureOscillatorTracksSine();
+    testLfoWavetableTriangle();
+    testDropoutSchedulesOnsets();
+    testDoublePrecisionTracksFloat();
+    testLazyMemoryMatchesEager();
+    testExtendedMemoryMatchesEager();
+    testReadBlockMatchesRead(MemoryBuffer<>::Layout::Planar, MemoryBuffer<>::Format::Native);
+    testReadBlockMatchesRead(MemoryBuffer<>::Layout::Interleaved, MemoryBuffer<>::Format::Native);
+    testReadBlockMatchesRead(MemoryBuffer<>::Layout::Planar, MemoryBuffer<>::Format::Half);
+    testReadBlockMatchesRead(MemoryBuffer<>::Layout::Interleaved, MemoryBuffer<>::Format::Int16);
+    testReadBlockMatchesRead(MemoryBuffer<>::Layout::Planar, MemoryBuffer<>::Format::Packed24);
+    testLongBufferKeepsFraction();
+    testMemoryLayoutsMatch();
+    testMemoryFormatQuality();
+    testMemoryFormatBlockWrites();
+    testMemoryClearIsLazy();
+    testEngineResetAndClear();
+    testPageArenaRecyclesPages();
+    testSpilledMemoryPrefetches();
+    testMemoryCodecRoundTrip();
+    testMemorySnapshotTracksWrites();
+    testMemoryResamplerKeepsDelays(44100.0, 96000.0, false);
+    testMemoryResamplerKeepsDelays(96000.0, 44100.0, true);
+    testMemoryResamplerKeepsDelays(48000.0, 47999.5, false);
+    testMemoryResamplerStreams(44100.0, 48000.0);
+    testMemoryResamplerStreams(96000.0, 44100.0);
+    testMemoryResamplerStreams(48000.0, 47999.5);
+    testMemoryResamplerStreams(48000.0, 48000.0);
+    testEngineSlotKeepsMemoryAcrossPrepare();
+    testWarmPrepareIsCheap();
+    testMemorySnapshotRestoresMemory(8000.0, false);
+    testMemorySnapshotRestoresMemory(16000.0, true);
+    testPlayheadSnapshotDelays();
+    testMemoryExporterWritesSnapshot();
+    testMemoryFeedRecordsBehindHead();
+    testMemoryImporterRecordsFile();
+    testSizeAutomationGlides();
+    testSizeGlideBoundsReadRate();
+    testSaturatorErrorBounds();
+    testSaturatorDeterminism();
+    testSmoothedParameterRamps();
+    testParameterChangesRamp();
+    testAutomationIsIndependentOfHostBlockSize();
     return 0;
 }
@@ -0,0 +1,234 @@
+// ReferenceModifiers.h
+//
+// The wow and flutter and pitch drift modifiers as the chain ran them before
+// TapeTransportModifier, each on a delay line of its own.  Nothing ships
+// them: in series they are the reference the tape transport is tested and
+// benchmarked against.
+
+#pragma once
+
+#include <JuceHeader.h>
+#include "Modifiers.h"
+#include <array>
+#include <cmath>
+
+template <typename SampleType>
+class ModulatedDelayLine
+{
+public:
+    void prepare(double newSampleRate, float maxDelayMs, int numChannels)
+    {
+        sampleRate = newSampleRate;
+        const int maxSamples = juce::jmax(1, static_cast<int>(std::ceil(sampleRate * (maxDelayMs / 1000.0f))) + 2);
+        buffer.setSize(numChannels, maxSamples);
+        buffer.clear();
+        writePos = 0;
+    }
+
+    void reset()
+    {
+        buffer.clear();
+        writePos = 0;
+    }
+
+    /** Writes input at the write position and returns it mixed by amount
+        towards the channel delayed by delaySamples. */
+    SampleType processSample(int channel, SampleType input, float delaySamples, float amount)
+    {
+        const SampleType delayed = readSample(channel, writePos, delaySamples);
+        buffer.setSample(channel, writePos, input);
+        return input + (delayed - input) * amount;
+    }
+
+    /** processSample() for numSamples consecutive frames of one channel in
+        place, from the write position on, with a delay per frame.  The
+        write position stays put until advance(). */
+    void processBlock(int channel, SampleType* samples, const float* delaySamples, int numSamples, float amount)
+    {
+        SampleType* data = buffer.getWritePointer(channel);
+        int position = writePos;
+        for (int i = 0; i < numSamples; ++i)
+        {
+            const SampleType input = samples[i];
+            const SampleType delayed = readSample(channel, position, delaySamples[i]);
+            data[position] = input;
+            samples[i] = input + (delayed - input) * amount;
+            if (++position >= buffer.getNumSamples())
+                position = 0;
+        }
+    }
+
+    void advance(int numSamples = 1)
+    {
+        writePos = (writePos + numSamples) % buffer.getNumSamples();
+    }
+
+private:
+    SampleType readSample(int channel, int position, float delaySamples) const
+    {
+        const int bufferSize = buffer.getNumSamples();
+        delaySamples = juce::jlimit(0.0f, static_cast<float>(bufferSize - 1), delaySamples);
+        float readPos = static_cast<float>(position) - delaySamples;
+        while (readPos < 0.0f)
+            readPos += bufferSize;
+        while (readPos >= bufferSize)
+            readPos -= bufferSize;
+        const int index1 = static_cast<int>(readPos);
+        int index2 = index1 + 1;
+        if (index2 >= bufferSize)
+            index2 -= bufferSize;
+        const float frac = readPos - static_cast<float>(index1);
+        const SampleType* data = buffer.getReadPointer(channel);
+        const SampleType s1 = data[index1];
+        const SampleType s2 = data[index2];
+        return s1 + frac * (s2 - s1);
+    }
+
+    double sampleRate { 44100.0 };
+    juce::AudioBuffer<SampleType> buffer;
+    int writePos { 0 };
+};
+
+/** Wow and flutter on a delay line of its own. */
+template <typename SampleType>
+class WowFlutterModifier final : public Modifier<SampleType>
+{
+public:
+    using Modifier<SampleType>::intensity;
+    using Modifier<SampleType>::bipolar;
+    using Modifier<SampleType>::kControlFrames;
+
+    void prepare(double newSampleRate, int, int numChannels)
+    {
+        channels = numChannels;
+        delayLine.prepare(newSampleRate, 12.0f, numChannels);
+        trajectory.prepare(newSampleRate);
+    }
+
+    void reset()
+    {
+        delayLine.reset();
+        trajectory.reset();
+    }
+
+    void setIntensity(float newIntensity)
+    {
+        Modifier<SampleType>::setIntensity(newIntensity);
+        trajectory.setShape(intensity, bipolar);
+    }
+
+    void setBipolar(float newValue)
+    {
+        Modifier<SampleType>::setBipolar(newValue);
+        trajectory.setShape(intensity, bipolar);
+    }
+
+    SampleType processSample(SampleType input, int channel)
+    {
+        if (channel == 0)
+            currentDelaySamples = trajectory.getNextDelay();
+
+        const SampleType output = delayLine.processSample(channel, input, currentDelaySamples, intensity);
+
+        if (channel == channels - 1)
+            delayLine.advance();
+
+        return output;
+    }
+
+    void processBlock(SampleType* const* channelData, int numChannels, int numSamples)
+    {
+        jassert(numChannels == channels);
+        for (int start = 0; start < numSamples;)
+        {
+            const int count = juce::jmin(kControlFrames, numSamples - start);
+            for (int i = 0; i < count; ++i)
+                delays[static_cast<size_t>(i)] = trajectory.getNextDelay();
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                delayLine.processBlock(channel, channelData[channel] + start, delays.data(), count, intensity);
+            delayLine.advance(count);
+            start += count;
+        }
+    }
+
+private:
+    int channels { 2 };
+    ModulatedDelayLine<SampleType> delayLine;
+    WowFlutterTrajectory trajectory;
+    float currentDelaySamples { 0.0f };
+    std::array<float, kControlFrames> delays {};
+};
+
+/** Pitch drift on a delay line of its own; see WowFlutterModifier. */
+template <typename SampleType>
+class PitchDriftModifier final : public Modifier<SampleType>
+{
+public:
+    using Modifier<SampleType>::intensity;
+    using Modifier<SampleType>::bipolar;
+    using Modifier<SampleType>::kControlFrames;
+
+    void prepare(double newSampleRate, int, int numChannels)
+    {
+        channels = numChannels;
+        delayLine.prepare(newSampleRate, 8.0f, numChannels);
+        trajectory.prepare(newSampleRate);
+    }
+
+    void reset()
+    {
+        delayLine.reset();
+        trajectory.reset();
+    }
+
+    void setIntensity(float newIntensity)
+    {
+        Modifier<SampleType>::setIntensity(newIntensity);
+        trajectory.setShape(intensity, bipolar);
+    }
+
+    void setBipolar(float newValue)
+    {
+        Modifier<SampleType>::setBipolar(newValue);
+        trajectory.setShape(intensity, bipolar);
+    }
+
+    SampleType processSample(SampleType input, int channel)
+    {
+        if (channel == 0)
+            currentDelaySamples = trajectory.getNextDelay(random);
+
+        const SampleType output = delayLine.processSample(channel, input, currentDelaySamples, intensity);
+
+        if (channel == channels - 1)
+            delayLine.advance();
+
+        return output;
+    }
+
+    void processBlock(SampleType* const* channelData, int numChannels, int numSamples)
+    {
+        jassert(numChannels == channels);
+        for (int start = 0; start < numSamples;)
+        {
+            const int count = juce::jmin(kControlFrames, numSamples - start);
+            for (int i = 0; i < count; ++i)
+                delays[static_cast<size_t>(i)] = trajectory.getNextDelay(random);
+
+            for (int channel = 0; channel < numChannels; ++channel)
+                delayLine.processBlock(channel, channelData[channel] + start, delays.data(), count, intensity);
+            delayLine.advance(count);
+            start += count;
+        }
+    }
+
+private:
+    using Modifier<SampleType>::random;
+
+    int channels { 2 };
+    ModulatedDelayLine<SampleType> delayLine;
+    PitchDriftTrajectory trajectory;
+    float currentDelaySamples { 0.0f };
+    std::array<float, kControlFrames> delays {};
+};